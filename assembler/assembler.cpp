@@ -32,8 +32,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     << std::endl; m_hasError = true; m_lastError = m_lineNbr;}
 
 #define InstructionError(msg) if (!(m_flags & FLAG_SUPPRESS_ALL_ERRORS)){\
-    std::cerr << "[Assembler]: Error at address " << "0x" << std::hex << m_instrAddr << ": " \
-    << msg << std::endl; m_hasError = true; m_lastError = m_instrAddr;}
+    std::cerr << "[Assembler]: Error at address " << "0x" << std::hex << m_instrAddr << std::dec \
+    << ": " << msg << std::endl; m_hasError = true; m_lastError = m_instrAddr;}
 
 namespace Assembly {
 
@@ -42,6 +42,9 @@ namespace Assembly {
         m_lineNbr(0),
         m_instrAddr(0),
         m_flags(0x0),
+        m_parseAddr(0),
+        m_pendingDataStart(false),
+        m_hasUnresolved(false),
         m_encoder()
     {
     }
@@ -93,16 +96,14 @@ namespace Assembly {
         return result;
     }
 
-    std::string Assembler::RemoveWhitespace(const std::string& str) const
+    std::string Assembler::RemoveWhitespace(const std::string& str, size_t begin, size_t end) const
     {   
         std::string out;
-        char ch;
-        auto it = str.cbegin();
-        while(it != str.cend())
+        out.reserve(end - begin);
+        for (size_t i = begin; i < end; i++)
         {
-            ch = *it++;
-            if (!std::isspace(ch))
-                out += ch;
+            if (!std::isspace((unsigned char)str[i]))
+                out += str[i];
         }
 
         return out;
@@ -115,20 +116,7 @@ namespace Assembly {
             printf("%02hhX", *ptr);
     }
 
-    BinaryInstruction Assembler::TranslateInstruction(const std::string& opcode, uint64_t* args)
-    {
-        BinaryInstruction result;
-        result.instr[0] = 0;
-        result.instr[1] = 0;
-        result.instr[2] = 0;
-
-        if (opcode.front() == '.')
-            return result;
-
-        return std::move(m_encoder.TranslateInstruction(opcode, args));
-    }
-
-    uint64_t Assembler::EvaluateArgument(const std::string& arg)
+    uint64_t Assembler::EvaluateArgument(const std::string& arg, bool allowUndefined)
     {
         size_t pos;
         uint64_t result = 0;
@@ -173,14 +161,13 @@ namespace Assembly {
             std::string rightStr = arg.substr(pos + 1);
             char op = arg[pos];
 
-            uint64_t left, right;
+            uint64_t left = 0, right = 0;
             if (leftStr.find_first_not_of("0123456789") == std::string::npos)
             {
                 left = std::stoull(leftStr);
             }
-            else if (!m_labelDict.ResolveLabel(leftStr, (uint32_t&)left))
+            else if (!ResolveLabel(leftStr, left, allowUndefined))
             {
-                InstructionError("Use of undefined label \"" << leftStr << "\".");
                 return 0;
             }
 
@@ -188,9 +175,8 @@ namespace Assembly {
             {
                 right = std::stoull(rightStr);
             }
-            else if (!m_labelDict.ResolveLabel(rightStr, (uint32_t&)right))
+            else if (!ResolveLabel(rightStr, right, allowUndefined))
             {
-                InstructionError("Use of undefined label \"" << rightStr << "\".");
                 return 0;
             }
 
@@ -199,7 +185,7 @@ namespace Assembly {
                 case '+': result = left + right; break;
                 case '-': result = left - right; break;
                 case '*': result = left * right; break;
-                case '/': result = left / right; break;
+                case '/': result = right != 0 ? left / right : 0; break;
             }
 
             return result;
@@ -208,15 +194,9 @@ namespace Assembly {
         {
             int isNegative = arg[0] == '-' ? 1 : 0;
             std::string label = arg.substr(isNegative);
-            uint32_t lblAddress;
 
-            if (!m_labelDict.ResolveLabel(label, lblAddress))
-            {
-                InstructionError("Use of undefined label \"" << label << "\".");
+            if (!ResolveLabel(label, result, allowUndefined))
                 return 0;
-            }
-
-            result = static_cast<uint64_t>(lblAddress);
 
             if (isNegative)                
                 result = -result;
@@ -228,32 +208,58 @@ namespace Assembly {
         return result;
     }
 
-    void Assembler::ExecAssemblerDirective(const std::string& directive, const std::string* args)
+    bool Assembler::ResolveLabel(const std::string& label, uint64_t& value, bool allowUndefined)
     {
-        // Make args[0] lower-case.
-        std::string lowerArg0 = ToLowerCase(args[0]);
+        uint32_t lblAddress;
+        if (m_labelDict.ResolveLabel(label, lblAddress))
+        {
+            value = static_cast<uint64_t>(lblAddress);
+            return true;
+        }
+
+        // The label may still be defined further down, in which case
+        // the caller leaves a fix-up to be patched at the end.
+        m_hasUnresolved = true;
+        if (!allowUndefined)
+            InstructionError("Use of undefined label \"" << label << "\".");
 
+        return false;
+    }
+
+    void Assembler::ExecAssemblerDirective(const std::string& directive, const std::string* args)
+    {
         if (directive == ".MODE") // Sets header info field 'MODE'.
         {
-            if (m_instrAddr > 0)
+            // Make args[0] lower-case.
+            std::string lowerArg0 = ToLowerCase(args[0]);
+
+            if (m_parseAddr > 0)
             {
                 LineError("Invalid use of directive \".MODE\". The VM mode may only be declared "\
                     "before instructions.");
                 return;
             }
 
-            if (lowerArg0 != "register" && lowerArg0 != "stack")
+            if (lowerArg0 == "register")
+                m_binHeader.mode = VM_MODE_REGISTER;
+            else if (lowerArg0 == "stack")
+                m_binHeader.mode = VM_MODE_STACK;
+            else if (lowerArg0 == "wide") // Register instruction set on 64-bit registers.
+            {
+                m_binHeader.mode = VM_MODE_REGISTER_WIDE;
+                m_labelDict.UseWideRegisters();
+            }
+            else
             {
                 LineError("Invalid argument for directive \".MODE\"");
                 return;
             }
 
-            m_binHeader.mode = lowerArg0 == "register" ? VM_MODE_REGISTER : VM_MODE_STACK;
             m_encoder.LoadInstructionSet(static_cast<VMMode>(m_binHeader.mode));
         }
         else if (directive == ".HEAP") // Sets header info field 'HEAP'.
         {
-            if (args[0].find_first_not_of("0123456789") != std::string::npos)
+            if (args[0].empty() || args[0].find_first_not_of("0123456789") != std::string::npos)
             {
                 LineError("Invalid argument for directive \".HEAP\". Must be an unsigned "\
                     "32-bit integer.");
@@ -264,7 +270,7 @@ namespace Assembly {
         }
         else if (directive == ".HEAP_MAX") // Sets header info field 'HEAP_MAX'.
         {
-            if (args[0].find_first_not_of("0123456789") != std::string::npos)
+            if (args[0].empty() || args[0].find_first_not_of("0123456789") != std::string::npos)
             {
                 LineError("Invalid argument for directive \".HEAP_MAX\". Must be an unsigned "\
                     "32-bit integer.");
@@ -277,31 +283,33 @@ namespace Assembly {
         {
             bool isString = args[1].find('"') != std::string::npos;
 
-            if (!isString)
+            if (args[0].empty() || args[0].find_first_not_of("0123456789") != std::string::npos)
             {
-                if (args[0].find_first_not_of("0123456789") != std::string::npos)
-                {
-                    LineError("Invalid size argument for directive \".BYTE\". Must be an unsigned integer.");
-                    return;
-                }
-                else if (args[1].find_first_not_of("\".f0123456789") != std::string::npos && !isString)
-                {
-                    LineError("Invalid data argument for directive \".BYTE\". Must be an unsigned integer, float, double, or string.");
-                    return;
-                }
-                else if (args[1] == "")
-                {
-                    LineError("No data defined for directive \".BYTE\".");
-                    return;
-                }
+                LineError("Invalid size argument for directive \".BYTE\". Must be an unsigned integer.");
+                return;
+            }
+            else if (args[1] == "")
+            {
+                LineError("No data defined for directive \".BYTE\".");
+                return;
+            }
+            else if (!isString && args[1].find_first_not_of(".f0123456789") != std::string::npos)
+            {
+                LineError("Invalid data argument for directive \".BYTE\". Must be an unsigned integer, float, double, or string.");
+                return;
             }
 
-            workingText << directive << ';' << args[0] << ';' << args[1] << ';' << std::endl;
-            m_instrAddr += std::stoul(args[0]);
+            AsmRecord rec;
+            rec.opcode = directive;
+            rec.args[0] = args[0];
+            rec.args[1] = args[1];
+            AddRecord(std::move(rec));
         }
         else if (directive == ".DATA") // Sets header info field 'dataStart'.
         {
-            m_binHeader.dataStart = m_instrAddr;
+            // Resolved when the next record is emitted, since its address may still
+            // change if the optimizer runs.
+            m_pendingDataStart = true;
         }
         else
         {
@@ -309,11 +317,10 @@ namespace Assembly {
         }
     }
 
-    void Assembler::FirstPassReadLine(std::string& line)
+    void Assembler::ReadLine(const std::string& line)
     {
         constexpr char whitespace[] = { ' ', '\t', '\0' };
         constexpr char wsOrComment[] = { ' ', '\t', ';', '/', '\0' };
-        constexpr char wsOrCommentOrComma[] = { ' ', '\t', ';', '/', ',', '\0' };
 
         size_t len = line.length();
         size_t pos = line.find_first_not_of(whitespace);
@@ -332,7 +339,7 @@ namespace Assembly {
         size_t posDelim = line.find(':', pos); // Look for label delimiter.
         if (posDelim != line.npos && (posDelim < posStr || posStr == line.npos))
         {
-            std::string label = line.substr(pos, posDelim);
+            std::string label = line.substr(pos, posDelim - pos);
 
             // Check for invalid characters in the label.
             if (label.find_first_of(wsOrComment) != label.npos)
@@ -342,24 +349,29 @@ namespace Assembly {
                 return;
             }
 
-            // Try to register the label.
-            if (!m_labelDict.RegisterLabel(label, m_instrAddr))
+            // Labels are only registered once their record is emitted, so remember 
+            // where each was defined to report a duplicate at its own line.
+            if (!m_labelLines.emplace(label, m_lineNbr).second)
             {
                 LineError("Multiple label definitions: \"" << label << "\".");
                 return;
             }
 
+            // The label points at the next record, whichever line it is on.
+            m_pendingLabels.push_back(std::move(label));
+
             pos = line.find_first_not_of(whitespace, posDelim + 1);
             if (pos == line.npos)
                 return;
         }
 
-        std::string opcode = "";
-        std::string args[3] = {"", "", ""};
+        AsmRecord rec;
+        std::string& opcode = rec.opcode;
+        std::string* args = rec.args;
 
         // Try to read the opcode.
         posDelim = std::min(line.find_first_of(wsOrComment, pos), len); // Cap to string length if not found.
-        opcode = line.substr(pos, posDelim - pos);
+        opcode.assign(line, pos, posDelim - pos);
 
         if (opcode.find_first_not_of("._ABCDEFGHIJKLMNOPQRSTUVWXYZ3264") != std::string::npos)
         {
@@ -371,10 +383,6 @@ namespace Assembly {
             return; 
         }
 
-        size_t argsRequired = m_encoder.GetInstructionArgCount(opcode);
-        if (opcode == ".BYTE")
-            argsRequired = 2;
-
         // Try to read arguments (max 3).
         int argsGiven = 0;
         for (int i = 0; i < 3; i++)
@@ -398,7 +406,7 @@ namespace Assembly {
                         break;
                     }
 
-                    args[i] = line.substr(posString, (posDelim+1) - posString);
+                    args[i].assign(line, posString, (posDelim+1) - posString);
                     ++argsGiven;
 
                     posDelim = std::min(line.find(",", posDelim), len); // Cap to string length if not found.
@@ -407,7 +415,7 @@ namespace Assembly {
 
                 if (posDelim != len && posDelim < posComment)
                 {
-                    args[i] = RemoveWhitespace(line.substr(pos, posDelim - pos));
+                    args[i] = RemoveWhitespace(line, pos, posDelim);
                     ++argsGiven;
                 }
                 else if (posDelim == len)
@@ -420,194 +428,337 @@ namespace Assembly {
                         posDelim = std::min(line.find_first_of(";/", posDelim + 1), len);
                     }
 
-                    args[i] = RemoveWhitespace(line.substr(pos, posDelim - pos));
+                    args[i] = RemoveWhitespace(line, pos, posDelim);
                     ++argsGiven;
                     break;
                 }
             }
         }
 
-        if (argsGiven != argsRequired && opcode.front() != '.')
+        ReadRecord(std::move(rec), argsGiven);
+    }
+
+    void Assembler::ReadRecord(AsmRecord&& rec, size_t argsGiven)
+    {
+        const std::string& opcode = rec.opcode;
+        if (opcode[0] == '.')
+        {
+            ExecAssemblerDirective(opcode, rec.args);
+            return;
+        }
+
+        if (!m_encoder.IsInstructionValid(opcode))
+        {
+            LineError("Unknown instruction \"" << opcode << "\".");
+            return;
+        }
+
+        size_t argsRequired = m_encoder.GetInstructionArgCount(opcode);
+        if (argsGiven != argsRequired)
         {
             LineError("\"" << opcode << "\" was given " << argsGiven << 
                       " arguments, but expects " << argsRequired << ".");
             return;
         }
 
-        size_t instrBytes = m_encoder.GetInstructionByteSize(opcode);
+        AddRecord(std::move(rec));
+    }
+
+    size_t Assembler::GetRecordByteSize(const AsmRecord& rec) const
+    {
+        if (rec.opcode.empty())
+            return 0;
+
+        if (rec.opcode == ".BYTE")
+            return std::stoul(rec.args[0]);
+
+        return m_encoder.GetInstructionByteSize(rec.opcode);
+    }
+
+    void Assembler::AddRecord(AsmRecord&& rec)
+    {
+        rec.lineNbr = m_lineNbr;
+        rec.labels.swap(m_pendingLabels);
+        rec.isDataStart = m_pendingDataStart;
+        m_pendingLabels.clear();
+        m_pendingDataStart = false;
+
+        m_parseAddr += GetRecordByteSize(rec);
+
+        // The optimizer and block layout need to see the whole program, so keep the 
+        // records until the end. Otherwise, the record is encoded right away.
+        if (IsKeepingRecords())
+            m_records.push_back(std::move(rec));
+        else
+            EmitRecord(rec);
+    }
 
-        // Output the opcode and arguments to workingText.
-        if (opcode != "")
+    void Assembler::EmitRecord(const AsmRecord& rec)
+    {
+        for (const std::string& label : rec.labels)
         {
-            if (opcode[0] == '.')
+            if (!m_labelDict.RegisterLabel(label, m_instrAddr))
             {
-                ExecAssemblerDirective(opcode, args);
-                return;
+                auto line = m_labelLines.find(label);
+                m_lineNbr = line != m_labelLines.end() ? line->second : rec.lineNbr;
+                LineError("Multiple label definitions: \"" << label << "\".");
             }
+        }
+
+        if (rec.isDataStart)
+            m_binHeader.dataStart = m_instrAddr;
+
+        if (rec.opcode.empty())
+            return;
 
-            workingText << opcode;
+        size_t byteSize = GetRecordByteSize(rec);
+        m_output.resize(m_instrAddr + byteSize);
+
+        if (rec.opcode == ".BYTE")
+        {
+            EncodeData(rec, m_instrAddr);
         }
-        else
+        else if (!EncodeInstruction(rec, m_instrAddr, true))
         {
-            LineError("An instruction must start with a label or opcode");
-            return;
+            // Refers to a label further down. Patched once all labels are known.
+            Fixup fixup;
+            fixup.address = m_instrAddr;
+            fixup.record.opcode = rec.opcode;
+            fixup.record.lineNbr = rec.lineNbr;
+            for (int i = 0; i < 3; i++)
+                fixup.record.args[i] = rec.args[i];
+
+            m_fixups.push_back(std::move(fixup));
         }
 
-        if (args[0] != "")
-             workingText << ";" << args[0];
-        if (args[1] != "")
-             workingText << ";" << args[1];
-        if (args[2] != "")
-             workingText << ";" << args[2];
+        if (m_flags & FLAG_SHOW_TRANSLATION)
+        {
+            std::string text = rec.opcode;
+            for (int i = 0; i < 3 && !rec.args[i].empty(); i++)
+                text.append(i == 0 ? " " : ", ").append(rec.args[i]);
+
+            m_translation.push_back({ m_instrAddr, byteSize, std::move(text) });
+        }
 
-        workingText << ";" << std::endl;
-        m_instrAddr += instrBytes;
+        m_instrAddr += byteSize;
     }
 
-    void Assembler::AssembleLine(std::string& line, std::iostream& binaryOutput)
+    bool Assembler::EncodeInstruction(const AsmRecord& rec, Address address, bool allowUndefined)
     {
-        size_t start = 0;
-        size_t end = 0;
-        std::string opcode = "";
-        std::string parsedArgs[3] = {"", "", ""};
-        
         uint64_t args[3] = {0U, 0U, 0U};
-        
-        end = line.find(';');
-        opcode = line.substr(start, end);
-     
-        for (int i = 0; i < 3; i++)
-        {
-            start = end + 1;
-            end = line.find(';', start);
-            if (end != std::string::npos)
-            {
-                parsedArgs[i] = line.substr(start, end - start);
-                
-                if (opcode != ".BYTE")
-                    args[i] = EvaluateArgument(parsedArgs[i]);
 
-                // TODO: check integer size of argument based on i and opcode.
-            }
-            else
-                break;
+        m_hasUnresolved = false;
+        for (int i = 0; i < 3 && !rec.args[i].empty(); i++)
+            args[i] = EvaluateArgument(rec.args[i], allowUndefined);
+
+        if (m_hasUnresolved)
+            return false;
+
+        size_t instrBytes = m_encoder.GetInstructionByteSize(rec.opcode);
+        if (instrBytes == 0 || instrBytes > 12)
+        {
+            InstructionError("Invalid instruction size: " << instrBytes);
+            return true;
         }
 
-        // Instruction size in bytes.
-        uint64_t sizeArg = 0;
-        if (opcode == ".BYTE")
-            sizeArg = std::stoull(parsedArgs[0]);
+        BinaryInstruction result = m_encoder.TranslateInstruction(rec.opcode, args);
+        m_output[address] = result.opcode;
+        std::memcpy(&m_output[address + 1], result.instr, instrBytes - 1);
+        return true;
+    }
+
+    void Assembler::EncodeData(const AsmRecord& rec, Address address)
+    {
+        size_t byteSize = GetRecordByteSize(rec);
+        uint8_t* dst = &m_output[address];
+        const std::string& data = rec.args[1];
 
-        size_t instrBytes = m_encoder.GetInstructionByteSize(opcode);
-        BinaryInstruction result = TranslateInstruction(opcode, args);
+        // Data shorter than the declared size is zero-padded.
+        std::memset(dst, 0, byteSize);
 
-        if (opcode == ".BYTE") // Output an arbitrary number of bytes. Used for program data.
+        if (data[0] == '"')
         {
-            if (parsedArgs[1][0] == '"')
-            {
-                // If it's a string, remove "" characters.
-                parsedArgs[1] = parsedArgs[1].substr(1, parsedArgs[1].length() - 2);
-                parsedArgs[1] = UnescapeString(parsedArgs[1]);
-                binaryOutput.write(parsedArgs[1].c_str() + '\0', sizeArg);
-            }
-            else if (parsedArgs[1].find('.') != std::string::npos) // If it's floating-point data.
+            // If it's a string, remove "" characters.
+            std::string str = UnescapeString(data.substr(1, data.length() - 2));
+            std::memcpy(dst, str.data(), std::min(byteSize, str.length()));
+        }
+        else if (data.find('.') != std::string::npos) // If it's floating-point data.
+        {
+            if (data.back() == 'f') // Suffix == f ? Treat as float.
             {
-                if (parsedArgs[1].back() == 'f')
-                    binaryOutput << std::stof(parsedArgs[1]); // Suffix == f ? Treat as float.
-                else
-                    binaryOutput << std::stod(parsedArgs[1]); // No suffix? Treat as double.
+                float tmp = std::stof(data);
+                std::memcpy(dst, &tmp, std::min(byteSize, sizeof(tmp)));
             }
-            else
+            else // No suffix? Treat as double.
             {
-                // 64-bit constants in program memory is not supported right now.
-                // Why would all this ever be needed anyway? (save for strings).
-                binaryOutput << static_cast<uint32_t>(std::stoul(parsedArgs[1]));
+                double tmp = std::stod(data);
+                std::memcpy(dst, &tmp, std::min(byteSize, sizeof(tmp)));
             }
         }
-        // If not a .BYTE directive, output instructions.
-        else if (instrBytes <= 12)
-        {
-            binaryOutput << result.opcode;
-            binaryOutput.write((char*)(result.instr), instrBytes - 1);            
-        }
         else
         {
-            InstructionError("Invalid instruction size: " << instrBytes);
-            return;
-        } 
+            uint64_t tmp = std::stoull(data);
+            std::memcpy(dst, &tmp, std::min(byteSize, sizeof(tmp)));
+        }
+    }
 
-        // Do a horrible attempt at formatting output into columns.
-        if ((m_flags & FLAG_SHOW_TRANSLATION) /* && opcode != ".BYTE" */)
+    void Assembler::PatchFixups()
+    {
+        Address end = m_instrAddr;
+
+        for (const Fixup& fixup : m_fixups)
         {
-            std::stringstream finalTranslation;
-            finalTranslation << std::left << std::setw(9) << opcode;
-            
-            if (parsedArgs[0] != "")
-                finalTranslation << std::left << std::setw(14) << args[0];
-            if (parsedArgs[1] != "")
-                finalTranslation << ',' << std::left << std::setw(10) << args[1];
-            if (parsedArgs[2] != "")
-                finalTranslation << ',' << std::left << std::setw(10) << args[2];
+            m_instrAddr = fixup.address;
+            m_lineNbr = fixup.record.lineNbr;
+            EncodeInstruction(fixup.record, fixup.address, false);
+        }
 
-            char instrAddr[13];
-            std::snprintf(instrAddr, 13, "[0x%.8X]", m_instrAddr);
+        m_instrAddr = end;
+    }
 
-            std::cout << std::setfill(' ') << std::left << std::setw(13) << instrAddr << std::setw(20) << line <<
-                '|' << std::setw(36) << finalTranslation.str(); 
-            std::cout << "(";
+    bool Assembler::IsKeepingRecords() const
+    {
+        return (m_flags & (FLAG_OPTIMIZE | FLAG_INLINE)) || !m_profilePath.empty();
+    }
 
-            printf("%02hhX", result.opcode);
+    // Runs the inliner, the peephole optimizer and the block layout on the records 
+    // read so far, and then emits them.
+    void Assembler::ProcessRecords()
+    {
+        // The end record holds labels at the very end of the program.
+        AsmRecord end;
+        AddRecord(std::move(end));
 
-            uint8_t* ptr = (uint8_t*)result.instr;
-            while (ptr < ((uint8_t*)result.instr) + instrBytes)
-                printf(" %02hhX", *ptr++);
+        // Remember which labels are referenced, since the optimizer may remove references.
+        std::vector<std::string> referenced;
+        for (const AsmRecord& rec : m_records)
+        {
+            if (rec.opcode == ".BYTE")
+                continue;
 
-            std::cout << ")" << std::endl;
+            for (int i = 0; i < 3 && !rec.args[i].empty(); i++)
+                referenced.push_back(rec.args[i]);
         }
 
-        m_instrAddr += instrBytes;
-    }
+        // Inlining goes first, so that the optimizer sees the inlined bodies in 
+        // the context of their call sites.
+        if (m_flags & FLAG_INLINE)
+        {
+            Inliner inliner(static_cast<VMMode>(m_binHeader.mode));
+            size_t changes = inliner.Inline(m_records);
 
-    //---- PUBLIC --------------------------------------------------------------------------------//
+            if (m_flags & FLAG_SHOW_TRANSLATION)
+                std::cout << "-------- INLINER: " << changes << " calls inlined --------" << std::endl;
+        }
 
-    size_t Assembler::Assemble(std::istream& textInput, std::iostream& binaryOutput)
-    {
-        m_hasError = false;
+        if (m_flags & FLAG_OPTIMIZE)
+        {
+            PeepholeOptimizer optimizer(static_cast<VMMode>(m_binHeader.mode));
+            size_t changes = optimizer.Optimize(m_records);
 
-        // Temporary stream of assembly source that can be altered by the first pass,
-        // and then read from by the second pass.
-        workingText.clear();
+            if (m_flags & FLAG_SHOW_TRANSLATION)
+                std::cout << "-------- OPTIMIZER: " << changes << " changes --------" << std::endl;
+        }
 
-        if (m_flags & FLAG_SHOW_FIRST_PASS)
-            std::cout << "-------- FIRST PASS START --------" << std::endl;
-        
-        std::string line;
-        for (m_lineNbr = 1, m_instrAddr = 0; std::getline(textInput, line); m_lineNbr++)
+        if (!m_profilePath.empty())
         {
-            if (m_flags & FLAG_SHOW_FIRST_PASS)
-                std::cout << m_lineNbr << " [" << m_instrAddr << "]\t" << line << std::endl;
-        
-            FirstPassReadLine(line);
+            // The profile refers to the program as it would be without a layout, 
+            // i.e. after the inliner and the optimizer.
+            BranchProfile profile;
+            if (!LoadBranchProfile(m_profilePath, profile))
+            {
+                std::cerr << "[Assembler]: Error: could not read profile \"" << m_profilePath 
+                    << "\"." << std::endl;
+                m_hasError = true;
+            }
+
+            BlockLayout layout(profile, [this](const AsmRecord& rec) { return GetRecordByteSize(rec); });
+            if (m_flags & FLAG_ALIGN_LOOPS)
+                layout.SetLoopAlignment(LOOP_ALIGNMENT);
+
+            size_t changes = layout.Layout(m_records);
+            if (layout.GetMismatchCount() > 0)
+            {
+                std::cerr << "Warning: profile \"" << m_profilePath << "\" does not match the program ("
+                    << layout.GetMismatchCount() << " branches differ), the layout is unchanged." << std::endl;
+            }
+
+            if (m_flags & FLAG_SHOW_TRANSLATION)
+                std::cout << "-------- LAYOUT: " << changes << " changes --------" << std::endl;
         }
 
-        if (m_flags & FLAG_SHOW_FIRST_PASS)
-            std::cout << "-------- FIRST PASS END --------" << std::endl;
+        for (const AsmRecord& rec : m_records)
+            EmitRecord(rec);
 
-        // Write the header data first.
-        binaryOutput.write((const char*)&m_binHeader, sizeof(m_binHeader));
+        for (const std::string& arg : referenced)
+        {
+            Address unused;
+            m_labelDict.ResolveLabel(arg, unused);
+        }
 
         if (m_flags & FLAG_SHOW_TRANSLATION)
-            std::cout << "-------- SECOND PASS BEGIN --------" << std::endl;
+        {
+            std::cout << "-------- " << m_parseAddr << " -> " << m_instrAddr << " bytes --------" << std::endl;
+        }
+
+        m_records.clear();
+    }
+
+    void Assembler::PrintTranslation() const
+    {
+        // Do a horrible attempt at formatting output into columns.
+        for (const TranslatedRecord& entry : m_translation)
+        {
+            char instrAddr[13];
+            std::snprintf(instrAddr, 13, "[0x%.8X]", entry.address);
+
+            std::cout << std::setfill(' ') << std::left << std::setw(13) << instrAddr << 
+                std::setw(36) << entry.text << '(';
 
-        // Begin the second pass, which actually starts to ouput binary.
+            // Data may be arbitrarily large, so only show the first bytes of it.
+            const uint8_t* ptr = &m_output[entry.address];
+            size_t shown = std::min(entry.byteSize, (size_t)16);
+            for (size_t i = 0; i < shown; i++)
+                printf(i == 0 ? "%02hhX" : " %02hhX", ptr[i]);
+
+            std::cout << (shown < entry.byteSize ? " ..." : "") << ")" << std::endl;
+        }
+    }
+
+    void Assembler::Reset()
+    {
+        m_hasError = false;
+        m_parseAddr = 0;
         m_instrAddr = 0;
-        while (std::getline(workingText, line))
+        m_pendingDataStart = false;
+        m_pendingLabels.clear();
+        m_labelLines.clear();
+        m_records.clear();
+        m_fixups.clear();
+        m_translation.clear();
+        m_output.clear();
+    }
+
+    size_t Assembler::Finish(std::ostream& binaryOutput)
+    {
+        if (IsKeepingRecords())
         {
-            AssembleLine(line, binaryOutput);
+            ProcessRecords();
+        }
+        else
+        {
+            AsmRecord end;
+            AddRecord(std::move(end));
         }
 
+        PatchFixups();
+
         if (m_flags & FLAG_SHOW_TRANSLATION)
-            std::cout << "-------- SECOND PASS END --------" << std::endl;
+        {
+            std::cout << "-------- TRANSLATION BEGIN --------" << std::endl;
+            PrintTranslation();
+            std::cout << "-------- TRANSLATION END --------" << std::endl;
+        }
 
         if (!(m_flags & FLAG_SUPPRESS_UNUSED_LABELS))
             m_labelDict.WarnAboutUnusedLabels();
@@ -615,99 +766,66 @@ namespace Assembly {
         if (m_hasError)
             return 0;
 
+        // The header is written last, since the start of data is not known until now.
+        binaryOutput.write((const char*)&m_binHeader, sizeof(m_binHeader));
+        binaryOutput.write((const char*)m_output.data(), m_output.size());
         binaryOutput.flush();
         return m_instrAddr; // In bytes.
     }
-}
 
-using namespace Assembly;
-
-void PrintHelp()
-{
-    std::cout << 
-        "====| rackasm - Assembler for RackVM |====" << std::endl <<
-        "By: Kasper Skott, 2022" << std::endl <<
-        "(Detecting " << (IsLittleEndian() ? "little endian" : "big endian") << ")" << std::endl <<
-        "    Usage: rackasm [flags]? FILE [flags]?" << std::endl <<
-        "    -v    Verbose, prints translation to stdout." << std::endl << 
-        "    -f    Prints the first pass to stdout." << std::endl <<
-        "    -l    Suppress unusused labels warning." << std::endl;
-}
+    //---- PUBLIC --------------------------------------------------------------------------------//
 
-int main(int argc, char* argv[])
-{
-    if (argc < 2)
+    size_t Assembler::Assemble(std::istream& textInput, std::ostream& binaryOutput)
     {
-        PrintHelp();
-        return 0;
-    }
-
-    Assembler assembler;
+        Reset();
 
-    // Parse arguments.
-    std::string inputPath = "";
-    std::vector<std::string> args(argv, argv+argc);
-    for (auto argIt = ++args.begin(); argIt != args.end(); ++argIt)
-    {
-        if (argIt->at(0) != '-') // This is the input file.
+        if (m_flags & FLAG_SHOW_FIRST_PASS)
+            std::cout << "-------- PARSING START --------" << std::endl;
+        
+        // Each line is read and tokenized once. Instructions are encoded as soon 
+        // as they are read, unless they must be kept for the optimizer.
+        std::string line;
+        for (m_lineNbr = 1; std::getline(textInput, line); m_lineNbr++)
         {
-            if (inputPath == "")
-                inputPath = *argIt;
-            else
-                std::cerr << "File path argument has already been defined." << std::endl;
-
-            continue;
+            if (m_flags & FLAG_SHOW_FIRST_PASS)
+                std::cout << m_lineNbr << " [" << m_parseAddr << "]\t" << line << std::endl;
+        
+            ReadLine(line);
         }
 
-        switch (argIt->at(1))
-        {
-            case 'v': assembler.AddFlags(FLAG_VERBOSE);
-                break;
-            case 'f': assembler.AddFlags(FLAG_SHOW_FIRST_PASS);
-                break;
-            case 'l': assembler.AddFlags(FLAG_SUPPRESS_UNUSED_LABELS);
-                break;
-            case 'h': PrintHelp();
-                return 0;
-        }
+        if (m_flags & FLAG_SHOW_FIRST_PASS)
+            std::cout << "-------- PARSING END --------" << std::endl;
+
+        return Finish(binaryOutput);
     }
 
-    std::ifstream inputFile(inputPath);
-    if (!inputFile.is_open())
+    size_t Assembler::Assemble(const RecordList& records, std::ostream& binaryOutput)
     {
-        std::cerr << "Could not open \"" << inputPath << "\"." << std::endl;
-        return 0;
-    }
+        Reset();
 
-    size_t pathLastDot = inputPath.rfind('.');
-    if (pathLastDot == inputPath.npos)
-        pathLastDot = inputPath.length();
+        // Errors refer to the index of the record, counting from 1.
+        m_lineNbr = 1;
+        for (const AsmRecord& rec : records)
+        {
+            AsmRecord copy = rec;
+            m_pendingLabels.insert(m_pendingLabels.end(), copy.labels.begin(), copy.labels.end());
+            copy.labels.clear();
 
-    std::string outputPath = inputPath.substr(0, pathLastDot) + ".bin";
-    std::fstream outFile(outputPath, std::ios::binary | std::ios::out);
+            if (copy.isDataStart)
+                m_pendingDataStart = true;
 
-    if (!outFile.is_open())
-    {
-        std::cerr << "Could not create \"" << outputPath << "\"." << std::endl;
-        return 0;
-    }
+            if (!copy.opcode.empty())
+            {
+                size_t argsGiven = 0;
+                while (argsGiven < 3 && !copy.args[argsGiven].empty())
+                    argsGiven++;
 
-    size_t binarySize = 0;
-    try
-    {
-        // Assemble the inputFile stream of assembly text into the binary output file.
-        // The byte cound does not account for the header.
-        binarySize = assembler.Assemble(inputFile, outFile);
-    }
-    catch(const std::exception& e)
-    {
-        std::cerr << e.what() << std::endl;
-    }   
+                ReadRecord(std::move(copy), argsGiven);
+            }
 
-    if (binarySize > 0)
-        std::cout << "Assembly successful! Wrote " << binarySize << " bytes." << std::endl;
-    else
-        std::cout << "Assembly failed!" << std::endl;
+            m_lineNbr++;
+        }
 
-    return 0;
+        return Finish(binaryOutput);
+    }
 }
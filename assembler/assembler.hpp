@@ -34,9 +34,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <iomanip>
 #include <vector>
+#include <unordered_map>
+#include <cstring>
 
 #include "label.hpp"
 #include "encoder.hpp"
+#include "optimizer.hpp"
+#include "layout.hpp"
+#include "inliner.hpp"
 
 namespace Assembly 
 {
@@ -50,6 +55,12 @@ namespace Assembly
     constexpr AssemblerFlags FLAG_SHOW_TRANSLATION = 0x2;
     constexpr AssemblerFlags FLAG_SUPPRESS_UNUSED_LABELS = 0x4;
     constexpr AssemblerFlags FLAG_SUPPRESS_ALL_ERRORS = 0x8;
+    constexpr AssemblerFlags FLAG_OPTIMIZE = 0x10;
+    constexpr AssemblerFlags FLAG_ALIGN_LOOPS = 0x20;
+    constexpr AssemblerFlags FLAG_INLINE = 0x40;
+
+    // Alignment of loop heads with FLAG_ALIGN_LOOPS, in bytes.
+    constexpr Address LOOP_ALIGNMENT = 16;
 
     constexpr AssemblerFlags FLAG_VERBOSE = FLAG_SHOW_TRANSLATION;
 
@@ -67,6 +78,22 @@ namespace Assembly
         {}
     };
 
+    // An instruction that refers to a label that was not yet defined when it was 
+    // encoded. It is encoded again once all labels are known.
+    struct Fixup
+    {
+        Address address;
+        AsmRecord record;
+    };
+
+    // Kept for printing the translation once all fix-ups are patched.
+    struct TranslatedRecord
+    {
+        Address address;
+        size_t byteSize;
+        std::string text;
+    };
+
     class Assembler
     {
     private:
@@ -75,7 +102,16 @@ namespace Assembly
         size_t m_lineNbr;
         Address m_instrAddr;            // Instruction addresses are all in bytes.
         AssemblerFlags m_flags;
-        std::stringstream workingText;
+        std::string m_profilePath;
+        Address m_parseAddr;            // Address of the next record read, before optimization.
+        std::vector<std::string> m_pendingLabels;
+        std::unordered_map<std::string, size_t> m_labelLines;  // Source line of each label.
+        bool m_pendingDataStart;
+        bool m_hasUnresolved;
+        RecordList m_records;           // Records kept for the inliner, optimizer and block layout.
+        std::vector<Fixup> m_fixups;
+        std::vector<TranslatedRecord> m_translation;
+        std::vector<uint8_t> m_output;  // Encoded program, excluding the header.
         BinaryHeader m_binHeader;
         LabelDictionary m_labelDict;
         InstructionEncoder m_encoder;
@@ -86,22 +122,41 @@ namespace Assembly
         // Attempts to assemble the textInput stream of assembly into its corresponding binary format.
         // Returns the number of bytes that was successfully generated.
         // Returns 0 on assembly error.
-        size_t Assemble(std::istream& textInput, std::iostream& binaryOutput);
+        size_t Assemble(std::istream& textInput, std::ostream& binaryOutput);
+
+        // Assembles records that are already tokenized, e.g. by the compiler, without 
+        // a round trip through text. Directives such as .MODE are given as records too.
+        size_t Assemble(const RecordList& records, std::ostream& binaryOutput);
 
         inline void AddFlags(AssemblerFlags flags)   { m_flags |= flags; }
         inline void ClearFlags(AssemblerFlags flags) { m_flags = 0x0; }
 
+        // Lays out the basic blocks of each function by the branch counts in the profile,
+        // as written by a VM built with PROFILE.
+        inline void SetProfile(const std::string& path) { m_profilePath = path; }
+
     private:
         static std::string UnescapeString(const std::string& str);
         std::string ToLowerCase(const std::string& str) const;
-        std::string RemoveWhitespace(const std::string& str) const;
+        std::string RemoveWhitespace(const std::string& str, size_t begin, size_t end) const;
         void PrintMemory(void* address, size_t byteCount) const;
 
-        BinaryInstruction TranslateInstruction(const std::string& opcode, uint64_t* args);
-        uint64_t EvaluateArgument(const std::string& arg);
+        uint64_t EvaluateArgument(const std::string& arg, bool allowUndefined);
+        bool ResolveLabel(const std::string& label, uint64_t& value, bool allowUndefined);
         void ExecAssemblerDirective(const std::string& directive, const std::string* args);
-        void FirstPassReadLine(std::string& line);
-        void AssembleLine(std::string& line, std::iostream& binaryOutput);
+        void ReadLine(const std::string& line);
+        void ReadRecord(AsmRecord&& rec, size_t argsGiven);
+        size_t GetRecordByteSize(const AsmRecord& rec) const;
+        void AddRecord(AsmRecord&& rec);
+        void EmitRecord(const AsmRecord& rec);
+        bool EncodeInstruction(const AsmRecord& rec, Address address, bool allowUndefined);
+        void EncodeData(const AsmRecord& rec, Address address);
+        void PatchFixups();
+        bool IsKeepingRecords() const;
+        void ProcessRecords();
+        void PrintTranslation() const;
+        void Reset();
+        size_t Finish(std::ostream& binaryOutput);
 
     };
 
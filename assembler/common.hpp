@@ -39,10 +39,16 @@ namespace Assembly
 
     enum VMMode
     {
-        VM_MODE_REGISTER = 0,
-        VM_MODE_STACK    = 1
+        VM_MODE_REGISTER      = 0,
+        VM_MODE_STACK         = 1,
+        VM_MODE_REGISTER_WIDE = 2  // Register instruction set on a separate file of 64-bit registers.
     };
 
+    constexpr bool IsRegisterMode(VMMode mode)
+    {
+        return mode == VM_MODE_REGISTER || mode == VM_MODE_REGISTER_WIDE;
+    }
+
     union EndianTester
     {
         uint32_t n;
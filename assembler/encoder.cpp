@@ -60,6 +60,10 @@ namespace Assembly
     #define DECL_REG_INSTR3(op, mn, a, b, c) inline BinaryInstruction R_##mn(const uint64_t Ra, const uint64_t Rb, const uint64_t Rc)\
     { return BinaryInstruction(op, (a)Ra, (b)Rb, (c)Rc); }
 
+    // Declares an alias of an instruction, which takes its first two operands in swapped order.
+    #define DECL_REG_INSTR3_SWAPPED(op, mn, a, b, c) inline BinaryInstruction R_##mn(const uint64_t Ra, const uint64_t Rb, const uint64_t Rc)\
+    { return BinaryInstruction(op, (a)Rb, (b)Ra, (c)Rc); }
+
     #define LOAD_REG_INSTR0(mn, fn, byteSize) {m_translate[mn] = R_##fn; m_info[mn] = InstructionData(byteSize);}
     #define LOAD_REG_INSTR(mn, fn, byteSize, ...) {m_translate[mn] = R_##fn; m_info[mn] = InstructionData(byteSize, __VA_ARGS__);}
 
@@ -242,6 +246,123 @@ namespace Assembly
     DECL_REG_INSTR3(0x98, STRCAT,   Register,   Register,   uint32_t)
     DECL_REG_INSTR3(0x99, STRCMB,   Register,   Register,   Register)
 
+    // TAILCALL addr, argsOld, argsNew: the address is given first, like for CALL,
+    // but is encoded last.
+    inline BinaryInstruction R_TAILCALL(const uint64_t C, const uint64_t Ra, const uint64_t Rb)
+    { return BinaryInstruction(0x9A, (Register)Ra, (Register)Rb, (uint32_t)C); }
+
+    DECL_REG_INSTR3(0x9B, LDLX,     Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0x9C, LDLX_64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0x9D, STLX,     Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0x9E, STLX_64,  Register,   Register,   uint32_t)
+
+    DECL_REG_INSTR1(0x9F, VLEN,     Register                        )
+    DECL_REG_INSTR3(0xA0, VADD,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA1, VADD_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA2, VADD_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA3, VADD_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA4, VSUB,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA5, VSUB_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA6, VSUB_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA7, VSUB_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA8, VMUL,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xA9, VMUL_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAA, VMUL_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAB, VMUL_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAC, VDIV,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAD, VDIV_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAE, VDIV_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xAF, VDIV_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB0, VFMA,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB1, VFMA_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB2, VFMA_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB3, VFMA_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB4, VMIN,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB5, VMIN_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB6, VMIN_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB7, VMIN_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB8, VMAX,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xB9, VMAX_64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBA, VMAX_F,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBB, VMAX_F64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBC, VCPEQ,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBD, VCPEQ_64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBE, VCPEQ_F,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xBF, VCPEQ_F64,Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC0, VCPLT,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC1, VCPLT_64, Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC2, VCPLT_F,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC3, VCPLT_F64,Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC4, MEMCPY,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC5, MEMMOVE,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC6, MEMSET,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC7, FILL,     Register,   Register,   Register)
+    DECL_REG_INSTR3(0xC8, FILL_64,  Register,   Register,   Register)
+    DECL_REG_INSTR2(0xC9, SQRT_F,   Register,   Register            )
+    DECL_REG_INSTR2(0xCA, SQRT_F64, Register,   Register            )
+    DECL_REG_INSTR3(0xCB, FMA_F,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xCC, FMA_F64,  Register,   Register,   Register)
+    DECL_REG_INSTR2(0xCD, ABS,      Register,   Register            )
+    DECL_REG_INSTR2(0xCE, ABS_64,   Register,   Register            )
+    DECL_REG_INSTR2(0xCF, ABS_F,    Register,   Register            )
+    DECL_REG_INSTR2(0xD0, ABS_F64,  Register,   Register            )
+    DECL_REG_INSTR3(0xD1, MIN,      Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD2, MIN_64,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD3, MIN_F,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD4, MIN_F64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD5, MAX,      Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD6, MAX_64,   Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD7, MAX_F,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xD8, MAX_F64,  Register,   Register,   Register)
+    DECL_REG_INSTR2(0xD9, FLOOR_F,  Register,   Register            )
+    DECL_REG_INSTR2(0xDA, FLOOR_F64,Register,   Register            )
+    DECL_REG_INSTR2(0xDB, CEIL_F,   Register,   Register            )
+    DECL_REG_INSTR2(0xDC, CEIL_F64, Register,   Register            )
+    DECL_REG_INSTR2(0xDD, ROUND_F,  Register,   Register            )
+    DECL_REG_INSTR2(0xDE, ROUND_F64,Register,   Register            )
+    DECL_REG_INSTR2(0xDF, SIN_F,    Register,   Register            )
+    DECL_REG_INSTR2(0xE0, SIN_F64,  Register,   Register            )
+    DECL_REG_INSTR2(0xE1, COS_F,    Register,   Register            )
+    DECL_REG_INSTR2(0xE2, COS_F64,  Register,   Register            )
+    DECL_REG_INSTR2(0xE3, EXP_F,    Register,   Register            )
+    DECL_REG_INSTR2(0xE4, EXP_F64,  Register,   Register            )
+    DECL_REG_INSTR2(0xE5, LOG_F,    Register,   Register            )
+    DECL_REG_INSTR2(0xE6, LOG_F64,  Register,   Register            )
+    DECL_REG_INSTR3(0xE7, POW_F,    Register,   Register,   Register)
+    DECL_REG_INSTR3(0xE8, POW_F64,  Register,   Register,   Register)
+    DECL_REG_INSTR3(0xE9, BEQ,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xEA, BEQ_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xEB, BEQ_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xEC, BEQ_F64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xED, BNE,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xEE, BNE_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xEF, BNE_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF0, BNE_F64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF1, BLT,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF2, BLT_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF3, BLT_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF4, BLT_F64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF5, BGE,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF6, BGE_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF7, BGE_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF8, BGE_F64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3(0xF9, BEQI,     Register,   int32_t,    uint32_t)
+    DECL_REG_INSTR3(0xFA, BNEI,     Register,   int32_t,    uint32_t)
+    DECL_REG_INSTR3(0xFB, BLTI,     Register,   int32_t,    uint32_t)
+    DECL_REG_INSTR3(0xFC, BGEI,     Register,   int32_t,    uint32_t)
+    DECL_REG_INSTR3(0xFD, SEL,      Register,   Register,   Register)
+    DECL_REG_INSTR3(0xFE, SEL_64,   Register,   Register,   Register)
+
+    // BGT and BLE are BLT and BGE with the operands swapped.
+    DECL_REG_INSTR3_SWAPPED(0xF1, BGT,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF2, BGT_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF3, BGT_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF4, BGT_F64,  Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF5, BLE,      Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF6, BLE_64,   Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF7, BLE_F,    Register,   Register,   uint32_t)
+    DECL_REG_INSTR3_SWAPPED(0xF8, BLE_F64,  Register,   Register,   uint32_t)
+
     //---- Stack-only instructions ----//
     DECL_STACK_INSTR1(0x09, LDI,        uint32_t)
     DECL_STACK_INSTR1(0x0A, LDI_64,     uint64_t)
@@ -357,6 +478,85 @@ namespace Assembly
     DECL_STACK_INSTR1(0x73, STRCPY,     uint32_t)
     DECL_STACK_INSTR1(0x74, STRCAT,     uint32_t)
     DECL_STACK_INSTR0(0x75, STRCMB              )
+
+    inline BinaryInstruction S_TAILCALL(const uint64_t C, const uint64_t Ra, const uint64_t Rb)
+    { return BinaryInstruction(0x76, (Register)Ra, (Register)Rb, (uint32_t)C); }
+
+    DECL_STACK_INSTR0(0x7B, VADD                )
+    DECL_STACK_INSTR0(0x7C, VADD_64             )
+    DECL_STACK_INSTR0(0x7D, VADD_F              )
+    DECL_STACK_INSTR0(0x7E, VADD_F64            )
+    DECL_STACK_INSTR0(0x7F, VSUB                )
+    DECL_STACK_INSTR0(0x80, VSUB_64             )
+    DECL_STACK_INSTR0(0x81, VSUB_F              )
+    DECL_STACK_INSTR0(0x82, VSUB_F64            )
+    DECL_STACK_INSTR0(0x83, VMUL                )
+    DECL_STACK_INSTR0(0x84, VMUL_64             )
+    DECL_STACK_INSTR0(0x85, VMUL_F              )
+    DECL_STACK_INSTR0(0x86, VMUL_F64            )
+    DECL_STACK_INSTR0(0x87, VDIV                )
+    DECL_STACK_INSTR0(0x88, VDIV_64             )
+    DECL_STACK_INSTR0(0x89, VDIV_F              )
+    DECL_STACK_INSTR0(0x8A, VDIV_F64            )
+    DECL_STACK_INSTR0(0x8B, VFMA                )
+    DECL_STACK_INSTR0(0x8C, VFMA_64             )
+    DECL_STACK_INSTR0(0x8D, VFMA_F              )
+    DECL_STACK_INSTR0(0x8E, VFMA_F64            )
+    DECL_STACK_INSTR0(0x8F, VMIN                )
+    DECL_STACK_INSTR0(0x90, VMIN_64             )
+    DECL_STACK_INSTR0(0x91, VMIN_F              )
+    DECL_STACK_INSTR0(0x92, VMIN_F64            )
+    DECL_STACK_INSTR0(0x93, VMAX                )
+    DECL_STACK_INSTR0(0x94, VMAX_64             )
+    DECL_STACK_INSTR0(0x95, VMAX_F              )
+    DECL_STACK_INSTR0(0x96, VMAX_F64            )
+    DECL_STACK_INSTR0(0x97, VCPEQ               )
+    DECL_STACK_INSTR0(0x98, VCPEQ_64            )
+    DECL_STACK_INSTR0(0x99, VCPEQ_F             )
+    DECL_STACK_INSTR0(0x9A, VCPEQ_F64           )
+    DECL_STACK_INSTR0(0x9B, VCPLT               )
+    DECL_STACK_INSTR0(0x9C, VCPLT_64            )
+    DECL_STACK_INSTR0(0x9D, VCPLT_F             )
+    DECL_STACK_INSTR0(0x9E, VCPLT_F64           )
+    DECL_STACK_INSTR0(0x9F, MEMCPY              )
+    DECL_STACK_INSTR0(0xA0, MEMMOVE             )
+    DECL_STACK_INSTR0(0xA1, MEMSET              )
+    DECL_STACK_INSTR0(0xA2, FILL                )
+    DECL_STACK_INSTR0(0xA3, FILL_64             )
+    DECL_STACK_INSTR0(0xA4, SQRT_F              )
+    DECL_STACK_INSTR0(0xA5, SQRT_F64            )
+    DECL_STACK_INSTR0(0xA6, FMA_F               )
+    DECL_STACK_INSTR0(0xA7, FMA_F64             )
+    DECL_STACK_INSTR0(0xA8, ABS                 )
+    DECL_STACK_INSTR0(0xA9, ABS_64              )
+    DECL_STACK_INSTR0(0xAA, ABS_F               )
+    DECL_STACK_INSTR0(0xAB, ABS_F64             )
+    DECL_STACK_INSTR0(0xAC, MIN                 )
+    DECL_STACK_INSTR0(0xAD, MIN_64              )
+    DECL_STACK_INSTR0(0xAE, MIN_F               )
+    DECL_STACK_INSTR0(0xAF, MIN_F64             )
+    DECL_STACK_INSTR0(0xB0, MAX                 )
+    DECL_STACK_INSTR0(0xB1, MAX_64              )
+    DECL_STACK_INSTR0(0xB2, MAX_F               )
+    DECL_STACK_INSTR0(0xB3, MAX_F64             )
+    DECL_STACK_INSTR0(0xB4, FLOOR_F             )
+    DECL_STACK_INSTR0(0xB5, FLOOR_F64           )
+    DECL_STACK_INSTR0(0xB6, CEIL_F              )
+    DECL_STACK_INSTR0(0xB7, CEIL_F64            )
+    DECL_STACK_INSTR0(0xB8, ROUND_F             )
+    DECL_STACK_INSTR0(0xB9, ROUND_F64           )
+    DECL_STACK_INSTR0(0xBA, SIN_F               )
+    DECL_STACK_INSTR0(0xBB, SIN_F64             )
+    DECL_STACK_INSTR0(0xBC, COS_F               )
+    DECL_STACK_INSTR0(0xBD, COS_F64             )
+    DECL_STACK_INSTR0(0xBE, EXP_F               )
+    DECL_STACK_INSTR0(0xBF, EXP_F64             )
+    DECL_STACK_INSTR0(0xC0, LOG_F               )
+    DECL_STACK_INSTR0(0xC1, LOG_F64             )
+    DECL_STACK_INSTR0(0xC2, POW_F               )
+    DECL_STACK_INSTR0(0xC3, POW_F64             )
+    DECL_STACK_INSTR0(0xC4, SEL                 )
+    DECL_STACK_INSTR0(0xC5, SEL_64              )
     //----------------------------------//
 
     InstructionEncoder::InstructionEncoder()
@@ -379,7 +579,7 @@ namespace Assembly
         LOAD_INSTR ("SCALL",   SCALL,      2,       UINT8_MAX );
         LOAD_INSTR ("SARG",    SARG,       2,       UINT8_MAX );
 
-        if (mode == VM_MODE_REGISTER)
+        if (IsRegisterMode(mode))
         {
             //              OPCODE       FUNC        BYTES    DATA RANGES ...
             LOAD_REG_INSTR ("MOV",       MOV,        3,       UINT8_MAX,  UINT8_MAX             );
@@ -532,6 +732,124 @@ namespace Assembly
             LOAD_REG_INSTR ("STRCPY",    STRCPY,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
             LOAD_REG_INSTR ("STRCAT",    STRCAT,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
             LOAD_REG_INSTR ("STRCMB",    STRCMB,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+
+            LOAD_REG_INSTR ("TAILCALL",  TAILCALL,   7,       UINT32_MAX, UINT8_MAX,  UINT8_MAX );
+
+            LOAD_REG_INSTR ("LDLX",      LDLX,       7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("LDLX.64",   LDLX_64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("STLX",      STLX,       7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("STLX.64",   STLX_64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+
+            LOAD_REG_INSTR ("VLEN",      VLEN,       2,       UINT8_MAX                         );
+            LOAD_REG_INSTR ("VADD",      VADD,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VADD.64",   VADD_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VADD.F",    VADD_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VADD.F64",  VADD_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VSUB",      VSUB,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VSUB.64",   VSUB_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VSUB.F",    VSUB_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VSUB.F64",  VSUB_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMUL",      VMUL,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMUL.64",   VMUL_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMUL.F",    VMUL_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMUL.F64",  VMUL_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VDIV",      VDIV,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VDIV.64",   VDIV_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VDIV.F",    VDIV_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VDIV.F64",  VDIV_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VFMA",      VFMA,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VFMA.64",   VFMA_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VFMA.F",    VFMA_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VFMA.F64",  VFMA_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMIN",      VMIN,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMIN.64",   VMIN_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMIN.F",    VMIN_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMIN.F64",  VMIN_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMAX",      VMAX,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMAX.64",   VMAX_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMAX.F",    VMAX_F,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VMAX.F64",  VMAX_F64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPEQ",     VCPEQ,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPEQ.64",  VCPEQ_64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPEQ.F",   VCPEQ_F,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPEQ.F64", VCPEQ_F64,  4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPLT",     VCPLT,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPLT.64",  VCPLT_64,   4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPLT.F",   VCPLT_F,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("VCPLT.F64", VCPLT_F64,  4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+
+            LOAD_REG_INSTR ("MEMCPY",    MEMCPY,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MEMMOVE",   MEMMOVE,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MEMSET",    MEMSET,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("FILL",      FILL,       4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("FILL.64",   FILL_64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+
+            LOAD_REG_INSTR ("SQRT.F",    SQRT_F,     3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("SQRT.F64",  SQRT_F64,   3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("FMA.F",     FMA_F,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("FMA.F64",   FMA_F64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("ABS",       ABS,        3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("ABS.64",    ABS_64,     3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("ABS.F",     ABS_F,      3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("ABS.F64",   ABS_F64,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("MIN",       MIN,        4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MIN.64",    MIN_64,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MIN.F",     MIN_F,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MIN.F64",   MIN_F64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MAX",       MAX,        4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MAX.64",    MAX_64,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MAX.F",     MAX_F,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("MAX.F64",   MAX_F64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("FLOOR.F",   FLOOR_F,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("FLOOR.F64", FLOOR_F64,  3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("CEIL.F",    CEIL_F,     3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("CEIL.F64",  CEIL_F64,   3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("ROUND.F",   ROUND_F,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("ROUND.F64", ROUND_F64,  3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("SIN.F",     SIN_F,      3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("SIN.F64",   SIN_F64,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("COS.F",     COS_F,      3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("COS.F64",   COS_F64,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("EXP.F",     EXP_F,      3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("EXP.F64",   EXP_F64,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("LOG.F",     LOG_F,      3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("LOG.F64",   LOG_F64,    3,       UINT8_MAX,  UINT8_MAX             );
+            LOAD_REG_INSTR ("POW.F",     POW_F,      4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("POW.F64",   POW_F64,    4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+
+            LOAD_REG_INSTR ("BEQ",       BEQ,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BEQ.64",    BEQ_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BEQ.F",     BEQ_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BEQ.F64",   BEQ_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BNE",       BNE,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BNE.64",    BNE_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BNE.F",     BNE_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BNE.F64",   BNE_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLT",       BLT,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLT.64",    BLT_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLT.F",     BLT_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLT.F64",   BLT_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGE",       BGE,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGE.64",    BGE_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGE.F",     BGE_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGE.F64",   BGE_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGT",       BGT,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGT.64",    BGT_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGT.F",     BGT_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BGT.F64",   BGT_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLE",       BLE,        7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLE.64",    BLE_64,     7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLE.F",     BLE_F,      7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BLE.F64",   BLE_F64,    7,       UINT8_MAX,  UINT8_MAX,  UINT32_MAX);
+            LOAD_REG_INSTR ("BEQI",      BEQI,       10,      UINT8_MAX,  UINT32_MAX, UINT32_MAX);
+            LOAD_REG_INSTR ("BNEI",      BNEI,       10,      UINT8_MAX,  UINT32_MAX, UINT32_MAX);
+            LOAD_REG_INSTR ("BLTI",      BLTI,       10,      UINT8_MAX,  UINT32_MAX, UINT32_MAX);
+            LOAD_REG_INSTR ("BGEI",      BGEI,       10,      UINT8_MAX,  UINT32_MAX, UINT32_MAX);
+            // SEL only moves bits, so the float forms share the integer opcodes.
+            LOAD_REG_INSTR ("SEL",       SEL,        4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("SEL.64",    SEL_64,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("SEL.F",     SEL,        4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
+            LOAD_REG_INSTR ("SEL.F64",   SEL_64,     4,       UINT8_MAX,  UINT8_MAX,  UINT8_MAX );
         }
         else if (mode == VM_MODE_STACK)
         {
@@ -651,6 +969,88 @@ namespace Assembly
             LOAD_STACK_INSTR ("STRCPY",  STRCPY,     5,       UINT32_MAX);
             LOAD_STACK_INSTR ("STRCAT",  STRCAT,     5,       UINT32_MAX);
             LOAD_STACK_INSTR0("STRCMB",  STRCMB,     1                  );
+            // Calls
+            LOAD_STACK_INSTR ("TAILCALL",TAILCALL,   7,       UINT32_MAX, UINT8_MAX,  UINT8_MAX);
+            // Vectors
+            LOAD_STACK_INSTR0("VADD",    VADD,       1                  );
+            LOAD_STACK_INSTR0("VADD.64", VADD_64,    1                  );
+            LOAD_STACK_INSTR0("VADD.F",  VADD_F,     1                  );
+            LOAD_STACK_INSTR0("VADD.F64",VADD_F64,   1                  );
+            LOAD_STACK_INSTR0("VSUB",    VSUB,       1                  );
+            LOAD_STACK_INSTR0("VSUB.64", VSUB_64,    1                  );
+            LOAD_STACK_INSTR0("VSUB.F",  VSUB_F,     1                  );
+            LOAD_STACK_INSTR0("VSUB.F64",VSUB_F64,   1                  );
+            LOAD_STACK_INSTR0("VMUL",    VMUL,       1                  );
+            LOAD_STACK_INSTR0("VMUL.64", VMUL_64,    1                  );
+            LOAD_STACK_INSTR0("VMUL.F",  VMUL_F,     1                  );
+            LOAD_STACK_INSTR0("VMUL.F64",VMUL_F64,   1                  );
+            LOAD_STACK_INSTR0("VDIV",    VDIV,       1                  );
+            LOAD_STACK_INSTR0("VDIV.64", VDIV_64,    1                  );
+            LOAD_STACK_INSTR0("VDIV.F",  VDIV_F,     1                  );
+            LOAD_STACK_INSTR0("VDIV.F64",VDIV_F64,   1                  );
+            LOAD_STACK_INSTR0("VFMA",    VFMA,       1                  );
+            LOAD_STACK_INSTR0("VFMA.64", VFMA_64,    1                  );
+            LOAD_STACK_INSTR0("VFMA.F",  VFMA_F,     1                  );
+            LOAD_STACK_INSTR0("VFMA.F64",VFMA_F64,   1                  );
+            LOAD_STACK_INSTR0("VMIN",    VMIN,       1                  );
+            LOAD_STACK_INSTR0("VMIN.64", VMIN_64,    1                  );
+            LOAD_STACK_INSTR0("VMIN.F",  VMIN_F,     1                  );
+            LOAD_STACK_INSTR0("VMIN.F64",VMIN_F64,   1                  );
+            LOAD_STACK_INSTR0("VMAX",    VMAX,       1                  );
+            LOAD_STACK_INSTR0("VMAX.64", VMAX_64,    1                  );
+            LOAD_STACK_INSTR0("VMAX.F",  VMAX_F,     1                  );
+            LOAD_STACK_INSTR0("VMAX.F64",VMAX_F64,   1                  );
+            LOAD_STACK_INSTR0("VCPEQ",   VCPEQ,      1                  );
+            LOAD_STACK_INSTR0("VCPEQ.64",VCPEQ_64,   1                  );
+            LOAD_STACK_INSTR0("VCPEQ.F", VCPEQ_F,    1                  );
+            LOAD_STACK_INSTR0("VCPEQ.F64",VCPEQ_F64,  1                  );
+            LOAD_STACK_INSTR0("VCPLT",   VCPLT,      1                  );
+            LOAD_STACK_INSTR0("VCPLT.64",VCPLT_64,   1                  );
+            LOAD_STACK_INSTR0("VCPLT.F", VCPLT_F,    1                  );
+            LOAD_STACK_INSTR0("VCPLT.F64",VCPLT_F64,  1                  );
+            // Bulk Memory
+            LOAD_STACK_INSTR0("MEMCPY",  MEMCPY,     1                  );
+            LOAD_STACK_INSTR0("MEMMOVE", MEMMOVE,    1                  );
+            LOAD_STACK_INSTR0("MEMSET",  MEMSET,     1                  );
+            LOAD_STACK_INSTR0("FILL",    FILL,       1                  );
+            LOAD_STACK_INSTR0("FILL.64", FILL_64,    1                  );
+            // Math
+            LOAD_STACK_INSTR0("SQRT.F",  SQRT_F,     1                  );
+            LOAD_STACK_INSTR0("SQRT.F64",SQRT_F64,   1                  );
+            LOAD_STACK_INSTR0("FMA.F",   FMA_F,      1                  );
+            LOAD_STACK_INSTR0("FMA.F64", FMA_F64,    1                  );
+            LOAD_STACK_INSTR0("ABS",     ABS,        1                  );
+            LOAD_STACK_INSTR0("ABS.64",  ABS_64,     1                  );
+            LOAD_STACK_INSTR0("ABS.F",   ABS_F,      1                  );
+            LOAD_STACK_INSTR0("ABS.F64", ABS_F64,    1                  );
+            LOAD_STACK_INSTR0("MIN",     MIN,        1                  );
+            LOAD_STACK_INSTR0("MIN.64",  MIN_64,     1                  );
+            LOAD_STACK_INSTR0("MIN.F",   MIN_F,      1                  );
+            LOAD_STACK_INSTR0("MIN.F64", MIN_F64,    1                  );
+            LOAD_STACK_INSTR0("MAX",     MAX,        1                  );
+            LOAD_STACK_INSTR0("MAX.64",  MAX_64,     1                  );
+            LOAD_STACK_INSTR0("MAX.F",   MAX_F,      1                  );
+            LOAD_STACK_INSTR0("MAX.F64", MAX_F64,    1                  );
+            LOAD_STACK_INSTR0("FLOOR.F", FLOOR_F,    1                  );
+            LOAD_STACK_INSTR0("FLOOR.F64",FLOOR_F64,  1                  );
+            LOAD_STACK_INSTR0("CEIL.F",  CEIL_F,     1                  );
+            LOAD_STACK_INSTR0("CEIL.F64",CEIL_F64,   1                  );
+            LOAD_STACK_INSTR0("ROUND.F", ROUND_F,    1                  );
+            LOAD_STACK_INSTR0("ROUND.F64",ROUND_F64,  1                  );
+            LOAD_STACK_INSTR0("SIN.F",   SIN_F,      1                  );
+            LOAD_STACK_INSTR0("SIN.F64", SIN_F64,    1                  );
+            LOAD_STACK_INSTR0("COS.F",   COS_F,      1                  );
+            LOAD_STACK_INSTR0("COS.F64", COS_F64,    1                  );
+            LOAD_STACK_INSTR0("EXP.F",   EXP_F,      1                  );
+            LOAD_STACK_INSTR0("EXP.F64", EXP_F64,    1                  );
+            LOAD_STACK_INSTR0("LOG.F",   LOG_F,      1                  );
+            LOAD_STACK_INSTR0("LOG.F64", LOG_F64,    1                  );
+            LOAD_STACK_INSTR0("POW.F",   POW_F,      1                  );
+            LOAD_STACK_INSTR0("POW.F64", POW_F64,    1                  );
+            LOAD_STACK_INSTR0("SEL",     SEL,        1                  );
+            LOAD_STACK_INSTR0("SEL.64",  SEL_64,     1                  );
+            LOAD_STACK_INSTR0("SEL.F",   SEL,        1                  );
+            LOAD_STACK_INSTR0("SEL.F64", SEL_64,     1                  );
         }
     }
 
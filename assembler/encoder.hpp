@@ -181,6 +181,19 @@ namespace Assembly
             instr[1] = (C >> 16) & 0x0000'FFFF;
         }
 
+        // For instructions with arguments: Ra, (int32_t) B, (uint32_t) C
+        // Final binary size: 10 bytes.
+        BinaryInstruction(uint8_t opcode, Register regA, int32_t B, uint32_t C)
+            : BinaryInstruction()
+        {
+            this->opcode = opcode;
+            instr[0] = regA;
+            instr[0] |= (B << 8) & 0xFFFF'FF00;            // Write 3/4 bytes of B.
+            instr[1] = ((uint32_t)B >> 24) & 0x0000'00FF;  // Write the remaining byte of B,
+            instr[1] |= (C << 8) & 0xFFFF'FF00;            // and 3/4 bytes of C.
+            instr[2] = (C >> 24) & 0x0000'00FF;            // Write the remaining byte of C.
+        }
+
         // For instructions with arguments: Ra, Rb, (uint64_t) C
         // Final binary size: 11 bytes.
         BinaryInstruction(uint8_t opcode, Register regA, Register regB, uint64_t C)
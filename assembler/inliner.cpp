@@ -0,0 +1,445 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "inliner.hpp"
+#include <cstdint>
+#include <unordered_set>
+
+namespace Assembly
+{
+    namespace
+    {
+        // Functions larger than this are not inlined, to limit the growth of code.
+        constexpr size_t MAX_INLINE_RECORDS = 24;
+
+        bool IsRet(const std::string& opcode)
+        {
+            return opcode == "RET" || opcode == "RET.32" || opcode == "RET.64";
+        }
+
+        // Instructions that use the stack or the frame of the function, or that may jump
+        // anywhere. Functions with these are not inlined. MOVS is only allowed right 
+        // before RET.32/RET.64, where it pushes the return value.
+        const std::unordered_set<std::string> g_notInlinable = {
+            "CALL", "TAILCALL", "SCALL", "SARG", "JMPI", "BRIZ", "BRINZ",
+            "LDL", "LDL.64", "STL", "STL.64", "STA", "STA.64",
+            "LDLX", "LDLX.64", "STLX", "STLX.64",
+            "PUSH", "PUSH.64", "POP", "POP.64", "MOVS", "MOVS.64", ".BYTE",
+        };
+
+        // Register instructions whose first argument is only read.
+        const std::unordered_set<std::string> g_readsFirstArg = {
+            "STM", "STMI", "STLX", "MOVS", "PUSH", "VLEN",
+            "VADD", "VSUB", "VMUL", "VDIV", "VFMA", "VMIN", "VMAX", "VCPEQ", "VCPLT",
+            "MEMCPY", "MEMMOVE", "MEMSET", "FILL",
+            "BEQ", "BNE", "BLT", "BGE", "BGT", "BLE", "BEQI", "BNEI", "BLTI", "BGEI",
+        };
+
+        // Whether the record may write any of the registers [reg, reg + count).
+        // 64-bit writes are assumed for all instructions, to be on the safe side.
+        // Those only write a single register in wide mode.
+        bool MayWriteRegisters(const AsmRecord& rec, int reg, int count, VMMode mode)
+        {
+            std::string base = BaseOf(rec.opcode);
+            int dst = RegisterIndex(rec.args[0]);
+
+            if (base.compare(0, 2, "CP") == 0) // Comparisons write CPR.
+                dst = 31;
+            else if (dst < 0 || g_readsFirstArg.count(base) > 0)
+                return false;
+
+            int width = mode == VM_MODE_REGISTER_WIDE ? 1 : 2;
+            return dst < reg + count && dst + width > reg;
+        }
+    }
+
+    Inliner::Inliner(VMMode mode) :
+        m_mode(mode),
+        m_changes(0),
+        m_inlineCount(0)
+    {
+    }
+
+    const Inliner::Function& Inliner::AnalyzeFunction(const RecordList& records, size_t entry, size_t codeEnd)
+    {
+        auto cached = m_functions.find(entry);
+        if (cached != m_functions.end())
+            return cached->second;
+
+        Function& function = m_functions[entry];
+        function.isInlinable = false;
+        function.argBytes = SIZE_MAX;
+
+        // Find the records reachable from the entry.
+        std::vector<bool> isReachable(codeEnd, false);
+        std::vector<size_t> work = { entry };
+        size_t count = 0;
+
+        while (!work.empty())
+        {
+            size_t idx = work.back();
+            work.pop_back();
+
+            if (idx >= codeEnd || ++count > MAX_INLINE_RECORDS)
+                return function;
+
+            if (isReachable[idx])
+            {
+                --count;
+                continue;
+            }
+
+            isReachable[idx] = true;
+            const AsmRecord& rec = records[idx];
+            bool isReturnValue = rec.opcode.compare(0, 4, "MOVS") == 0 && idx + 1 < codeEnd && 
+                (records[idx + 1].opcode == "RET.32" || records[idx + 1].opcode == "RET.64");
+
+            if (g_notInlinable.count(rec.opcode) > 0 && !isReturnValue)
+                return function;
+
+            // Only the entry may be jumped to from outside, which is checked by the caller.
+            for (int i = 0; i < 3 && !rec.args[i].empty(); i++)
+            {
+                if (!IsPlainLabel(rec.args[i]) && RegisterIndex(rec.args[i]) < 0 && 
+                    !IsNumber(rec.args[i]) && !IsFloat(rec.args[i]))
+                    return function;
+            }
+
+            if (IsRet(rec.opcode))
+            {
+                size_t argBytes = std::stoul(rec.args[0]);
+                if (function.argBytes != SIZE_MAX && function.argBytes != argBytes)
+                    return function;
+
+                function.argBytes = argBytes;
+                continue;
+            }
+
+            if (rec.opcode == "JMP" || IsConditionalBranch(rec.opcode))
+            {
+                auto it = m_labelIndex.find(rec.args[BranchTargetArg(rec.opcode)]);
+                if (it == m_labelIndex.end())
+                    return function;
+
+                work.push_back(it->second);
+            }
+
+            if (!EndsFlow(rec.opcode))
+                work.push_back(idx + 1);
+        }
+
+        // A function that never returns is not worth the trouble.
+        if (function.argBytes == SIZE_MAX)
+            return function;
+
+        for (size_t i = entry; i < codeEnd; i++)
+        {
+            if (isReachable[i])
+                function.body.push_back(i);
+        }
+
+        function.isInlinable = true;
+        return function;
+    }
+
+    bool Inliner::MatchCallSite(const RecordList& records, size_t call, const Function& function, 
+        CallSite& site) const
+    {
+        // Collect the pushes of the arguments, from the last one.
+        size_t offset = 0;
+        size_t idx = call;
+        while (offset < function.argBytes)
+        {
+            if (idx == 0)
+                return false;
+
+            const AsmRecord& rec = records[--idx];
+            if (rec.isDataStart || (rec.IsLabeled() && offset + 8 < function.argBytes))
+                return false;
+
+            size_t byteSize;
+            if (rec.opcode == "MOVS" || rec.opcode == "PUSH")
+                byteSize = 4;
+            else if (rec.opcode == "MOVS.64" || rec.opcode == "PUSH.64")
+                byteSize = 8;
+            else
+                return false;
+
+            // A label on a push, other than the first one, would skip the others.
+            offset += byteSize;
+            if (rec.IsLabeled() && offset != function.argBytes)
+                return false;
+
+            site.args[offset] = { idx, byteSize };
+        }
+
+        if (offset != function.argBytes)
+            return false;
+
+        // Each LDA must read exactly one argument.
+        for (size_t i : function.body)
+        {
+            const AsmRecord& rec = records[i];
+            if (rec.opcode != "LDA" && rec.opcode != "LDA.64")
+                continue;
+
+            auto it = site.args.find(std::stoul(rec.args[1]));
+            if (it == site.args.end() || it->second.byteSize != (rec.opcode == "LDA" ? 4 : 8))
+                return false;
+        }
+
+        // Registers that are pushed are read in place of the argument, so the 
+        // function must not write to them.
+        for (const auto& arg : site.args)
+        {
+            const AsmRecord& push = records[arg.second.record];
+            if (push.opcode.compare(0, 4, "MOVS") != 0)
+                continue;
+
+            int reg = RegisterIndex(push.args[0]);
+            int count = arg.second.byteSize == 8 && m_mode != VM_MODE_REGISTER_WIDE ? 2 : 1;
+            for (size_t i : function.body)
+            {
+                if (MayWriteRegisters(records[i], reg, count, m_mode))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    void Inliner::EmitBody(const RecordList& records, const Function& function, const CallSite& site,
+        RecordList& output, std::vector<std::string>& pendingLabels)
+    {
+        std::string suffix = "__inl" + std::to_string(m_inlineCount++);
+        std::string endLabel = "__inl_end" + std::to_string(m_inlineCount - 1);
+        bool isEndUsed = false;
+
+        std::unordered_set<std::string> localLabels;
+        for (size_t i : function.body)
+        {
+            for (const std::string& label : records[i].labels)
+                localLabels.insert(label);
+        }
+
+        // Only the labels that the body branches to are copied, e.g. not the entry 
+        // label, which would otherwise be left unused by every inlined call.
+        std::unordered_set<std::string> branchTargets;
+        for (size_t i : function.body)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                if (localLabels.count(records[i].args[j]) > 0)
+                    branchTargets.insert(records[i].args[j]);
+            }
+        }
+
+        for (size_t k = 0; k < function.body.size(); k++)
+        {
+            const AsmRecord& rec = records[function.body[k]];
+            AsmRecord copy;
+            copy.opcode = rec.opcode;
+            copy.lineNbr = rec.lineNbr;
+            copy.labels = std::move(pendingLabels);
+            pendingLabels.clear();
+
+            for (const std::string& label : rec.labels)
+            {
+                if (branchTargets.count(label) > 0)
+                    copy.labels.push_back(label + suffix);
+            }
+
+            for (int i = 0; i < 3; i++)
+            {
+                copy.args[i] = rec.args[i];
+                if (localLabels.count(rec.args[i]) > 0)
+                    copy.args[i] += suffix;
+            }
+
+            if (rec.opcode == "LDA" || rec.opcode == "LDA.64")
+            {
+                const AsmRecord& push = records[site.args.at(std::stoul(rec.args[1])).record];
+                bool isRegister = push.opcode.compare(0, 4, "MOVS") == 0;
+                bool isWide = rec.opcode == "LDA.64";
+
+                copy.opcode = isRegister ? (isWide ? "MOV.64" : "MOV") : (isWide ? "LDI.64" : "LDI");
+                copy.args[1] = push.args[0];
+            }
+            else if (IsRet(rec.opcode))
+            {
+                // The last return falls through to the code after the call.
+                if (k + 1 == function.body.size())
+                {
+                    pendingLabels = std::move(copy.labels);
+                    break;
+                }
+
+                copy.opcode = "JMP";
+                copy.args[0] = endLabel;
+                isEndUsed = true;
+            }
+
+            output.push_back(std::move(copy));
+        }
+
+        if (isEndUsed)
+            pendingLabels.push_back(endLabel);
+    }
+
+    size_t Inliner::Inline(RecordList& records)
+    {
+        m_changes = 0;
+        if (!IsRegisterMode(m_mode))
+            return 0;
+
+        m_labelIndex.clear();
+        m_functions.clear();
+
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            for (const std::string& label : records[i].labels)
+                m_labelIndex[label] = i;
+        }
+
+        // Only instructions are inlined, data stays where it is.
+        size_t codeEnd = 0;
+        while (codeEnd < records.size() && !records[codeEnd].opcode.empty() &&
+            records[codeEnd].opcode != ".BYTE" && !records[codeEnd].isDataStart)
+        {
+            ++codeEnd;
+        }
+
+        std::unordered_map<std::string, size_t> refCount;
+        for (const AsmRecord& rec : records)
+        {
+            for (int i = 0; i < 3 && rec.opcode != ".BYTE"; i++)
+            {
+                if (IsPlainLabel(rec.args[i]))
+                    ++refCount[rec.args[i]];
+            }
+        }
+
+        // Decide on the call sites first, since the pushes before them are removed.
+        std::unordered_map<size_t, CallSite> sites;
+        std::vector<bool> isPush(records.size(), false);
+        std::unordered_map<size_t, size_t> inlinedCalls;
+
+        for (size_t i = 0; i < codeEnd; i++)
+        {
+            if (records[i].opcode != "CALL")
+                continue;
+
+            auto it = m_labelIndex.find(records[i].args[0]);
+            if (it == m_labelIndex.end() || it->second >= codeEnd)
+                continue;
+
+            const Function& function = AnalyzeFunction(records, it->second, codeEnd);
+            CallSite site;
+            site.function = it->second;
+            if (!function.isInlinable || !MatchCallSite(records, i, function, site))
+                continue;
+
+            for (const auto& arg : site.args)
+                isPush[arg.second.record] = true;
+
+            ++inlinedCalls[site.function];
+            sites[i] = std::move(site);
+        }
+
+        // Remove functions that nothing refers to anymore. Any labels within them
+        // must only be used by the function itself.
+        std::vector<bool> isRemoved(records.size(), false);
+        for (const auto& inlined : inlinedCalls)
+        {
+            const Function& function = m_functions[inlined.first];
+            size_t entry = inlined.first;
+            if (entry > 0 && !EndsFlow(records[entry - 1].opcode))
+                continue;
+
+            std::unordered_map<std::string, size_t> localRefs;
+            for (size_t i : function.body)
+            {
+                for (int j = 0; j < 3; j++)
+                {
+                    if (IsPlainLabel(records[i].args[j]))
+                        ++localRefs[records[i].args[j]];
+                }
+            }
+
+            bool isReferenced = false;
+            for (size_t i : function.body)
+            {
+                for (const std::string& label : records[i].labels)
+                {
+                    size_t calls = i == entry ? inlined.second : 0;
+                    isReferenced |= refCount[label] != localRefs[label] + calls;
+                }
+            }
+
+            if (isReferenced)
+                continue;
+
+            for (size_t i : function.body)
+                isRemoved[i] = true;
+        }
+
+        RecordList output;
+        output.reserve(records.size() * 2);
+
+        std::vector<std::string> pendingLabels;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            if (isRemoved[i])
+                continue;
+
+            AsmRecord& rec = records[i];
+            auto site = sites.find(i);
+            if (isPush[i] || site != sites.end())
+            {
+                pendingLabels.insert(pendingLabels.end(), rec.labels.begin(), rec.labels.end());
+                if (site != sites.end())
+                {
+                    EmitBody(records, m_functions[site->second.function], site->second, output, pendingLabels);
+                    ++m_changes;
+                }
+
+                continue;
+            }
+
+            if (!pendingLabels.empty())
+            {
+                rec.labels.insert(rec.labels.begin(), pendingLabels.begin(), pendingLabels.end());
+                pendingLabels.clear();
+            }
+
+            output.push_back(std::move(rec));
+        }
+
+        records.swap(output);
+        return m_changes;
+    }
+}
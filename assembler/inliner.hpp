@@ -0,0 +1,94 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_INLINER_HPP
+#define INC_INLINER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "common.hpp"
+#include "record.hpp"
+
+namespace Assembly
+{
+    // Copies the bodies of small leaf functions into their call sites, so that 
+    // CALL and RET, and the pushing of arguments, are saved. Only the register
+    // instruction set is supported, since arguments are replaced by registers.
+    //
+    // A function is inlined if it is reachable only from its own label, calls nothing,
+    // doesn't use its frame other than reading its arguments with LDA, and leaves the 
+    // stack as is, save for the value returned with RET.32/RET.64. At each call site, 
+    // the arguments must be pushed right before the CALL, with MOVS of registers the 
+    // function doesn't write to, or PUSH of constants. The original function is removed
+    // if nothing else refers to it.
+    class Inliner
+    {
+    private:
+        struct Function
+        {
+            bool isInlinable;
+            std::vector<size_t> body;   // Reachable records in their original order.
+            size_t argBytes;            // Bytes of arguments popped by RET.
+        };
+
+        // An argument pushed before a call.
+        struct Argument
+        {
+            size_t record;
+            size_t byteSize;
+        };
+
+        struct CallSite
+        {
+            size_t function;            // Index of the function's first record.
+            std::unordered_map<size_t, Argument> args;  // By LDA offset.
+        };
+
+        VMMode m_mode;
+        size_t m_changes;
+        size_t m_inlineCount;
+        std::unordered_map<std::string, size_t> m_labelIndex;
+        std::unordered_map<size_t, Function> m_functions;
+
+    public:
+        Inliner(VMMode mode);
+
+        // Inlines the calls in place. The list must end with an end record.
+        // Returns the number of calls inlined.
+        size_t Inline(RecordList& records);
+
+    private:
+        const Function& AnalyzeFunction(const RecordList& records, size_t entry, size_t codeEnd);
+        bool MatchCallSite(const RecordList& records, size_t call, const Function& function, 
+            CallSite& site) const;
+        void EmitBody(const RecordList& records, const Function& function, const CallSite& site,
+            RecordList& output, std::vector<std::string>& pendingLabels);
+    };
+}
+
+#endif // INC_INLINER_HPP
@@ -45,9 +45,23 @@ namespace Assembly
 			{"__open",  Label(4)},
 			{"__close", Label(5)},
 			{"__str",   Label(6)},
+			{"__readall", Label(7)},
+			{"__aread",   Label(8)},
+			{"__awrite",  Label(9)},
+			{"__await",   Label(10)},
+			{"__apoll",   Label(11)},
+			{"__mmap",    Label(12)},
+			{"__munmap",  Label(13)},
+			{"__snapshot", Label(14)},
 		});
 	}
 
+	void LabelDictionary::UseWideRegisters()
+	{
+		for (int i = 0; i < 32; i++)
+			m_labels["R"+std::to_string(i)].address = i * 2;
+	}
+
 	bool LabelDictionary::RegisterLabel(const std::string& label, Address value)
 	{
 		Label lbl;
@@ -63,10 +77,11 @@ namespace Assembly
 	}
 	bool LabelDictionary::ResolveLabel(const std::string& label, Address& addressOut)
 	{
-		if (m_labels.count(label) < 1) // If label isn't defined.
+		auto it = m_labels.find(label);
+		if (it == m_labels.end()) // If label isn't defined.
 			return false;
 
-		Label& lbl = m_labels[label];
+		Label& lbl = it->second;
 		lbl.refCount++;
 
 		addressOut = lbl.address;
@@ -57,6 +57,10 @@ namespace Assembly
     public:
         LabelDictionary();
 
+        // Maps each register onto its slot in the wide register file, where every 
+        // register takes two 32-bit slots, so that R1 is encoded as 2 and so on.
+        void UseWideRegisters();
+
         bool RegisterLabel(const std::string& label, Address value);
         bool ResolveLabel(const std::string& label, Address& addressOut);
         void WarnAboutUnusedLabels() const;
@@ -0,0 +1,516 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "layout.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace Assembly
+{
+    namespace
+    {
+        constexpr size_t NO_RECORD = SIZE_MAX;
+
+        bool IsBranch(const std::string& opcode)
+        {
+            return opcode == "JMP" || IsConditionalBranch(opcode);
+        }
+
+        // Branches to computed addresses, which may target any label.
+        bool IsIndirectBranch(const std::string& opcode)
+        {
+            return opcode == "JMPI" || opcode == "BRIZ" || opcode == "BRINZ";
+        }
+    }
+
+    bool LoadBranchProfile(const std::string& path, BranchProfile& profile)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            Address address;
+            BranchCount count;
+            if (!(fields >> std::hex >> address >> std::dec >> count.taken >> count.notTaken))
+                return false;
+
+            profile[address] = count;
+        }
+
+        return true;
+    }
+
+    BlockLayout::BlockLayout(const BranchProfile& profile, RecordSizeFunc sizeOf) :
+        m_profile(profile),
+        m_sizeOf(sizeOf),
+        m_loopAlignment(0),
+        m_changes(0),
+        m_mismatches(0),
+        m_labelCount(0)
+    {
+    }
+
+    void BlockLayout::IndexRecords(const RecordList& records)
+    {
+        m_addresses.clear();
+        m_labelIndex.clear();
+
+        Address addr = 0;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            m_addresses.push_back(addr);
+            addr += m_sizeOf(records[i]);
+
+            for (const std::string& label : records[i].labels)
+                m_labelIndex[label] = i;
+        }
+    }
+
+    size_t BlockLayout::CountMismatches(const RecordList& records) const
+    {
+        std::unordered_map<Address, size_t> recordAt;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            if (!records[i].opcode.empty() && records[i].opcode != ".BYTE")
+                recordAt[m_addresses[i]] = i;
+        }
+
+        size_t mismatches = 0;
+        for (const auto& entry : m_profile)
+        {
+            auto it = recordAt.find(entry.first);
+            if (it == recordAt.end() || !IsBranch(records[it->second].opcode))
+                ++mismatches;
+        }
+
+        return mismatches;
+    }
+
+    size_t BlockLayout::FindTarget(const AsmRecord& rec) const
+    {
+        auto it = m_labelIndex.find(rec.args[BranchTargetArg(rec.opcode)]);
+        return it != m_labelIndex.end() ? it->second : NO_RECORD;
+    }
+
+    const std::string& BlockLayout::EnsureLabel(RecordList& records, size_t idx)
+    {
+        AsmRecord& rec = records[idx];
+        if (rec.labels.empty())
+            rec.labels.push_back("__block_" + std::to_string(m_labelCount++));
+
+        return rec.labels.front();
+    }
+
+    std::vector<BlockLayout::Block> BlockLayout::BuildBlocks(const RecordList& records, 
+        size_t begin, size_t end) const
+    {
+        std::vector<Block> blocks;
+
+        size_t first = begin;
+        while (first < end)
+        {
+            // A block ends at a branch, or before the next label.
+            size_t last = first;
+            while (!IsBranch(records[last].opcode) && !EndsFlow(records[last].opcode) &&
+                last + 1 < end && !records[last + 1].IsLabeled())
+            {
+                ++last;
+            }
+
+            const AsmRecord& rec = records[last];
+
+            Block block;
+            block.first = first;
+            block.last = last;
+            block.target = IsBranch(rec.opcode) ? FindTarget(rec) : NO_RECORD;
+            block.next = EndsFlow(rec.opcode) ? NO_RECORD : last + 1;
+            block.takenCount = 0;
+            block.notTakenCount = 0;
+            block.weight = 0;
+
+            auto it = m_profile.find(m_addresses[last]);
+            if (it != m_profile.end() && IsBranch(rec.opcode))
+            {
+                block.takenCount = it->second.taken;
+                block.notTakenCount = it->second.notTaken;
+            }
+
+            blocks.push_back(block);
+            first = last + 1;
+        }
+
+        return blocks;
+    }
+
+    // Chains blocks together along the heaviest edges first, in the manner of 
+    // Pettis and Hansen, and returns the new order of the blocks. The entry block
+    // always comes first, and chains that never executed come last.
+    std::vector<size_t> BlockLayout::OrderBlocks(std::vector<Block>& blocks) const
+    {
+        size_t count = blocks.size();
+
+        std::unordered_map<size_t, size_t> blockAt;
+        for (size_t i = 0; i < count; i++)
+            blockAt[blocks[i].first] = i;
+
+        auto findBlock = [&](size_t record) -> size_t
+        {
+            auto it = blockAt.find(record);
+            return it != blockAt.end() ? it->second : NO_RECORD;
+        };
+
+        // Estimate how many times each block executed. Only branches are counted, 
+        // so blocks that end without one get the count of what flows into them.
+        std::vector<uint64_t> inflow(count, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            const Block& block = blocks[i];
+            size_t target = findBlock(block.target);
+            size_t next = findBlock(block.next);
+
+            if (target != NO_RECORD)
+                inflow[target] += block.takenCount;
+            if (next != NO_RECORD)
+                inflow[next] += block.notTakenCount;
+        }
+
+        std::vector<Edge> edges;
+        for (size_t i = 0; i < count; i++)
+        {
+            Block& block = blocks[i];
+            block.weight = std::max(inflow[i], block.takenCount + block.notTakenCount);
+
+            size_t target = findBlock(block.target);
+            size_t next = findBlock(block.next);
+            bool hasBranch = block.target != NO_RECORD;
+
+            if (target != NO_RECORD)
+                edges.push_back({ i, target, block.takenCount, false });
+
+            if (next != NO_RECORD && hasBranch)
+            {
+                edges.push_back({ i, next, block.notTakenCount, false });
+            }
+            else if (next != NO_RECORD)
+            {
+                edges.push_back({ i, next, block.weight, true });
+                inflow[next] = std::max(inflow[next], block.weight);
+            }
+        }
+
+        std::stable_sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b)
+        {
+            if (a.isFallthrough != b.isFallthrough)
+                return a.isFallthrough;
+
+            return a.weight > b.weight;
+        });
+
+        // Each chain is identified by the index of its first block.
+        std::vector<std::vector<size_t>> chains(count);
+        std::vector<size_t> chainOf(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            chains[i].push_back(i);
+            chainOf[i] = i;
+        }
+
+        for (const Edge& edge : edges)
+        {
+            if ((!edge.isFallthrough && edge.weight == 0) || edge.to == 0)
+                continue;
+
+            size_t from = chainOf[edge.from];
+            size_t to = chainOf[edge.to];
+            if (from == to || chains[from].back() != edge.from || chains[to].front() != edge.to)
+                continue;
+
+            for (size_t block : chains[to])
+            {
+                chains[from].push_back(block);
+                chainOf[block] = from;
+            }
+
+            chains[to].clear();
+        }
+
+        auto chainWeight = [&](size_t chain) -> uint64_t
+        {
+            uint64_t weight = 0;
+            for (size_t block : chains[chain])
+                weight = std::max(weight, blocks[block].weight);
+
+            return weight;
+        };
+
+        std::vector<size_t> order = chains[chainOf[0]];
+        for (int cold = 0; cold < 2; cold++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                if (i == chainOf[0] || chains[i].empty() || (chainWeight(i) == 0) != (cold == 1))
+                    continue;
+
+                order.insert(order.end(), chains[i].begin(), chains[i].end());
+            }
+        }
+
+        return order;
+    }
+
+    void BlockLayout::LayoutFunction(RecordList& records, size_t begin, size_t end, RecordList& output)
+    {
+        auto keepAsIs = [&]()
+        {
+            for (size_t i = begin; i < end; i++)
+                output.push_back(std::move(records[i]));
+        };
+
+        std::vector<Block> blocks = BuildBlocks(records, begin, end);
+
+        bool isProfiled = false;
+        for (const Block& block : blocks)
+        {
+            const std::string& opcode = records[block.last].opcode;
+
+            // Computed branches may target any label, and branches with expressions
+            // can't be followed, so leave these functions alone.
+            if (IsIndirectBranch(opcode) || (IsBranch(opcode) && block.target == NO_RECORD))
+            {
+                keepAsIs();
+                return;
+            }
+
+            isProfiled |= block.takenCount + block.notTakenCount > 0;
+        }
+
+        if (!isProfiled || blocks.size() < 2)
+        {
+            keepAsIs();
+            return;
+        }
+
+        std::vector<size_t> order = OrderBlocks(blocks);
+
+        // Fix the end of each block to the new order, so that control flow is kept.
+        struct Terminator
+        {
+            std::string opcode;     // Replaces the branch, if set.
+            std::string branchTo;   // New branch target.
+            std::string jumpTo;     // Appended JMP, if set.
+            size_t branchRecord = NO_RECORD;
+            size_t jumpRecord = NO_RECORD;
+            bool isRemoved = false;
+        };
+
+        std::vector<Terminator> terminators(order.size());
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            const Block& block = blocks[order[k]];
+            const std::string& opcode = records[block.last].opcode;
+            size_t nextRecord = k + 1 < order.size() ? blocks[order[k + 1]].first : end;
+            Terminator& term = terminators[k];
+
+            if (order[k] != k)
+                ++m_changes;
+
+            if (IsConditionalBranch(opcode))
+            {
+                if (block.next == nextRecord)
+                    continue;
+
+                std::string inverse = InvertBranch(opcode);
+                if (block.target == nextRecord && !inverse.empty()) // Invert the branch to fall through.
+                {
+                    term.opcode = inverse;
+                    term.branchRecord = block.next;
+                }
+                else
+                {
+                    term.jumpRecord = block.next;
+                }
+
+                ++m_changes;
+            }
+            else if (opcode == "JMP")
+            {
+                // Only the first record of a block may be labeled.
+                if (block.target == nextRecord && block.first != block.last)
+                {
+                    term.isRemoved = true;
+                    ++m_changes;
+                }
+            }
+            else if (block.next != NO_RECORD && block.next != nextRecord)
+            {
+                term.jumpRecord = block.next;
+                ++m_changes;
+            }
+        }
+
+        // Labels must be added before any records are moved.
+        for (Terminator& term : terminators)
+        {
+            if (term.branchRecord != NO_RECORD)
+                term.branchTo = EnsureLabel(records, term.branchRecord);
+            if (term.jumpRecord != NO_RECORD)
+                term.jumpTo = EnsureLabel(records, term.jumpRecord);
+        }
+
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            const Block& block = blocks[order[k]];
+            const Terminator& term = terminators[k];
+            size_t lineNbr = records[block.last].lineNbr;
+
+            for (size_t i = block.first; i <= block.last; i++)
+            {
+                if (i == block.last && term.isRemoved)
+                    break;
+
+                output.push_back(std::move(records[i]));
+            }
+
+            if (!term.opcode.empty())
+            {
+                output.back().opcode = term.opcode;
+                output.back().args[BranchTargetArg(term.opcode)] = term.branchTo;
+            }
+
+            if (!term.jumpTo.empty())
+            {
+                AsmRecord jump;
+                jump.opcode = "JMP";
+                jump.args[0] = term.jumpTo;
+                jump.lineNbr = lineNbr;
+                output.push_back(std::move(jump));
+            }
+        }
+    }
+
+    void BlockLayout::AlignLoops(RecordList& records)
+    {
+        IndexRecords(records);
+
+        // A loop head is the target of a branch at or after it.
+        std::vector<bool> isLoopHead(records.size(), false);
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            if (!IsBranch(records[i].opcode))
+                continue;
+
+            size_t target = FindTarget(records[i]);
+            if (target != NO_RECORD && target <= i)
+                isLoopHead[target] = true;
+        }
+
+        RecordList output;
+        output.reserve(records.size());
+
+        Address addr = 0;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            // Only pad where the padding is never executed.
+            bool isPadded = isLoopHead[i] && !output.empty() && EndsFlow(output.back().opcode);
+            m_changes += isPadded && addr % m_loopAlignment != 0;
+            while (isPadded && addr % m_loopAlignment != 0)
+            {
+                AsmRecord nop;
+                nop.opcode = "NOP";
+                nop.lineNbr = records[i].lineNbr;
+                output.push_back(std::move(nop));
+                addr += m_sizeOf(output.back());
+            }
+
+            addr += m_sizeOf(records[i]);
+            output.push_back(std::move(records[i]));
+        }
+
+        records.swap(output);
+    }
+
+    size_t BlockLayout::Layout(RecordList& records)
+    {
+        m_changes = 0;
+
+        IndexRecords(records);
+        m_mismatches = CountMismatches(records);
+        if (m_mismatches > 0)
+            return 0;
+
+        // Only instructions are laid out, data stays where it is.
+        size_t codeEnd = 0;
+        while (codeEnd < records.size() && !records[codeEnd].opcode.empty() &&
+            records[codeEnd].opcode != ".BYTE" && !records[codeEnd].isDataStart)
+        {
+            ++codeEnd;
+        }
+
+        // Blocks are never moved between functions, i.e. the targets of CALL and TAILCALL.
+        std::vector<bool> isEntry(codeEnd + 1, false);
+        isEntry[0] = true;
+        isEntry[codeEnd] = true;
+        for (size_t i = 0; i < codeEnd; i++)
+        {
+            bool isCall = records[i].opcode == "CALL" || records[i].opcode == "TAILCALL";
+            size_t target = isCall ? FindTarget(records[i]) : NO_RECORD;
+            if (target < codeEnd)
+                isEntry[target] = true;
+        }
+
+        RecordList output;
+        output.reserve(records.size() + records.size() / 8);
+
+        size_t begin = 0;
+        for (size_t i = 1; i <= codeEnd; i++)
+        {
+            if (!isEntry[i])
+                continue;
+
+            LayoutFunction(records, begin, i, output);
+            begin = i;
+        }
+
+        for (size_t i = codeEnd; i < records.size(); i++)
+            output.push_back(std::move(records[i]));
+
+        records.swap(output);
+
+        if (m_loopAlignment > 0)
+            AlignLoops(records);
+
+        return m_changes;
+    }
+}
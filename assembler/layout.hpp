@@ -0,0 +1,117 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_LAYOUT_HPP
+#define INC_LAYOUT_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "common.hpp"
+#include "record.hpp"
+
+namespace Assembly
+{
+    struct BranchCount
+    {
+        uint64_t taken;
+        uint64_t notTaken;
+    };
+
+    // Branch counts by the address of the branch instruction, as written by a VM built 
+    // with PROFILE. The addresses refer to the program the profile was recorded with.
+    using BranchProfile = std::unordered_map<Address, BranchCount>;
+
+    // Reads a branch profile. Returns false if the file could not be read.
+    bool LoadBranchProfile(const std::string& path, BranchProfile& profile);
+
+    using RecordSizeFunc = std::function<size_t(const AsmRecord&)>;
+
+    // Profile-guided basic block layout, run on the records after the optimizer.
+    // Blocks are reordered within each function so that the most taken edges fall 
+    // through, and blocks that never executed are moved to the end of the function. 
+    // Branches are inverted, or followed by a JMP, to keep the control flow intact.
+    class BlockLayout
+    {
+    private:
+        struct Block
+        {
+            size_t first, last;     // Range of records, inclusive.
+            size_t target;          // Block branched or jumped to, if any.
+            size_t next;            // Block executed if the last record doesn't branch, if any.
+            uint64_t takenCount;
+            uint64_t notTakenCount;
+            uint64_t weight;        // Estimated number of executions.
+        };
+
+        struct Edge
+        {
+            size_t from, to;
+            uint64_t weight;
+            bool isFallthrough;     // The block has no branch, so prefer to never break this edge.
+        };
+
+        const BranchProfile& m_profile;
+        RecordSizeFunc m_sizeOf;
+        Address m_loopAlignment;
+        size_t m_changes;
+        size_t m_mismatches;
+        size_t m_labelCount;
+        std::vector<Address> m_addresses;
+        std::unordered_map<std::string, size_t> m_labelIndex;
+
+    public:
+        BlockLayout(const BranchProfile& profile, RecordSizeFunc sizeOf);
+
+        // Pads loop heads that are only reached by branches with NOPs, so that they
+        // start at a multiple of the given number of bytes. 0 disables alignment.
+        inline void SetLoopAlignment(Address bytes) { m_loopAlignment = bytes; }
+
+        // Reorders the records in place. The list must end with an end record, and be 
+        // laid out the same as the program the profile was recorded with.
+        // Returns the number of changes made.
+        size_t Layout(RecordList& records);
+
+        // The number of profiled addresses that are not a branch in the records, 
+        // e.g. if the program was changed after profiling. If any, nothing is changed.
+        inline size_t GetMismatchCount() const { return m_mismatches; }
+
+    private:
+        void IndexRecords(const RecordList& records);
+        size_t CountMismatches(const RecordList& records) const;
+        size_t FindTarget(const AsmRecord& rec) const;
+        const std::string& EnsureLabel(RecordList& records, size_t idx);
+
+        void LayoutFunction(RecordList& records, size_t begin, size_t end, RecordList& output);
+        std::vector<Block> BuildBlocks(const RecordList& records, size_t begin, size_t end) const;
+        std::vector<size_t> OrderBlocks(std::vector<Block>& blocks) const;
+        void AlignLoops(RecordList& records);
+    };
+}
+
+#endif // INC_LAYOUT_HPP
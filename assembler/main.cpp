@@ -0,0 +1,139 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "assembler.hpp"
+
+using namespace Assembly;
+
+void PrintHelp()
+{
+    std::cout << 
+        "====| rackasm - Assembler for RackVM |====" << std::endl <<
+        "By: Kasper Skott, 2022" << std::endl <<
+        "(Detecting " << (IsLittleEndian() ? "little endian" : "big endian") << ")" << std::endl <<
+        "    Usage: rackasm [flags]? FILE [flags]?" << std::endl <<
+        "    -v    Verbose, prints translation to stdout." << std::endl << 
+        "    -f    Prints each line as it is read to stdout." << std::endl <<
+        "    -l    Suppress unusused labels warning." << std::endl <<
+        "    -O    Optimize, runs a peephole optimizer before encoding." << std::endl <<
+        "    -i    Inlines calls to small leaf functions (register mode only)." << std::endl <<
+        "    -p    Lays out basic blocks by a branch profile from the VM, e.g. -p FILE.prof" << std::endl <<
+        "    -a    Aligns loop heads to " << LOOP_ALIGNMENT << " bytes, if used with -p." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        PrintHelp();
+        return 0;
+    }
+
+    Assembler assembler;
+
+    // Parse arguments.
+    std::string inputPath = "";
+    std::vector<std::string> args(argv, argv+argc);
+    for (auto argIt = ++args.begin(); argIt != args.end(); ++argIt)
+    {
+        if (argIt->at(0) != '-') // This is the input file.
+        {
+            if (inputPath == "")
+                inputPath = *argIt;
+            else
+                std::cerr << "File path argument has already been defined." << std::endl;
+
+            continue;
+        }
+
+        switch (argIt->at(1))
+        {
+            case 'v': assembler.AddFlags(FLAG_VERBOSE);
+                break;
+            case 'f': assembler.AddFlags(FLAG_SHOW_FIRST_PASS);
+                break;
+            case 'l': assembler.AddFlags(FLAG_SUPPRESS_UNUSED_LABELS);
+                break;
+            case 'O': assembler.AddFlags(FLAG_OPTIMIZE);
+                break;
+            case 'a': assembler.AddFlags(FLAG_ALIGN_LOOPS);
+                break;
+            case 'i': assembler.AddFlags(FLAG_INLINE);
+                break;
+            case 'p': 
+                if (argIt + 1 == args.end())
+                {
+                    std::cerr << "Missing profile path after -p." << std::endl;
+                    return 0;
+                }
+
+                assembler.SetProfile(*++argIt);
+                break;
+            case 'h': PrintHelp();
+                return 0;
+        }
+    }
+
+    std::ifstream inputFile(inputPath);
+    if (!inputFile.is_open())
+    {
+        std::cerr << "Could not open \"" << inputPath << "\"." << std::endl;
+        return 0;
+    }
+
+    size_t pathLastDot = inputPath.rfind('.');
+    if (pathLastDot == inputPath.npos)
+        pathLastDot = inputPath.length();
+
+    std::string outputPath = inputPath.substr(0, pathLastDot) + ".bin";
+    std::fstream outFile(outputPath, std::ios::binary | std::ios::out);
+
+    if (!outFile.is_open())
+    {
+        std::cerr << "Could not create \"" << outputPath << "\"." << std::endl;
+        return 0;
+    }
+
+    size_t binarySize = 0;
+    try
+    {
+        // Assemble the inputFile stream of assembly text into the binary output file.
+        // The byte cound does not account for the header.
+        binarySize = assembler.Assemble(inputFile, outFile);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+    }   
+
+    if (binarySize > 0)
+        std::cout << "Assembly successful! Wrote " << binarySize << " bytes." << std::endl;
+    else
+        std::cout << "Assembly failed!" << std::endl;
+
+    return 0;
+}
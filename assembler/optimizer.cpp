@@ -0,0 +1,679 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "optimizer.hpp"
+#include <unordered_set>
+#include <algorithm>
+#include <map>
+
+namespace Assembly
+{
+    namespace
+    {
+        // Optimizations can enable each other, e.g. removing unreachable code
+        // can make a jump target the next instruction. Stop after this many passes.
+        constexpr int MAX_PASSES = 8;
+
+        // Upper limit of jumps to follow when threading, in case of cycles.
+        constexpr int MAX_JUMP_HOPS = 16;
+
+        // Register instructions that only write their first argument, and only
+        // read the rest. Used to determine when the value of a register is dead.
+        const std::unordered_set<std::string> g_writesFirstArg = {
+            "MOV", "LDI", "LDM", "LDMI", "LDL", "LDLX", "LDA", "POP",
+            "ADD", "ADDI", "SUB", "SUBI", "MUL", "MULI", "DIV", "DIVI",
+            "BOR", "BORI", "BXOR", "BXORI", "BAND", "BANDI",
+            "ITOL", "ITOF", "ITOD", "ITOS", "LTOI", "LTOF", "LTOD", "LTOS",
+            "FTOI", "FTOL", "FTOD", "FTOS", "DTOI", "DTOL", "DTOF", "DTOS",
+            "NEW", "NEWI", "SIZE", "STR", "STRCPY", "STRCAT", "STRCMB",
+            "SQRT", "ABS", "MIN", "MAX", "FLOOR", "CEIL", "ROUND", "SIN", "COS", "EXP", "LOG", "POW",
+            "SEL",
+        };
+
+        // Comparisons write their result to R31, also known as CPR.
+        constexpr int CPR_INDEX = 31;
+
+        // Register instructions that write CPR, and only read their arguments.
+        const std::unordered_set<std::string> g_writesCpr = {
+            "CPZ", "CPI", "CPEQ", "CPNQ", "CPGT", "CPLT", "CPGQ", "CPLQ", "CPSTR", "CPCHR",
+            "OR", "ORI", "AND", "ANDI",
+        };
+
+        // The compare-and-branch instruction taken when each comparison is true.
+        const std::unordered_map<std::string, std::string> g_compareBranches = {
+            {"CPEQ", "BEQ"}, {"CPNQ", "BNE"}, {"CPLT", "BLT"}, 
+            {"CPGQ", "BGE"}, {"CPGT", "BGT"}, {"CPLQ", "BLE"},
+        };
+
+        inline bool ReadsCpr(const std::string& opcode)
+        {
+            return opcode == "BRZ" || opcode == "BRNZ" || opcode == "BRIZ" || opcode == "BRINZ" ||
+                   BaseOf(opcode) == "SEL";
+        }
+
+        // Splits the string data of a .BYTE record into its characters, as they are
+        // written in the source, e.g. "a\\n" -> {"a", "\\n"}. Returns false if the
+        // record isn't a null-terminated string.
+        bool SplitStringData(const AsmRecord& rec, std::vector<std::string>& chars)
+        {
+            const std::string& data = rec.args[1];
+            if (rec.opcode != ".BYTE" || data.length() < 2 || data.front() != '"' || data.back() != '"')
+                return false;
+
+            chars.clear();
+            for (size_t i = 1; i < data.length() - 1; i += chars.back().length())
+                chars.push_back(data.substr(i, data[i] == '\\' ? 2 : 1));
+
+            return std::stoul(rec.args[0]) > chars.size();
+        }
+    }
+
+    PeepholeOptimizer::PeepholeOptimizer(VMMode mode) :
+        m_mode(mode),
+        m_changes(0)
+    {
+    }
+
+    size_t PeepholeOptimizer::Next(const RecordList& records, size_t idx) const
+    {
+        do { ++idx; } while (idx < records.size() && records[idx].isRemoved);
+        return idx;
+    }
+
+    void PeepholeOptimizer::Remove(RecordList& records, size_t idx)
+    {
+        records[idx].isRemoved = true;
+        ++m_changes;
+    }
+
+    void PeepholeOptimizer::Compact(RecordList& records)
+    {
+        RecordList result;
+        result.reserve(records.size());
+
+        std::vector<std::string> pendingLabels;
+        bool pendingDataStart = false;
+
+        for (AsmRecord& rec : records)
+        {
+            if (rec.isRemoved)
+            {
+                // Labels of removed records now point to whatever comes after.
+                pendingLabels.insert(pendingLabels.end(), rec.labels.begin(), rec.labels.end());
+                pendingDataStart |= rec.isDataStart;
+                continue;
+            }
+
+            rec.labels.insert(rec.labels.begin(), pendingLabels.begin(), pendingLabels.end());
+            rec.isDataStart |= pendingDataStart;
+            pendingLabels.clear();
+            pendingDataStart = false;
+
+            result.push_back(std::move(rec));
+        }
+
+        records = std::move(result);
+    }
+
+    size_t PeepholeOptimizer::FindLabel(const RecordList& records, const std::string& label) const
+    {
+        auto it = m_labelIndex.find(label);
+        if (it == m_labelIndex.end())
+            return records.size();
+
+        size_t target = it->second;
+        return records[target].isRemoved ? Next(records, target) : target;
+    }
+
+    // Scans forward from the instruction at idx, to see whether the value in 
+    // register reg is overwritten before it could be read, on every path. JMPs
+    // and conditional branches are followed, anything else that leaves the 
+    // straight line of code is assumed to read it. Labels don't matter here,
+    // since other paths joining in can't read the value from this one.
+    // CPR is not preserved across calls, so a CALL or a return overwrites it.
+    // If the instruction at idx is a branch, its target is followed too.
+    // In wide mode, registers are 64-bit and never read or written in pairs.
+    bool PeepholeOptimizer::IsRegisterDeadAfter(const RecordList& records, size_t idx, int reg) const
+    {
+        bool isWideMode = m_mode == VM_MODE_REGISTER_WIDE;
+        std::vector<size_t> work;
+        std::unordered_set<size_t> visited;
+
+        const AsmRecord& from = records[idx];
+        if (from.opcode == "JMP" || IsConditionalBranch(from.opcode))
+        {
+            size_t target = FindLabel(records, from.args[BranchTargetArg(from.opcode)]);
+            if (target >= records.size())
+                return false;
+
+            work.push_back(target);
+        }
+
+        if (from.opcode != "JMP")
+            work.push_back(Next(records, idx));
+
+        while (!work.empty())
+        {
+            size_t i = work.back();
+            work.pop_back();
+
+            for (; i < records.size(); i = Next(records, i))
+            {
+                // Paths that join one that is already scanned end there.
+                if (!visited.insert(i).second)
+                    break;
+
+                const AsmRecord& rec = records[i];
+                if (rec.opcode.empty() || rec.opcode == ".BYTE")
+                    return false;
+
+                if (rec.opcode == "EXIT")
+                    break;
+
+                bool writesFirstArg = g_writesFirstArg.count(BaseOf(rec.opcode)) > 0;
+                for (int a = writesFirstArg ? 1 : 0; a < 3; ++a)
+                {
+                    const std::string& arg = rec.args[a];
+                    if (arg.empty())
+                        continue;
+
+                    // Any read of the register, or the pair below it, keeps it alive.
+                    // Registers may also be given by number, or by expressions.
+                    // Numbers longer than two digits can't be registers. In wide
+                    // mode, numbers are 32-bit slots, two to a register.
+                    int r = RegisterIndex(arg);
+                    if (r < 0 && IsNumber(arg))
+                        r = arg.length() <= 2 && arg[0] != '-' ? std::stoi(arg) >> (isWideMode ? 1 : 0) : -1;
+                    else if (r < 0 && !IsPlainLabel(arg) && !IsFloat(arg))
+                        return false;
+
+                    if (r >= 0 && (r == reg || (!isWideMode && r + 1 == reg)))
+                        return false;
+                }
+
+                if (reg == CPR_INDEX)
+                {
+                    if (ReadsCpr(rec.opcode))
+                        return false;
+                    if (g_writesCpr.count(BaseOf(rec.opcode)) > 0 || rec.opcode == "CALL" || 
+                        rec.opcode == "TAILCALL" || rec.opcode.compare(0, 3, "RET") == 0)
+                        break;
+                }
+
+                if (writesFirstArg)
+                {
+                    int r = RegisterIndex(rec.args[0]);
+                    if (r == reg || (r >= 0 && UsesRegisterPair(rec.opcode, m_mode) && r + 1 == reg))
+                        break;
+                }
+
+                if (rec.opcode == "JMP" || IsConditionalBranch(rec.opcode))
+                {
+                    size_t target = FindLabel(records, rec.args[BranchTargetArg(rec.opcode)]);
+                    if (target >= records.size())
+                        return false;
+
+                    work.push_back(target);
+                    if (rec.opcode == "JMP")
+                        break;
+                }
+                else if (IsControlFlow(rec.opcode))
+                    return false;
+            }
+
+            if (i >= records.size())
+                return false;
+        }
+
+        return true;
+    }
+
+    // MOV Rx, Rx
+    void PeepholeOptimizer::RemoveSelfMoves(RecordList& records, size_t idx)
+    {
+        const AsmRecord& rec = records[idx];
+        if (!IsRegisterMode(m_mode) || (rec.opcode != "MOV" && rec.opcode != "MOV.64"))
+            return;
+
+        if (RegisterIndex(rec.args[0]) >= 0 && rec.args[0] == rec.args[1])
+            Remove(records, idx);
+    }
+
+    // Register mode:
+    //   STL off, Ra  +  LDL Rb, off   ->  STL off, Ra  +  MOV Rb, Ra
+    //   LDL Ra, off  +  STL off, Ra   ->  LDL Ra, off
+    // Stack mode:
+    //   LDL off      +  STL off       ->  (nothing)
+    //
+    // STA/LDA are left alone in register mode, since STA is assembled as STL there.
+    void PeepholeOptimizer::RemoveRedundantLoadStore(RecordList& records, size_t idx)
+    {
+        AsmRecord& first = records[idx];
+        size_t nextIdx = Next(records, idx);
+        if (nextIdx >= records.size() || records[nextIdx].IsLabeled())
+            return;
+
+        AsmRecord& second = records[nextIdx];
+        std::string suffix = SuffixOf(first.opcode);
+        if (SuffixOf(second.opcode) != suffix)
+            return;
+
+        std::string firstBase = BaseOf(first.opcode);
+        std::string secondBase = BaseOf(second.opcode);
+
+        if (IsRegisterMode(m_mode))
+        {
+            if (firstBase == "STL" && secondBase == "LDL" && first.args[0] == second.args[1])
+            {
+                if (second.args[0] == first.args[1])
+                {
+                    Remove(records, nextIdx);
+                }
+                else
+                {
+                    second.opcode = "MOV" + suffix;
+                    second.args[1] = first.args[1];
+                    ++m_changes;
+                }
+            }
+            else if (firstBase == "LDL" && secondBase == "STL" && 
+                     first.args[1] == second.args[0] && first.args[0] == second.args[1])
+            {
+                Remove(records, nextIdx);
+            }
+        }
+        else
+        {
+            bool isLocalPair = firstBase == "LDL" && secondBase == "STL";
+            bool isArgPair = firstBase == "LDA" && secondBase == "STA";
+            if ((isLocalPair || isArgPair) && first.args[0] == second.args[0])
+            {
+                Remove(records, idx);
+                Remove(records, nextIdx);
+            }
+        }
+    }
+
+    // LDI Rt, C  +  ADD Rd, Rs, Rt  ->  ADDI Rd, Rs, C
+    // This only applies if Rt isn't read afterwards, and for ADD, SUB, MUL, DIV,
+    // BOR, BXOR and BAND.
+    void PeepholeOptimizer::FoldImmediates(RecordList& records, size_t idx)
+    {
+        const AsmRecord& load = records[idx];
+        if (!IsRegisterMode(m_mode) || (load.opcode != "LDI" && load.opcode != "LDI.64"))
+            return;
+
+        size_t opIdx = Next(records, idx);
+        if (opIdx >= records.size() || records[opIdx].IsLabeled())
+            return;
+
+        AsmRecord& op = records[opIdx];
+        std::string base = BaseOf(op.opcode);
+        bool isCommutative = base == "ADD" || base == "MUL" || 
+                             base == "BOR" || base == "BXOR" || base == "BAND";
+        if (!isCommutative && base != "SUB" && base != "DIV")
+            return;
+
+        bool isWide = load.opcode == "LDI.64";
+        if (IsWide(op.opcode) != isWide)
+            return;
+
+        bool isPair = UsesRegisterPair(load.opcode, m_mode);
+
+        int t = RegisterIndex(load.args[0]);
+        int d = RegisterIndex(op.args[0]);
+        int lhs = RegisterIndex(op.args[1]);
+        int rhs = RegisterIndex(op.args[2]);
+        if (t < 0 || d < 0 || lhs < 0 || rhs < 0)
+            return;
+
+        // Find the operand that isn't the loaded one. It must not overlap it.
+        int other;
+        if (rhs == t)
+            other = lhs;
+        else if (lhs == t && isCommutative)
+            other = rhs;
+        else
+            return;
+
+        if (other == t || (isPair && (other == t - 1 || other == t + 1)))
+            return;
+
+        // The loaded registers must be dead after the operation, unless it overwrites them.
+        for (int reg = t; reg <= t + (isPair ? 1 : 0); ++reg)
+        {
+            bool isOverwritten = reg == d || (isPair && reg == d + 1);
+            if (!isOverwritten && !IsRegisterDeadAfter(records, opIdx, reg))
+                return;
+        }
+
+        op.opcode = base + "I" + SuffixOf(op.opcode);
+        op.args[1] = "R" + std::to_string(other);
+        op.args[2] = load.args[1];
+        Remove(records, idx);
+    }
+
+    // JMP/BRZ/BRNZ/Bxx to a JMP  ->  jump directly to where that JMP goes.
+    // JMP to the next instruction  ->  (nothing)
+    void PeepholeOptimizer::ThreadJumps(RecordList& records, size_t idx)
+    {
+        AsmRecord& jump = records[idx];
+        if (jump.opcode != "JMP" && !IsConditionalBranch(jump.opcode))
+            return;
+
+        std::string& targetArg = jump.args[BranchTargetArg(jump.opcode)];
+        if (!IsPlainLabel(targetArg))
+            return;
+
+        std::string target = targetArg;
+        for (int hops = 0; hops < MAX_JUMP_HOPS; ++hops)
+        {
+            size_t targetIdx = FindLabel(records, target);
+            if (targetIdx >= records.size() || targetIdx == idx)
+                break;
+
+            const AsmRecord& targetRec = records[targetIdx];
+            if (targetRec.opcode != "JMP" || !IsPlainLabel(targetRec.args[0]) || 
+                targetRec.args[0] == target)
+                break;
+
+            target = targetRec.args[0];
+        }
+
+        if (target != targetArg)
+        {
+            targetArg = target;
+            ++m_changes;
+        }
+
+        if (jump.opcode == "JMP" && FindLabel(records, target) == Next(records, idx))
+            Remove(records, idx);
+    }
+
+    // CPxx Ra, Rb  +  BRNZ label  ->  Bxx Ra, Rb, label
+    // CPxx Ra, Rb  +  BRZ label   ->  B(not xx) Ra, Rb, label
+    // CPI Ra, k    +  BRNZ label  ->  BEQI Ra, k, label     (BNEI for BRZ)
+    // CPZ Ra       +  BRNZ label  ->  BEQI Ra, 0, label     (BNEI for BRZ)
+    //
+    // This only applies if CPR isn't read afterwards, on either path. Floating 
+    // point comparisons other than equality are only fused with BRNZ, since 
+    // their inverse is not the same as the opposite comparison for NaN.
+    void PeepholeOptimizer::FuseCompareBranches(RecordList& records, size_t idx)
+    {
+        AsmRecord& compare = records[idx];
+        if (!IsRegisterMode(m_mode) || compare.opcode.compare(0, 2, "CP") != 0)
+            return;
+
+        size_t branchIdx = Next(records, idx);
+        if (branchIdx >= records.size() || records[branchIdx].IsLabeled())
+            return;
+
+        AsmRecord& branch = records[branchIdx];
+        if (branch.opcode != "BRZ" && branch.opcode != "BRNZ")
+            return;
+
+        std::string base = BaseOf(compare.opcode);
+        std::string suffix = SuffixOf(compare.opcode);
+        std::string fused;
+        std::string args[2] = {compare.args[0], compare.args[1]};
+
+        auto it = g_compareBranches.find(base);
+        if (it != g_compareBranches.end())
+            fused = it->second + suffix;
+        else if ((base == "CPI" || base == "CPZ") && suffix.empty())
+        {
+            fused = "BEQI";
+            if (base == "CPZ")
+                args[1] = "0";
+        }
+        else
+            return;
+
+        if (branch.opcode == "BRZ")
+            fused = InvertBranch(fused);
+
+        if (fused.empty() || !IsRegisterDeadAfter(records, branchIdx, CPR_INDEX))
+            return;
+
+        branch.args[2] = branch.args[0];
+        branch.args[0] = args[0];
+        branch.args[1] = args[1];
+        branch.opcode = fused;
+        Remove(records, idx);
+    }
+
+    // LDI Rt, k  +  Bxx Ra, Rt, label  ->  BxxI Ra, k, label
+    //
+    // This only applies if Rt isn't read afterwards, and for BEQ, BNE, BLT and BGE 
+    // on 32-bit integers. For BEQ and BNE, the constant may be either operand.
+    void PeepholeOptimizer::FoldBranchImmediates(RecordList& records, size_t idx)
+    {
+        const AsmRecord& load = records[idx];
+        if (!IsRegisterMode(m_mode) || load.opcode != "LDI" || !IsNumber(load.args[1]))
+            return;
+
+        size_t branchIdx = Next(records, idx);
+        if (branchIdx >= records.size() || records[branchIdx].IsLabeled())
+            return;
+
+        AsmRecord& branch = records[branchIdx];
+        bool isEquality = branch.opcode == "BEQ" || branch.opcode == "BNE";
+        if (!isEquality && branch.opcode != "BLT" && branch.opcode != "BGE")
+            return;
+
+        int t = RegisterIndex(load.args[0]);
+        int lhs = RegisterIndex(branch.args[0]);
+        int rhs = RegisterIndex(branch.args[1]);
+        if (t < 0 || lhs < 0 || rhs < 0 || lhs == rhs)
+            return;
+
+        std::string other;
+        if (rhs == t)
+            other = branch.args[0];
+        else if (lhs == t && isEquality)
+            other = branch.args[1];
+        else
+            return;
+
+        if (!IsRegisterDeadAfter(records, branchIdx, t))
+            return;
+
+        branch.opcode += "I";
+        branch.args[0] = other;
+        branch.args[1] = load.args[1];
+        Remove(records, idx);
+    }
+
+    // Removes everything after an unconditional jump or return, up until the 
+    // next label or program data.
+    void PeepholeOptimizer::RemoveUnreachable(RecordList& records, size_t idx)
+    {
+        if (!EndsFlow(records[idx].opcode))
+            return;
+
+        for (size_t i = Next(records, idx); i < records.size(); i = Next(records, i))
+        {
+            const AsmRecord& rec = records[i];
+            if (rec.opcode.empty() || rec.opcode == ".BYTE" || rec.IsLabeled())
+                break;
+
+            Remove(records, i);
+        }
+    }
+
+    size_t PeepholeOptimizer::Optimize(RecordList& records)
+    {
+        m_changes = 0;
+
+        for (int pass = 0; pass < MAX_PASSES; ++pass)
+        {
+            size_t changesBefore = m_changes;
+
+            m_labelIndex.clear();
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                for (const std::string& label : records[i].labels)
+                    m_labelIndex[label] = i;
+            }
+
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                if (records[i].isRemoved || records[i].opcode.empty() || records[i].opcode == ".BYTE")
+                    continue;
+
+                RemoveSelfMoves(records, i);
+                if (!records[i].isRemoved)
+                    RemoveRedundantLoadStore(records, i);
+                if (!records[i].isRemoved)
+                    FoldImmediates(records, i);
+                if (!records[i].isRemoved)
+                    FoldBranchImmediates(records, i);
+                if (!records[i].isRemoved)
+                    FuseCompareBranches(records, i);
+                if (!records[i].isRemoved)
+                    ThreadJumps(records, i);
+                if (!records[i].isRemoved)
+                    RemoveUnreachable(records, i);
+            }
+
+            Compact(records);
+
+            if (m_changes == changesBefore)
+                break;
+        }
+
+        MergeStringSuffixes(records);
+
+        return m_changes;
+    }
+
+    void PeepholeOptimizer::MergeStringSuffixes(RecordList& records)
+    {
+        struct StringData
+        {
+            size_t idx;
+            std::vector<std::string> chars;
+        };
+
+        std::vector<StringData> strings;
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            StringData str;
+            str.idx = i;
+            if (SplitStringData(records[i], str.chars))
+                strings.push_back(std::move(str));
+        }
+
+        // Longer strings first, so that each string is only compared against the
+        // ones that could contain it.
+        std::stable_sort(strings.begin(), strings.end(), 
+            [](const StringData& a, const StringData& b) { return a.chars.size() > b.chars.size(); });
+
+        // Offsets into each host string, and the labels that point there.
+        std::unordered_map<size_t, std::map<size_t, std::vector<std::string>>> splits;
+        std::vector<const StringData*> hosts;
+
+        for (const StringData& str : strings)
+        {
+            const AsmRecord& rec = records[str.idx];
+
+            // Unlabeled data following the string may belong to it, so it has to stay.
+            bool isRemovable = !rec.labels.empty() && !rec.isDataStart && 
+                (str.idx + 1 >= records.size() || records[str.idx + 1].opcode != ".BYTE" || 
+                 records[str.idx + 1].IsLabeled());
+
+            const StringData* host = nullptr;
+            for (size_t h = 0; isRemovable && h < hosts.size() && !host; ++h)
+            {
+                const std::vector<std::string>& chars = hosts[h]->chars;
+                if (std::equal(str.chars.begin(), str.chars.end(), chars.end() - str.chars.size()))
+                    host = hosts[h];
+            }
+
+            if (!host)
+            {
+                hosts.push_back(&str);
+                continue;
+            }
+
+            std::vector<std::string>& labels = splits[host->idx][host->chars.size() - str.chars.size()];
+            labels.insert(labels.end(), rec.labels.begin(), rec.labels.end());
+            records[str.idx].isRemoved = true;
+            ++m_changes;
+        }
+
+        if (splits.empty())
+            return;
+
+        RecordList result;
+        result.reserve(records.size() + strings.size());
+
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            if (records[i].isRemoved)
+                continue;
+
+            auto it = splits.find(i);
+            if (it == splits.end())
+            {
+                result.push_back(std::move(records[i]));
+                continue;
+            }
+
+            std::vector<std::string> chars;
+            SplitStringData(records[i], chars);
+            size_t byteSize = std::stoul(records[i].args[0]);
+
+            // The host keeps its own labels on its first part, and the last part 
+            // keeps the terminator and any padding.
+            std::map<size_t, std::vector<std::string>>& offsets = it->second;
+            std::vector<std::string>& first = offsets[0];
+            first.insert(first.begin(), records[i].labels.begin(), records[i].labels.end());
+
+            for (auto offset = offsets.begin(); offset != offsets.end(); ++offset)
+            {
+                auto next = std::next(offset);
+                size_t end = next == offsets.end() ? chars.size() : next->first;
+
+                AsmRecord part;
+                part.opcode = ".BYTE";
+                part.lineNbr = records[i].lineNbr;
+                part.isDataStart = offset == offsets.begin() && records[i].isDataStart;
+                part.labels = std::move(offset->second);
+                part.args[1] = "\"";
+                for (size_t c = offset->first; c < end; ++c)
+                    part.args[1] += chars[c];
+                part.args[1] += '"';
+                part.args[0] = std::to_string(next == offsets.end() ? byteSize - offset->first : end - offset->first);
+
+                result.push_back(std::move(part));
+            }
+        }
+
+        records = std::move(result);
+    }
+}
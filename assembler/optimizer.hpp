@@ -0,0 +1,82 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_OPTIMIZER_HPP
+#define INC_OPTIMIZER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "common.hpp"
+#include "record.hpp"
+
+namespace Assembly
+{
+    // Peephole optimizer, run on the records before they are encoded.
+    // Records are rewritten or removed, but never moved. The labels of a removed
+    // record are moved on to the next record, so that they can be re-resolved 
+    // from the final record list.
+    class PeepholeOptimizer
+    {
+    private:
+        VMMode m_mode;
+        size_t m_changes;
+        std::unordered_map<std::string, size_t> m_labelIndex;
+
+    public:
+        PeepholeOptimizer(VMMode mode);
+
+        // Optimizes the records in place. The list must end with an end record.
+        // Returns the number of changes made.
+        size_t Optimize(RecordList& records);
+
+    private:
+        size_t Next(const RecordList& records, size_t idx) const;
+        void Remove(RecordList& records, size_t idx);
+        void Compact(RecordList& records);
+
+        // Returns the index of the record the label points at, or the size of the list.
+        size_t FindLabel(const RecordList& records, const std::string& label) const;
+
+        bool IsRegisterDeadAfter(const RecordList& records, size_t idx, int reg) const;
+
+        void RemoveSelfMoves(RecordList& records, size_t idx);
+        void RemoveRedundantLoadStore(RecordList& records, size_t idx);
+        void FoldImmediates(RecordList& records, size_t idx);
+        void FoldBranchImmediates(RecordList& records, size_t idx);
+        void FuseCompareBranches(RecordList& records, size_t idx);
+        void ThreadJumps(RecordList& records, size_t idx);
+        void RemoveUnreachable(RecordList& records, size_t idx);
+
+        // Removes string data that is the tail of a longer string, and points its 
+        // labels into the longer one instead. The longer string is split into 
+        // several .BYTE records, so that every label still starts a record.
+        void MergeStringSuffixes(RecordList& records);
+    };
+}
+
+#endif // INC_OPTIMIZER_HPP
@@ -0,0 +1,179 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_RECORD_HPP
+#define INC_RECORD_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.hpp"
+
+namespace Assembly
+{
+    // A tokenized line of assembly, i.e. an instruction or a .BYTE directive.
+    // A record with an empty opcode marks the end of the program.
+    struct AsmRecord
+    {
+        std::string opcode;
+        std::string args[3];
+        std::vector<std::string> labels;    // Labels that point at this record.
+        size_t lineNbr;
+        bool isDataStart;                   // Whether .DATA points at this record.
+        bool isRemoved;
+
+        AsmRecord() : lineNbr(0), isDataStart(false), isRemoved(false)
+        {
+        }
+
+        inline bool IsLabeled() const { return !labels.empty() || isDataStart; }
+    };
+
+    using RecordList = std::vector<AsmRecord>;
+
+    // Helpers for inspecting the opcodes and arguments of records.
+
+    // Returns the index of a register argument, e.g. "R12", or -1 if it isn't one.
+    inline int RegisterIndex(const std::string& arg)
+    {
+        if (arg.length() < 2 || arg.length() > 3 || arg[0] != 'R' || 
+            arg.find_first_not_of("0123456789", 1) != std::string::npos)
+            return -1;
+
+        int idx = std::stoi(arg.substr(1));
+        return idx < 32 ? idx : -1;
+    }
+
+    inline bool IsNumber(const std::string& arg)
+    {
+        return !arg.empty() && arg.find_first_not_of("-0123456789") == std::string::npos;
+    }
+
+    inline bool IsFloat(const std::string& arg)
+    {
+        return !arg.empty() && arg.find('.') != std::string::npos &&
+            arg.find_first_not_of("-.0123456789f") == std::string::npos;
+    }
+
+    // Whether the argument is a single label, and not a register or an expression.
+    inline bool IsPlainLabel(const std::string& arg)
+    {
+        return !arg.empty() && RegisterIndex(arg) < 0 && !IsNumber(arg) &&
+            arg.find_first_of("+-*/\".") == std::string::npos;
+    }
+
+    // "ADD.F64" -> "ADD"
+    inline std::string BaseOf(const std::string& opcode)
+    {
+        return opcode.substr(0, opcode.find('.'));
+    }
+
+    // "ADD.F64" -> ".F64"
+    inline std::string SuffixOf(const std::string& opcode)
+    {
+        size_t pos = opcode.find('.');
+        return pos == std::string::npos ? "" : opcode.substr(pos);
+    }
+
+    // Whether the instruction operates on 64-bit values.
+    inline bool IsWide(const std::string& opcode)
+    {
+        std::string suffix = SuffixOf(opcode);
+        return suffix == ".64" || suffix == ".F64";
+    }
+
+    // 64-bit register instructions operate on the register pair Rx and Rx+1,
+    // except in wide mode, where each register holds a 64-bit value of its own.
+    inline bool UsesRegisterPair(const std::string& opcode, VMMode mode)
+    {
+        return mode != VM_MODE_REGISTER_WIDE && IsWide(opcode);
+    }
+
+    // Whether execution never continues to the next instruction.
+    inline bool EndsFlow(const std::string& opcode)
+    {
+        return opcode == "JMP" || opcode == "JMPI" || opcode == "EXIT" ||
+            opcode == "RET" || opcode == "RET.32" || opcode == "RET.64" || opcode == "TAILCALL";
+    }
+
+    // Whether the opcode compares two registers, or a register and an immediate, 
+    // and branches on the result, e.g. "BLT R1, R2, label" or "BLTI R1, 10, label".
+    inline bool IsCompareBranch(const std::string& opcode)
+    {
+        std::string base = BaseOf(opcode);
+        return base == "BEQ" || base == "BNE" || base == "BLT" || base == "BGE" || 
+            base == "BGT" || base == "BLE" || base == "BEQI" || base == "BNEI" || 
+            base == "BLTI" || base == "BGEI";
+    }
+
+    // Whether the opcode branches to a label, depending on a condition.
+    inline bool IsConditionalBranch(const std::string& opcode)
+    {
+        return opcode == "BRZ" || opcode == "BRNZ" || IsCompareBranch(opcode);
+    }
+
+    // Returns the index of the argument that holds the target of a branch.
+    inline int BranchTargetArg(const std::string& opcode)
+    {
+        return IsCompareBranch(opcode) ? 2 : 0;
+    }
+
+    // Returns the branch that is taken exactly when the given one is not, or an 
+    // empty string if there is none. Floating point comparisons other than 
+    // BEQ/BNE have none, since both a comparison and its inverse are false for NaN.
+    inline std::string InvertBranch(const std::string& opcode)
+    {
+        static const std::pair<const char*, const char*> inverses[] = {
+            {"BRZ", "BRNZ"}, {"BEQ", "BNE"}, {"BLT", "BGE"}, {"BGT", "BLE"}, 
+            {"BEQI", "BNEI"}, {"BLTI", "BGEI"},
+        };
+
+        std::string base = BaseOf(opcode);
+        std::string suffix = SuffixOf(opcode);
+        bool isFloat = suffix == ".F" || suffix == ".F64";
+        for (const auto& pair : inverses)
+        {
+            if (isFloat && base != "BEQ" && base != "BNE")
+                break;
+
+            if (base == pair.first)
+                return pair.second + suffix;
+            if (base == pair.second)
+                return pair.first + suffix;
+        }
+
+        return "";
+    }
+
+    inline bool IsControlFlow(const std::string& opcode)
+    {
+        return EndsFlow(opcode) || opcode == "CALL" || opcode == "BRZ" || 
+            opcode == "BRNZ" || opcode == "BRIZ" || opcode == "BRINZ" || IsCompareBranch(opcode);
+    }
+}
+
+#endif // INC_RECORD_HPP
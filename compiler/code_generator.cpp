@@ -26,6 +26,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "code_generator.hpp"
+#include "assembler.hpp"
 
 #define STR(x) std::to_string(x)
 #define MOV(x) std::move(x)
@@ -44,7 +45,15 @@ namespace Compiler
         "read",
         "open",
         "close",
-        "str"
+        "str",
+        "readall",
+        "aread",
+        "awrite",
+        "await",
+        "apoll",
+        "mmap",
+        "munmap",
+        "snapshot"
     };
 
     bool IsSystemFunction(const std::string& id)
@@ -52,6 +61,73 @@ namespace Compiler
         return std::find(g_sysFuncs.begin(), g_sysFuncs.end(), id) != g_sysFuncs.end();
     }
 
+    struct MathFunction
+    {
+        const char* name;
+        size_t argCount;
+        bool hasIntegerTypes; // Whether ints and longs are taken, besides floats and doubles.
+    };
+
+    static const std::initializer_list<MathFunction> g_mathFuncs =
+    {
+        {"sqrt",  1, false},
+        {"fma",   3, false},
+        {"abs",   1, true },
+        {"min",   2, true },
+        {"max",   2, true },
+        {"floor", 1, false},
+        {"ceil",  1, false},
+        {"round", 1, false},
+        {"sin",   1, false},
+        {"cos",   1, false},
+        {"exp",   1, false},
+        {"log",   1, false},
+        {"pow",   2, false}
+    };
+
+    bool IsMathFunction(const std::string& id)
+    {
+        return std::any_of(g_mathFuncs.begin(), g_mathFuncs.end(), 
+            [&](const MathFunction& f) { return id == f.name; });
+    }
+
+    std::vector<func> GetMathFunctionDeclarations()
+    {
+        std::vector<func> declarations;
+        for (const MathFunction& f : g_mathFuncs)
+        {
+            for (DataType type : {DataType::INT, DataType::LONG, DataType::FLOAT, DataType::DOUBLE})
+            {
+                if (!f.hasIntegerTypes && (type == DataType::INT || type == DataType::LONG))
+                    continue;
+
+                StmtList args(f.argCount, stmt(stmt_type::DECLARATION, identifier(identifier_type::ARG_VAR, type)));
+                declarations.push_back(func("__" + std::string(f.name), type, std::move(args)));
+            }
+        }
+
+        return declarations;
+    }
+
+    // Gets the instruction of a call to a math function, or an empty string for other calls.
+    static std::string GetMathInstruction(const expr& call)
+    {
+        const std::string& label = call.operands.front().id.id;
+        if (label.compare(0, 2, "__") != 0 || !IsMathFunction(label.substr(2)))
+            return "";
+
+        std::string instr = label.substr(2);
+        std::transform(instr.begin(), instr.end(), instr.begin(), ::toupper);
+
+        switch (call.dataType)
+        {
+            case DataType::FLOAT:  return instr + ".F";
+            case DataType::DOUBLE: return instr + ".F64";
+            case DataType::LONG:   return instr + ".64";
+            default:               return instr;
+        }
+    }
+
     bool HasVariadicArguments(const func& function)
     {
         auto varArg = std::find_if(function.args.begin(), function.args.end(), 
@@ -67,6 +143,7 @@ namespace Compiler
         m_ss(), 
         m_hasError(false), 
         m_nextLabel(0), 
+        m_isResolved(false),
         m_currFunc(""),
         m_lastInstr(),
         m_funcList(funcList),
@@ -91,33 +168,32 @@ namespace Compiler
             m_currFunc = funcName;
             m_instr.emplace(m_currFunc, std::vector<Instruction>());
 
-            if (funcIt->argVarCnt > 0)
-            {
-                // First, load up the argument variable values, which are consumed from the stack.
-                // It is important to load them in a reversed order, because... stack.
-                for (auto argIt = funcIt->args.rbegin(); argIt != funcIt->args.rend(); ++argIt)
-                {
-                    if (GetDataTypeBytes(argIt->id.dataType) == 8)
-                        AddInstruction({"STA.64", STR(argIt->id.position)});
-                    else
-                        AddInstruction({"STA", STR(argIt->id.position)});
-                }
-            }
+            BeginFunction(*funcIt);
 
             // Translate the contained statements of the function.
             auto stmtIt = funcIt->statements.begin();
             while (stmtIt != funcIt->statements.end())
                 TranslateStatement(*stmtIt++);
 
+            EndFunction(*funcIt);
+
             m_instr[m_currFunc].front().label = m_currFunc;
         }
 
         return !m_hasError;
     }
 
+    void CodeGenerator::BeginFunction(const func& /*function*/)
+    {
+    }
+
+    void CodeGenerator::EndFunction(const func& /*function*/)
+    {
+    }
+
     bool CodeGenerator::TranslateStatement(const stmt& s)
     {
-        std::vector<stmt>::const_iterator substmt;
+        StmtList::const_iterator substmt;
 
         switch (s.type)
         {
@@ -132,6 +208,9 @@ namespace Compiler
             case stmt_type::BRANCH: stmt_branch(s);
                 break;
 
+            case stmt_type::LOOP: stmt_loop(s);
+                break;
+
             case stmt_type::BLOCK: 
                 substmt = s.substmts.begin();
                 while (substmt != s.substmts.end())
@@ -147,6 +226,10 @@ namespace Compiler
             case stmt_type::RETURN: stmt_return(s);
                 break;
 
+            case stmt_type::ARRAY_FILL:
+            case stmt_type::ARRAY_COPY: stmt_array_bulk(s);
+                break;
+
             default: break;
         }
 
@@ -194,6 +277,9 @@ namespace Compiler
 
             case expr_type::CAST: expr_cast(e);
                 break;
+
+            case expr_type::SELECT: expr_select(e);
+                break;
         }
 
         return !m_hasError;
@@ -223,30 +309,20 @@ namespace Compiler
         return m_ss.str();
     }
 
-    void CodeGenerator::Flush(std::ostream& output)
+    void CodeGenerator::ResolveJumps()
     {
-        // First, write the header.
-        if (typeid(*this) == typeid(StackCodeGenerator))
-            output << std::left << std::setw(10) << ".MODE" << std::setw(14) << "Stack" << "; Use the stack instruction set." << std::endl;
-        else
-            output << std::setw(10) << ".MODE" << std::setw(14) << "Register" << "; Use the register instruction set." << std::endl;
-
-        output << std::setw(10) << ".HEAP" << std::setw(14) << m_initHeapSize << "; KiB" << std::endl;
-        output << std::setw(10) << ".HEAP_MAX" << std::setw(14) << m_maxHeapSize << "; KiB" << std::endl;
-        output << std::endl;
+        if (m_isResolved)
+            return;
 
-        // Start on the actual instructions.
+        m_isResolved = true;
         for (auto& map : m_instr)
         {
-            // Do a first pass to add labels to the instructions that
-            // are pointed to by next or cond.
+            // Add labels to the instructions that are pointed to by next or cond.
             for (auto instr = map.second.begin(); instr != map.second.end(); ++instr)
             {
                 // This instruction refers to the instruction AFTER what it is pointing to.
                 if (instr->jumpAfter > -1)
                 {
-                    auto isJumpAfter = [&](Instruction& i) { return &i == &map.second[instr->jumpTo]; };
-
                     // Get the iterator to the instruction directly after what instr->jumpAfter points to.
                     if (instr->jumpAfter + 1 < map.second.size())
                     {
@@ -271,8 +347,33 @@ namespace Compiler
                     instr->operands.push_back(map.second[instr->jumpTo].label);
                 }
             }
+        }
+    }
+
+    void CodeGenerator::Flush(std::ostream& output)
+    {
+        ResolveJumps();
+
+        // First, write the header.
+        if (typeid(*this) == typeid(StackCodeGenerator))
+            output << std::left << std::setw(10) << ".MODE" << std::setw(14) << GetModeName() << "; Use the stack instruction set." << std::endl;
+        else
+            output << std::setw(10) << ".MODE" << std::setw(14) << GetModeName() << "; Use the register instruction set." << std::endl;
+
+        output << std::setw(10) << ".HEAP" << std::setw(14) << m_initHeapSize << "; KiB" << std::endl;
+        output << std::setw(10) << ".HEAP_MAX" << std::setw(14) << m_maxHeapSize << "; KiB" << std::endl;
+        output << std::endl;
+
+        // Call main, so that it gets a stack frame of its own to keep locals in.
+        if (m_instr.find("main") != m_instr.end())
+        {
+            output << BuildAsm({"CALL", "main"}) << std::endl;
+            output << BuildAsm({"EXIT"}) << std::endl;
+        }
 
-            // Do a second pass to actually flush the instruction as text to 'output'.
+        // Start on the actual instructions.
+        for (auto& map : m_instr)
+        {
             for (auto& instr : map.second)
             {
                 // If instruction has a label, output that first.
@@ -293,145 +394,604 @@ namespace Compiler
         }
     }
 
-    //---- StackCodeGenerator Implementation ----//
-
-    StackCodeGenerator::StackCodeGenerator(uint32_t initialHeapSize, uint32_t maxHeapSize, 
-        const std::vector<func>& funcList, const StringLiteralMap& literals) :
-        CodeGenerator(initialHeapSize, maxHeapSize, funcList, literals)
+    size_t CodeGenerator::Assemble(std::ostream& binaryOutput, bool isOptimizing)
     {
-    }
+        ResolveJumps();
 
-    StackCodeGenerator::~StackCodeGenerator()
-    {
-    }
+        // Build the same program as Flush, but as records for the assembler.
+        Assembly::RecordList records;
+        auto addRecord = [&records](const std::vector<std::string>& operands, const std::string& label)
+        {
+            Assembly::AsmRecord rec;
+            rec.opcode = operands.front();
+            for (size_t i = 1; i < operands.size() && i <= 3; i++)
+                rec.args[i - 1] = operands[i];
 
-    void StackCodeGenerator::stmt_assignment(const stmt& s)
-    {
-        TranslateExpression(s.expressions.front());
-        
-        identifier_type idType = s.id.type;
-        std::string instr;
-        if (idType == identifier_type::ARG_VAR)
-            instr = "STA";
-        else if (idType == identifier_type::LOCAL_VAR)
-            instr = "STL";
-        else
-            RETURN_ERROR();
+            if (label != "")
+                rec.labels.push_back(label);
 
-        if (GetDataTypeBytes(s.id.dataType) == 8) // If 64-bit data type.
-            instr.append(".64");
+            records.push_back(std::move(rec));
+        };
 
-        AddInstruction({instr, STR(s.id.position)});
-    }
+        addRecord({".MODE", GetModeName()}, "");
+        addRecord({".HEAP", STR(m_initHeapSize)}, "");
+        addRecord({".HEAP_MAX", STR(m_maxHeapSize)}, "");
 
-    void StackCodeGenerator::stmt_func_call(const stmt& s)
-    {
-        TranslateExpression(s.expressions.front());
-    }
+        if (m_instr.find("main") != m_instr.end())
+        {
+            addRecord({"CALL", "main"}, "");
+            addRecord({"EXIT"}, "");
+        }
 
-    void StackCodeGenerator::stmt_branch(const stmt& s)
-    {
-        const stmt& ifStmt = s.substmts.front();
-        const expr& ifCond = ifStmt.expressions.front();
+        for (auto& map : m_instr)
+            for (auto& instr : map.second)
+                addRecord(instr.operands, instr.label);
 
-        TranslateExpression(ifCond);
-        
-        // Always try to branch directly after the condition expression.
-        int32_t condBranchInstr = AddInstruction({"BRZ"}); // Should jump to else block, or to end, if none exists.
+        for (auto literal : m_literals)
+            addRecord({".BYTE", STR(literal.first.size()+1), '\"'+literal.first+'\"'}, literal.second);
+
+        // Labels of functions that are never called are expected.
+        Assembly::Assembler assembler;
+        assembler.AddFlags(Assembly::FLAG_SUPPRESS_UNUSED_LABELS);
+        if (isOptimizing)
+            assembler.AddFlags(Assembly::FLAG_OPTIMIZE);
+        return assembler.Assemble(records, binaryOutput);
+    }
 
-        // Here starts the if block.
+    bool CodeGenerator::GetCastInstruction(const expr& e, std::string& instr, std::string& arg) const
+    {
+        DataType from = e.operands.front().dataType;
+        DataType to = e.dataType;
+        instr = "";
+        arg = "";
+        const expr* argExpr = nullptr;
+        if (&e.operands.back() != &e.operands.front()) // If an arg was given.
+            argExpr = &e.operands.back();
 
-        auto stmtIt = ifStmt.substmts.begin();
-        while (stmtIt != ifStmt.substmts.end())
-            TranslateStatement(*stmtIt++);
+        if (from == to && from != DataType::STRING)
+            return true; // Ignore
 
-        int32_t jumpToEnd = -1;
-        if (s.substmts.size() == 2)
+        if (from == DataType::INT)
         {
-            jumpToEnd = AddInstruction({"JMP"}); // Should jump to the end.
-            GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr; // Should jump to else.
+            switch (to)
+            {
+                case DataType::LONG:   instr = "ITOL"; break;
+                case DataType::FLOAT:  instr = "ITOF"; break;
+                case DataType::DOUBLE: instr = "ITOD"; break;
+                case DataType::STRING: instr = "ITOS"; break;
+            }
         }
-        else // Handle when there is no else statement.
+        else if (from == DataType::LONG)
         {
-            // If not already set, then set conditional branch to jump to the 
-            // instruction AFTER the last instruction made, i.e. the end.
-            GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
-            return;
+            switch (to)
+            {
+                case DataType::INT:    instr = "LTOI"; break;
+                case DataType::FLOAT:  instr = "LTOF"; break;
+                case DataType::DOUBLE: instr = "LTOD"; break;
+                case DataType::STRING: instr = "LTOS"; break;
+            }
+        }
+        else if (from == DataType::FLOAT)
+        {
+            switch (to)
+            {
+                case DataType::INT:    instr = "FTOI"; break;
+                case DataType::LONG:   instr = "FTOL"; break;
+                case DataType::DOUBLE: instr = "FTOD"; break;
+                case DataType::STRING: instr = "FTOS";
+                    arg = argExpr ? std::to_string(argExpr->intValue) : "255"; // Set to VM default.
+                    break;
+            }
+        }
+        else if (from == DataType::DOUBLE)
+        {
+            switch (to)
+            {
+                case DataType::INT:    instr = "DTOI"; break;
+                case DataType::FLOAT:  instr = "DTOF"; break;
+                case DataType::LONG:   instr = "DTOL"; break;
+                case DataType::STRING: instr = "DTOS";
+                    arg = argExpr ? std::to_string(argExpr->intValue) : "255"; // Set to VM default.
+                    break;
+            }
         }
+        else if (from == DataType::STRING)
+        {
+            // Needs to process arg if present, otherwise use a default.
+            switch (to)
+            {
+                // Special case: if explicity casting a string to a string, then copy it into a new string.
+                // The arg specifies how many characters to copy. This can be used for substring functionality.
+                case DataType::STRING: instr = "STRCPY";
+                    arg = argExpr ? std::to_string(argExpr->intValue+1) : "2147483647";
+                    break; 
 
-        // Here starts the else block.
+                case DataType::INT: instr = "STOI"; 
+                    arg = argExpr ? std::to_string(argExpr->intValue) : "0";
+                    break;
 
-        const stmt& elseStmt = s.substmts.back();
+                case DataType::FLOAT: instr = "STOF";
+                    arg = argExpr ? std::to_string(argExpr->floatValue) : "0.0f";
+                    break;
 
-        stmtIt = elseStmt.substmts.begin();
-        while (stmtIt != elseStmt.substmts.end())
-            TranslateStatement(*stmtIt++);
+                case DataType::LONG: instr = "STOL";
+                    arg = argExpr ? std::to_string(argExpr->longValue) : "0";
+                    break;
 
-        // Set the instruction 'jumpToEnd' to jump to the instruction after the last instruction.
-        // Labels are created and resolved when calling Flush().
-        GetFuncInstr(jumpToEnd)->jumpAfter = m_lastInstr;
+                case DataType::DOUBLE: instr = "STOD";
+                    arg = argExpr ? std::to_string(argExpr->doubleValue) : "0.0";
+                    break;
+            }
+        }
+
+        return instr != "";
     }
 
-    void StackCodeGenerator::stmt_creation(const stmt& s)
+    // Arrays are only placed in the frame up to this many bytes per function,
+    // since the stack of the VM is small, and may hold many frames.
+    static constexpr int32_t MAX_FRAME_ARRAY_BYTES = 128;
+
+    // Evaluates an integer expression that only consists of constants, e.g. the 
+    // scaled size of an array. Returns false if it isn't constant.
+    static bool EvaluateConstant(const expr& e, int64_t& value)
     {
-        TranslateExpression(s.expressions.front());
+        if (e.type == expr_type::NUMBER && e.dataType == DataType::INT)
+        {
+            value = e.intValue;
+            return true;
+        }
 
-        AddInstruction({"NEW"});
+        int64_t lhs, rhs;
+        if (e.type == expr_type::MUL && e.operands.size() == 2 && 
+            EvaluateConstant(e.operands.front(), lhs) && EvaluateConstant(e.operands.back(), rhs))
+        {
+            value = lhs * rhs;
+            return true;
+        }
 
-        if (s.id.type == identifier_type::ARG_VAR)
-            AddInstruction({"STA", STR(s.id.position)});
-        else if (s.id.type == identifier_type::LOCAL_VAR)
-            AddInstruction({"STL", STR(s.id.position)});
-        else
-            RETURN_ERROR();
+        return false;
     }
 
-    void StackCodeGenerator::stmt_destruction(const stmt& s)
+    // An element of a local array, accessed through a constant index.
+    struct ArrayAccess
     {
-        TranslateExpression(s.expressions.front());
-
-        AddInstruction({"DEL"});
-    }
+        size_t array;   // Position of the array variable.
+        int64_t offset; // In bytes.
+        int64_t size;   // Size of the element in bytes.
+    };
 
-    void StackCodeGenerator::stmt_return(const stmt& s)
+    // What the escape analysis knows about the local arrays of a function, by position.
+    struct ArrayUses
     {
-        if (s.expressions.size() > 0)
-            TranslateExpression(s.expressions.front());
-
-        AddInstruction({"RET"});
-    }
-
+        std::map<size_t, int64_t> sizes; // Size in bytes of each array created once.
+        std::set<size_t> escaping;       // Arrays that must stay on the heap.
+        std::vector<ArrayAccess> constantAccesses;
+    };
 
-    void StackCodeGenerator::expr_id(const expr& e)
+    // Marks the local variables that are used in the expression other than by being indexed.
+    static void FindArrayUses(const expr& e, ArrayUses& uses)
     {
-        identifier_type idType = e.id.type;
-        int32_t dataTypeSize = GetDataTypeBytes(e.dataType);
-        std::string instr;
+        if (e.type == expr_type::ID && e.id.type == identifier_type::LOCAL_VAR)
+            uses.escaping.insert(e.id.position);
 
-        if (idType == identifier_type::ARG_VAR)
-            instr = "LDA";
-        else if (idType == identifier_type::LOCAL_VAR)
-            instr = "LDL";
-        else
-            RETURN_ERROR();
+        auto it = e.operands.begin();
+        if (e.type == expr_type::ID_OFFSET && it->type == expr_type::ID)
+        {
+            // The index is already scaled to bytes.
+            int64_t offset;
+            if (it->id.type == identifier_type::LOCAL_VAR && EvaluateConstant(e.operands.back(), offset))
+                uses.constantAccesses.push_back({it->id.position, offset, GetDataTypeBytes(e.dataType)});
 
-        if (dataTypeSize == 8) // If 64-bit data type.
-            instr.append(".64");
+            ++it;
+        }
 
-        AddInstruction({instr, STR(e.id.position)});
+        for (; it != e.operands.end(); ++it)
+            FindArrayUses(*it, uses);
     }
 
-    void StackCodeGenerator::expr_id_offset(const expr& e)
+    static void FindArrayUses(const stmt& s, ArrayUses& uses)
     {
-        TranslateExpression(e.operands.front());
-        
-        const expr& index = e.operands.back();
-        if (index.intValue > 0 || index.type != expr_type::NUMBER)
+        bool isLocal = s.id.type == identifier_type::LOCAL_VAR;
+        int64_t value;
+
+        switch (s.type)
         {
-            TranslateExpression(index);
-            AddInstruction({"ADD"});
-        }
-        
+            case stmt_type::CREATION:
+                if (isLocal && IsArray(s.id.dataType) && uses.sizes.count(s.id.position) == 0 &&
+                    EvaluateConstant(s.expressions.front(), value) && value > 0)
+                {
+                    uses.sizes[s.id.position] = value;
+                }
+                else if (isLocal)
+                    uses.escaping.insert(s.id.position);
+                break;
+
+            case stmt_type::ASSIGN_OFFSET:
+                if (isLocal && EvaluateConstant(s.expressions.front(), value))
+                {
+                    int64_t elementSize = GetDataTypeBytes(ARRAY_TO_BASE(s.id.dataType));
+                    uses.constantAccesses.push_back({s.id.position, value * elementSize, elementSize});
+                }
+                break;
+
+            // The array would be replaced by another one, or freed, or accessed through its address.
+            case stmt_type::ASSIGNMENT:
+            case stmt_type::ARRAY_FILL:
+            case stmt_type::ARRAY_COPY:
+            case stmt_type::INITIALIZATION:
+            case stmt_type::DESTRUCTION:
+                if (isLocal)
+                    uses.escaping.insert(s.id.position);
+                break;
+
+            default: 
+                break;
+        }
+
+        for (const expr& e : s.expressions)
+            FindArrayUses(e, uses);
+
+        for (const stmt& sub : s.substmts)
+            FindArrayUses(sub, uses);
+    }
+
+    int32_t CodeGenerator::PlaceFrameArrays(const func& function, int32_t firstOffset, 
+        std::map<size_t, int32_t>& offsets) const
+    {
+        ArrayUses uses;
+        for (const stmt& s : function.statements)
+            FindArrayUses(s, uses);
+
+        // Constant indices outside of the array would reach other locals, or the frame itself.
+        for (const ArrayAccess& access : uses.constantAccesses)
+        {
+            auto it = uses.sizes.find(access.array);
+            if (it != uses.sizes.end() && (access.offset < 0 || access.offset + access.size > it->second))
+                uses.escaping.insert(access.array);
+        }
+
+        int32_t end = firstOffset;
+        for (const auto& array : uses.sizes)
+        {
+            int32_t size = static_cast<int32_t>((array.second + 3) / 4 * 4); // Whole stack slots.
+            if (uses.escaping.count(array.first) > 0 || end - firstOffset + size > MAX_FRAME_ARRAY_BYTES)
+                continue;
+
+            offsets[array.first] = end;
+            end += size;
+        }
+
+        return end;
+    }
+
+    bool CodeGenerator::IsTailCall(const expr& value, size_t argBytes) const
+    {
+        if (value.type != expr_type::CALL)
+            return false;
+
+        const std::string& label = value.operands.front().id.id;
+        auto funcIt = std::find_if(m_funcList.begin(), m_funcList.end(),
+            [&](const Compiler::func& f) { return f.id.id == label;});
+
+        if (funcIt == m_funcList.end() || (label[0] == '_' && label[1] == '_') || 
+            HasVariadicArguments(*funcIt))
+            return false;
+
+        // TAILCALL encodes the sizes of both argument lists in a byte each.
+        size_t calleeArgBytes = 0;
+        for (const stmt& arg : funcIt->args)
+            calleeArgBytes += GetDataTypeBytes(arg.id.dataType);
+
+        // The value must be returned as is, so the return types must match too.
+        return argBytes <= UINT8_MAX && calleeArgBytes <= UINT8_MAX && 
+            funcIt->returnType == value.dataType;
+    }
+
+    // Gets the instruction of a bulk array statement, whose three expressions are its operands.
+    static std::string GetBulkInstruction(const stmt& s)
+    {
+        if (s.type == stmt_type::ARRAY_COPY)
+            return "MEMCPY";
+
+        return GetDataTypeBytes(ARRAY_TO_BASE(s.id.dataType)) == 8 ? "FILL.64" : "FILL";
+    }
+
+    // Locals start after the return address, which is at offset 0 from the locals of the frame.
+    static constexpr int32_t FIRST_LOCAL_OFFSET = 4;
+
+    // Finds the size in bytes of each local variable used in the expression, by position.
+    static void FindLocalSizes(const expr& e, std::map<size_t, int32_t>& sizes)
+    {
+        if (e.type == expr_type::ID && e.id.type == identifier_type::LOCAL_VAR)
+            sizes[e.id.position] = GetDataTypeBytes(e.id.dataType);
+
+        for (const expr& operand : e.operands)
+            FindLocalSizes(operand, sizes);
+    }
+
+    static void FindLocalSizes(const stmt& s, std::map<size_t, int32_t>& sizes)
+    {
+        if (s.id.type == identifier_type::LOCAL_VAR)
+            sizes[s.id.position] = GetDataTypeBytes(s.id.dataType);
+
+        for (const expr& e : s.expressions)
+            FindLocalSizes(e, sizes);
+        for (const stmt& sub : s.substmts)
+            FindLocalSizes(sub, sizes);
+    }
+
+    // Gets the flags of a system function argument, as given to SARG.
+    static int32_t GetSystemArgFlags(DataType dataType)
+    {
+        switch (dataType)
+        {
+            case DataType::DOUBLE: return 0x40 | 8;
+            case DataType::FLOAT:  return 0x20 | 4;
+            case DataType::LONG:   return 0x10 | 8;
+            case DataType::INT:    return 4;
+            default:               return 0x80 | 4; // Strings and arrays are pointers.
+        }
+    }
+
+    //---- StackCodeGenerator Implementation ----//
+
+    StackCodeGenerator::StackCodeGenerator(uint32_t initialHeapSize, uint32_t maxHeapSize, 
+        const std::vector<func>& funcList, const StringLiteralMap& literals) :
+        CodeGenerator(initialHeapSize, maxHeapSize, funcList, literals),
+        m_argBytes(0)
+    {
+    }
+
+    StackCodeGenerator::~StackCodeGenerator()
+    {
+    }
+
+    void StackCodeGenerator::BeginFunction(const func& function)
+    {
+        m_argOffsets.clear();
+        m_localOffsets.clear();
+
+        // The arguments stay where the caller pushed them. The last one is closest to the frame.
+        m_argBytes = 0;
+        for (auto argIt = function.args.rbegin(); argIt != function.args.rend(); ++argIt)
+        {
+            m_argBytes += GetDataTypeBytes(argIt->id.dataType);
+            m_argOffsets[argIt->id.position] = static_cast<int32_t>(m_argBytes);
+        }
+
+        // Reserve the locals, by pushing zeros.
+        std::map<size_t, int32_t> sizes;
+        for (const stmt& s : function.statements)
+            FindLocalSizes(s, sizes);
+
+        int32_t offset = FIRST_LOCAL_OFFSET;
+        for (const auto& local : sizes)
+        {
+            m_localOffsets[local.first] = offset;
+            offset += local.second;
+            AddInstruction({local.second == 8 ? "LDI.64" : "LDI", "0"});
+        }
+    }
+
+    std::string StackCodeGenerator::GetOffset(const identifier& id)
+    {
+        const std::map<size_t, int32_t>& offsets = 
+            id.type == identifier_type::ARG_VAR ? m_argOffsets : m_localOffsets;
+
+        // The offset is encoded in a byte.
+        auto it = offsets.find(id.position);
+        if (it == offsets.end() || it->second > UINT8_MAX)
+        {
+            RETURN_ERROR();
+            return "0";
+        }
+
+        return STR(it->second);
+    }
+
+    void StackCodeGenerator::stmt_assignment(const stmt& s)
+    {
+        if (s.type == stmt_type::ASSIGN_OFFSET)
+        {
+            // STM takes the address on top of the value. Unlike when reading an 
+            // element, the index is not yet scaled to bytes.
+            DataType valueType = ARRAY_TO_BASE(s.id.dataType);
+            int32_t elementSize = s.id.dataType == DataType::STRING ? 1 : GetDataTypeBytes(valueType);
+
+            TranslateExpression(s.expressions.back());
+            TranslateExpression(expr(s.id));
+            TranslateExpression(s.expressions.front());
+            if (elementSize > 1)
+            {
+                AddInstruction({"LDI", STR(elementSize)});
+                AddInstruction({"MUL"});
+            }
+
+            AddInstruction({"ADD"});
+            AddInstruction({GetDataTypeBytes(valueType) == 8 ? "STM.64" : "STM"});
+            return;
+        }
+
+        TranslateExpression(s.expressions.front());
+        
+        identifier_type idType = s.id.type;
+        std::string instr;
+        if (idType == identifier_type::ARG_VAR)
+            instr = "STA";
+        else if (idType == identifier_type::LOCAL_VAR)
+            instr = "STL";
+        else
+            RETURN_ERROR();
+
+        if (GetDataTypeBytes(s.id.dataType) == 8) // If 64-bit data type.
+            instr.append(".64");
+
+        AddInstruction({instr, GetOffset(s.id)});
+    }
+
+    void StackCodeGenerator::stmt_func_call(const stmt& s)
+    {
+        TranslateExpression(s.expressions.front());
+    }
+
+    void StackCodeGenerator::stmt_branch(const stmt& s)
+    {
+        const stmt& ifStmt = s.substmts.front();
+        const expr& ifCond = ifStmt.expressions.front();
+
+        TranslateExpression(ifCond);
+        
+        // Always try to branch directly after the condition expression.
+        int32_t condBranchInstr = AddInstruction({"BRZ"}); // Should jump to else block, or to end, if none exists.
+
+        // Here starts the if block.
+
+        auto stmtIt = ifStmt.substmts.begin();
+        while (stmtIt != ifStmt.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        int32_t jumpToEnd = -1;
+        if (s.substmts.size() == 2)
+        {
+            jumpToEnd = AddInstruction({"JMP"}); // Should jump to the end.
+            GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr; // Should jump to else.
+        }
+        else // Handle when there is no else statement.
+        {
+            // If not already set, then set conditional branch to jump to the 
+            // instruction AFTER the last instruction made, i.e. the end.
+            GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
+            return;
+        }
+
+        // Here starts the else block.
+
+        const stmt& elseStmt = s.substmts.back();
+
+        stmtIt = elseStmt.substmts.begin();
+        while (stmtIt != elseStmt.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        // Set the instruction 'jumpToEnd' to jump to the instruction after the last instruction.
+        // Labels are created and resolved when calling Flush().
+        GetFuncInstr(jumpToEnd)->jumpAfter = m_lastInstr;
+    }
+
+    void StackCodeGenerator::stmt_loop(const stmt& s)
+    {
+        // The condition is evaluated at the top of the loop, and jumped back to after each iteration.
+        int32_t condInstr = static_cast<int32_t>(GetFuncInstructions().size());
+
+        TranslateExpression(s.expressions.front());
+        int32_t condBranchInstr = AddInstruction({"BRZ"}); // Should jump to the end.
+
+        auto stmtIt = s.substmts.begin();
+        while (stmtIt != s.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        GetFuncInstr(AddInstruction({"JMP"}))->jumpTo = condInstr;
+        GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
+    }
+
+    void StackCodeGenerator::stmt_creation(const stmt& s)
+    {
+        TranslateExpression(s.expressions.front());
+
+        AddInstruction({"NEW"});
+
+        if (s.id.type == identifier_type::ARG_VAR)
+            AddInstruction({"STA", GetOffset(s.id)});
+        else if (s.id.type == identifier_type::LOCAL_VAR)
+            AddInstruction({"STL", GetOffset(s.id)});
+        else
+            RETURN_ERROR();
+    }
+
+    void StackCodeGenerator::stmt_destruction(const stmt& s)
+    {
+        TranslateExpression(s.expressions.front());
+
+        AddInstruction({"DEL"});
+    }
+
+    void StackCodeGenerator::stmt_return(const stmt& s)
+    {
+        if (s.expressions.size() == 0)
+        {
+            AddInstruction({"RET", STR(m_argBytes)});
+            return;
+        }
+
+        const expr& value = s.expressions.front();
+        if (IsTailCall(value, m_argBytes))
+        {
+            // The callee returns directly to our caller, in place of this frame.
+            size_t argBytes = TranslateArguments(value.operands.back(), false);
+            AddInstruction({"TAILCALL", value.operands.front().id.id, STR(m_argBytes), STR(argBytes)});
+            return;
+        }
+
+        TranslateExpression(value);
+        bool isWide = GetDataTypeBytes(value.dataType) == 8;
+        AddInstruction({isWide ? "RET.64" : "RET.32", STR(m_argBytes)});
+    }
+
+    void StackCodeGenerator::stmt_array_bulk(const stmt& s)
+    {
+        for (const expr& e : s.expressions)
+            TranslateExpression(e);
+
+        AddInstruction({GetBulkInstruction(s)});
+    }
+
+    size_t StackCodeGenerator::TranslateArguments(const expr& e, bool hasVariadicArgs)
+    {
+        size_t argBytes = 0;
+        for (auto it = e.operands.begin(); it != e.operands.end(); ++it)
+        {
+            TranslateExpression(*it);
+            argBytes += GetDataTypeBytes(it->dataType);
+        }
+
+        // The system arguments are only given once all of them are pushed, since 
+        // calls within the arguments would otherwise give their own in between.
+        for (auto it = e.operands.begin(); it != e.operands.end() && hasVariadicArgs; ++it)
+            AddInstruction({"SARG", STR(GetSystemArgFlags(it->dataType))});
+
+        return argBytes;
+    }
+
+
+    void StackCodeGenerator::expr_id(const expr& e)
+    {
+        identifier_type idType = e.id.type;
+        int32_t dataTypeSize = GetDataTypeBytes(e.dataType);
+        std::string instr;
+
+        if (idType == identifier_type::ARG_VAR)
+            instr = "LDA";
+        else if (idType == identifier_type::LOCAL_VAR)
+            instr = "LDL";
+        else
+            RETURN_ERROR();
+
+        if (dataTypeSize == 8) // If 64-bit data type.
+            instr.append(".64");
+
+        AddInstruction({instr, GetOffset(e.id)});
+    }
+
+    void StackCodeGenerator::expr_id_offset(const expr& e)
+    {
+        TranslateExpression(e.operands.front());
+        
+        const expr& index = e.operands.back();
+        if (index.intValue > 0 || index.type != expr_type::NUMBER)
+        {
+            TranslateExpression(index);
+            AddInstruction({"ADD"});
+        }
+        
         // Don't load from mem if it's a string. Strings are just pointers.
         if (e.operands.front().dataType != DataType::STRING) 
         {
@@ -467,6 +1027,26 @@ namespace Compiler
     void StackCodeGenerator::expr_arithmetic(const expr& e)
     {
         TranslateExpression(e.operands.front());
+
+        // Strings are concatenated into a new string on the heap. A literal on the 
+        // right hand side is read directly from the program data.
+        if (e.dataType == DataType::STRING)
+        {
+            if (e.type != expr_type::ADD)
+                RETURN_ERROR();
+
+            const expr& rhs = e.operands.back();
+            const auto it = rhs.type == expr_type::STRING ? m_literals.find(rhs.strValue) : m_literals.end();
+            if (it != m_literals.end())
+                AddInstruction({"STRCAT", it->second});
+            else
+            {
+                TranslateExpression(rhs);
+                AddInstruction({"STRCMB"});
+            }
+            return;
+        }
+
         TranslateExpression(e.operands.back());
 
         std::string instr;
@@ -541,22 +1121,30 @@ namespace Compiler
         const expr& args = e.operands.back();
 
         auto funcIt = std::find_if(m_funcList.begin(), m_funcList.end(),
-            [=](const Compiler::func& f) { return f.id.id == func.id.id;});
+            [&](const Compiler::func& f) { return f.id.id == func.id.id;});
 
-        bool hasVariadicArgs = false;
-        if (funcIt != m_funcList.end())
-            hasVariadicArgs = HasVariadicArguments(*funcIt);
-
-        for (auto it = args.operands.begin(); it != args.operands.end(); ++it)
+        // The accumulator of fma(a, b, c) goes below the factors.
+        std::string mathInstr = GetMathInstruction(e);
+        if (!mathInstr.empty())
         {
-            TranslateExpression(*it);
+            if (mathInstr.compare(0, 3, "FMA") == 0)
+                TranslateExpression(args.operands.back());
+
+            for (size_t i = 0; i < args.operands.size() && i < 2; i++)
+                TranslateExpression(args.operands[i]);
 
-            if (hasVariadicArgs)
-                AddInstruction({"SARG", STR(GetDataTypeBytes(it->dataType))});
+            AddInstruction({mathInstr});
+            return;
         }
 
-        std::string label = func.id.id;
-        if (label[0] = '_' && label[1] == '_')
+        bool hasVariadicArgs = false;
+        if (funcIt != m_funcList.end())
+            hasVariadicArgs = HasVariadicArguments(*funcIt);
+
+        TranslateArguments(args, hasVariadicArgs);
+
+        const std::string& label = func.id.id;
+        if (label[0] == '_' && label[1] == '_')
             AddInstruction({"SCALL", label});
         else
             AddInstruction({"CALL", label});
@@ -583,109 +1171,123 @@ namespace Compiler
     {
         TranslateExpression(e.operands.front());
 
-        DataType from = e.operands.front().dataType;
-        DataType to = e.dataType;
-        std::string instr = "";
-        std::string arg = "";
-        const expr* argExpr = nullptr;
-        if (&e.operands.back() != &e.operands.front()) // If an arg was given.
-            argExpr = &e.operands.back();
-
-        if (from == DataType::INT)
-        {
-            switch (to)
-            {
-                case DataType::INT:    return; // Ignore
-                case DataType::LONG:   instr = "ITOL"; break;
-                case DataType::FLOAT:  instr = "ITOF"; break;
-                case DataType::DOUBLE: instr = "ITOD"; break;
-                case DataType::STRING: instr = "ITOS"; break;
-            }
-        }
-        else if (from == DataType::LONG)
+        std::string instr;
+        std::string arg;
+        if (!GetCastInstruction(e, instr, arg))
         {
-            switch (to)
-            {
-                case DataType::LONG:   return; // Ignore
-                case DataType::INT:    instr = "LTOI"; break;
-                case DataType::FLOAT:  instr = "LTOF"; break;
-                case DataType::DOUBLE: instr = "LTOD"; break;
-                case DataType::STRING: instr = "LTOS"; break;
-            }
+            RETURN_ERROR();   
         }
-        else if (from == DataType::FLOAT)
+        else if (instr != "")
         {
-            switch (to)
-            {
-                case DataType::FLOAT:  return; // Ignore
-                case DataType::INT:    instr = "FTOI"; break;
-                case DataType::LONG:   instr = "FTOL"; break;
-                case DataType::DOUBLE: instr = "FTOD"; break;
-                case DataType::STRING: instr = "FTOS";
-                    arg = argExpr ? std::to_string(argExpr->intValue) : "255"; // Set to VM default.
-                    break;
-            }
+            if (arg == "")
+                AddInstruction({instr});
+            else
+                AddInstruction({instr, arg});
         }
-        else if (from == DataType::DOUBLE)
+    }
+
+    void StackCodeGenerator::expr_select(const expr& e)
+    {
+        // SEL takes the condition on top of both values.
+        TranslateExpression(e.operands[1]);
+        TranslateExpression(e.operands[2]);
+        TranslateExpression(e.operands[0]);
+
+        if (GetDataTypeBytes(e.dataType) == 8)
+            AddInstruction({"SEL.64"});
+        else
+            AddInstruction({"SEL"});
+    }
+
+    //---- RegisterCodeGenerator Implementation ----//
+
+    // Registers R0-R30 are allocated, R31 is CPR.
+    static constexpr int32_t REGISTER_COUNT = 31;
+
+    // If anything is spilled, the last 6 registers are kept for loading spilled values, 
+    // which is enough for 3 operands of 64 bits each.
+    static constexpr int32_t SPILL_REGISTER_BEGIN = 25;
+
+    // Returns the index of a virtual register operand, e.g. 12 for "%12", or -1.
+    static int32_t GetVirtualIndex(const std::string& operand)
+    {
+        if (operand.size() < 2 || operand[0] != '%')
+            return -1;
+
+        return std::stoi(operand.substr(1));
+    }
+
+    // Gets the virtual registers that are written to and read from by the instruction.
+    static void GetDefsAndUses(const Instruction& instr, std::vector<int32_t>& defs, std::vector<int32_t>& uses)
+    {
+        // Instructions that only read their first operand. Comparisons write to CPR.
+        static const std::set<std::string> readsFirst = {
+            "STM", "STMI", "STLX", "MOVS", "DEL", "STL", "STA", "OR", "AND", "ORI", "ANDI",
+            "MEMCPY", "MEMMOVE", "MEMSET", "FILL"
+        };
+
+        defs.clear();
+        uses.clear();
+
+        const std::string& opcode = instr.operands.front();
+        std::string base = opcode.substr(0, opcode.find('.'));
+        for (size_t i = 1; i < instr.operands.size(); i++)
         {
-            switch (to)
+            int32_t vreg = GetVirtualIndex(instr.operands[i]);
+            if (vreg < 0)
+                continue;
+
+            if (i > 1 || readsFirst.count(base) > 0 || base.compare(0, 2, "CP") == 0)
             {
-                case DataType::DOUBLE: return; // Ignore
-                case DataType::INT:    instr = "DTOI"; break;
-                case DataType::FLOAT:  instr = "DTOF"; break;
-                case DataType::LONG:   instr = "DTOL"; break;
-                case DataType::STRING: instr = "DTOS";
-                    arg = argExpr ? std::to_string(argExpr->intValue) : "255"; // Set to VM default.
-                    break;
+                uses.push_back(vreg);
+                continue;
             }
-        }
-        else if (from == DataType::STRING)
-        {
-            // Needs to process arg if present, otherwise use a default.
-            switch (to)
-            {
-                // Special case: if explicity casting a string to a string, then copy it into a new string.
-                // The arg specifies how many characters to copy. This can be used for substring functionality.
-                case DataType::STRING: instr = "STRCPY";
-                    arg = argExpr ? std::to_string(argExpr->intValue+1) : "2147483647";
-                    break; 
 
-                case DataType::INT: instr = "STOI"; 
-                    arg = argExpr ? std::to_string(argExpr->intValue) : "0";
-                    break;
+            defs.push_back(vreg);
+            if (base == "NEG" || base == "INV" || base == "FMA") // Operates in place.
+                uses.push_back(vreg);
+        }
+    }
 
-                case DataType::FLOAT: instr = "STOF";
-                    arg = argExpr ? std::to_string(argExpr->floatValue) : "0.0f";
-                    break;
+    // Returns the index of the instruction that is jumped to, or -1.
+    static int32_t GetJumpTarget(const Instruction& instr)
+    {
+        if (instr.jumpAfter > -1)
+            return instr.jumpAfter + 1;
 
-                case DataType::LONG: instr = "STOL";
-                    arg = argExpr ? std::to_string(argExpr->longValue) : "0";
-                    break;
+        return instr.jumpTo;
+    }
 
-                case DataType::DOUBLE: instr = "STOD";
-                    arg = argExpr ? std::to_string(argExpr->doubleValue) : "0.0";
-                    break;
-            }
-        }
+    static bool IsFallingThrough(const Instruction& instr)
+    {
+        const std::string& opcode = instr.operands.front();
+        return opcode != "JMP" && opcode != "EXIT" && opcode != "TAILCALL" && 
+            opcode.compare(0, 3, "RET") != 0;
+    }
 
-        if (instr != "")
-        {
-            if (arg == "")
-                AddInstruction({instr});
-            else
-                AddInstruction({instr, arg});
-        }
-        else
+    static std::string GetTypeSuffix(DataType dataType)
+    {
+        switch (dataType)
         {
-            RETURN_ERROR();   
+            case DataType::FLOAT:  return ".F";
+            case DataType::DOUBLE: return ".F64";
+            case DataType::LONG:   return ".64";
+            default:               return "";
         }
     }
 
-    //---- RegisterCodeGenerator Implementation ----//
-  
+    static std::string GetSizeSuffix(DataType dataType)
+    {
+        return GetDataTypeBytes(dataType) == 8 ? ".64" : "";
+    }
+
     RegisterCodeGenerator::RegisterCodeGenerator(uint32_t initialHeapSize, uint32_t maxHeapSize, 
-        const std::vector<func>& funcList, const StringLiteralMap& literals) :
-        CodeGenerator(initialHeapSize, maxHeapSize, funcList, literals)
+        const std::vector<func>& funcList, const StringLiteralMap& literals, bool hasWideRegisters) :
+        CodeGenerator(initialHeapSize, maxHeapSize, funcList, literals),
+        m_spillOffset(FIRST_LOCAL_OFFSET),
+        m_argBytes(0),
+        m_nextCall(0),
+        m_hasWideRegisters(hasWideRegisters)
     {
     }
 
@@ -693,79 +1295,1058 @@ namespace Compiler
     {
     }
 
-    void RegisterCodeGenerator::stmt_assignment(const stmt& s)
+    void RegisterCodeGenerator::BeginFunction(const func& function)
     {
-        RETURN_ERROR();
+        m_isWide.clear();
+        m_isVariable.clear();
+        m_argOffset.clear();
+        m_variables.clear();
+        m_frameArrays.clear();
+        m_argBytes = 0;
+
+        // Arrays in the frame come first, and spilled registers after them.
+        m_spillOffset = PlaceFrameArrays(function, FIRST_LOCAL_OFFSET, m_frameArrays);
+
+        // Load the arguments into registers. The last argument is closest to the frame.
+        for (auto argIt = function.args.rbegin(); argIt != function.args.rend(); ++argIt)
+        {
+            m_argBytes += GetDataTypeBytes(argIt->id.dataType);
+            const std::string& var = GetVariable(argIt->id);
+            m_argOffset[GetVirtualIndex(var)] = static_cast<int32_t>(m_argBytes);
+            AddInstruction({"LDA" + GetSizeSuffix(argIt->id.dataType), var, STR(m_argBytes)});
+        }
     }
 
-    void RegisterCodeGenerator::stmt_func_call(const stmt& s)
+    void RegisterCodeGenerator::EndFunction(const func& /*function*/)
     {
-        RETURN_ERROR();
+        std::vector<Instruction>& instructions = GetFuncInstructions();
+        std::vector<RegisterSet> liveIn;
+        std::vector<RegisterSet> liveOut;
+
+        do
+        {
+            ComputeLiveness(instructions, liveIn, liveOut);
+        } while (RemoveDeadCode(instructions, liveOut));
+
+        std::vector<LiveInterval> intervals = BuildIntervals(instructions, liveIn, liveOut);
+
+        // Only keep registers for spilled values if needed.
+        std::vector<int32_t> location;
+        if (!LinearScan(intervals, REGISTER_COUNT, location))
+            LinearScan(intervals, SPILL_REGISTER_BEGIN, location);
+
+        RewriteInstructions(instructions, location, liveIn, liveOut);
     }
 
-    void RegisterCodeGenerator::stmt_branch(const stmt& s)
+    void RegisterCodeGenerator::stmt_assignment(const stmt& s)
     {
-        RETURN_ERROR();
+        if (s.type == stmt_type::ASSIGN_OFFSET)
+        {
+            const expr& index = s.expressions.front();
+            const expr& value = s.expressions.back();
+            DataType valueType = ARRAY_TO_BASE(s.id.dataType);
+            int32_t elementSize = s.id.dataType == DataType::STRING ? 1 : GetDataTypeBytes(valueType);
+            std::string instr = "STM" + GetSizeSuffix(valueType);
+
+            int32_t frameOffset = GetFrameArray(s.id);
+            std::string array = frameOffset < 0 ? GetVariable(s.id) : "";
+            std::string valueReg = TranslateValue(value);
+            int64_t constIndex;
+            if (frameOffset > -1 && EvaluateConstant(index, constIndex))
+            {
+                AddInstruction({"STL" + GetSizeSuffix(valueType), STR(frameOffset + constIndex * elementSize), valueReg});
+                return;
+            }
+            else if (index.type == expr_type::NUMBER)
+            {
+                AddInstruction({instr.insert(3, "I"), array, valueReg, STR(index.intValue * elementSize)});
+                return;
+            }
+
+            std::string offset = TranslateValue(index);
+            if (elementSize > 1)
+            {
+                std::string scaled = NewRegister(DataType::INT);
+                AddInstruction({"MULI", scaled, offset, STR(elementSize)});
+                offset = scaled;
+            }
+
+            if (frameOffset > -1)
+            {
+                AddInstruction({"STLX" + GetSizeSuffix(valueType), offset, valueReg, STR(frameOffset)});
+                return;
+            }
+
+            std::string address = NewRegister(DataType::INT);
+            AddInstruction({"ADD", address, array, offset});
+            AddInstruction({instr, address, valueReg});
+            return;
+        }
+
+        const std::string& var = GetVariable(s.id);
+        std::string value = TranslateValue(s.expressions.front());
+
+        // Let the instruction that computed a temporary value write to the variable directly.
+        Instruction* last = GetFuncInstr(m_lastInstr);
+        int32_t vreg = GetVirtualIndex(value);
+        if (last && vreg > -1 && !m_isVariable[vreg] && last->operands.size() > 1 && last->operands[1] == value)
+        {
+            std::vector<int32_t> defs;
+            std::vector<int32_t> uses;
+            GetDefsAndUses(*last, defs, uses);
+            if (defs.size() == 1 && std::find(uses.begin(), uses.end(), vreg) == uses.end())
+            {
+                last->operands[1] = var;
+                return;
+            }
+        }
+
+        AddInstruction({"MOV" + GetSizeSuffix(s.id.dataType), var, value});
     }
 
-    void RegisterCodeGenerator::stmt_creation(const stmt& s)
+    void RegisterCodeGenerator::stmt_func_call(const stmt& s)
     {
-        RETURN_ERROR();
+        TranslateExpression(s.expressions.front());
     }
 
-    void RegisterCodeGenerator::stmt_destruction(const stmt& s)
+    void RegisterCodeGenerator::stmt_branch(const stmt& s)
     {
-        RETURN_ERROR();
+        const stmt& ifStmt = s.substmts.front();
+        const expr& ifCond = ifStmt.expressions.front();
+
+        // Branch to the else block, or to the end, if the condition is false.
+        int32_t condBranchInstr = AddInstruction({TranslateCondition(ifCond)});
+
+        auto stmtIt = ifStmt.substmts.begin();
+        while (stmtIt != ifStmt.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        if (s.substmts.size() < 2)
+        {
+            GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
+            return;
+        }
+
+        int32_t jumpToEnd = AddInstruction({"JMP"});
+        GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
+
+        const stmt& elseStmt = s.substmts.back();
+        stmtIt = elseStmt.substmts.begin();
+        while (stmtIt != elseStmt.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        GetFuncInstr(jumpToEnd)->jumpAfter = m_lastInstr;
     }
 
-    void RegisterCodeGenerator::stmt_return(const stmt& s)
+    void RegisterCodeGenerator::stmt_loop(const stmt& s)
     {
-        RETURN_ERROR();
-    }
+        int32_t condInstr = static_cast<int32_t>(GetFuncInstructions().size());
 
+        // Leave the loop if the condition is false.
+        int32_t condBranchInstr = AddInstruction({TranslateCondition(s.expressions.front())});
 
-    void RegisterCodeGenerator::expr_id(const expr& e)
-    {
-        RETURN_ERROR();
+        auto stmtIt = s.substmts.begin();
+        while (stmtIt != s.substmts.end())
+            TranslateStatement(*stmtIt++);
+
+        GetFuncInstr(AddInstruction({"JMP"}))->jumpTo = condInstr;
+        GetFuncInstr(condBranchInstr)->jumpAfter = m_lastInstr;
     }
 
-    void RegisterCodeGenerator::expr_id_offset(const expr& e)
+    void RegisterCodeGenerator::stmt_creation(const stmt& s)
     {
-        RETURN_ERROR();
+        // Arrays in the frame are reserved along with the other locals.
+        if (GetFrameArray(s.id) > -1)
+            return;
+
+        const expr& size = s.expressions.front();
+        const std::string& var = GetVariable(s.id);
+
+        if (size.type == expr_type::NUMBER && size.dataType == DataType::INT)
+            AddInstruction({"NEWI", var, STR(size.intValue)});
+        else
+            AddInstruction({"NEW", var, TranslateValue(size)});
     }
 
-    void RegisterCodeGenerator::expr_literal(const expr& e)
+    void RegisterCodeGenerator::stmt_destruction(const stmt& s)
     {
-        RETURN_ERROR();
+        AddInstruction({"DEL", GetVariable(s.id)});
     }
 
-    void RegisterCodeGenerator::expr_arithmetic(const expr& e)
+    void RegisterCodeGenerator::stmt_return(const stmt& s)
     {
-        RETURN_ERROR();
+        if (s.expressions.size() == 0)
+        {
+            AddInstruction({"RET", STR(m_argBytes)});
+            return;
+        }
+
+        const expr& value = s.expressions.front();
+        if (IsTailCall(value, m_argBytes))
+        {
+            // The callee returns directly to our caller, in place of this frame. Nothing
+            // is live after the call, so no registers are saved around it.
+            const expr& args = value.operands.back();
+            std::vector<std::string> argRegs;
+            for (const expr& arg : args.operands)
+                argRegs.push_back(TranslateValue(arg));
+
+            size_t argBytes = 0;
+            for (size_t i = 0; i < argRegs.size(); i++)
+            {
+                DataType dataType = args.operands[i].dataType;
+                AddInstruction({"MOVS" + GetSizeSuffix(dataType), argRegs[i]});
+                argBytes += GetDataTypeBytes(dataType);
+            }
+
+            AddInstruction({"TAILCALL", value.operands.front().id.id, STR(m_argBytes), STR(argBytes)});
+            return;
+        }
+
+        bool isWide = GetDataTypeBytes(value.dataType) == 8;
+
+        AddInstruction({isWide ? "MOVS.64" : "MOVS", TranslateValue(value)});
+        AddInstruction({isWide ? "RET.64" : "RET.32", STR(m_argBytes)});
     }
 
-    void RegisterCodeGenerator::expr_logical(const expr& e)
+    void RegisterCodeGenerator::stmt_array_bulk(const stmt& s)
     {
-        RETURN_ERROR();
+        std::string dst = TranslateValue(s.expressions[0]);
+        std::string arg = TranslateValue(s.expressions[1]);
+        std::string size = TranslateValue(s.expressions[2]);
+        AddInstruction({GetBulkInstruction(s), dst, arg, size});
     }
 
-    void RegisterCodeGenerator::expr_comparison(const expr& e)
+
+    void RegisterCodeGenerator::expr_id(const expr& e)
     {
-        RETURN_ERROR();
+        m_result = GetVariable(e.id);
     }
 
-    void RegisterCodeGenerator::expr_func_call(const expr& e)
+    void RegisterCodeGenerator::expr_id_offset(const expr& e)
     {
-        RETURN_ERROR();
+        const expr& index = e.operands.back(); // Already scaled to bytes by the parser.
+        const expr& base = e.operands.front();
+
+        int32_t frameOffset = base.type == expr_type::ID ? GetFrameArray(base.id) : -1;
+        if (frameOffset > -1)
+        {
+            std::string suffix = GetSizeSuffix(e.dataType);
+            int64_t constIndex;
+            if (EvaluateConstant(index, constIndex))
+            {
+                m_result = NewRegister(e.dataType);
+                AddInstruction({"LDL" + suffix, m_result, STR(frameOffset + constIndex)});
+                return;
+            }
+
+            std::string offset = TranslateValue(index);
+            m_result = NewRegister(e.dataType);
+            AddInstruction({"LDLX" + suffix, m_result, offset, STR(frameOffset)});
+            return;
+        }
+
+        std::string array = TranslateValue(base);
+        bool isString = e.operands.front().dataType == DataType::STRING;
+
+        // Strings are just pointers, so indexing gives the rest of the string.
+        if (index.type == expr_type::NUMBER)
+        {
+            if (isString && index.intValue == 0)
+            {
+                m_result = array;
+                return;
+            }
+
+            m_result = NewRegister(e.dataType);
+            if (isString)
+                AddInstruction({"ADDI", m_result, array, STR(index.intValue)});
+            else
+                AddInstruction({"LDMI" + GetSizeSuffix(e.dataType), m_result, array, STR(index.intValue)});
+
+            return;
+        }
+
+        std::string address = NewRegister(DataType::INT);
+        AddInstruction({"ADD", address, array, TranslateValue(index)});
+
+        if (isString)
+        {
+            m_result = address;
+            return;
+        }
+
+        m_result = NewRegister(e.dataType);
+        AddInstruction({"LDM" + GetSizeSuffix(e.dataType), m_result, address});
     }
 
-    void RegisterCodeGenerator::expr_unary(const expr& e)
+    void RegisterCodeGenerator::expr_literal(const expr& e)
     {
-        RETURN_ERROR();
+        m_result = NewRegister(e.dataType);
+
+        if (e.dataType == DataType::INT)
+        {
+            AddInstruction({"LDI", m_result, STR(e.intValue)});
+        }
+        else if (e.dataType == DataType::LONG)
+        {
+            AddInstruction({"LDI.64", m_result, STR(e.longValue)});
+        }
+        else if (e.dataType == DataType::STRING)
+        {
+            const auto it = m_literals.find(e.strValue);
+            if (it != m_literals.end())
+                AddInstruction({"STR", m_result, it->second});
+            else
+                RETURN_ERROR();
+        }
+        else
+            RETURN_ERROR();
     }
 
-    void RegisterCodeGenerator::expr_cast(const expr& e)
+    void RegisterCodeGenerator::expr_arithmetic(const expr& e)
     {
-        RETURN_ERROR();
+        const expr* lhs = &e.operands.front();
+        const expr* rhs = &e.operands.back();
+
+        std::string instr;
+        if      (e.type == expr_type::ADD) instr = "ADD";
+        else if (e.type == expr_type::SUB) instr = "SUB";
+        else if (e.type == expr_type::MUL) instr = "MUL";
+        else if (e.type == expr_type::DIV) instr = "DIV";
+        else    RETURN_ERROR();
+
+        // Strings are concatenated into a new string on the heap. A literal on the 
+        // right hand side is read directly from the program data.
+        if (e.dataType == DataType::STRING)
+        {
+            if (e.type != expr_type::ADD)
+                RETURN_ERROR();
+
+            std::string lhsReg = TranslateValue(*lhs);
+            std::string result = NewRegister(DataType::STRING);
+
+            const auto it = rhs->type == expr_type::STRING ? m_literals.find(rhs->strValue) : m_literals.end();
+            if (it != m_literals.end())
+                AddInstruction({"STRCAT", result, lhsReg, it->second});
+            else
+            {
+                std::string rhsReg = TranslateValue(*rhs);
+                AddInstruction({"STRCMB", result, lhsReg, rhsReg});
+            }
+
+            m_result = result;
+            return;
+        }
+
+        // Put literals on the right hand side, where they can be immediate values.
+        bool isCommutative = e.type == expr_type::ADD || e.type == expr_type::MUL;
+        if (isCommutative && lhs->type == expr_type::NUMBER)
+            std::swap(lhs, rhs);
+
+        std::string lhsReg = TranslateValue(*lhs);
+        m_result = NewRegister(e.dataType);
+
+        if (rhs->type == expr_type::NUMBER && rhs->dataType == e.dataType)
+        {
+            if (e.dataType == DataType::INT)
+            {
+                AddInstruction({instr + "I", m_result, lhsReg, STR(rhs->intValue)});
+                return;
+            }
+            else if (e.dataType == DataType::LONG)
+            {
+                AddInstruction({instr + "I.64", m_result, lhsReg, STR(rhs->longValue)});
+                return;
+            }
+        }
+
+        std::string result = m_result;
+        std::string rhsReg = TranslateValue(*rhs);
+        AddInstruction({instr + GetTypeSuffix(e.dataType), result, lhsReg, rhsReg});
+        m_result = result;
+    }
+
+    void RegisterCodeGenerator::expr_comparison(const expr& e)
+    {
+        bool isInverted = TranslateComparison(e);
+        if (isInverted)
+            AddInstruction({"CPZ", "R31"});
+
+        m_result = NewRegister(DataType::INT);
+        AddInstruction({"MOV", m_result, "R31"});
+    }
+
+    void RegisterCodeGenerator::expr_logical(const expr& e)
+    {
+        expr_comparison(e);
+    }
+
+    void RegisterCodeGenerator::expr_func_call(const expr& e)
+    {
+        const expr& func = e.operands.front();
+        const expr& args = e.operands.back();
+
+        auto funcIt = std::find_if(m_funcList.begin(), m_funcList.end(),
+            [&](const Compiler::func& f) { return f.id.id == func.id.id;});
+
+        if (funcIt == m_funcList.end())
+        {
+            RETURN_ERROR();
+            return;
+        }
+
+        const std::string& label = func.id.id;
+        bool isSystemCall = label.size() > 2 && label[0] == '_' && label[1] == '_';
+
+        // Evaluate all arguments before pushing any of them, since calls within them
+        // would otherwise push their own arguments, and system arguments, in between.
+        std::vector<std::string> argRegs;
+        for (auto it = args.operands.begin(); it != args.operands.end(); ++it)
+            argRegs.push_back(TranslateValue(*it));
+
+        // Math functions write their result directly. FMA adds to its first operand.
+        std::string mathInstr = GetMathInstruction(e);
+        if (!mathInstr.empty())
+        {
+            std::vector<std::string> operands = {mathInstr, NewRegister(e.dataType)};
+            if (mathInstr.compare(0, 3, "FMA") == 0)
+            {
+                AddInstruction({"MOV" + GetSizeSuffix(e.dataType), operands.back(), argRegs.back()});
+                argRegs.pop_back();
+            }
+
+            operands.insert(operands.end(), argRegs.begin(), argRegs.end());
+            m_result = operands[1];
+            AddInstruction(std::move(operands));
+            return;
+        }
+
+        int32_t call = m_nextCall++;
+        if (!isSystemCall)
+            AddInstruction({"SAVE", STR(call)});
+
+        for (size_t i = 0; i < argRegs.size(); i++)
+        {
+            DataType dataType = args.operands[i].dataType;
+            AddInstruction({"MOVS" + GetSizeSuffix(dataType), argRegs[i]});
+
+            if (isSystemCall)
+                AddInstruction({"SARG", STR(GetSystemArgFlags(dataType))});
+        }
+
+        AddInstruction({isSystemCall ? "SCALL" : "CALL", label});
+
+        // The return value is left on the stack.
+        m_result = "";
+        if (funcIt->returnType != DataType::UNDEFINED)
+        {
+            m_result = NewRegister(funcIt->returnType);
+            AddInstruction({"POP" + GetSizeSuffix(funcIt->returnType), m_result});
+        }
+
+        if (!isSystemCall)
+            AddInstruction({"RESTORE", STR(call)});
+    }
+
+    void RegisterCodeGenerator::expr_unary(const expr& e)
+    {
+        const expr& operand = e.operands.front();
+        DataType dataType = operand.dataType;
+
+        if (e.type != expr_type::NEG)
+        {
+            RETURN_ERROR();
+            return;
+        }
+
+        if (operand.type == expr_type::NUMBER && dataType == DataType::INT)
+        {
+            m_result = NewRegister(dataType);
+            AddInstruction({"LDI", m_result, STR(-operand.intValue)});
+            return;
+        }
+
+        if (operand.type == expr_type::NUMBER && dataType == DataType::LONG)
+        {
+            m_result = NewRegister(dataType);
+            AddInstruction({"LDI.64", m_result, STR(-operand.longValue)});
+            return;
+        }
+
+        // NEG works in place, so don't touch the register of a variable.
+        std::string value = TranslateValue(operand);
+        m_result = NewRegister(dataType);
+        AddInstruction({"MOV" + GetSizeSuffix(dataType), m_result, value});
+        AddInstruction({"NEG" + GetTypeSuffix(dataType), m_result});
+    }
+
+    void RegisterCodeGenerator::expr_cast(const expr& e)
+    {
+        std::string value = TranslateValue(e.operands.front());
+
+        std::string instr;
+        std::string arg;
+        if (!GetCastInstruction(e, instr, arg))
+        {
+            RETURN_ERROR();
+        }
+        else if (instr == "")
+        {
+            m_result = value;
+        }
+        else
+        {
+            m_result = NewRegister(e.dataType);
+            if (arg == "")
+                AddInstruction({instr, m_result, value});
+            else
+                AddInstruction({instr, m_result, value, arg});
+        }
+    }
+
+    void RegisterCodeGenerator::expr_select(const expr& e)
+    {
+        // Compute the values first, so that nothing overwrites CPR before SEL reads it.
+        std::string ifTrue = TranslateValue(e.operands[1]);
+        std::string ifFalse = TranslateValue(e.operands[2]);
+        if (TranslateCondition(e.operands[0]) == "BRNZ") // CPR holds the inverse of the condition.
+            std::swap(ifTrue, ifFalse);
+
+        m_result = NewRegister(e.dataType);
+        AddInstruction({"SEL" + GetSizeSuffix(e.dataType), m_result, ifTrue, ifFalse});
+    }
+
+    std::string RegisterCodeGenerator::NewRegister(DataType dataType)
+    {
+        m_isWide.push_back(GetDataTypeBytes(dataType) == 8);
+        m_isVariable.push_back(false);
+        m_argOffset.push_back(-1);
+        return "%" + STR(m_isWide.size() - 1);
+    }
+
+    const std::string& RegisterCodeGenerator::GetVariable(const identifier& id)
+    {
+        auto key = std::make_pair(id.type, id.position);
+        auto it = m_variables.find(key);
+        if (it != m_variables.end())
+            return it->second;
+
+        std::string vreg = NewRegister(id.dataType);
+        m_isVariable.back() = true;
+        return m_variables.emplace(key, vreg).first->second;
+    }
+
+    int32_t RegisterCodeGenerator::GetFrameArray(const identifier& id) const
+    {
+        if (id.type != identifier_type::LOCAL_VAR)
+            return -1;
+
+        auto it = m_frameArrays.find(id.position);
+        return it != m_frameArrays.end() ? it->second : -1;
+    }
+
+    std::string RegisterCodeGenerator::TranslateValue(const expr& e)
+    {
+        m_result = "";
+        TranslateExpression(e);
+
+        // Keep going with a dummy register after an error, to report as many as possible.
+        if (m_result == "")
+            m_result = NewRegister(e.dataType);
+
+        return m_result;
+    }
+
+    bool RegisterCodeGenerator::TranslateComparison(const expr& e)
+    {
+        const expr& lhs = e.operands.front();
+        const expr& rhs = e.operands.back();
+
+        if (e.type == expr_type::OR || e.type == expr_type::AND)
+        {
+            std::string instr = e.type == expr_type::OR ? "OR" : "AND";
+            std::string lhsReg = TranslateValue(lhs);
+
+            if (rhs.type == expr_type::NUMBER && rhs.dataType == DataType::INT)
+                AddInstruction({instr + "I", lhsReg, STR(rhs.intValue)});
+            else
+                AddInstruction({instr, lhsReg, TranslateValue(rhs)});
+
+            return false;
+        }
+
+        if (lhs.dataType == DataType::STRING)
+        {
+            if (rhs.dataType != DataType::STRING)
+            {
+                RETURN_ERROR();
+                return false;
+            }
+
+            std::string lhsReg = TranslateValue(lhs);
+            std::string rhsReg = TranslateValue(rhs);
+            switch (e.type)
+            {
+                case expr_type::EQ:    AddInstruction({"CPSTR", lhsReg, rhsReg}); return false;
+                case expr_type::NEQ:   AddInstruction({"CPSTR", lhsReg, rhsReg}); return true;
+                case expr_type::STREQ: AddInstruction({"CPCHR", lhsReg, rhsReg}); return false;
+                default:               RETURN_ERROR(); return false;
+            }
+        }
+
+        // Compare against zero, or other 32-bit literals, without loading them.
+        bool isEquality = e.type == expr_type::EQ || e.type == expr_type::NEQ;
+        if (isEquality && rhs.type == expr_type::NUMBER)
+        {
+            if (rhs.dataType == DataType::INT)
+            {
+                std::string lhsReg = TranslateValue(lhs);
+                if (rhs.intValue == 0)
+                    AddInstruction({"CPZ", lhsReg});
+                else
+                    AddInstruction({"CPI", lhsReg, STR(rhs.intValue)});
+
+                // CPZ is true if equal to zero.
+                return (e.type == expr_type::NEQ);
+            }
+            else if (rhs.dataType == DataType::LONG && rhs.longValue == 0)
+            {
+                AddInstruction({"CPZ.64", TranslateValue(lhs)});
+                return (e.type == expr_type::NEQ);
+            }
+        }
+
+        std::string instr;
+        if      (e.type == expr_type::EQ)    instr = "CPEQ";
+        else if (e.type == expr_type::NEQ)   instr = "CPNQ";
+        else if (e.type == expr_type::GT)    instr = "CPGT";
+        else if (e.type == expr_type::LT)    instr = "CPLT";
+        else if (e.type == expr_type::GEQ)   instr = "CPGQ";
+        else if (e.type == expr_type::LEQ)   instr = "CPLQ";
+        else
+        {
+            RETURN_ERROR();
+            return false;
+        }
+
+        std::string lhsReg = TranslateValue(lhs);
+        std::string rhsReg = TranslateValue(rhs);
+        AddInstruction({instr + GetTypeSuffix(lhs.dataType), lhsReg, rhsReg});
+        return false;
+    }
+
+    std::string RegisterCodeGenerator::TranslateCondition(const expr& e)
+    {
+        switch (e.type)
+        {
+            case expr_type::EQ:
+            case expr_type::NEQ:
+            case expr_type::GT:
+            case expr_type::LT:
+            case expr_type::GEQ:
+            case expr_type::LEQ:
+            case expr_type::STREQ:
+            case expr_type::OR:
+            case expr_type::AND: 
+                return TranslateComparison(e) ? "BRNZ" : "BRZ";
+
+            default: break;
+        }
+
+        // CPZ is true if the value is zero, i.e. the condition is false.
+        std::string value = TranslateValue(e);
+        AddInstruction({"CPZ" + GetSizeSuffix(e.dataType), value});
+        return "BRNZ";
+    }
+
+    //---- Register allocation ----//
+
+    void RegisterCodeGenerator::ComputeLiveness(const std::vector<Instruction>& instructions,
+        std::vector<RegisterSet>& liveIn, std::vector<RegisterSet>& liveOut) const
+    {
+        size_t count = instructions.size();
+        size_t vregCount = m_isWide.size();
+        liveIn.assign(count, RegisterSet(vregCount, false));
+        liveOut.assign(count, RegisterSet(vregCount, false));
+
+        std::vector<std::vector<int32_t>> defs(count);
+        std::vector<std::vector<int32_t>> uses(count);
+        for (size_t i = 0; i < count; i++)
+            GetDefsAndUses(instructions[i], defs[i], uses[i]);
+
+        // Iterate backwards until nothing changes. Only loops need more than one pass.
+        bool isChanged = true;
+        while (isChanged)
+        {
+            isChanged = false;
+            for (size_t i = count; i-- > 0;)
+            {
+                RegisterSet out(vregCount, false);
+                const Instruction& instr = instructions[i];
+                int32_t target = GetJumpTarget(instr);
+
+                if (IsFallingThrough(instr) && i + 1 < count)
+                    out = liveIn[i + 1];
+
+                if (target > -1 && static_cast<size_t>(target) < count)
+                {
+                    for (size_t v = 0; v < vregCount; v++)
+                        out[v] = out[v] || liveIn[target][v];
+                }
+
+                RegisterSet in = out;
+                for (int32_t v : defs[i])
+                    in[v] = false;
+
+                for (int32_t v : uses[i])
+                    in[v] = true;
+
+                if (in != liveIn[i] || out != liveOut[i])
+                {
+                    liveIn[i] = std::move(in);
+                    liveOut[i] = std::move(out);
+                    isChanged = true;
+                }
+            }
+        }
+    }
+
+    bool RegisterCodeGenerator::RemoveDeadCode(std::vector<Instruction>& instructions, 
+        const std::vector<RegisterSet>& liveOut)
+    {
+        // Instructions that do nothing but write to their first operand.
+        static const std::set<std::string> pure = {
+            "MOV", "MOV.64", "LDI", "LDI.64", "LDA", "LDA.64",
+            "ADD", "SUB", "MUL", "ADDI", "SUBI", "MULI", "ADD.64", "SUB.64", "MUL.64",
+            "SEL", "SEL.64",
+        };
+
+        std::vector<int32_t> newIndex(instructions.size() + 1);
+        std::vector<Instruction> kept;
+        kept.reserve(instructions.size());
+
+        std::vector<int32_t> defs;
+        std::vector<int32_t> uses;
+        for (size_t i = 0; i < instructions.size(); i++)
+        {
+            newIndex[i] = static_cast<int32_t>(kept.size());
+
+            GetDefsAndUses(instructions[i], defs, uses);
+            if (pure.count(instructions[i].operands.front()) > 0 && defs.size() == 1 && !liveOut[i][defs.front()])
+                continue;
+
+            kept.push_back(std::move(instructions[i]));
+        }
+
+        if (kept.size() == instructions.size())
+        {
+            instructions.swap(kept);
+            return false;
+        }
+
+        newIndex[instructions.size()] = static_cast<int32_t>(kept.size());
+        for (Instruction& instr : kept)
+        {
+            int32_t target = GetJumpTarget(instr);
+            if (target > -1)
+            {
+                instr.jumpTo = newIndex[target];
+                instr.jumpAfter = -1;
+            }
+        }
+
+        instructions.swap(kept);
+        return true;
+    }
+
+    std::vector<RegisterCodeGenerator::LiveInterval> RegisterCodeGenerator::BuildIntervals(
+        const std::vector<Instruction>& instructions, const std::vector<RegisterSet>& liveIn, 
+        const std::vector<RegisterSet>& liveOut) const
+    {
+        std::vector<LiveInterval> intervals(m_isWide.size(), {-1, -1, -1});
+
+        auto extend = [&](int32_t vreg, int32_t idx)
+        {
+            LiveInterval& interval = intervals[vreg];
+            if (interval.vreg < 0)
+                interval = {vreg, idx, idx};
+            else
+                interval.end = idx;
+        };
+
+        std::vector<int32_t> defs;
+        std::vector<int32_t> uses;
+        for (int32_t i = 0; i < static_cast<int32_t>(instructions.size()); i++)
+        {
+            GetDefsAndUses(instructions[i], defs, uses);
+            for (int32_t v = 0; v < static_cast<int32_t>(m_isWide.size()); v++)
+            {
+                if (liveIn[i][v] || liveOut[i][v] || std::find(defs.begin(), defs.end(), v) != defs.end())
+                    extend(v, i);
+            }
+        }
+
+        // Remove registers that are never used, and order by the start of the interval.
+        intervals.erase(std::remove_if(intervals.begin(), intervals.end(), 
+            [](const LiveInterval& interval) { return interval.vreg < 0; }), intervals.end());
+
+        std::stable_sort(intervals.begin(), intervals.end(), 
+            [](const LiveInterval& a, const LiveInterval& b) { return a.start < b.start; });
+
+        return intervals;
+    }
+
+    int32_t RegisterCodeGenerator::RegisterWidth(int32_t vreg) const
+    {
+        return m_isWide[vreg] && !m_hasWideRegisters ? 2 : 1;
+    }
+
+    bool RegisterCodeGenerator::LinearScan(const std::vector<LiveInterval>& intervals, int32_t regCount, 
+        std::vector<int32_t>& location) const
+    {
+        location.assign(m_isWide.size(), -1);
+        std::vector<int32_t> owner(regCount, -1); // The virtual register using each register.
+        std::vector<const LiveInterval*> active;
+        bool isAllAllocated = true;
+
+        auto release = [&](const LiveInterval* interval)
+        {
+            int32_t reg = location[interval->vreg];
+            owner[reg] = -1;
+            if (RegisterWidth(interval->vreg) == 2)
+                owner[reg + 1] = -1;
+        };
+
+        auto findFree = [&](int32_t vreg)
+        {
+            int32_t width = RegisterWidth(vreg);
+            for (int32_t reg = 0; reg + width <= regCount; reg++)
+            {
+                if (owner[reg] == -1 && (width == 1 || owner[reg + 1] == -1))
+                    return reg;
+            }
+
+            return -1;
+        };
+
+        for (const LiveInterval& current : intervals)
+        {
+            // Free the registers of intervals that have ended.
+            for (auto it = active.begin(); it != active.end();)
+            {
+                if ((*it)->end < current.start)
+                {
+                    release(*it);
+                    it = active.erase(it);
+                }
+                else
+                    ++it;
+            }
+
+            int32_t reg = findFree(current.vreg);
+
+            // Spill the intervals that end last, until there is room. If the current 
+            // one ends before those, it is spilled itself.
+            while (reg < 0)
+            {
+                auto furthest = std::max_element(active.begin(), active.end(), 
+                    [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; });
+
+                isAllAllocated = false;
+                if (furthest == active.end() || (*furthest)->end <= current.end)
+                    break;
+
+                release(*furthest);
+                location[(*furthest)->vreg] = -1;
+                active.erase(furthest);
+                reg = findFree(current.vreg);
+            }
+
+            if (reg < 0)
+                continue;
+
+            location[current.vreg] = reg;
+            owner[reg] = current.vreg;
+            if (RegisterWidth(current.vreg) == 2)
+                owner[reg + 1] = current.vreg;
+
+            active.push_back(&current);
+        }
+
+        return isAllAllocated;
+    }
+
+    void RegisterCodeGenerator::RewriteInstructions(std::vector<Instruction>& instructions, 
+        const std::vector<int32_t>& location, const std::vector<RegisterSet>& liveIn, 
+        const std::vector<RegisterSet>& liveOut) const
+    {
+        size_t vregCount = m_isWide.size();
+        auto reg = [](int32_t idx) { return "R" + STR(idx); };
+
+        // Arguments that are never assigned to can always be loaded again from the 
+        // frame, instead of being saved around calls or spilled.
+        std::vector<int32_t> defCount(vregCount, 0);
+        std::vector<int32_t> defs;
+        std::vector<int32_t> uses;
+        for (const Instruction& instr : instructions)
+        {
+            GetDefsAndUses(instr, defs, uses);
+            for (int32_t v : defs)
+                ++defCount[v];
+        }
+
+        auto isReloadable = [&](int32_t v) { return m_argOffset[v] > -1 && defCount[v] == 1; };
+        auto reload = [&](int32_t v, int32_t r) -> Instruction
+        { 
+            return {{m_isWide[v] ? "LDA.64" : "LDA", reg(r), STR(m_argOffset[v])}}; 
+        };
+
+        // Give each spilled register a local.
+        std::vector<int32_t> slot(vregCount, -1);
+        int32_t localEnd = m_spillOffset;
+        for (size_t v = 0; v < vregCount; v++)
+        {
+            bool isUsed = false;
+            for (size_t i = 0; i < instructions.size() && !isUsed; i++)
+                isUsed = liveIn[i][v] || liveOut[i][v];
+
+            if (location[v] < 0 && isUsed && !isReloadable(v))
+            {
+                slot[v] = localEnd;
+                localEnd += m_isWide[v] ? 8 : 4;
+            }
+        }
+
+        // Find the registers that must be saved around each call. These are the ones
+        // that are live both before the arguments are pushed, and after the call.
+        std::map<std::string, std::vector<int32_t>> saved;
+        std::map<std::string, size_t> saveIndex;
+        for (size_t i = 0; i < instructions.size(); i++)
+        {
+            const std::vector<std::string>& operands = instructions[i].operands;
+            if (operands.front() == "SAVE")
+                saveIndex[operands[1]] = i;
+            else if (operands.front() == "RESTORE")
+            {
+                std::vector<int32_t>& regs = saved[operands[1]];
+                size_t save = saveIndex[operands[1]];
+                for (size_t v = 0; v < vregCount; v++)
+                {
+                    if (location[v] > -1 && liveIn[save][v] && liveOut[i][v])
+                        regs.push_back(static_cast<int32_t>(v));
+                }
+            }
+        }
+
+        std::vector<Instruction> output;
+        output.reserve(instructions.size() * 2);
+
+        // Reserve the locals, by pushing zeros.
+        for (int32_t offset = FIRST_LOCAL_OFFSET; offset < localEnd; offset += 4)
+        {
+            if (localEnd - offset >= 8)
+            {
+                output.push_back({{"PUSH.64", "0"}});
+                offset += 4;
+            }
+            else
+                output.push_back({{"PUSH", "0"}});
+        }
+
+        std::vector<int32_t> newIndex(instructions.size() + 1);
+        for (size_t i = 0; i < instructions.size(); i++)
+        {
+            Instruction& instr = instructions[i];
+            const std::string& opcode = instr.operands.front();
+            newIndex[i] = static_cast<int32_t>(output.size());
+
+            if (opcode == "SAVE")
+            {
+                for (int32_t v : saved[instr.operands[1]])
+                {
+                    if (!isReloadable(v))
+                        output.push_back({{m_isWide[v] ? "MOVS.64" : "MOVS", reg(location[v])}});
+                }
+
+                continue;
+            }
+            else if (opcode == "RESTORE")
+            {
+                const std::vector<int32_t>& regs = saved[instr.operands[1]];
+                for (auto it = regs.rbegin(); it != regs.rend(); ++it)
+                {
+                    if (isReloadable(*it))
+                        output.push_back(reload(*it, location[*it]));
+                    else
+                        output.push_back({{m_isWide[*it] ? "POP.64" : "POP", reg(location[*it])}});
+                }
+
+                continue;
+            }
+
+            GetDefsAndUses(instr, defs, uses);
+
+            // Spilled arguments are loaded when used, so they need not be loaded up front.
+            if (defs.size() == 1 && location[defs.front()] < 0 && isReloadable(defs.front()))
+                continue;
+
+            // Spilled registers are loaded into, and stored from, the registers kept for them.
+            std::map<int32_t, int32_t> spillRegs;
+            int32_t nextSpillReg = SPILL_REGISTER_BEGIN;
+            for (size_t k = 1; k < instr.operands.size(); k++)
+            {
+                int32_t v = GetVirtualIndex(instr.operands[k]);
+                if (v < 0)
+                    continue;
+
+                if (location[v] > -1)
+                {
+                    instr.operands[k] = reg(location[v]);
+                    continue;
+                }
+
+                auto it = spillRegs.find(v);
+                if (it == spillRegs.end())
+                {
+                    it = spillRegs.emplace(v, nextSpillReg).first;
+                    nextSpillReg += RegisterWidth(v);
+                }
+
+                instr.operands[k] = reg(it->second);
+            }
+
+            for (int32_t v : uses)
+            {
+                if (location[v] > -1)
+                    continue;
+
+                if (isReloadable(v))
+                    output.push_back(reload(v, spillRegs[v]));
+                else if (slot[v] > -1)
+                    output.push_back({{m_isWide[v] ? "LDL.64" : "LDL", reg(spillRegs[v]), STR(slot[v])}});
+            }
+
+            output.push_back(std::move(instr));
+
+            for (int32_t v : defs)
+            {
+                if (location[v] < 0 && slot[v] > -1)
+                    output.push_back({{m_isWide[v] ? "STL.64" : "STL", STR(slot[v]), reg(spillRegs[v])}});
+            }
+        }
+
+        newIndex[instructions.size()] = static_cast<int32_t>(output.size());
+        for (Instruction& instr : output)
+        {
+            int32_t target = GetJumpTarget(instr);
+            if (target > -1)
+            {
+                instr.jumpTo = newIndex[target];
+                instr.jumpAfter = -1;
+            }
+        }
+
+        instructions.swap(output);
     }
 }
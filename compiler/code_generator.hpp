@@ -34,6 +34,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sstream>
 #include <algorithm>
 #include <typeinfo>
+#include <set>
 
 #include "types.hpp"
 
@@ -42,6 +43,12 @@ namespace Compiler
     using StringLiteralMap = std::map<std::string, std::string>;
 
     extern bool IsSystemFunction(const std::string& id);
+
+    // Math functions, e.g. sqrt(x), are translated into the instruction of the same 
+    // name for the type, e.g. SQRT.F64, instead of being called. They are declared 
+    // like system functions, once for each type the instruction takes.
+    extern bool IsMathFunction(const std::string& id);
+    extern std::vector<func> GetMathFunctionDeclarations();
     extern bool IsVariadicSystemFunction(const func& function);
 
     struct Instruction
@@ -76,6 +83,7 @@ namespace Compiler
     private:
         std::stringstream m_ss;
         int64_t m_nextLabel;
+        bool m_isResolved; // Whether jumps have been given the labels they refer to.
         std::map<std::string, std::vector<Instruction>> m_instr; // Contains a map of function ids and their instructions.
         std::string m_currFunc;
 
@@ -92,12 +100,21 @@ namespace Compiler
         // Creates, and resolves labels, and flushes all instructions to the given output stream.
         void Flush(std::ostream& output);
 
+        // Encodes all instructions into a binary program for the VM, without going 
+        // through assembly text. If optimizing, the assembler also runs its peephole 
+        // optimizer, which merges string literals that end other literals.
+        // Returns the number of bytes written, or 0 on error.
+        size_t Assemble(std::ostream& binaryOutput, bool isOptimizing);
+
         // Configures the heap size of the resulting compiled program. 
         // This is encoded into the header of the produced assembly code.
         // If zero, it will be set to the default.
         void SetHeapSize(uint32_t initialSize, uint32_t maxSize = 0);
 
     protected:
+        // Returns the argument of the .MODE directive for the generated program.
+        virtual const char* GetModeName() const = 0;
+
         // Translates the given statement recursively, and outputs 
         // the resulting assembly code into m_out.
         bool TranslateStatement(const stmt& stmt);
@@ -106,12 +123,18 @@ namespace Compiler
         // the resulting assembly code into m_out.
         bool TranslateExpression(const expr& expr);
 
+        // Called before and after the statements of a function are translated.
+        virtual void BeginFunction(const func& function);
+        virtual void EndFunction(const func& function);
+
         virtual void stmt_assignment(const stmt& s) = 0;
         virtual void stmt_func_call(const stmt& s) = 0;
         virtual void stmt_branch(const stmt& s) = 0;
+        virtual void stmt_loop(const stmt& s) = 0;
         virtual void stmt_creation(const stmt& s) = 0;
         virtual void stmt_destruction(const stmt& s) = 0;
         virtual void stmt_return(const stmt& s) = 0;
+        virtual void stmt_array_bulk(const stmt& s) = 0;
 
         virtual void expr_id(const expr& e) = 0;
         virtual void expr_id_offset(const expr& e) = 0;
@@ -122,10 +145,29 @@ namespace Compiler
         virtual void expr_func_call(const expr& e) = 0;
         virtual void expr_unary(const expr& e) = 0;
         virtual void expr_cast(const expr& e) = 0;
+        virtual void expr_select(const expr& e) = 0;
+
+        // Creates labels for the targets of jumps, and appends them to the jump instructions.
+        void ResolveJumps();
 
         // Builds a single assembly instruction as a string, based on the given operands.
         std::string BuildAsm(const std::vector<std::string>& operands);
 
+        // Gets the conversion instruction of a cast expression, and its argument if it takes one.
+        // The instruction is empty if no conversion is needed. Returns false if the cast is illegal.
+        bool GetCastInstruction(const expr& e, std::string& instr, std::string& arg) const;
+
+        // Finds the local arrays whose references never escape the function, i.e. that are 
+        // created once with a constant size, and are otherwise only ever indexed. Each of 
+        // them is given an offset into the locals of the frame, by the position of the variable,
+        // starting at firstOffset. Returns the end of the area used by the arrays.
+        int32_t PlaceFrameArrays(const func& function, int32_t firstOffset, 
+            std::map<size_t, int32_t>& offsets) const;
+
+        // Whether the value of a return statement is a call that may reuse the frame, 
+        // of a function whose own arguments take up the given number of bytes.
+        bool IsTailCall(const expr& value, size_t argBytes) const;
+
         template<typename ...T>
         inline void Error(const T&... args)
         {
@@ -153,6 +195,11 @@ namespace Compiler
             return m_lastInstr;
         }
 
+        inline std::vector<Instruction>& GetFuncInstructions()
+        {
+            return m_instr.at(m_currFunc);
+        }
+
         inline Instruction* GetFuncInstr(int32_t index)
         {
             auto& instructions = m_instr.at(m_currFunc);
@@ -172,12 +219,18 @@ namespace Compiler
         ~StackCodeGenerator();
 
     private:
+        virtual const char* GetModeName() const { return "Stack"; }
+
+        virtual void BeginFunction(const func& function);
+
         virtual void stmt_assignment(const stmt& s);
         virtual void stmt_func_call(const stmt& s);
         virtual void stmt_branch(const stmt& s);
+        virtual void stmt_loop(const stmt& s);
         virtual void stmt_creation(const stmt& s);
         virtual void stmt_destruction(const stmt& s);
         virtual void stmt_return(const stmt& s);
+        virtual void stmt_array_bulk(const stmt& s);
 
         virtual void expr_id(const expr& e);
         virtual void expr_id_offset(const expr& e);
@@ -188,23 +241,74 @@ namespace Compiler
         virtual void expr_func_call(const expr& e);
         virtual void expr_unary(const expr& e);
         virtual void expr_cast(const expr& e);
+        virtual void expr_select(const expr& e);
+
+        // Pushes the arguments of a function call, and returns their size in bytes.
+        size_t TranslateArguments(const expr& e, bool hasVariadicArgs);
+
+        // Gets the offset of an argument or local variable in the frame, as an operand.
+        std::string GetOffset(const identifier& id);
+
+    private:
+        size_t m_argBytes; // Size of the arguments of the current function.
+        std::map<size_t, int32_t> m_argOffsets;   // The offset of each argument, by position.
+        std::map<size_t, int32_t> m_localOffsets; // The offset of each local, by position.
     };
 
     ////======== RegisterCodeGenerator ========////
+
+    // Generates code for the register instruction set. Expressions are first translated 
+    // into instructions on virtual registers, "%0", "%1" and so on, which are then mapped 
+    // onto R0-R30 by a linear scan over their live intervals. R31 is left as CPR.
+    // Virtual registers that don't fit are spilled to locals, and registers that are 
+    // live across a CALL are pushed before it and popped after it. Local arrays that 
+    // never escape the function are placed among the locals, instead of on the heap.
+    // With the wide register file, every register holds 64 bits, so 64-bit values 
+    // take one register instead of a pair.
     class RegisterCodeGenerator : public CodeGenerator
     {
+    private:
+        using RegisterSet = std::vector<bool>;
+
+        // The range of instructions in which a virtual register is live.
+        struct LiveInterval
+        {
+            int32_t vreg;
+            int32_t start;
+            int32_t end;
+        };
+
+        std::vector<bool> m_isWide;     // Whether each virtual register holds 64 bits.
+        std::vector<bool> m_isVariable; // Whether each virtual register holds a variable.
+        std::vector<int32_t> m_argOffset; // The offset of the argument held by each virtual register, or -1.
+        std::map<std::pair<identifier_type, size_t>, std::string> m_variables;
+        std::map<size_t, int32_t> m_frameArrays; // The local offset of each array placed in the frame.
+        int32_t m_spillOffset;          // The local offset of the first spilled register.
+        std::string m_result;           // The virtual register holding the value of the last expression.
+        size_t m_argBytes;
+        int32_t m_nextCall;
+        bool m_hasWideRegisters;        // Whether the program uses the wide register file.
+
     public:
         RegisterCodeGenerator(uint32_t initialHeapSize, uint32_t maxHeapSize, 
-            const std::vector<func>& funcList, const StringLiteralMap& literals);
+            const std::vector<func>& funcList, const StringLiteralMap& literals,
+            bool hasWideRegisters = false);
         ~RegisterCodeGenerator();
 
     private:
+        virtual const char* GetModeName() const { return m_hasWideRegisters ? "Wide" : "Register"; }
+
+        virtual void BeginFunction(const func& function);
+        virtual void EndFunction(const func& function);
+
         virtual void stmt_assignment(const stmt& s);
         virtual void stmt_func_call(const stmt& s);
         virtual void stmt_branch(const stmt& s);
+        virtual void stmt_loop(const stmt& s);
         virtual void stmt_creation(const stmt& s);
         virtual void stmt_destruction(const stmt& s);
         virtual void stmt_return(const stmt& s);
+        virtual void stmt_array_bulk(const stmt& s);
 
         virtual void expr_id(const expr& e);
         virtual void expr_id_offset(const expr& e);
@@ -215,6 +319,43 @@ namespace Compiler
         virtual void expr_func_call(const expr& e);
         virtual void expr_unary(const expr& e);
         virtual void expr_cast(const expr& e);
+        virtual void expr_select(const expr& e);
+
+        std::string NewRegister(DataType dataType);
+        const std::string& GetVariable(const identifier& id);
+
+        // Returns the local offset of the array, if it is placed in the frame, or -1.
+        int32_t GetFrameArray(const identifier& id) const;
+
+        // Translates the expression, and returns the virtual register holding its value.
+        std::string TranslateValue(const expr& e);
+
+        // Translates a comparison or logical expression, leaving the result in CPR.
+        // Returns true if CPR holds the inverse of the result.
+        bool TranslateComparison(const expr& e);
+
+        // Translates a branch condition, and returns the branch instruction that 
+        // should be taken if the condition is false.
+        std::string TranslateCondition(const expr& e);
+
+        //---- Register allocation ----//
+
+        // Returns the number of registers taken by the virtual register.
+        int32_t RegisterWidth(int32_t vreg) const;
+
+        void ComputeLiveness(const std::vector<Instruction>& instructions,
+            std::vector<RegisterSet>& liveIn, std::vector<RegisterSet>& liveOut) const;
+        bool RemoveDeadCode(std::vector<Instruction>& instructions, const std::vector<RegisterSet>& liveOut);
+        std::vector<LiveInterval> BuildIntervals(const std::vector<Instruction>& instructions,
+            const std::vector<RegisterSet>& liveIn, const std::vector<RegisterSet>& liveOut) const;
+
+        // Assigns each virtual register a register below regCount, or -1 if it is spilled.
+        // Returns false if any register was spilled.
+        bool LinearScan(const std::vector<LiveInterval>& intervals, int32_t regCount, 
+            std::vector<int32_t>& location) const;
+
+        void RewriteInstructions(std::vector<Instruction>& instructions, const std::vector<int32_t>& location,
+            const std::vector<RegisterSet>& liveIn, const std::vector<RegisterSet>& liveOut) const;
     };
 
 }
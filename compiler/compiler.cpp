@@ -33,10 +33,14 @@ namespace Compiler
 
     RackCompiler::RackCompiler(CodeGenerationType codeGenType) :
         m_traceParsing(false),
+        m_hasError(false),
         m_currFunction(),
         m_codeGenType(codeGenType),
         m_heapSize(0),
         m_maxHeapSize(0),
+        m_isOptimizing(false),
+        m_isListing(false),
+        m_outputFile(),
         m_funcList(),
         m_literals()
     {
@@ -47,13 +51,24 @@ namespace Compiler
         m_funcList.insert(m_funcList.begin(), {
             func("__print", DataType::UNDEFINED, { SYSFUNC_ARG(STRING), SYSFUNC_VARIADIC_ARG() }),
             func("__input", DataType::STRING,    {}),
-            func("__write", DataType::UNDEFINED, { SYSFUNC_ARG(INT), SYSFUNC_ARG(STRING) }),
-            func("__read",  DataType::STRING,    { SYSFUNC_ARG(INT) }),
+            func("__write", DataType::INT,       { SYSFUNC_ARG(INT), SYSFUNC_ARG(STRING), SYSFUNC_ARG(INT) }),
+            func("__read",  DataType::INT,       { SYSFUNC_ARG(INT), SYSFUNC_ARG(STRING), SYSFUNC_ARG(INT) }),
             func("__open",  DataType::INT,       { SYSFUNC_ARG(STRING), SYSFUNC_ARG(STRING) }),
-            func("__close", DataType::UNDEFINED, { SYSFUNC_ARG(INT) }),
-            func("__str",   DataType::STRING,    { SYSFUNC_ARG(STRING), SYSFUNC_VARIADIC_ARG() })
+            func("__close", DataType::INT,       { SYSFUNC_ARG(INT) }),
+            func("__str",   DataType::STRING,    { SYSFUNC_ARG(STRING), SYSFUNC_VARIADIC_ARG() }),
+            func("__readall", DataType::STRING,  { SYSFUNC_ARG(INT) }),
+            func("__aread", DataType::INT,       { SYSFUNC_ARG(INT), SYSFUNC_ARG(STRING), SYSFUNC_ARG(INT) }),
+            func("__awrite", DataType::INT,      { SYSFUNC_ARG(INT), SYSFUNC_ARG(STRING), SYSFUNC_ARG(INT) }),
+            func("__await", DataType::INT,       { SYSFUNC_ARG(INT) }),
+            func("__apoll", DataType::INT,       { SYSFUNC_ARG(INT) }),
+            func("__mmap",  DataType::STRING,    { SYSFUNC_ARG(STRING), SYSFUNC_ARG(INT) }),
+            func("__munmap", DataType::INT,      { SYSFUNC_ARG(STRING) }),
+            func("__snapshot", DataType::INT,    { SYSFUNC_ARG(STRING) })
         });
 
+        std::vector<func> mathFuncs = GetMathFunctionDeclarations();
+        m_funcList.insert(m_funcList.end(), mathFuncs.begin(), mathFuncs.end());
+
 #undef SYSFUNC_ARG
 #undef SYSFUNC_VARIADIC_ARG
     }
@@ -62,7 +77,7 @@ namespace Compiler
     {
     }
 
-    int RackCompiler::Parse(const std::string& file)
+    bool RackCompiler::Parse(const std::string& file)
     {
         m_file = file;
         m_location.initialize(&m_file);
@@ -78,6 +93,25 @@ namespace Compiler
 
         delete m_parser;
 
+        // Nothing is generated from a program with errors, since it would be incomplete.
+        if (parseResult != 0 || m_hasError)
+            return false;
+
+        // Optimize the parsed functions before any of them are translated, 
+        // so that both code generators get the same optimized statements.
+        if (m_isOptimizing)
+        {
+            Optimizer optimizer;
+            for (func& function : m_funcList)
+                if (!IsSystemFunction(function.id.id))
+                    optimizer.Optimize(function);
+
+            // Folding strings creates new literals, and may leave others unused.
+            m_literals.clear();
+            for (const func& function : m_funcList)
+                AddStringLiterals(function.statements);
+        }
+
         bool codeGenResult = true;
         if (m_codeGenType != CodeGenerationType::NONE)
         {
@@ -87,18 +121,40 @@ namespace Compiler
                                 m_maxHeapSize, m_funcList, m_literals);
             else
                 codeGenerator = new RegisterCodeGenerator(m_heapSize, 
-                                m_maxHeapSize, m_funcList, m_literals);
+                                m_maxHeapSize, m_funcList, m_literals,
+                                m_codeGenType == CodeGenerationType::REGISTER_WIDE);
 
-            // Generate the assembly source.
+            // Generate the binary program directly, and the assembly source if asked for.
             if (codeGenResult = codeGenerator->TranslateFunctions())
-                codeGenerator->Flush(std::cout); // Flush to .asm file.
+            {
+                if (m_isListing)
+                    codeGenerator->Flush(std::cout); // Flush to .asm file.
+
+                // Assemble into memory first, so that no file is left behind on failure.
+                std::ostringstream binary;
+                if (codeGenerator->Assemble(binary, m_isOptimizing) == 0)
+                {
+                    std::cerr << "Could not assemble \"" << m_outputFile << "\"." << std::endl;
+                    codeGenResult = false;
+                }
+                else
+                {
+                    std::string bytes = binary.str();
+                    std::ofstream binaryFile(m_outputFile, std::ios::binary);
+                    if (!binaryFile.is_open() || !binaryFile.write(bytes.data(), bytes.size()))
+                    {
+                        std::cerr << "Could not create \"" << m_outputFile << "\"." << std::endl;
+                        codeGenResult = false;
+                    }
+                }
+            }
             else
                 codeGenerator->Flush(std::cout); // Flush an error log.
 
             delete codeGenerator;
         }
 
-        return parseResult && codeGenResult;
+        return codeGenResult;
     }
 
     void RackCompiler::SetHeapSize(uint32_t initialSize, uint32_t maxSize)
@@ -107,7 +163,18 @@ namespace Compiler
         m_maxHeapSize = maxSize;
     }
 
-    void RackCompiler::AddFunc(std::vector<stmt>&& statements)
+    void RackCompiler::SetOptimizing(bool isOptimizing)
+    {
+        m_isOptimizing = isOptimizing;
+    }
+
+    void RackCompiler::SetOutput(const std::string& outputFile, bool isListing)
+    {
+        m_outputFile = outputFile;
+        m_isListing = isListing;
+    }
+
+    void RackCompiler::AddFunc(StmtList&& statements)
     {
         std::cout << "Added function \"" << m_currFunction.id << "\":" << std::endl;
 
@@ -137,7 +204,7 @@ namespace Compiler
         m_currFunction = {};
     }
 
-    void RackCompiler::DeclFunc(DataType dataType, std::string&& id, std::vector<stmt>&& args)
+    void RackCompiler::DeclFunc(DataType dataType, std::string&& id, StmtList&& args)
     {
         func& fun = m_currFunction;
         fun.id = identifier(identifier_type::FUNC_NAME, std::move(id), 0, dataType);
@@ -145,7 +212,7 @@ namespace Compiler
         fun.args = std::move(args);
     }
 
-    const identifier& RackCompiler::DeclVar(DataType dataType, std::string&& varId, identifier_type idType)
+    const identifier& RackCompiler::DeclVar(DataType dataType, Symbol varId, identifier_type idType)
     {
         if (m_scopes.empty())
             throw RackParser::syntax_error(m_location, "Variables may not be declared in global scope.");
@@ -158,12 +225,12 @@ namespace Compiler
             identifier(idType, varId, (*varCount)++, dataType));
             
         if (!result.second)
-            throw RackParser::syntax_error(m_location, "\""+varId+"\" has already been defined.");
+            throw RackParser::syntax_error(m_location, "\""+varId.str()+"\" has already been defined.");
 
         return result.first->second;
     }
 
-    const identifier& RackCompiler::UseVar(std::string&& varId) const
+    const identifier& RackCompiler::UseVar(Symbol varId) const
     {
         for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
         {
@@ -174,17 +241,17 @@ namespace Compiler
 
         }
         
-        throw RackParser::syntax_error(m_location, "Unknown identifier \""+varId+"\".");
+        throw RackParser::syntax_error(m_location, "Unknown identifier \""+varId.str()+"\".");
     }
 
-    const func& RackCompiler::UseFunc(const std::string& funcId, const std::vector<expr>& args) const
+    const func& RackCompiler::UseFunc(Symbol funcId, const ExprList& args) const
     {
         const func* function;
         bool funcIdFound = false;
-        std::string funcName = std::string(funcId);
+        Symbol funcName = funcId;
 
-        if (IsSystemFunction(funcId))
-            funcName = "__" + funcId;
+        if (IsSystemFunction(funcId) || IsMathFunction(funcId))
+            funcName = "__" + funcId.str();
 
         auto it = std::find_if(m_funcList.begin(), m_funcList.end(),
             [&](const func& f) 
@@ -204,9 +271,9 @@ namespace Compiler
         if (function == nullptr || function->id.id != funcName)
         {
             if (!funcIdFound)
-                throw RackParser::syntax_error(m_location, "Couldn't find function \""+funcId+"\".");
+                throw RackParser::syntax_error(m_location, "Couldn't find function \""+funcId.str()+"\".");
             else
-                throw RackParser::syntax_error(m_location, "Function arguments did not match declaration for \""+funcId+"\".");
+                throw RackParser::syntax_error(m_location, "Function arguments did not match declaration for \""+funcId.str()+"\".");
         }
 
         return *function;
@@ -222,6 +289,26 @@ namespace Compiler
         }
     }
 
+    void RackCompiler::AddStringLiterals(const StmtList& stmts)
+    {
+        for (const stmt& s : stmts)
+        {
+            for (const expr& e : s.expressions)
+                AddStringLiterals(e);
+
+            AddStringLiterals(s.substmts);
+        }
+    }
+
+    void RackCompiler::AddStringLiterals(const expr& e)
+    {
+        if (e.type == expr_type::STRING)
+            AddStringLiteral(e.strValue);
+
+        for (const expr& operand : e.operands)
+            AddStringLiterals(operand);
+    }
+
     std::string RackCompiler::CheckReturnType(const stmt& retStmt) const
     {
         if (retStmt.expressions.size() == 0)
@@ -236,7 +323,7 @@ namespace Compiler
         return "";
     }
 
-    bool RackCompiler::MatchFunctionArgs(const func& fun, const std::vector<expr>& args) const
+    bool RackCompiler::MatchFunctionArgs(const func& fun, const ExprList& args) const
     {   
         if (fun.args.size() == 0 && args.size() == 0)
             return true;
@@ -272,14 +359,16 @@ namespace Compiler
         if (st.expressions.back().dataType != DataType::INT)
             return (std::stringstream() << "Array length must be an int value: " << st.expressions.back().dataType).str();
         
-        // Handle arrays of > 4 byte elements.
+        // The heap is allocated in bytes.
         int32_t dataTypeSize = GetDataTypeBytes(ARRAY_TO_BASE(st.id.dataType));
         expr arrayLen = std::move(st.expressions.back());
         st.expressions.pop_back();
 
-        // If element data type is larger than 4 bytes, multiply array length by nbr of bytes.
-        if (dataTypeSize > 4)
+        // Multiply the array length by the number of bytes per element. Strings are already in bytes.
+        if (IsArray(st.id.dataType))
             st.expressions.emplace_back(expr_type::MUL, std::move(arrayLen), expr(dataTypeSize));
+        else
+            st.expressions.push_back(std::move(arrayLen));
 
         st.expressions.back().CheckType();
         return "";
@@ -289,7 +378,7 @@ namespace Compiler
 
     std::ostream& operator <<(std::ostream& os, const stmt& s)
     {
-        std::vector<stmt>::const_iterator it;        
+        StmtList::const_iterator it;        
 
         switch (s.type)
         {
@@ -317,6 +406,14 @@ namespace Compiler
             case stmt_type::DESTRUCTION: os << "destroy: " << s.id; 
                 break;
 
+            case stmt_type::ARRAY_FILL: os << "fill: " << s.id << " at expr{" << s.expressions[0] << 
+                "} with expr{" << s.expressions[1] << "}, count expr{" << s.expressions[2] << "}"; 
+                break;
+
+            case stmt_type::ARRAY_COPY: os << "copy: " << s.id << " at expr{" << s.expressions[0] << 
+                "} from expr{" << s.expressions[1] << "}, bytes expr{" << s.expressions[2] << "}"; 
+                break;
+
             case stmt_type::RETURN: 
                 if (s.expressions.size() == 0)
                     os << "return"; 
@@ -350,6 +447,14 @@ namespace Compiler
                 }
                 break;
 
+            case stmt_type::LOOP: 
+                os << "while: ( " << s.expressions.front() << " )" << std::endl;
+
+                it = s.substmts.begin();
+                while (it != s.substmts.end())
+                    os << std::string(4, ' ') << *it++ << std::endl;
+                break;
+
             default: os << "unknown statement"; break;
         }
 
@@ -398,6 +503,7 @@ namespace Compiler
             case expr_type::NEG:    os << "or";     break;
             case expr_type::CALL:   os << "call";   break;
             case expr_type::STREQ:  os << "starts with";   break;
+            case expr_type::SELECT: os << "select"; break;
 
             default: os << "unknown expr_type";     break;
         }
@@ -456,6 +562,7 @@ namespace Compiler
             case expr_type::NEG:       os << "-(" << e.operands.front() << ")";                               break;
             case expr_type::CAST:      os << e.dataType << "(" << e.operands.front() << ")";                  break;
             case expr_type::STREQ:     os << "(" << e.operands.front() << " starts with " << e.operands.back() << ")"; break;
+            case expr_type::SELECT:    os << "(" << e.operands[0] << " ? " << e.operands[1] << " : " << e.operands[2] << ")"; break;
             case expr_type::CALL:      os << e.operands.front().id << '(' << (e.operands.back().operands.size() > 0 ?
                                              (BuildCommaListString(e.operands.back().operands)) : "") << ')'; break;
 
@@ -502,9 +609,12 @@ int main(int argc, char** argv)
     std::initializer_list<CLIArgs::ArgInfo> args = 
     {
         {"-r",          ArgType::NONE,  "Sets the code generation mode to 'register'."},
+        {"-w",          ArgType::NONE,  "Sets the code generation mode to 'register', on 64-bit registers."},
         {"-s",          ArgType::NONE,  "Sets the code generation mode to 'stack' (default)."},
         {"--heap",      ArgType::INT,   "Sets initial heap size of the compiled program."},
         {"--max-heap",  ArgType::INT,   "Sets maximum heap size of the compiled program."},
+        {"-O",          ArgType::NONE,  "Optimizes the program before generating code."},
+        {"--asm",       ArgType::NONE,  "Prints the assembly code to stdout, besides writing the binary."},
     };
 
     if (argc == 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0))
@@ -525,9 +635,12 @@ int main(int argc, char** argv)
     }
 
     bool registerMode = arg.Get("-r", false);
+    bool wideMode     = arg.Get("-w", false);
     bool stackMode    = arg.Get("-s", true);
     int initHeapSize  = arg.Get("--heap", 0);
     int maxHeapSize   = arg.Get("--max-heap", 0);
+    bool isOptimizing = arg.Get("-O", false);
+    bool isListing    = arg.Get("--asm", false);
 
     // File name should be the first argument without a leading '-'.
     int i;
@@ -548,19 +661,34 @@ int main(int argc, char** argv)
     auto codeType = Compiler::RackCompiler::CodeGenerationType::STACK;
     if (registerMode)
         codeType = Compiler::RackCompiler::CodeGenerationType::REGISTER;
+    if (wideMode)
+        codeType = Compiler::RackCompiler::CodeGenerationType::REGISTER_WIDE;
 
     Compiler::RackCompiler compiler(codeType);
 
     compiler.SetHeapSize(initHeapSize, maxHeapSize);
+    compiler.SetOptimizing(isOptimizing);
+
+    // The binary program is written next to the source file, e.g. "prog.rk" -> "prog.bin".
+    std::string outputFile(fileName);
+    size_t pathLastDot = outputFile.rfind('.');
+    size_t pathLastSlash = outputFile.find_last_of("/\\");
+    if (pathLastDot == std::string::npos || (pathLastSlash != std::string::npos && pathLastDot < pathLastSlash))
+        pathLastDot = outputFile.length();
+
+    outputFile = outputFile.substr(0, pathLastDot) + ".bin";
+    compiler.SetOutput(outputFile, isListing);
 
     try
     {
-        compiler.Parse(fileName);
+        if (!compiler.Parse(fileName))
+            return EXIT_FAILURE;
     }
     catch(const std::exception& e)
     {
         std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
     }
 
-    return 0;
+    return EXIT_SUCCESS;
 }
@@ -37,12 +37,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 
 #include "parser.hpp"
 #include "lexer.hpp"
 #include "code_generator.hpp"
+#include "optimizer.hpp"
 #include "cli_args.hpp"
 
 namespace Compiler
@@ -54,11 +56,12 @@ namespace Compiler
         {
             NONE,
             STACK,
-            REGISTER
+            REGISTER,
+            REGISTER_WIDE
         };
 
     private:
-        using ScopedVars = std::map<std::string, identifier>;
+        using ScopedVars = std::unordered_map<Symbol, identifier, Symbol::Hash>;
 
         RackParser*             m_parser;
         CodeGenerationType      m_codeGenType;
@@ -69,10 +72,14 @@ namespace Compiler
         func m_currFunction;
         uint32_t m_heapSize;
         uint32_t m_maxHeapSize;
+        bool m_isOptimizing;
+        bool m_isListing;           // Whether to print the assembly code as well.
+        std::string m_outputFile;
 
     public:
         std::string m_file;
         bool m_traceParsing;    // Whether to generate parsing debug traces.
+        bool m_hasError;        // Whether the parser reported any errors.
 
         Compiler::location m_location;
 
@@ -82,14 +89,20 @@ namespace Compiler
 
         RackCompiler(CodeGenerationType codeGenType);
 
-        int Parse(const std::string& file);
+        // Parses the file, and generates the binary program from it if there were no errors.
+        // Returns whether it succeeded.
+        bool Parse(const std::string& file);
         void SetHeapSize(uint32_t initialSize, uint32_t maxSize);
+        void SetOptimizing(bool isOptimizing);
 
-        void  AddFunc(std::vector<stmt>&& statements);
-        void  DeclFunc(DataType dataType, std::string&& id, std::vector<stmt>&& args);
-        const identifier& DeclVar(DataType dataType, std::string&& varId, identifier_type idType);
-        const identifier& UseVar(std::string&& varId) const;
-        const func& UseFunc(const std::string& funcId, const std::vector<expr>& args) const;
+        // Sets the path of the binary program, and whether to print its assembly code to stdout.
+        void SetOutput(const std::string& outputFile, bool isListing);
+
+        void  AddFunc(StmtList&& statements);
+        void  DeclFunc(DataType dataType, std::string&& id, StmtList&& args);
+        const identifier& DeclVar(DataType dataType, Symbol varId, identifier_type idType);
+        const identifier& UseVar(Symbol varId) const;
+        const func& UseFunc(Symbol funcId, const ExprList& args) const;
         void AddStringLiteral(const std::string& literal);
 
         std::string CheckReturnType(const stmt& retStmt) const;
@@ -99,7 +112,11 @@ namespace Compiler
         inline void ExitScope()  { m_scopes.pop_back(); }
 
     private:
-        bool MatchFunctionArgs(const func& fun, const std::vector<expr>& args) const;
+        bool MatchFunctionArgs(const func& fun, const ExprList& args) const;
+
+        // Adds the string literals that are still used by the statements.
+        void AddStringLiterals(const StmtList& stmts);
+        void AddStringLiterals(const expr& e);
 
     };
 }
@@ -0,0 +1,1147 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace Compiler
+{
+    // Upper bound of propagation and dead code passes over a function.
+    static const size_t MAX_PASSES = 16;
+
+    // Upper bound of the size of a value that is computed unconditionally when 
+    // a branch is replaced by a select.
+    static const size_t MAX_SELECT_NODES = 3;
+
+    static bool IsVariable(const expr& e)
+    {
+        return e.type == expr_type::ID && 
+            (e.id.type == identifier_type::LOCAL_VAR || e.id.type == identifier_type::ARG_VAR);
+    }
+
+    static Optimizer::Variable GetVariable(const identifier& id)
+    {
+        return std::make_pair(id.type, id.position);
+    }
+
+    static bool IsNumeric(DataType dataType)
+    {
+        return dataType == DataType::INT || dataType == DataType::LONG || 
+               dataType == DataType::FLOAT || dataType == DataType::DOUBLE;
+    }
+
+    static bool IsIntegerConstant(const expr& e)
+    {
+        return e.type == expr_type::NUMBER && (e.dataType == DataType::INT || e.dataType == DataType::LONG);
+    }
+
+    static int64_t GetConstant(const expr& e)
+    {
+        return e.dataType == DataType::LONG ? e.longValue : e.intValue;
+    }
+
+    static expr MakeConstant(DataType dataType, int64_t value)
+    {
+        if (dataType == DataType::LONG)
+            return expr(value);
+
+        return expr(static_cast<int32_t>(value));
+    }
+
+    // Evaluates an integer operation the way the VM does, wrapping on overflow.
+    // Returns false if it can't be evaluated at compile time.
+    static bool EvaluateBinary(expr_type type, int64_t lhs, int64_t rhs, int64_t& result)
+    {
+        uint64_t ulhs = static_cast<uint64_t>(lhs);
+        uint64_t urhs = static_cast<uint64_t>(rhs);
+
+        switch (type)
+        {
+            case expr_type::ADD: result = static_cast<int64_t>(ulhs + urhs); break;
+            case expr_type::SUB: result = static_cast<int64_t>(ulhs - urhs); break;
+            case expr_type::MUL: result = static_cast<int64_t>(ulhs * urhs); break;
+            case expr_type::DIV: 
+                // Leave division by zero to fail at runtime, as well as the overflowing MIN / -1.
+                if (rhs == 0 || rhs == -1)
+                    return false;
+                result = lhs / rhs; 
+                break;
+
+            case expr_type::EQ:  result = lhs == rhs; break;
+            case expr_type::NEQ: result = lhs != rhs; break;
+            case expr_type::GT:  result = lhs > rhs;  break;
+            case expr_type::LT:  result = lhs < rhs;  break;
+            case expr_type::GEQ: result = lhs >= rhs; break;
+            case expr_type::LEQ: result = lhs <= rhs; break;
+
+            default: return false;
+        }
+
+        return true;
+    }
+
+    // Returns the first character of a string literal, as written in the source.
+    static std::string GetFirstChar(const Symbol& literal)
+    {
+        const std::string& str = literal.str();
+        return str.substr(0, !str.empty() && str[0] == '\\' ? 2 : 1);
+    }
+
+    static bool IsArithmetic(expr_type type)
+    {
+        return type == expr_type::ADD || type == expr_type::SUB || 
+               type == expr_type::MUL || type == expr_type::DIV;
+    }
+
+    static bool HasSideEffects(const expr& e)
+    {
+        if (e.type == expr_type::CALL)
+            return true;
+
+        for (const expr& operand : e.operands)
+            if (HasSideEffects(operand))
+                return true;
+
+        return false;
+    }
+
+    static void CollectUses(const expr& e, Optimizer::VariableSet& uses)
+    {
+        if (IsVariable(e))
+            uses.insert(GetVariable(e.id));
+
+        for (const expr& operand : e.operands)
+            CollectUses(operand, uses);
+    }
+
+    // Whether the expression reads memory or calls a function, in which case its 
+    // value may change when an array is written.
+    static bool ReadsMemory(const expr& e)
+    {
+        if (e.type == expr_type::ID_OFFSET || e.type == expr_type::CALL)
+            return true;
+
+        for (const expr& operand : e.operands)
+            if (ReadsMemory(operand))
+                return true;
+
+        return false;
+    }
+
+    // Collects the variables that are given a new value anywhere in the statements.
+    static void CollectAssigned(const StmtList& stmts, Optimizer::VariableSet& assigned)
+    {
+        for (const stmt& s : stmts)
+        {
+            switch (s.type)
+            {
+                case stmt_type::ASSIGNMENT:
+                case stmt_type::INITIALIZATION:
+                case stmt_type::DECLARATION:
+                case stmt_type::CREATION: assigned.insert(GetVariable(s.id));
+                    break;
+
+                default: CollectAssigned(s.substmts, assigned);
+                    break;
+            }
+        }
+    }
+
+    // Whether the expression may be computed once into a temporary, and then be reused.
+    // This is only the case for arithmetic on numbers that doesn't read memory or 
+    // call a function. Division is left out where it could be evaluated speculatively, 
+    // since it may trap.
+    static bool IsReusable(const expr& e, bool allowDivision)
+    {
+        switch (e.type)
+        {
+            case expr_type::ADD:
+            case expr_type::SUB:
+            case expr_type::MUL:
+            case expr_type::NEG:
+            case expr_type::CAST: break;
+            case expr_type::DIV: 
+                if (!allowDivision)
+                    return false;
+                break;
+
+            default: return false;
+        }
+
+        if (!IsNumeric(e.dataType))
+            return false;
+
+        for (const expr& operand : e.operands)
+        {
+            if (!IsNumeric(operand.dataType))
+                return false;
+
+            if (!IsVariable(operand) && operand.type != expr_type::NUMBER && !IsReusable(operand, allowDivision))
+                return false;
+        }
+
+        return true;
+    }
+
+    static std::string GetExpressionKey(const expr& e)
+    {
+        std::stringstream ss;
+        ss << e.dataType << ' ' << e;
+        return ss.str();
+    }
+
+    static size_t CountNodes(const expr& e)
+    {
+        size_t count = 1;
+        for (const expr& operand : e.operands)
+            count += CountNodes(operand);
+
+        return count;
+    }
+
+    // Returns the expressions evaluated when executing the statement, not counting substatements.
+    static std::vector<expr*> GetEvaluated(stmt& s)
+    {
+        std::vector<expr*> evaluated;
+        if (s.type == stmt_type::BRANCH)
+            evaluated.push_back(&s.substmts.front().expressions.front());
+        else if (s.type != stmt_type::LOOP)
+            for (expr& e : s.expressions)
+                evaluated.push_back(&e);
+
+        return evaluated;
+    }
+
+    static bool IsAssigning(const stmt& s)
+    {
+        return s.type == stmt_type::ASSIGNMENT || s.type == stmt_type::INITIALIZATION || 
+               s.type == stmt_type::DECLARATION || s.type == stmt_type::CREATION;
+    }
+
+    static bool IsCondition(const expr& e)
+    {
+        switch (e.type)
+        {
+            case expr_type::EQ:
+            case expr_type::NEQ:
+            case expr_type::GT:
+            case expr_type::LT:
+            case expr_type::GEQ:
+            case expr_type::LEQ:
+            case expr_type::STREQ:
+            case expr_type::OR:
+            case expr_type::AND: return true;
+
+            default: return false;
+        }
+    }
+
+    // Whether the statement assigns a small number to a variable, that may be computed 
+    // whether or not the statement is reached, i.e. without reading memory or trapping.
+    static bool IsSelectableAssignment(const stmt& s)
+    {
+        if (s.type != stmt_type::ASSIGNMENT || !IsNumeric(s.id.dataType) ||
+            (s.id.type != identifier_type::LOCAL_VAR && s.id.type != identifier_type::ARG_VAR))
+        {
+            return false;
+        }
+
+        const expr& value = s.expressions.front();
+        return value.dataType == s.id.dataType && CountNodes(value) <= MAX_SELECT_NODES &&
+            (IsVariable(value) || value.type == expr_type::NUMBER || IsReusable(value, false));
+    }
+
+    static size_t ReplaceExpression(expr& e, const std::string& key, const identifier& temp)
+    {
+        if (IsReusable(e, true) && GetExpressionKey(e) == key)
+        {
+            e = expr(temp);
+            return 1;
+        }
+
+        size_t count = 0;
+        for (expr& operand : e.operands)
+            count += ReplaceExpression(operand, key, temp);
+
+        return count;
+    }
+
+    ////======== Optimizer ========////
+
+    Optimizer::Optimizer() :
+        m_func(nullptr),
+        m_changes(0),
+        m_nextTemp(0)
+    {
+    }
+
+    Optimizer::~Optimizer()
+    {
+    }
+
+    size_t Optimizer::Optimize(func& function)
+    {
+        m_func = &function;
+        m_changes = 0;
+
+        Simplify();
+
+        size_t changes = m_changes;
+        LowerMemoryLoops(function.statements);
+        EliminateCommonSubexpressions(function.statements);
+        HoistLoopInvariants(function.statements);
+
+        // After hoisting, since invariant values may have been moved out of the branches.
+        LowerSelects(function.statements);
+
+        // The temporaries may open up for more propagation.
+        if (m_changes != changes)
+            Simplify();
+
+        return m_changes;
+    }
+
+    void Optimizer::Simplify()
+    {
+        for (size_t pass = 0; pass < MAX_PASSES; pass++)
+        {
+            size_t changes = m_changes;
+
+            ValueMap values;
+            PropagateValues(m_func->statements, values);
+            SimplifyControlFlow(m_func->statements);
+
+            VariableSet live;
+            RemoveDeadCode(m_func->statements, live, true);
+
+            if (m_changes == changes)
+                break;
+        }
+    }
+
+    bool Optimizer::FoldConstants(expr& e)
+    {
+        bool isChanged = false;
+        for (expr& operand : e.operands)
+            isChanged |= FoldConstants(operand);
+
+        switch (e.type)
+        {
+            case expr_type::ADD:
+            case expr_type::SUB:
+            case expr_type::MUL:
+            case expr_type::DIV:
+            case expr_type::EQ:
+            case expr_type::NEQ:
+            case expr_type::GT:
+            case expr_type::LT:
+            case expr_type::GEQ:
+            case expr_type::LEQ:
+            {
+                const expr& lhs = e.operands.front();
+                const expr& rhs = e.operands.back();
+
+                // Concatenate string literals, so that only the result is put on the heap.
+                if (e.type == expr_type::ADD && lhs.type == expr_type::STRING && rhs.type == expr_type::STRING)
+                {
+                    e = expr(lhs.strValue.str() + rhs.strValue.str());
+                    return true;
+                }
+
+                // Scaled array indices are built without being type checked.
+                if (e.dataType == DataType::UNDEFINED && IsArithmetic(e.type) && lhs.dataType == rhs.dataType)
+                    e.dataType = lhs.dataType;
+
+                if (e.dataType != DataType::INT && e.dataType != DataType::LONG)
+                    break;
+
+                int64_t result;
+                if (IsIntegerConstant(lhs) && IsIntegerConstant(rhs) && lhs.dataType == rhs.dataType &&
+                    EvaluateBinary(e.type, GetConstant(lhs), GetConstant(rhs), result))
+                {
+                    e = MakeConstant(e.dataType, result);
+                    return true;
+                }
+
+                if (!IsArithmetic(e.type))
+                    break;
+
+                // Remove additions of 0, and multiplications by 1.
+                const expr* kept = nullptr;
+                if (IsIntegerConstant(rhs) && GetConstant(rhs) == (e.type == expr_type::ADD || e.type == expr_type::SUB ? 0 : 1))
+                    kept = &lhs;
+                else if (IsIntegerConstant(lhs) && GetConstant(lhs) == (e.type == expr_type::ADD ? 0 : 1) && 
+                         (e.type == expr_type::ADD || e.type == expr_type::MUL))
+                    kept = &rhs;
+
+                // Element addresses add an int offset to an array, which may be left as is.
+                if (kept && (kept->dataType == e.dataType || IsArray(kept->dataType)))
+                {
+                    expr operand = *kept;
+                    e = std::move(operand);
+                    return true;
+                }
+                break;
+            }
+
+            case expr_type::NEG:
+                if (IsIntegerConstant(e.operands.front()) && e.dataType == e.operands.front().dataType)
+                {
+                    e = MakeConstant(e.dataType, static_cast<int64_t>(0 - static_cast<uint64_t>(GetConstant(e.operands.front()))));
+                    return true;
+                }
+                break;
+
+            case expr_type::STREQ:
+            {
+                const expr& lhs = e.operands.front();
+                const expr& rhs = e.operands.back();
+                if (lhs.type != expr_type::STRING || rhs.type != expr_type::STRING)
+                    break;
+
+                // Different escape sequences may still be the same character.
+                std::string lhsChar = GetFirstChar(lhs.strValue);
+                std::string rhsChar = GetFirstChar(rhs.strValue);
+                if (lhsChar != rhsChar && (lhsChar.compare(0, 1, "\\") == 0 || rhsChar.compare(0, 1, "\\") == 0))
+                    break;
+
+                e = MakeConstant(DataType::INT, lhsChar == rhsChar);
+                return true;
+            }
+
+            case expr_type::SELECT:
+                if (IsIntegerConstant(e.operands.front()))
+                {
+                    expr value = std::move(e.operands[GetConstant(e.operands.front()) != 0 ? 1 : 2]);
+                    e = std::move(value);
+                    return true;
+                }
+                break;
+
+            case expr_type::CAST:
+                if (e.operands.size() == 1 && IsIntegerConstant(e.operands.front()) && 
+                    (e.dataType == DataType::INT || e.dataType == DataType::LONG))
+                {
+                    e = MakeConstant(e.dataType, GetConstant(e.operands.front()));
+                    return true;
+                }
+
+                // Formatted the same way as ITOS and LTOS.
+                if (e.operands.size() == 1 && IsIntegerConstant(e.operands.front()) && e.dataType == DataType::STRING)
+                {
+                    e = expr(std::to_string(GetConstant(e.operands.front())));
+                    return true;
+                }
+                break;
+
+            default: break;
+        }
+
+        return isChanged;
+    }
+
+    void Optimizer::SubstituteValues(expr& e, const ValueMap& values)
+    {
+        if (IsVariable(e))
+        {
+            auto it = values.find(GetVariable(e.id));
+            if (it != values.end())
+            {
+                e = it->second;
+                m_changes++;
+            }
+            return;
+        }
+
+        for (expr& operand : e.operands)
+            SubstituteValues(operand, values);
+    }
+
+    void Optimizer::PropagateValues(StmtList& stmts, ValueMap& values)
+    {
+        for (stmt& s : stmts)
+            PropagateValues(s, values);
+    }
+
+    void Optimizer::PropagateValues(stmt& s, ValueMap& values)
+    {
+        auto rewrite = [&](expr& e)
+        {
+            SubstituteValues(e, values);
+            if (FoldConstants(e))
+                m_changes++;
+        };
+
+        // Forgets the value of the variable, and of the variables that copied it.
+        auto kill = [&](const Variable& var)
+        {
+            values.erase(var);
+            for (auto it = values.begin(); it != values.end();)
+            {
+                if (IsVariable(it->second) && GetVariable(it->second.id) == var)
+                    it = values.erase(it);
+                else
+                    ++it;
+            }
+        };
+
+        switch (s.type)
+        {
+            case stmt_type::ASSIGNMENT:
+            case stmt_type::INITIALIZATION:
+            {
+                expr& value = s.expressions.front();
+                rewrite(value);
+
+                Variable var = GetVariable(s.id);
+                kill(var);
+
+                bool isCopy = IsVariable(value) && GetVariable(value.id) != var;
+                if ((IsIntegerConstant(value) || isCopy) && value.dataType == s.id.dataType)
+                    values[var] = value;
+                break;
+            }
+
+            case stmt_type::DECLARATION: kill(GetVariable(s.id));
+                break;
+
+            case stmt_type::CREATION: 
+                rewrite(s.expressions.front());
+                kill(GetVariable(s.id));
+                break;
+
+            case stmt_type::ASSIGN_OFFSET:
+            case stmt_type::ARRAY_FILL:
+            case stmt_type::ARRAY_COPY:
+            case stmt_type::FUNC_CALL:
+            case stmt_type::RETURN: 
+                for (expr& e : s.expressions)
+                    rewrite(e);
+                break;
+
+            case stmt_type::BLOCK: PropagateValues(s.substmts, values);
+                break;
+
+            case stmt_type::BRANCH:
+            {
+                stmt& ifStmt = s.substmts.front();
+                rewrite(ifStmt.expressions.front());
+
+                ValueMap thenValues = values;
+                PropagateValues(ifStmt.substmts, thenValues);
+
+                ValueMap elseValues = values;
+                if (s.substmts.size() == 2)
+                    PropagateValues(s.substmts.back().substmts, elseValues);
+
+                // Only keep the values that are known after both paths.
+                values.clear();
+                for (auto& value : thenValues)
+                {
+                    auto it = elseValues.find(value.first);
+                    if (it != elseValues.end() && GetExpressionKey(it->second) == GetExpressionKey(value.second))
+                        values.insert(value);
+                }
+                break;
+            }
+
+            case stmt_type::LOOP:
+            {
+                // Anything assigned in the body is unknown at the condition, 
+                // which is also where the loop is left.
+                VariableSet assigned;
+                CollectAssigned(s.substmts, assigned);
+                for (const Variable& var : assigned)
+                    kill(var);
+
+                rewrite(s.expressions.front());
+
+                ValueMap bodyValues = values;
+                PropagateValues(s.substmts, bodyValues);
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    void Optimizer::SimplifyControlFlow(StmtList& stmts)
+    {
+        size_t i = 0;
+        while (i < stmts.size())
+        {
+            stmt& s = stmts[i];
+            switch (s.type)
+            {
+                case stmt_type::BLOCK:
+                {
+                    // Scopes are already resolved, so the block can be inlined into its parent.
+                    StmtList substmts = std::move(s.substmts);
+                    stmts.erase(stmts.begin() + i);
+                    stmts.insert(stmts.begin() + i, std::make_move_iterator(substmts.begin()), 
+                        std::make_move_iterator(substmts.end()));
+                    m_changes++;
+                    continue;
+                }
+
+                case stmt_type::BRANCH:
+                {
+                    for (stmt& block : s.substmts)
+                        SimplifyControlFlow(block.substmts);
+
+                    const expr& cond = s.substmts.front().expressions.front();
+                    if (IsIntegerConstant(cond))
+                    {
+                        StmtList taken;
+                        if (GetConstant(cond) != 0)
+                            taken = std::move(s.substmts.front().substmts);
+                        else if (s.substmts.size() == 2)
+                            taken = std::move(s.substmts.back().substmts);
+
+                        s = stmt(stmt_type::BLOCK, std::move(taken));
+                        m_changes++;
+                        continue;
+                    }
+                    break;
+                }
+
+                case stmt_type::LOOP:
+                    SimplifyControlFlow(s.substmts);
+                    if (IsIntegerConstant(s.expressions.front()) && GetConstant(s.expressions.front()) == 0)
+                    {
+                        stmts.erase(stmts.begin() + i);
+                        m_changes++;
+                        continue;
+                    }
+                    break;
+
+                case stmt_type::RETURN:
+                    if (i + 1 < stmts.size())
+                    {
+                        stmts.erase(stmts.begin() + i + 1, stmts.end());
+                        m_changes++;
+                    }
+                    break;
+
+                default: break;
+            }
+
+            i++;
+        }
+    }
+
+    void Optimizer::RemoveDeadCode(StmtList& stmts, VariableSet& live, bool isRemoving)
+    {
+        for (size_t i = stmts.size(); i-- > 0;)
+        {
+            stmt& s = stmts[i];
+            switch (s.type)
+            {
+                case stmt_type::ASSIGNMENT:
+                case stmt_type::INITIALIZATION:
+                {
+                    Variable var = GetVariable(s.id);
+                    if (isRemoving && live.count(var) == 0 && !HasSideEffects(s.expressions.front()))
+                    {
+                        stmts.erase(stmts.begin() + i);
+                        m_changes++;
+                        break;
+                    }
+
+                    live.erase(var);
+                    CollectUses(s.expressions.front(), live);
+                    break;
+                }
+
+                case stmt_type::DECLARATION: live.erase(GetVariable(s.id));
+                    break;
+
+                case stmt_type::CREATION:
+                    live.erase(GetVariable(s.id));
+                    CollectUses(s.expressions.front(), live);
+                    break;
+
+                case stmt_type::ASSIGN_OFFSET:
+                case stmt_type::ARRAY_FILL:
+                case stmt_type::ARRAY_COPY:
+                case stmt_type::DESTRUCTION:
+                    live.insert(GetVariable(s.id));
+                    for (const expr& e : s.expressions)
+                        CollectUses(e, live);
+                    break;
+
+                case stmt_type::FUNC_CALL: CollectUses(s.expressions.front(), live);
+                    break;
+
+                case stmt_type::RETURN:
+                    live.clear();
+                    for (const expr& e : s.expressions)
+                        CollectUses(e, live);
+                    break;
+
+                case stmt_type::BLOCK: RemoveDeadCode(s.substmts, live, isRemoving);
+                    break;
+
+                case stmt_type::BRANCH:
+                {
+                    VariableSet thenLive = live;
+                    RemoveDeadCode(s.substmts.front().substmts, thenLive, isRemoving);
+                    if (s.substmts.size() == 2)
+                        RemoveDeadCode(s.substmts.back().substmts, live, isRemoving);
+
+                    live.insert(thenLive.begin(), thenLive.end());
+                    CollectUses(s.substmts.front().expressions.front(), live);
+                    break;
+                }
+
+                case stmt_type::LOOP:
+                {
+                    // Find what is live at the condition, which is reached both 
+                    // before the loop and from the end of the body.
+                    VariableSet exitLive = live;
+                    CollectUses(s.expressions.front(), exitLive);
+
+                    VariableSet condLive = exitLive;
+                    while (true)
+                    {
+                        VariableSet bodyLive = condLive;
+                        RemoveDeadCode(s.substmts, bodyLive, false);
+                        bodyLive.insert(exitLive.begin(), exitLive.end());
+                        if (bodyLive == condLive)
+                            break;
+
+                        condLive.swap(bodyLive);
+                    }
+
+                    if (isRemoving)
+                    {
+                        VariableSet bodyLive = condLive;
+                        RemoveDeadCode(s.substmts, bodyLive, true);
+                    }
+
+                    live.swap(condLive);
+                    break;
+                }
+
+                default: break;
+            }
+        }
+    }
+
+    void Optimizer::EliminateCommonSubexpressions(StmtList& stmts)
+    {
+        // Statements are handled in runs without control flow. The condition of a
+        // branch is evaluated in the same run as the statements before it.
+        size_t begin = 0;
+        for (size_t i = 0; i <= stmts.size(); i++)
+        {
+            size_t end = i;
+            if (i < stmts.size())
+            {
+                stmt& s = stmts[i];
+                switch (s.type)
+                {
+                    case stmt_type::BRANCH: 
+                        for (stmt& block : s.substmts)
+                            EliminateCommonSubexpressions(block.substmts);
+                        end = i + 1;
+                        break;
+
+                    case stmt_type::BLOCK:
+                    case stmt_type::LOOP: EliminateCommonSubexpressions(s.substmts);
+                        break;
+
+                    default: continue;
+                }
+            }
+
+            // Each elimination inserts a statement before the current one.
+            while (EliminateCommonSubexpression(stmts, begin, end))
+            {
+                i++;
+                end++;
+            }
+
+            begin = i + 1;
+        }
+    }
+
+    bool Optimizer::EliminateCommonSubexpression(StmtList& stmts, size_t begin, size_t end)
+    {
+        // A run of statements in which an expression keeps its value.
+        struct Occurrences
+        {
+            expr        value;
+            VariableSet uses;
+            size_t      count;
+            size_t      first;
+            size_t      last;
+        };
+
+        std::map<std::string, Occurrences> open;
+        std::vector<Occurrences> closed;
+
+        auto close = [&](std::map<std::string, Occurrences>::iterator it)
+        {
+            if (it->second.count > 1)
+                closed.push_back(std::move(it->second));
+
+            return open.erase(it);
+        };
+
+        for (size_t i = begin; i < end; i++)
+        {
+            std::vector<expr*> evaluated = GetEvaluated(stmts[i]);
+            std::vector<const expr*> pending(evaluated.begin(), evaluated.end());
+            while (!pending.empty())
+            {
+                const expr* e = pending.back();
+                pending.pop_back();
+
+                for (const expr& operand : e->operands)
+                    pending.push_back(&operand);
+
+                if (!IsReusable(*e, true))
+                    continue;
+
+                auto result = open.emplace(GetExpressionKey(*e), Occurrences{*e, {}, 0, i, i});
+                Occurrences& occurrences = result.first->second;
+                if (result.second)
+                    CollectUses(*e, occurrences.uses);
+
+                occurrences.count++;
+                occurrences.last = i;
+            }
+
+            // The assignment happens after the statement is evaluated.
+            if (!IsAssigning(stmts[i]))
+                continue;
+
+            Variable var = GetVariable(stmts[i].id);
+            for (auto it = open.begin(); it != open.end();)
+            {
+                if (it->second.uses.count(var) > 0)
+                    it = close(it);
+                else
+                    ++it;
+            }
+        }
+
+        for (auto it = open.begin(); it != open.end();)
+            it = close(it);
+
+        if (closed.empty())
+            return false;
+
+        // Start with the largest expression, since it may contain smaller ones.
+        auto best = std::max_element(closed.begin(), closed.end(), 
+            [](const Occurrences& a, const Occurrences& b) 
+            { 
+                return CountNodes(a.value) < CountNodes(b.value);
+            });
+
+        std::string key = GetExpressionKey(best->value);
+        identifier temp = NewTemporary(best->value.dataType);
+        for (size_t i = best->first; i <= best->last; i++)
+            for (expr* e : GetEvaluated(stmts[i]))
+                ReplaceExpression(*e, key, temp);
+
+        stmts.insert(stmts.begin() + best->first, stmt(stmt_type::INITIALIZATION, temp, std::move(best->value)));
+        m_changes++;
+        return true;
+    }
+
+    void Optimizer::HoistLoopInvariants(StmtList& stmts)
+    {
+        for (size_t i = 0; i < stmts.size(); i++)
+        {
+            // Hoist out of inner loops first, so that their invariants may be hoisted further.
+            switch (stmts[i].type)
+            {
+                case stmt_type::BLOCK:
+                case stmt_type::LOOP: HoistLoopInvariants(stmts[i].substmts);
+                    break;
+
+                case stmt_type::BRANCH:
+                    for (stmt& block : stmts[i].substmts)
+                        HoistLoopInvariants(block.substmts);
+                    break;
+
+                default: break;
+            }
+
+            if (stmts[i].type != stmt_type::LOOP)
+                continue;
+
+            VariableSet assigned;
+            CollectAssigned(stmts[i].substmts, assigned);
+
+            std::map<std::string, identifier> temps;
+            StmtList hoisted;
+            HoistInvariants(stmts[i], assigned, temps, hoisted);
+
+            m_changes += hoisted.size();
+            stmts.insert(stmts.begin() + i, std::make_move_iterator(hoisted.begin()), 
+                std::make_move_iterator(hoisted.end()));
+            i += hoisted.size();
+        }
+    }
+
+    void Optimizer::HoistInvariants(stmt& s, const VariableSet& assigned, 
+        std::map<std::string, identifier>& temps, StmtList& hoisted)
+    {
+        for (expr& e : s.expressions)
+            HoistInvariants(e, assigned, temps, hoisted);
+
+        for (stmt& substmt : s.substmts)
+            HoistInvariants(substmt, assigned, temps, hoisted);
+    }
+
+    void Optimizer::HoistInvariants(expr& e, const VariableSet& assigned, 
+        std::map<std::string, identifier>& temps, StmtList& hoisted)
+    {
+        if (IsReusable(e, false))
+        {
+            VariableSet uses;
+            CollectUses(e, uses);
+
+            bool isInvariant = std::none_of(uses.begin(), uses.end(), 
+                [&](const Variable& var) { return assigned.count(var) > 0; });
+
+            if (isInvariant)
+            {
+                std::string key = GetExpressionKey(e);
+                auto it = temps.find(key);
+                if (it == temps.end())
+                {
+                    identifier temp = NewTemporary(e.dataType);
+                    hoisted.push_back(stmt(stmt_type::INITIALIZATION, temp, expr(e)));
+                    it = temps.emplace(key, temp).first;
+                }
+
+                e = expr(it->second);
+                return;
+            }
+        }
+
+        for (expr& operand : e.operands)
+            HoistInvariants(operand, assigned, temps, hoisted);
+    }
+
+    void Optimizer::LowerMemoryLoops(StmtList& stmts)
+    {
+        for (stmt& s : stmts)
+        {
+            switch (s.type)
+            {
+                case stmt_type::BLOCK:
+                case stmt_type::LOOP: LowerMemoryLoops(s.substmts);
+                    break;
+
+                case stmt_type::BRANCH:
+                    for (stmt& block : s.substmts)
+                        LowerMemoryLoops(block.substmts);
+                    break;
+
+                default: break;
+            }
+
+            if (s.type == stmt_type::LOOP && LowerMemoryLoop(s))
+                m_changes++;
+        }
+    }
+
+    bool Optimizer::LowerMemoryLoop(stmt& loop)
+    {
+        // The condition compares the index to a bound that the loop doesn't change.
+        const expr& cond = loop.expressions.front();
+        if (cond.type != expr_type::LT || !IsVariable(cond.operands.front()) || 
+            cond.operands.front().dataType != DataType::INT)
+        {
+            return false;
+        }
+
+        const identifier& index = cond.operands.front().id;
+        const expr& bound = cond.operands.back();
+        Variable var = GetVariable(index);
+
+        auto isIndex = [&](const expr& e) { return IsVariable(e) && GetVariable(e.id) == var; };
+        auto usesIndex = [&](const expr& e)
+        {
+            VariableSet uses;
+            CollectUses(e, uses);
+            return uses.count(var) > 0;
+        };
+
+        if (bound.dataType != DataType::INT || ReadsMemory(bound) || usesIndex(bound))
+            return false;
+
+        // The body stores a single element, and then steps the index by one.
+        if (loop.substmts.size() != 2)
+            return false;
+
+        const stmt& store = loop.substmts.front();
+        const stmt& step = loop.substmts.back();
+        if (step.type != stmt_type::ASSIGNMENT || GetVariable(step.id) != var || 
+            step.expressions.front().type != expr_type::ADD)
+        {
+            return false;
+        }
+
+        const expr& next = step.expressions.front();
+        auto isOne = [](const expr& e) { return IsIntegerConstant(e) && GetConstant(e) == 1; };
+        if (!(isIndex(next.operands.front()) && isOne(next.operands.back())) &&
+            !(isOne(next.operands.front()) && isIndex(next.operands.back())))
+        {
+            return false;
+        }
+
+        bool isArrayVariable = store.id.type == identifier_type::LOCAL_VAR || store.id.type == identifier_type::ARG_VAR;
+        if (store.type != stmt_type::ASSIGN_OFFSET || !isArrayVariable || !IsArray(store.id.dataType) ||
+            GetVariable(store.id) == var || !isIndex(store.expressions.front()))
+        {
+            return false;
+        }
+
+        DataType elementType = ARRAY_TO_BASE(store.id.dataType);
+        int32_t elementSize = GetDataTypeBytes(elementType);
+        const expr& value = store.expressions.back();
+
+        // Element reads are indexed in bytes, e.g. b[i] is b[4 * i] for ints.
+        auto isElementOffset = [&](const expr& e)
+        {
+            auto isSize = [&](const expr& size) { return IsIntegerConstant(size) && GetConstant(size) == elementSize; };
+            return e.type == expr_type::MUL &&
+                ((isSize(e.operands.front()) && isIndex(e.operands.back())) ||
+                 (isIndex(e.operands.front()) && isSize(e.operands.back())));
+        };
+
+        auto makeInt = [](expr_type type, expr&& lhs, expr&& rhs)
+        {
+            expr e(type, std::move(lhs), std::move(rhs));
+            e.dataType = DataType::INT;
+            return e;
+        };
+
+        auto elementAddress = [&](const identifier& array)
+        {
+            return makeInt(expr_type::ADD, expr(array), 
+                makeInt(expr_type::MUL, expr(index), expr(elementSize)));
+        };
+
+        expr count = makeInt(expr_type::SUB, expr(bound), expr(index));
+        ExprList operands;
+        stmt_type bulkType;
+
+        if (value.type == expr_type::ID_OFFSET && IsVariable(value.operands.front()) && 
+            value.operands.front().dataType == store.id.dataType && !isIndex(value.operands.front()) &&
+            isElementOffset(value.operands.back()))
+        {
+            bulkType = stmt_type::ARRAY_COPY;
+            operands = MakeList<expr>(elementAddress(store.id), elementAddress(value.operands.front().id),
+                makeInt(expr_type::MUL, std::move(count), expr(elementSize)));
+        }
+        else if (value.dataType == elementType && !ReadsMemory(value) && !usesIndex(value) &&
+            (IsNumeric(value.dataType) || value.type == expr_type::STRING || IsVariable(value)))
+        {
+            // Values that would allocate a new string for each element are left alone.
+            bulkType = stmt_type::ARRAY_FILL;
+            operands = MakeList<expr>(elementAddress(store.id), expr(value), std::move(count));
+        }
+        else
+            return false;
+
+        StmtList body = MakeList<stmt>(
+            stmt(bulkType, store.id, std::move(operands)),
+            stmt(stmt_type::ASSIGNMENT, index, expr(bound)));
+
+        expr guard = std::move(loop.expressions.front());
+        loop = stmt(stmt_type::BRANCH, MakeList<stmt>(stmt(stmt_type::BLOCK, std::move(guard), std::move(body))));
+        return true;
+    }
+
+    void Optimizer::LowerSelects(StmtList& stmts)
+    {
+        for (stmt& s : stmts)
+        {
+            switch (s.type)
+            {
+                case stmt_type::BLOCK:
+                case stmt_type::LOOP: LowerSelects(s.substmts);
+                    break;
+
+                case stmt_type::BRANCH:
+                    for (stmt& block : s.substmts)
+                        LowerSelects(block.substmts);
+                    break;
+
+                default: break;
+            }
+
+            if (s.type == stmt_type::BRANCH && LowerSelect(s))
+                m_changes++;
+        }
+    }
+
+    bool Optimizer::LowerSelect(stmt& branch)
+    {
+        // The if-block assigns a single variable, and so does the else-block, if any.
+        const stmt& ifBlock = branch.substmts.front();
+        const expr& cond = ifBlock.expressions.front();
+        if (!IsCondition(cond) || ifBlock.substmts.size() != 1 || !IsSelectableAssignment(ifBlock.substmts.front()))
+            return false;
+
+        const stmt& assignment = ifBlock.substmts.front();
+        expr otherwise(assignment.id);
+        if (branch.substmts.size() == 2)
+        {
+            const stmt& elseBlock = branch.substmts.back();
+            if (elseBlock.substmts.size() != 1 || !IsSelectableAssignment(elseBlock.substmts.front()) ||
+                GetVariable(elseBlock.substmts.front().id) != GetVariable(assignment.id))
+            {
+                return false;
+            }
+
+            otherwise = elseBlock.substmts.front().expressions.front();
+        }
+
+        expr value(expr_type::SELECT, expr(cond), expr(assignment.expressions.front()), std::move(otherwise));
+        value.dataType = assignment.id.dataType;
+
+        identifier id = assignment.id;
+        branch = stmt(stmt_type::ASSIGNMENT, id, std::move(value));
+        return true;
+    }
+
+    identifier Optimizer::NewTemporary(DataType dataType)
+    {
+        return identifier(identifier_type::LOCAL_VAR, "_t" + std::to_string(m_nextTemp++), 
+            m_func->localVarCnt++, dataType);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_OPTIMIZER_HPP
+#define INC_OPTIMIZER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "types.hpp"
+
+namespace Compiler
+{
+    // Optimizes the statements of a function in place, before they are handed to
+    // either code generator. Since locals and arguments can't be aliased, the
+    // statement tree already names every value a variable may hold, and each
+    // pass is a data-flow analysis over the tree:
+    //  - constant folding, and constant and copy propagation,
+    //  - removal of dead assignments, constant branches and unreachable statements,
+    //  - common subexpression elimination within straight-line statements,
+    //  - hoisting of loop-invariant expressions out of while-loops,
+    //  - lowering of loops that fill or copy arrays element by element to bulk statements,
+    //  - lowering of branches that only pick the value of a variable to selects.
+    // New temporaries are declared as locals of the function being optimized.
+    class Optimizer
+    {
+    public:
+        using Variable    = std::pair<identifier_type, size_t>;
+        using VariableSet = std::set<Variable>;
+        using ValueMap    = std::map<Variable, expr>; // Known constant or copied value of each variable.
+
+    private:
+        func*  m_func;
+        size_t m_changes;
+        size_t m_nextTemp;
+
+    public:
+        Optimizer();
+        ~Optimizer();
+
+        // Optimizes the function, and returns the number of changes made.
+        size_t Optimize(func& function);
+
+    private:
+        // Runs propagation and dead code removal until nothing changes.
+        void Simplify();
+
+        bool FoldConstants(expr& e);
+        void SubstituteValues(expr& e, const ValueMap& values);
+
+        void PropagateValues(StmtList& stmts, ValueMap& values);
+        void PropagateValues(stmt& s, ValueMap& values);
+
+        // Replaces branches on constant conditions by the taken block, and
+        // removes statements directly following a return.
+        void SimplifyControlFlow(StmtList& stmts);
+
+        // Removes assignments to variables that are not in 'live' afterwards,
+        // going backwards. 'live' holds the variables live after the statements, 
+        // and is updated to hold the ones live before them.
+        void RemoveDeadCode(StmtList& stmts, VariableSet& live, bool isRemoving);
+
+        void EliminateCommonSubexpressions(StmtList& stmts);
+        bool EliminateCommonSubexpression(StmtList& stmts, size_t begin, size_t end);
+
+        void HoistLoopInvariants(StmtList& stmts);
+        void HoistInvariants(stmt& s, const VariableSet& assigned, 
+            std::map<std::string, identifier>& temps, StmtList& hoisted);
+        void HoistInvariants(expr& e, const VariableSet& assigned, 
+            std::map<std::string, identifier>& temps, StmtList& hoisted);
+
+        // Replaces loops of the forms below by a single fill or copy of the 
+        // remaining elements, guarded by the loop condition:
+        //   while (i < n) { a[i] = v; i = i + 1; }     -> if (i < n) { fill; i = n; }
+        //   while (i < n) { a[i] = b[i]; i = i + 1; }  -> if (i < n) { copy; i = n; }
+        void LowerMemoryLoops(StmtList& stmts);
+        bool LowerMemoryLoop(stmt& loop);
+
+        // Replaces branches that assign a variable one of two values, that are
+        // cheap and safe to compute either way, by a select of the value:
+        //   if (c) { x = a; }                -> x = c ? a : x;
+        //   if (c) { x = a; } else { x = b; } -> x = c ? a : b;
+        void LowerSelects(StmtList& stmts);
+        bool LowerSelect(stmt& branch);
+
+        identifier NewTemporary(DataType dataType);
+    };
+}
+
+#endif // INC_OPTIMIZER_HPP
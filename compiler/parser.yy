@@ -125,9 +125,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
  /* Rules with types */
 %type<func> func
-%type<std::vector<stmt>> stmts args_comma func_args
-%type<stmt> stmt cond_stmt arg_decl
-%type<std::vector<expr>> expr_list_1 expr_list_0
+%type<StmtList> stmts args_comma func_args
+%type<stmt> stmt cond_stmt loop_stmt arg_decl
+%type<ExprList> expr_list_1 expr_list_0
 %type<expr> expr number func_call binary_expr unary_expr
 %type<DataType> data_type
 
@@ -198,7 +198,7 @@ stmts: stmts stmt               {$$ = M($1); $$.push_back(M($2));}
 stmt: data_type ID SEMICOLON                    {$$ = stmt(stmt_type::DECLARATION, cmp.DeclVar($1, M($2), identifier_type::LOCAL_VAR));}
     | ID ASSIGN expr SEMICOLON                  {$$ = stmt(stmt_type::ASSIGNMENT, cmp.UseVar(M($1)), M($3)); TypeCheckAssign($$);}
     | ID ASSIGN CREATE expr SEMICOLON           {$$ = stmt(stmt_type::CREATION, cmp.UseVar(M($1)), M($4));}
-    | ID L_SQ expr R_SQ ASSIGN expr SEMICOLON   {$$ = stmt(stmt_type::ASSIGN_OFFSET, cmp.UseVar(M($1)), {M($3), M($6)}); TypeCheckAssign($$);}
+    | ID L_SQ expr R_SQ ASSIGN expr SEMICOLON   {$$ = stmt(stmt_type::ASSIGN_OFFSET, cmp.UseVar(M($1)), MakeList<expr>(M($3), M($6))); TypeCheckAssign($$);}
     | data_type ID ASSIGN expr SEMICOLON        {$$ = stmt(stmt_type::INITIALIZATION, cmp.DeclVar($1, M($2), identifier_type::LOCAL_VAR), M($4));  TypeCheckAssign($$);}
     | data_type ID ASSIGN CREATE expr SEMICOLON {$$ = stmt(stmt_type::CREATION, cmp.DeclVar($1, M($2), identifier_type::LOCAL_VAR), M($5)); CheckArrayCreation($$);}
  /* | DESTROY ID SEMICOLON                      {$$ = stmt(stmt_type::DESTRUCTION, cmp.UseVar(M($2)));} */
@@ -206,11 +206,15 @@ stmt: data_type ID SEMICOLON                    {$$ = stmt(stmt_type::DECLARATIO
     | RETURN SEMICOLON                          {$$ = stmt(stmt_type::RETURN); TypeCheckReturn($$);}
     | func_call SEMICOLON                       {$$ = stmt(stmt_type::FUNC_CALL, M($1));}
     | cond_stmt                                 {$$ = M($1);}
+    | loop_stmt                                 {$$ = M($1);}
     | {cmp.EnterScope();} L_CURL stmts R_CURL   {$$ = stmt(stmt_type::BLOCK, M($3)); cmp.ExitScope();}
     ;
 
-cond_stmt: IF L_PAR expr R_PAR stmt %prec IFX {$$ = stmt(stmt_type::BRANCH, {stmt(stmt_type::BLOCK, M($3), {M($5)})});}
-         | IF L_PAR expr R_PAR stmt ELSE stmt {$$ = stmt(stmt_type::BRANCH, {stmt(stmt_type::BLOCK, M($3), {M($5)}), stmt(stmt_type::BLOCK, {M($7)})});}
+cond_stmt: IF L_PAR expr R_PAR stmt %prec IFX {$$ = stmt(stmt_type::BRANCH, MakeList<stmt>(stmt(stmt_type::BLOCK, M($3), MakeList<stmt>(M($5)))));}
+         | IF L_PAR expr R_PAR stmt ELSE stmt {$$ = stmt(stmt_type::BRANCH, MakeList<stmt>(stmt(stmt_type::BLOCK, M($3), MakeList<stmt>(M($5))), stmt(stmt_type::BLOCK, MakeList<stmt>(M($7)))));}
+         ;
+
+loop_stmt: WHILE L_PAR expr R_PAR stmt        {$$ = stmt(stmt_type::LOOP, M($3), MakeList<stmt>(M($5)));}
          ;
 
 expr: ID                        {$$ = expr(cmp.UseVar(M($1)));}
@@ -244,7 +248,7 @@ unary_expr: MINUS expr                 {$$ = expr(expr_type::NEG, M($2));}
           | data_type L_PAR expr COMMA expr R_PAR {$$ = expr($1, M($3), M($5)); TypeCheck($$); }
           ;
 
-func_call: ID L_PAR expr_list_0 R_PAR   {$$ = expr(expr_type::CALL, cmp.UseFunc($1, $3), expr($3));}
+func_call: ID L_PAR expr_list_0 R_PAR   {const func& f = cmp.UseFunc($1, $3); $$ = expr(expr_type::CALL, expr(f), expr(M($3)));}
          ;
 
 %%
@@ -252,4 +256,5 @@ func_call: ID L_PAR expr_list_0 R_PAR   {$$ = expr(expr_type::CALL, cmp.UseFunc(
 void Compiler::RackParser::error(const location_type& loc, const std::string& msg)
 {
     std::cerr << loc << ": " << msg << '\n';
+    cmp.m_hasError = true;
 }
@@ -29,11 +29,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define INC_TYPES_HPP
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <new>
 #include <vector>
 #include <list>
 #include <ostream>
 #include <map>
 #include <sstream>
+#include <unordered_set>
 
 #define ARRAY_TO_BASE(x) (::Compiler::g_arrToBaseType[x])
 
@@ -41,6 +45,188 @@ namespace Compiler
 {
     struct func;
     struct stmt;
+    struct expr;
+
+    // An interned string, such as the name of a variable or a string literal. Every
+    // distinct string is only stored once, for as long as the program runs, so
+    // symbols are copied and compared as pointers.
+    class Symbol
+    {
+    private:
+        const std::string* m_str;
+
+        static const std::string* Intern(std::string&& str)
+        {
+            static std::unordered_set<std::string> pool;
+            return &*pool.insert(std::move(str)).first;
+        }
+
+        static const std::string* Empty()
+        {
+            static const std::string* empty = Intern(std::string());
+            return empty;
+        }
+
+    public:
+        Symbol() : m_str(Empty()) {}
+        Symbol(const std::string& str) : m_str(Intern(std::string(str))) {}
+        Symbol(std::string&& str) : m_str(Intern(std::move(str))) {}
+
+        inline const std::string& str() const { return *m_str; }
+        inline operator const std::string&() const { return *m_str; }
+
+        friend bool operator ==(const Symbol& lhs, const Symbol& rhs) { return lhs.m_str == rhs.m_str; }
+        friend bool operator !=(const Symbol& lhs, const Symbol& rhs) { return lhs.m_str != rhs.m_str; }
+        friend bool operator ==(const Symbol& lhs, const std::string& rhs) { return *lhs.m_str == rhs; }
+        friend bool operator !=(const Symbol& lhs, const std::string& rhs) { return *lhs.m_str != rhs; }
+        friend bool operator ==(const std::string& lhs, const Symbol& rhs) { return lhs == *rhs.m_str; }
+        friend bool operator !=(const std::string& lhs, const Symbol& rhs) { return lhs != *rhs.m_str; }
+
+        friend std::ostream& operator <<(std::ostream& os, const Symbol& symbol) { return os << *symbol.m_str; }
+
+        struct Hash
+        {
+            inline size_t operator()(const Symbol& symbol) const { return std::hash<const std::string*>()(symbol.m_str); }
+        };
+    };
+
+    // A bump arena for the nodes of one kind, which keeps the nodes of a program 
+    // together in large blocks instead of in one heap allocation per list. Freed 
+    // lists are kept by length, and reused by later lists of that length or less.
+    // The blocks are kept until exit.
+    template<typename T>
+    class AstPool
+    {
+    private:
+        static constexpr size_t BLOCK_COUNT = 4096;            // Nodes per block.
+        static constexpr size_t MAX_POOLED = BLOCK_COUNT / 16; // Longer lists use the heap.
+        static constexpr size_t FREE_WORDS = MAX_POOLED / 64 + 1;
+
+        struct FreeList { FreeList* next; };
+
+        static T*        s_next;
+        static T*        s_end;
+        static FreeList* s_free[MAX_POOLED + 1];
+        static uint64_t  s_used[FREE_WORDS]; // Which free lists aren't empty.
+
+        // Finds the shortest free list of at least the given length, or returns 0.
+        static size_t FindFree(size_t count)
+        {
+            for (size_t word = count / 64; word < FREE_WORDS; ++word)
+            {
+                uint64_t bits = s_used[word];
+                if (word == count / 64)
+                    bits &= ~0ull << (count % 64);
+
+                if (bits != 0)
+                {
+                    size_t length = word * 64;
+                    for (; (bits & 0xFF) == 0; bits >>= 8)
+                        length += 8;
+                    for (; (bits & 1) == 0; bits >>= 1)
+                        ++length;
+
+                    return length;
+                }
+            }
+
+            return 0;
+        }
+
+        // Puts a list of at most MAX_POOLED nodes on the free list of its length.
+        static void Free(T* nodes, size_t count)
+        {
+            FreeList* list = reinterpret_cast<FreeList*>(nodes);
+            list->next = s_free[count];
+            s_free[count] = list;
+            s_used[count / 64] |= 1ull << (count % 64);
+        }
+
+    public:
+        static T* Allocate(size_t count)
+        {
+            if (count > MAX_POOLED)
+                return static_cast<T*>(::operator new(count * sizeof(T)));
+
+            if (size_t length = FindFree(count))
+            {
+                FreeList* list = s_free[length];
+                s_free[length] = list->next;
+                if (list->next == nullptr)
+                    s_used[length / 64] &= ~(1ull << (length % 64));
+
+                // The rest of a longer list is freed again.
+                T* nodes = reinterpret_cast<T*>(list);
+                if (length > count)
+                    Free(nodes + count, length - count);
+
+                return nodes;
+            }
+
+            if (count > static_cast<size_t>(s_end - s_next))
+            {
+                if (s_next != s_end)
+                    Free(s_next, s_end - s_next);
+
+                s_next = static_cast<T*>(::operator new(BLOCK_COUNT * sizeof(T)));
+                s_end = s_next + BLOCK_COUNT;
+            }
+
+            T* nodes = s_next;
+            s_next += count;
+            return nodes;
+        }
+
+        static void Deallocate(T* nodes, size_t count)
+        {
+            if (count > MAX_POOLED)
+            {
+                ::operator delete(nodes);
+                return;
+            }
+
+            Free(nodes, count);
+        }
+    };
+
+    template<typename T> T* AstPool<T>::s_next = nullptr;
+    template<typename T> T* AstPool<T>::s_end = nullptr;
+    template<typename T> typename AstPool<T>::FreeList* AstPool<T>::s_free[AstPool<T>::MAX_POOLED + 1] = {};
+    template<typename T> uint64_t AstPool<T>::s_used[AstPool<T>::FREE_WORDS] = {};
+
+    // Allocates the lists of the syntax tree from the pool of their node kind.
+    template<typename T>
+    struct AstAllocator
+    {
+        typedef T value_type;
+
+        AstAllocator() = default;
+        template<typename U> AstAllocator(const AstAllocator<U>&) {}
+
+        inline T* allocate(size_t count) { return AstPool<T>::Allocate(count); }
+        inline void deallocate(T* nodes, size_t count) { AstPool<T>::Deallocate(nodes, count); }
+
+        template<typename U> bool operator ==(const AstAllocator<U>&) const { return true; }
+        template<typename U> bool operator !=(const AstAllocator<U>&) const { return false; }
+    };
+
+    template<typename T>
+    using AstList = std::vector<T, AstAllocator<T>>;
+
+    using ExprList = AstList<expr>;
+    using StmtList = AstList<stmt>;
+
+    // Builds a list by moving the given nodes into it. Unlike an initializer list,
+    // which can only be copied from, this never copies whole subtrees.
+    template<typename T, typename... Args>
+    inline AstList<T> MakeList(Args&&... args)
+    {
+        AstList<T> list;
+        list.reserve(sizeof...(Args));
+        int expansion[sizeof...(Args) + 1] = {0, (list.emplace_back(std::forward<Args>(args)), 0)...};
+        (void)expansion;
+        return list;
+    }
 
     enum class DataType : unsigned char
     {
@@ -81,7 +267,8 @@ namespace Compiler
         CALL,
         EXPR_LIST,
         CAST,
-        STREQ       // Compares the first byte of two string.
+        STREQ,      // Compares the first byte of two string.
+        SELECT      // Condition, and the values if true and if false. Both values are evaluated.
     };
 
     extern std::ostream& operator <<(std::ostream& os, const expr_type& e);
@@ -154,9 +341,12 @@ namespace Compiler
         FUNC_CALL,
         BRANCH,     // Contains multiple 1 or more block statements.
         BLOCK,      // A block of statements, used for branching.
+        LOOP,       // Condition expression, with the loop body as its only substatement.
         CREATION,
         DESTRUCTION,
-        RETURN
+        RETURN,
+        ARRAY_FILL, // Destination address, value and element count. The id is the filled array.
+        ARRAY_COPY  // Destination address, source address and byte count. The id is the destination array.
     };
 
     enum class identifier_type
@@ -173,7 +363,7 @@ namespace Compiler
     struct identifier
     {
         identifier_type type;
-        std::string     id;
+        Symbol          id;
         size_t          position;
         DataType        dataType;
 
@@ -201,8 +391,8 @@ namespace Compiler
         DataType                 returnType;
         size_t                   localVarCnt;
         size_t                   argVarCnt;
-        std::vector<stmt>        statements;
-        std::vector<stmt>        args;
+        StmtList                 statements;
+        StmtList                 args;
 
         func() :
             id(),
@@ -214,7 +404,7 @@ namespace Compiler
         {
         }
 
-        func(const std::string& id, DataType retType, std::vector<stmt>&& args) :
+        func(const std::string& id, DataType retType, StmtList&& args) :
             id(identifier_type::FUNC_NAME, id, 0, retType),
             returnType(retType),
             localVarCnt(0),
@@ -235,13 +425,13 @@ namespace Compiler
             double      doubleValue;
         };
 
-        std::string strValue;
+        Symbol strValue;
         
         identifier      id;
         expr_type       type;
         DataType        dataType;
         const func*     function;
-        std::vector<expr> operands;
+        ExprList        operands;
 
         expr() : dataType(DataType::UNDEFINED) {}
 
@@ -249,17 +439,24 @@ namespace Compiler
         expr(expr_type type, T&&... args) : 
             type(type), 
             dataType(DataType::UNDEFINED), 
-            operands{std::forward<T>(args)...} 
+            operands(MakeList<expr>(std::forward<T>(args)...))
         {
         }
 
-        expr(const std::vector<expr>& list) :
+        expr(const ExprList& list) :
             type(expr_type::EXPR_LIST),
             dataType(DataType::UNDEFINED), 
             operands(list)
         {
         }
 
+        expr(ExprList&& list) :
+            type(expr_type::EXPR_LIST),
+            dataType(DataType::UNDEFINED), 
+            operands(std::move(list))
+        {
+        }
+
         expr(const identifier& value) : 
             type(expr_type::ID), 
             dataType(value.dataType), 
@@ -313,14 +510,14 @@ namespace Compiler
         expr(DataType castType, expr&& value) : 
             type(expr_type::CAST), 
             dataType(castType), 
-            operands({std::move(value)})
+            operands(MakeList<expr>(std::move(value)))
         {
         }
 
         expr(DataType castType, expr&& value, expr&& castArg) : 
             type(expr_type::CAST), 
             dataType(castType), 
-            operands({std::move(value), std::move(castArg)})
+            operands(MakeList<expr>(std::move(value), std::move(castArg)))
         {
         }
 
@@ -435,7 +632,7 @@ namespace Compiler
                     if (rhs.type == expr_type::NUMBER)
                         rhs.intValue *= elementSize;
                     else
-                        rhs = expr(expr_type::MUL, expr((int32_t)elementSize), rhs);
+                        rhs = expr(expr_type::MUL, expr((int32_t)elementSize), std::move(rhs));
                 }
 
                 return "";
@@ -459,6 +656,9 @@ namespace Compiler
                 switch (type)
                 {
                     case expr_type::ADD:
+                        // Strings may be concatenated.
+                        if (lhs.dataType == DataType::STRING && rhs.dataType == DataType::STRING)
+                            break;
                     case expr_type::SUB:
                     case expr_type::MUL:
                     case expr_type::DIV:
@@ -481,8 +681,8 @@ namespace Compiler
     {
         stmt_type         type;
         identifier        id;
-        std::vector<expr> expressions;
-        std::vector<stmt> substmts;
+        ExprList          expressions;
+        StmtList          substmts;
 
         stmt() :
             type(stmt_type::UNDEFINED),
@@ -503,7 +703,7 @@ namespace Compiler
         stmt(stmt_type type, expr&& expr) : 
             type(type),
             id(),
-            expressions({std::move(expr)}),
+            expressions(MakeList<Compiler::expr>(std::move(expr))),
             substmts()
         {
         }
@@ -521,14 +721,14 @@ namespace Compiler
         stmt(stmt_type type, const identifier& id, expr&& exp) :
             type(type), 
             id(id),
-            expressions({std::move(exp)}),
+            expressions(MakeList<expr>(std::move(exp))),
             substmts()
         {
             CheckAssignmentType();
         }
 
         // For indexed variable assignment, eg. numbers[5] = ...
-        stmt(stmt_type type, const identifier& id, std::vector<expr>&& exprs) :
+        stmt(stmt_type type, const identifier& id, ExprList&& exprs) :
             type(type), 
             id(id),
             expressions(std::move(exprs)),
@@ -536,21 +736,21 @@ namespace Compiler
         {
         }
 
-        // For if-statements
-        stmt(stmt_type type, expr&& cond_expr, std::vector<stmt>&& stmts) : 
+        // For if-statements and while-loops.
+        stmt(stmt_type type, expr&& cond_expr, StmtList&& stmts) : 
             type(type),
             id(),
-            expressions({std::move(cond_expr)}),
-            substmts(stmts)
+            expressions(MakeList<expr>(std::move(cond_expr))),
+            substmts(std::move(stmts))
         {
         }
 
         // For block-statements.
-        stmt(stmt_type type, std::vector<stmt>&& stmts) : 
+        stmt(stmt_type type, StmtList&& stmts) : 
             type(type),
             id(),
             expressions(),
-            substmts(stmts)
+            substmts(std::move(stmts))
         {
         }
 
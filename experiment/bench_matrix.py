@@ -0,0 +1,202 @@
+# BSD 2-Clause License
+
+# Copyright (c) 2022, Kasper Skott
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Builds the VM in every configured variant and runs the benchmark suite on
+# all of them, writing a single combined results file. This replaces building
+# each configuration by hand, like the ones found in ./data.
+#
+# A variant is the combination of a compiler, an optimization level and a
+# decoding technique. Additional variants can be given with --variant, which
+# takes a label followed by extra CMake definitions, e.g. for other dispatch 
+# techniques:
+#   --variant "goto:-DSOME_OPTION=ON"
+#
+# All runs are pinned to a single CPU (--cpu), and the variants are run in an
+# interleaved order, so that drift in the machine state (thermals, other 
+# processes) is spread out over all of them instead of biasing one.
+#
+# The results can be compared with a previous results file through:
+#   genfig.py compare old.csv new.csv
+
+import argparse
+import csv
+import os
+import os.path
+import shutil
+import subprocess
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(SCRIPT_DIR, "..", "vm", "benchmarks"))
+
+import run_benchmarks
+
+class config:
+    def __init__(self, compiler: str, opt: str, decoding: str, 
+                 extra: "tuple[str, list[str]]" = ("", [])) -> None:
+        self.compiler = compiler
+        self.opt      = opt
+        self.decoding = decoding
+        self.extra    = extra
+        self.label    = "%s-%s-%s" % (os.path.basename(compiler), opt, decoding)
+        if extra[0]:
+            self.label += "-" + extra[0]
+
+    def cmake_args(self) -> "list[str]":
+        return ["-DCMAKE_BUILD_TYPE=Release",
+                "-DCMAKE_C_COMPILER=" + self.compiler,
+                "-DVM_OPTIMIZATION=-" + self.opt,
+                "-DUNION_DECODING=" + ("ON" if self.decoding == "union" else "OFF")
+               ] + self.extra[1]
+
+def run(cmd: "list[str]", quiet: bool) -> None:
+    out = subprocess.DEVNULL if quiet else None
+    subprocess.run(cmd, stdout=out, check=True)
+
+def build(cfg: config, source: str, build_root: str, 
+          quiet: bool) -> "tuple[str, str]":
+    build_dir = os.path.join(build_root, cfg.label)
+    print("Building %s..." % cfg.label)
+    run(["cmake", "-S", source, "-B", build_dir] + cfg.cmake_args(), quiet)
+    # Multiple targets per invocation need CMake 3.15, the project requires 3.13.
+    for target in ("vm", "benchmarks"):
+        run(["cmake", "--build", build_dir, "--target", target], quiet)
+
+    vm = os.path.join(build_dir, "vm", "vm")
+    if not os.path.exists(vm):
+        vm += ".exe"
+    return build_dir, vm
+
+def pin_to_cpu(cpu: int) -> None:
+    if not hasattr(os, "sched_setaffinity"):
+        print("Warning: CPU affinity is not supported on this platform.")
+        return
+    # Child processes inherit the affinity of this one.
+    os.sched_setaffinity(0, {cpu})
+
+def parse_variant(spec: str) -> "tuple[str, list[str]]":
+    label, _, defines = spec.partition(":")
+    return label, defines.split()
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description="Builds and benchmarks every configured variant of RackVM.")
+    parser.add_argument("--source", default=os.path.join(SCRIPT_DIR, ".."),
+                        help="root of the RackVM source tree")
+    parser.add_argument("--build-root", default="build-matrix",
+                        help="directory in which every variant is built")
+    parser.add_argument("--compilers", default=os.environ.get("CC", "cc"),
+                        help="comma separated list of C compilers")
+    parser.add_argument("--opt", default="O0,O1,O2,O3",
+                        help="comma separated list of optimization levels")
+    parser.add_argument("--decoding", default="union,bitmask",
+                        help="comma separated list of decoding techniques")
+    parser.add_argument("--variant", action="append", default=[],
+                        help="extra variant as LABEL:-DDEFINE=VALUE ...")
+    parser.add_argument("--runs", type=int, default=10,
+                        help="number of measured runs per benchmark and variant")
+    parser.add_argument("--cpu", type=int, default=None,
+                        help="CPU to pin the runs to (default: the last one)")
+    parser.add_argument("--filter", default="",
+                        help="only run benchmarks whose name contains this")
+    parser.add_argument("--out", default="results.csv",
+                        help="combined results file")
+    parser.add_argument("--verbose", action="store_true",
+                        help="show the output of CMake")
+    args = parser.parse_args()
+
+    configs = list()
+    for compiler in args.compilers.split(","):
+        if not shutil.which(compiler):
+            print("Warning: compiler \"%s\" not found, skipping it." % compiler)
+            continue
+        for opt in args.opt.split(","):
+            for decoding in args.decoding.split(","):
+                configs.append(config(compiler, opt, decoding))
+                for spec in args.variant:
+                    configs.append(config(compiler, opt, decoding, 
+                                          parse_variant(spec)))
+
+    if not configs:
+        print("Nothing to build.")
+        return 1
+
+    source = os.path.abspath(args.source)
+    build_root = os.path.abspath(args.build_root)
+    vms = list()
+    for cfg in configs:
+        build_dir, path = build(cfg, source, build_root, not args.verbose)
+        vms.append((cfg, run_benchmarks.variant(cfg.label + "=" + path)))
+
+    # All variants run the same binaries, from the first build.
+    bin_dir = os.path.join(build_root, configs[0].label, "vm", "benchmarks")
+    binaries = run_benchmarks.find_binaries(bin_dir, args.filter)
+
+    cpu = args.cpu
+    if cpu is None and hasattr(os, "sched_getaffinity"):
+        cpu = max(os.sched_getaffinity(0))
+    if cpu is not None:
+        pin_to_cpu(cpu)
+
+    results = dict()
+    failed = set()
+    for binary in binaries:
+        for cfg, vm in vms:
+            res = run_benchmarks.run_benchmark(vm, binary, 0)
+            results[(binary, cfg.label)] = res
+            if res.error:
+                failed.add((binary, cfg.label))
+
+    for run in range(args.runs):
+        print("Run %d/%d..." % (run + 1, args.runs))
+        for binary in binaries:
+            for cfg, vm in vms:
+                if (binary, cfg.label) in failed:
+                    continue
+                elapsed, _ = run_benchmarks.run_once(vm, binary)
+                results[(binary, cfg.label)].elapsed.append(elapsed)
+
+    ordered = [results[(binary, cfg.label)] 
+               for binary in binaries for cfg, _ in vms]
+    run_benchmarks.print_table(ordered)
+    failures = len(failed) + run_benchmarks.check_outputs(ordered)
+
+    with open(args.out, "w", newline="") as file:
+        writer = csv.writer(file)
+        writer.writerow(["Compiler", "Opt", "Decoding", "Variant", 
+                         "Benchmark", "Run", "Elapsed"])
+        for cfg, vm in vms:
+            for binary in binaries:
+                res = results[(binary, cfg.label)]
+                for i, elapsed in enumerate(res.elapsed):
+                    writer.writerow([os.path.basename(cfg.compiler), cfg.opt, 
+                                     cfg.decoding, cfg.extra[0] or "default",
+                                     res.benchmark, i + 1, "%f" % elapsed])
+
+    print("Wrote %s." % args.out)
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -26,8 +26,17 @@
 import os
 import os.path
 import csv
-import matplotlib.pyplot as plt
-import numpy as np
+import math
+import sys
+
+# The plotting libraries are only needed for the figures, so comparing two
+# results files works without them.
+try:
+    import matplotlib.pyplot as plt
+    import numpy as np
+except ImportError:
+    plt = None
+    np  = None
 
 class benchdata:
     def __init__(self, data: list) -> None:
@@ -168,6 +177,187 @@ def generate_all():
 
     return
 
+#### Comparison of two results files ####
+
+# Continued fraction for the incomplete beta function (Numerical Recipes).
+def betacf(a: float, b: float, x: float) -> float:
+    tiny = 1.0e-300
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c = 1.0
+    d = 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 1.0e-12:
+            break
+    return h
+
+# Regularized incomplete beta function I_x(a, b).
+def betai(a: float, b: float, x: float) -> float:
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    lbeta = math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b)
+    front = math.exp(lbeta + a * math.log(x) + b * math.log(1.0 - x))
+    if x < (a + 1.0) / (a + b + 2.0):
+        return front * betacf(a, b, x) / a
+    return 1.0 - front * betacf(b, a, 1.0 - x) / b
+
+# Two-sided p-value of Student's t-distribution with df degrees of freedom.
+def t_pvalue(t: float, df: float) -> float:
+    return betai(df / 2.0, 0.5, df / (df + t * t))
+
+# The critical value t such that P(|T| > t) = alpha.
+def t_critical(alpha: float, df: float) -> float:
+    lo, hi = 0.0, 1000.0
+    for _ in range(100):
+        mid = (lo + hi) / 2.0
+        if t_pvalue(mid, df) > alpha:
+            lo = mid
+        else:
+            hi = mid
+    return (lo + hi) / 2.0
+
+class sample:
+    def __init__(self, elapsed: "list[float]") -> None:
+        self.n    = len(elapsed)
+        self.mean = sum(elapsed) / self.n
+        self.var  = sum((e - self.mean) ** 2 for e in elapsed) / (self.n - 1) \
+                    if self.n > 1 else 0.0
+
+    # Half-width of the confidence interval of the mean.
+    def ci(self, alpha: float) -> float:
+        if self.n < 2:
+            return float("inf")
+        return t_critical(alpha, self.n - 1) * math.sqrt(self.var / self.n)
+
+# Welch's t-test, which does not assume equal variances. Returns the p-value.
+def welch_pvalue(base: sample, new: sample) -> float:
+    if base.n < 2 or new.n < 2:
+        return 1.0
+    vb, vn = base.var / base.n, new.var / new.n
+    if vb + vn == 0.0:
+        return 0.0 if base.mean != new.mean else 1.0
+    t = (new.mean - base.mean) / math.sqrt(vb + vn)
+    df = (vb + vn) ** 2 / (vb ** 2 / (base.n - 1) + vn ** 2 / (new.n - 1))
+    return t_pvalue(t, df)
+
+# Reads a results file from bench_matrix.py or run_benchmarks.py. Every column
+# other than 'Run' and 'Elapsed' identifies what was measured.
+def read_results(filePath: str) -> "dict[tuple, list[float]]":
+    results = dict()
+    with open(filePath, "tr") as file:
+        reader = csv.DictReader(file)
+        for row in reader:
+            key = tuple((k, v) for k, v in row.items() 
+                        if k not in ("Run", "Elapsed") and k)
+            results.setdefault(key, list()).append(float(row["Elapsed"]))
+    return results
+
+def gen_comparison(filePath, labels, base, new, base_ci, new_ci):
+    x = np.arange(len(labels))
+    fig, ax = plt.subplots(figsize=(max(9, len(labels) * 0.6), 5))
+    ax.bar(x - 0.2, base, 0.4, yerr=base_ci, label='Base', color=(0.60, 0.60, 0.60))
+    ax.bar(x + 0.2, new, 0.4, yerr=new_ci, label='New', color=(0.30, 0.30, 0.30))
+    ax.set_ylabel('Elapsed Time (ms)')
+    ax.set_xticks(x, labels, rotation=90)
+    ax.grid()
+    ax.legend()
+    fig.tight_layout()
+    plt.savefig(filePath)
+
+# Compares every measurement present in both files. A difference is only 
+# reported if it's statistically significant (p < alpha) and larger than the
+# threshold. Returns the number of regressions.
+def compare(base_path: str, new_path: str, alpha: float, threshold: float, 
+            plot_path: str) -> int:
+    base_results = read_results(base_path)
+    new_results  = read_results(new_path)
+
+    keys = [k for k in base_results if k in new_results]
+    if not keys:
+        print("No common measurements between the two files.")
+        return 0
+
+    confidence = (1.0 - alpha) * 100.0
+    print("%-40s %22s %22s %8s %8s" % 
+          ("Measurement", "Base (ms, %.0f%% CI)" % confidence, 
+           "New (ms, %.0f%% CI)" % confidence, "Change", "p"))
+    print("-" * 106)
+
+    regressions = 0
+    labels, base_means, new_means, base_cis, new_cis = [], [], [], [], []
+    for key in keys:
+        base = sample(base_results[key])
+        new  = sample(new_results[key])
+        change = new.mean / base.mean - 1.0
+        p = welch_pvalue(base, new)
+        label = "/".join(v for _, v in key)
+
+        verdict = ""
+        if p < alpha and abs(change) > threshold:
+            verdict = "REGRESSION" if change > 0.0 else "improvement"
+            if change > 0.0:
+                regressions += 1
+
+        print("%-40s %10.3f +- %-8.3f %10.3f +- %-8.3f %+7.2f%% %8.4f %s" %
+              (label, base.mean, base.ci(alpha), new.mean, new.ci(alpha), 
+               change * 100.0, p, verdict))
+
+        labels.append(label)
+        base_means.append(base.mean)
+        new_means.append(new.mean)
+        base_cis.append(base.ci(alpha))
+        new_cis.append(new.ci(alpha))
+
+    print("-" * 106)
+    print("%d regression(s) out of %d measurement(s)." % (regressions, len(keys)))
+
+    if plot_path:
+        if plt is None:
+            print("matplotlib is not installed, skipping the figure.")
+        else:
+            gen_comparison(plot_path, labels, base_means, new_means, 
+                           base_cis, new_cis)
+
+    return regressions
+
 if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(
+        description="Generates figures from benchmark data, or compares two results files.")
+    subparsers = parser.add_subparsers(dest="command")
+    cmp_parser = subparsers.add_parser("compare", 
+        help="compare two results files and flag significant regressions")
+    cmp_parser.add_argument("base", help="results file to compare against")
+    cmp_parser.add_argument("new", help="results file to compare")
+    cmp_parser.add_argument("--alpha", type=float, default=0.05,
+                            help="significance level (default: 0.05)")
+    cmp_parser.add_argument("--threshold", type=float, default=0.02,
+                            help="smallest relative change to report (default: 0.02)")
+    cmp_parser.add_argument("--plot", default=None,
+                            help="also save a figure of the comparison to this file")
+    args = parser.parse_args()
+
+    if args.command == "compare":
+        # Exit with a failure if anything regressed, for use in scripts.
+        sys.exit(1 if compare(args.base, args.new, args.alpha, 
+                              args.threshold, args.plot) else 0)
+
     generate_all()
     exit()
@@ -0,0 +1,80 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: fib_r.asm
+; Description: Computes the 32nd fibonacci number through naive recursion.
+;              Dominated by CALL/RET and argument passing on the stack.
+
+.MODE       Register
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; int fib(int n)
+; Out: pushed on the stack
+; Uses: R1-R4
+;
+; if (n < 2)
+;     return n;
+; return fib(n - 1) + fib(n - 2);
+fib:
+  LDA       R1,   4           ; n
+  LDI       R2,   2
+  CPLT      R1,   R2
+  BRZ       fib_rec
+  MOVS      R1
+  RET.32    4
+fib_rec:
+  SUBI      R2,   R1,   1
+  MOVS      R2
+  CALL      fib               ; fib(n - 1) is left on the stack.
+  LDA       R1,   4           ; n was clobbered by the call.
+  SUBI      R2,   R1,   2
+  MOVS      R2
+  CALL      fib
+  POP       R3                ; fib(n - 2)
+  POP       R4                ; fib(n - 1)
+  ADD       R3,   R3,   R4
+  MOVS      R3
+  RET.32    4
+
+; Entry point
+main:
+  PUSH      32
+  CALL      fib
+  POP       R0
+
+  STR       R5,   _S0
+  MOVS      R5
+  SARG      132
+  MOVS      R0
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     14,   "fib(32) = %d\n"
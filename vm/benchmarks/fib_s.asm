@@ -0,0 +1,77 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: fib_s.asm
+; Description: Computes the 32nd fibonacci number through naive recursion.
+;              Dominated by CALL/RET and argument passing on the stack.
+
+.MODE       Stack
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; int fib(int n)
+;
+; if (n < 2)
+;     return n;
+; return fib(n - 1) + fib(n - 2);
+fib:
+  LDA       4
+  LDI       2
+  CPLT
+  BRZ       fib_rec
+  LDA       4
+  RET.32    4
+fib_rec:
+  LDA       4
+  LDI       1
+  SUB
+  CALL      fib               ; fib(n - 1) is left on the stack.
+  LDA       4
+  LDI       2
+  SUB
+  CALL      fib
+  ADD
+  RET.32    4
+
+; Entry point
+main:
+  LDI       0                 ; +4 int result
+
+  LDI       32
+  CALL      fib
+  STL       4
+
+  STR       _S0
+  SARG      132
+  LDL       4
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     14,   "fib(32) = %d\n"
@@ -0,0 +1,88 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: float_r.asm
+; Description: Integrates 4 / (1 + x^2) over [0, 1] with 5,000,000 steps,
+;              while also summing x in single precision. Dominated by double
+;              and float arithmetic and int/float conversions.
+
+.MODE       Register
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; Entry point
+;
+; double h = 1.0 / 5000000, sum = 0;
+; float fsum = 0;
+; for (i = 0; i < 5000000; ++i) {
+;     double x = (i + 0.5) * h;
+;     sum += 4.0 / (1.0 + x * x);
+;     fsum += (float)x;
+; }
+; pi = sum * h;
+main:
+  LDI       R0,   0           ; i
+  LDI       R1,   5000000
+  LDI.64    R2,   0.0         ; sum
+  ITOD      R4,   R1
+  LDI.64    R6,   1.0
+  DIV.F64   R4,   R6,   R4    ; h
+  LDI       R6,   0
+  ITOF      R6,   R6          ; fsum
+main_test:
+  CPLT      R0,   R1
+  BRZ       main_done
+  ITOD      R8,   R0
+  ADDI.F64  R8,   R8,   0.5
+  MUL.F64   R8,   R8,   R4    ; x
+  MUL.F64   R10,  R8,   R8
+  ADDI.F64  R10,  R10,  1.0
+  LDI.64    R12,  4.0
+  DIV.F64   R12,  R12,  R10
+  ADD.F64   R2,   R2,   R12
+  DTOF      R14,  R8
+  ADD.F     R6,   R6,   R14
+  ADDI      R0,   R0,   1
+  JMP       main_test
+
+main_done:
+  MUL.F64   R2,   R2,   R4
+  DTOS      R16,  R2,   9
+  FTOS      R17,  R6,   1
+  STR       R15,  _S0
+  MOVS      R15
+  SARG      132
+  MOVS      R16
+  SARG      132
+  MOVS      R17
+  SARG      132
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     18,   "pi: %s, fsum: %s\n"
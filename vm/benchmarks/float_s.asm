@@ -0,0 +1,106 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: float_s.asm
+; Description: Integrates 4 / (1 + x^2) over [0, 1] with 5,000,000 steps,
+;              while also summing x in single precision. Dominated by double
+;              and float arithmetic and int/float conversions.
+
+.MODE       Stack
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; Entry point
+;
+; double h = 1.0 / 5000000, sum = 0;
+; float fsum = 0;
+; for (i = 0; i < 5000000; ++i) {
+;     double x = (i + 0.5) * h;
+;     sum += 4.0 / (1.0 + x * x);
+;     fsum += (float)x;
+; }
+; pi = sum * h;
+main:
+  LDI       0                 ; +4  int i
+  LDI.64    0.0               ; +8  double sum
+  LDI.64    1.0               ; +16 double h
+  LDI       5000000
+  ITOD
+  DIV.F64
+  LDI       0                 ; +24 float fsum
+  ITOF
+  LDI.64    0.0               ; +28 double x
+main_test:
+  LDL       4
+  LDI       5000000
+  CPLT
+  BRZ       main_done
+  LDL       4
+  ITOD
+  LDI.64    0.5
+  ADD.F64
+  LDL.64    16
+  MUL.F64
+  STL.64    28
+  LDL.64    8
+  LDI.64    4.0
+  LDI.64    1.0
+  LDL.64    28
+  LDL.64    28
+  MUL.F64
+  ADD.F64
+  DIV.F64
+  ADD.F64
+  STL.64    8
+  LDL       24
+  LDL.64    28
+  DTOF
+  ADD.F
+  STL       24
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       main_test
+
+main_done:
+  STR       _S0
+  SARG      132
+  LDL.64    8
+  LDL.64    16
+  MUL.F64
+  DTOS      9
+  SARG      132
+  LDL       24
+  FTOS      1
+  SARG      132
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     18,   "pi: %s, fsum: %s\n"
@@ -0,0 +1,72 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: int64_r.asm
+; Description: Mixes 64-bit multiplication, division, addition and xor over
+;              10,000,000 iterations. Dominated by 64-bit register traffic.
+
+.MODE       Register
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; Entry point
+;
+; long acc = 0;
+; for (i = 1; i <= 10000000; ++i) {
+;     long x = i;
+;     acc += (x * x) / (x + 3);
+;     acc ^= x;
+; }
+main:
+  LDI       R0,   1           ; i
+  LDI       R1,   10000000
+  LDI.64    R2,   0           ; acc
+  LDI.64    R4,   3
+main_test:
+  CPLQ      R0,   R1
+  BRZ       main_done
+  ITOL      R6,   R0          ; x
+  MUL.64    R8,   R6,   R6
+  ADD.64    R10,  R6,   R4
+  DIV.64    R8,   R8,   R10
+  ADD.64    R2,   R2,   R8
+  BXOR.64   R2,   R2,   R6
+  ADDI      R0,   R0,   1
+  JMP       main_test
+
+main_done:
+  STR       R12,  _S0
+  MOVS      R12
+  SARG      132
+  MOVS.64   R2
+  SARG      24
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     11,   "acc: %lld\n"
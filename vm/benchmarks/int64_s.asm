@@ -0,0 +1,84 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: int64_s.asm
+; Description: Mixes 64-bit multiplication, division, addition and xor over
+;              10,000,000 iterations. Dominated by 64-bit stack traffic.
+
+.MODE       Stack
+.HEAP       1
+.HEAP_MAX   1
+
+  JMP       main
+
+; Entry point
+;
+; long acc = 0;
+; for (i = 1; i <= 10000000; ++i) {
+;     long x = i;
+;     acc += (x * x) / (x + 3);
+;     acc ^= x;
+; }
+main:
+  LDI       1                 ; +4  int i
+  LDI.64    0                 ; +8  long acc
+  LDI.64    0                 ; +16 long x
+main_test:
+  LDL       4
+  LDI       10000000
+  CPLQ
+  BRZ       main_done
+  LDL       4
+  ITOL
+  STL.64    16
+  LDL.64    8
+  LDL.64    16
+  LDL.64    16
+  MUL.64
+  LDL.64    16
+  LDI.64    3
+  ADD.64
+  DIV.64
+  ADD.64
+  LDL.64    16
+  BXOR.64
+  STL.64    8
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       main_test
+
+main_done:
+  STR       _S0
+  SARG      132
+  LDL.64    8
+  SARG      24
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     11,   "acc: %lld\n"
@@ -0,0 +1,167 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: list_r.asm
+; Description: Repeatedly builds, walks and frees a linked list of 2,000
+;              nodes, then grows an array to 50,000 elements by doubling it
+;              with RESZ. Dominated by NEW/DEL/RESZ and the heap allocator.
+
+.MODE       Register
+.HEAP       1024
+.HEAP_MAX   1024
+
+  JMP       main
+
+; int list_sum(int count)
+; Out: pushed on the stack
+; Uses: R10-R16
+;
+; head = 0;
+; for (i = 0; i < count; ++i) {
+;     node = new int[2];
+;     node[0] = i;
+;     node[1] = head;
+;     head = node;
+; }
+; sum = 0;
+; while (head) {
+;     sum += head[0];
+;     next = head[1];
+;     delete head;
+;     head = next;
+; }
+; return sum;
+list_sum:
+  LDA       R10,  4           ; count
+  LDI       R11,  0           ; head
+  LDI       R12,  0           ; i
+list_build_test:
+  CPLT      R12,  R10
+  BRZ       list_walk
+  NEWI      R13,  8
+  STMI      R13,  R12,  0
+  STMI      R13,  R11,  4
+  MOV       R11,  R13
+  ADDI      R12,  R12,  1
+  JMP       list_build_test
+list_walk:
+  LDI       R14,  0           ; sum
+list_walk_test:
+  CPZ       R11
+  BRNZ      list_ret
+  LDMI      R15,  R11,  0
+  ADD       R14,  R14,  R15
+  LDMI      R16,  R11,  4
+  DEL       R11
+  MOV       R11,  R16
+  JMP       list_walk_test
+list_ret:
+  MOVS      R14
+  RET.32    4
+
+; int array_sum(int count)
+; Out: pushed on the stack
+; Uses: R10-R16
+;
+; cap = 4;
+; arr = new int[cap];
+; for (i = 0; i < count; ++i) {
+;     if (i == cap) {
+;         cap *= 2;
+;         arr = resize(arr, cap * 4);
+;     }
+;     arr[i] = i;
+; }
+; sum = 0;
+; for (i = 0; i < count; ++i)
+;     sum += arr[i];
+; delete arr;
+; return sum;
+array_sum:
+  LDA       R10,  4           ; count
+  LDI       R11,  4           ; cap
+  NEWI      R12,  16          ; arr
+  LDI       R13,  0           ; i
+array_fill_test:
+  CPLT      R13,  R10
+  BRZ       array_sum_loop
+  CPEQ      R13,  R11
+  BRZ       array_fill_store
+  MULI      R11,  R11,  2
+  MULI      R14,  R11,  4
+  RESZ      R12,  R14
+array_fill_store:
+  MULI      R14,  R13,  4
+  ADD       R14,  R14,  R12
+  STM       R14,  R13
+  ADDI      R13,  R13,  1
+  JMP       array_fill_test
+array_sum_loop:
+  LDI       R15,  0           ; sum
+  LDI       R13,  0
+array_sum_test:
+  CPLT      R13,  R10
+  BRZ       array_ret
+  MULI      R14,  R13,  4
+  ADD       R14,  R14,  R12
+  LDM       R16,  R14
+  ADD       R15,  R15,  R16
+  ADDI      R13,  R13,  1
+  JMP       array_sum_test
+array_ret:
+  DEL       R12
+  MOVS      R15
+  RET.32    4
+
+; Entry point
+main:
+  LDI       R0,   0           ; rep
+main_test:
+  LDI       R3,   40
+  CPLT      R0,   R3
+  BRZ       main_done
+  PUSH      2000
+  CALL      list_sum
+  POP       R1
+  PUSH      50000
+  CALL      array_sum
+  POP       R2
+  ADDI      R0,   R0,   1
+  JMP       main_test
+
+main_done:
+  STR       R5,   _S0
+  MOVS      R5
+  SARG      132
+  MOVS      R1
+  SARG      4
+  MOVS      R2
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     21,   "list: %d, array: %d\n"
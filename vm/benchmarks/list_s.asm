@@ -0,0 +1,214 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: list_s.asm
+; Description: Repeatedly builds, walks and frees a linked list of 2,000
+;              nodes, then grows an array to 50,000 elements by doubling it
+;              with RESZ. Dominated by NEW/DEL/RESZ and the heap allocator.
+
+.MODE       Stack
+.HEAP       1024
+.HEAP_MAX   1024
+
+  JMP       main
+
+; int list_sum(int count)
+;
+; head = 0;
+; for (i = 0; i < count; ++i) {
+;     node = new int[2];
+;     node[0] = i;
+;     node[1] = head;
+;     head = node;
+; }
+; sum = 0;
+; while (head) {
+;     sum += head[0];
+;     next = head[1];
+;     delete head;
+;     head = next;
+; }
+; return sum;
+list_sum:
+  LDI       0                 ; +4  int head
+  LDI       0                 ; +8  int i
+  LDI       0                 ; +12 int node
+  LDI       0                 ; +16 int sum
+list_build_test:
+  LDL       8
+  LDA       4
+  CPLT
+  BRZ       list_walk_test
+  LDI       8
+  NEW
+  STL       12
+  LDL       8
+  LDL       12
+  STMI      0
+  LDL       4
+  LDL       12
+  STMI      4
+  LDL       12
+  STL       4
+  LDL       8
+  LDI       1
+  ADD
+  STL       8
+  JMP       list_build_test
+list_walk_test:
+  LDL       4
+  BRZ       list_ret
+  LDL       16
+  LDL       4
+  LDMI      0
+  ADD
+  STL       16
+  LDL       4
+  LDMI      4
+  LDL       4
+  DEL
+  STL       4
+  JMP       list_walk_test
+list_ret:
+  LDL       16
+  RET.32    4
+
+; int array_sum(int count)
+;
+; cap = 4;
+; arr = new int[cap];
+; for (i = 0; i < count; ++i) {
+;     if (i == cap) {
+;         cap *= 2;
+;         arr = resize(arr, cap * 4);
+;     }
+;     arr[i] = i;
+; }
+; sum = 0;
+; for (i = 0; i < count; ++i)
+;     sum += arr[i];
+; delete arr;
+; return sum;
+array_sum:
+  LDI       4                 ; +4  int cap
+  LDI       16                ; +8  int arr
+  NEW
+  LDI       0                 ; +12 int i
+  LDI       0                 ; +16 int sum
+array_fill_test:
+  LDL       12
+  LDA       4
+  CPLT
+  BRZ       array_sum_loop
+  LDL       12
+  LDL       4
+  CPEQ
+  BRZ       array_fill_store
+  LDL       4
+  LDI       2
+  MUL
+  STL       4
+  LDL       4
+  LDI       4
+  MUL
+  LDL       8
+  RESZ
+  STL       8
+array_fill_store:
+  LDL       12
+  LDL       12
+  LDI       4
+  MUL
+  LDL       8
+  ADD
+  STM
+  LDL       12
+  LDI       1
+  ADD
+  STL       12
+  JMP       array_fill_test
+array_sum_loop:
+  LDI       0
+  STL       12
+array_sum_test:
+  LDL       12
+  LDA       4
+  CPLT
+  BRZ       array_ret
+  LDL       16
+  LDL       12
+  LDI       4
+  MUL
+  LDL       8
+  ADD
+  LDM
+  ADD
+  STL       16
+  LDL       12
+  LDI       1
+  ADD
+  STL       12
+  JMP       array_sum_test
+array_ret:
+  LDL       8
+  DEL
+  LDL       16
+  RET.32    4
+
+; Entry point
+main:
+  LDI       0                 ; +4  int rep
+  LDI       0                 ; +8  int listSum
+  LDI       0                 ; +12 int arraySum
+main_test:
+  LDL       4
+  LDI       40
+  CPLT
+  BRZ       main_done
+  LDI       2000
+  CALL      list_sum
+  STL       8
+  LDI       50000
+  CALL      array_sum
+  STL       12
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       main_test
+
+main_done:
+  STR       _S0
+  SARG      132
+  LDL       8
+  SARG      4
+  LDL       12
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     21,   "list: %d, array: %d\n"
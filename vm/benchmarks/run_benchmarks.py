@@ -0,0 +1,204 @@
+# BSD 2-Clause License
+
+# Copyright (c) 2022, Kasper Skott
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Runs every assembled benchmark (*.bin) on one or more VM executables and
+# reports the wall-clock time of each run. Every VM is handed the same binary,
+# so different builds of the VM (decoding technique, optimization level,
+# compiler, ...) can be compared on the same workloads.
+#
+# Usage:
+#   run_benchmarks.py [--runs N] [--bin-dir DIR] [--filter NAME] [--csv FILE]
+#                     VM [VM ...]
+#
+# A VM may be given as a plain path or as LABEL=PATH. The output of each
+# benchmark is checked against the first VM, as well as against its
+# register/stack counterpart, so that a variant that computes the wrong
+# result is never reported as a speedup.
+
+import argparse
+import csv
+import os
+import os.path
+import statistics
+import subprocess
+import sys
+import time
+
+class variant:
+    def __init__(self, spec: str) -> None:
+        if "=" in spec:
+            self.label, self.path = spec.split("=", 1)
+        else:
+            self.label, self.path = spec, spec
+        self.path = os.path.abspath(self.path)
+
+class result:
+    def __init__(self, benchmark: str, vm: variant) -> None:
+        self.benchmark = benchmark
+        self.vm        = vm
+        self.elapsed   = list()
+        self.output    = None
+        self.error     = None
+
+    def mean(self) -> float:
+        return statistics.mean(self.elapsed)
+
+    def stdev(self) -> float:
+        return statistics.stdev(self.elapsed) if len(self.elapsed) > 1 else 0.0
+
+# Strips everything the VM itself prints, e.g. the stack dump of debug builds,
+# leaving only the output of the program.
+def program_output(stdout: str) -> str:
+    lines = list()
+    for line in stdout.splitlines():
+        if line.startswith("======== STACK DUMP"):
+            break
+        if line.startswith("[RackVM]"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+# Anything the VM reports about an abnormal exit is treated as a failure, 
+# since the VM itself always returns 0.
+def vm_error(stdout: str) -> "str | None":
+    for line in stdout.splitlines():
+        if line.startswith("[RackVM] Exited with exit code") or \
+           line.startswith("[RackVM] Warning") or \
+           line.startswith("[RackVM] Couldn't"):
+            return line
+    return None
+
+def run_once(vm: variant, binary: str) -> "tuple[float, str]":
+    start = time.perf_counter()
+    proc = subprocess.run([vm.path, binary], stdin=subprocess.DEVNULL,
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    elapsed = (time.perf_counter() - start) * 1000.0
+    return elapsed, proc.stdout
+
+def run_benchmark(vm: variant, binary: str, runs: int) -> result:
+    res = result(os.path.splitext(os.path.basename(binary))[0], vm)
+
+    # The first run is a warm-up, which is not measured.
+    _, stdout = run_once(vm, binary)
+    res.output = program_output(stdout)
+    res.error = vm_error(stdout)
+    if res.error:
+        return res
+
+    for _ in range(runs):
+        elapsed, stdout = run_once(vm, binary)
+        res.elapsed.append(elapsed)
+    return res
+
+def find_binaries(dir: str, name_filter: str) -> "list[str]":
+    return sorted(os.path.join(dir, f) for f in os.listdir(dir)
+                  if f.endswith(".bin") and name_filter in f)
+
+# Returns the name of the counterpart of a benchmark in the other instruction
+# set, e.g. fib_r -> fib_s.
+def counterpart(benchmark: str) -> "str | None":
+    if benchmark.endswith("_r"):
+        return benchmark[:-2] + "_s"
+    if benchmark.endswith("_s"):
+        return benchmark[:-2] + "_r"
+    return None
+
+def check_outputs(results: "list[result]") -> int:
+    mismatches = 0
+    reference = dict()
+    for res in results:
+        if res.error:
+            continue
+        ref = reference.setdefault(res.benchmark, res)
+        if res.output != ref.output:
+            print("MISMATCH: %s on %s differs from %s" % 
+                  (res.benchmark, res.vm.label, ref.vm.label))
+            mismatches += 1
+
+    for name, ref in sorted(reference.items()):
+        other = reference.get(counterpart(name))
+        if other and name.endswith("_r") and ref.output != other.output:
+            print("MISMATCH: %s and %s disagree" % (name, counterpart(name)))
+            mismatches += 1
+    return mismatches
+
+def print_table(results: "list[result]") -> None:
+    print("%-14s %-24s %12s %12s %12s" % 
+          ("Benchmark", "VM", "Mean (ms)", "Std. dev.", "Min (ms)"))
+    print("-" * 78)
+    for res in results:
+        if res.error:
+            print("%-14s %-24s %s" % (res.benchmark, res.vm.label, res.error))
+            continue
+        print("%-14s %-24s %12.3f %12.3f %12.3f" % 
+              (res.benchmark, res.vm.label, res.mean(), res.stdev(), 
+               min(res.elapsed)))
+
+def write_csv(path: str, results: "list[result]") -> None:
+    with open(path, "w", newline="") as file:
+        writer = csv.writer(file)
+        writer.writerow(["Benchmark", "VM", "Run", "Elapsed"])
+        for res in results:
+            for i, elapsed in enumerate(res.elapsed):
+                writer.writerow([res.benchmark, res.vm.label, i + 1, 
+                                 "%f" % elapsed])
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Runs the RackVM benchmarks.")
+    parser.add_argument("vms", metavar="VM", nargs="+",
+                        help="VM executable, optionally given as LABEL=PATH")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="number of measured runs per benchmark and VM")
+    parser.add_argument("--bin-dir", default=os.path.dirname(__file__),
+                        help="directory containing the assembled benchmarks")
+    parser.add_argument("--filter", default="",
+                        help="only run benchmarks whose name contains this")
+    parser.add_argument("--csv", help="write the run times to this file")
+    args = parser.parse_args()
+
+    vms = [variant(spec) for spec in args.vms]
+    binaries = find_binaries(args.bin_dir, args.filter)
+    if not binaries:
+        print("No benchmarks found in \"%s\"." % args.bin_dir)
+        return 1
+
+    results = list()
+    for binary in binaries:
+        for vm in vms:
+            res = run_benchmark(vm, binary, args.runs)
+            results.append(res)
+
+    print_table(results)
+    failures = sum(1 for res in results if res.error)
+    failures += check_outputs(results)
+
+    if args.csv:
+        write_csv(args.csv, results)
+
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,130 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: sieve_r.asm
+; Description: Counts the primes below 1,000,000 with the sieve of
+;              Eratosthenes, 3 times over. Dominated by tight integer loops
+;              and LDM/STM on a heap array.
+
+.MODE       Register
+.HEAP       4100
+.HEAP_MAX   4100
+
+  JMP       main
+
+; int sieve(int flags, int n)
+; Out: R10
+; Uses: R10-R17
+;
+; for (i = 0; i < n; ++i)
+;     flags[i] = 1;
+; for (i = 2; i * i < n; ++i)
+;     if (flags[i])
+;         for (j = i * i; j < n; j += i)
+;             flags[j] = 0;
+; count = 0;
+; for (i = 2; i < n; ++i)
+;     count += flags[i];
+; return count;
+sieve:
+  LDA       R11,  4           ; flags
+  LDA       R12,  8           ; n
+  LDI       R13,  0           ; i
+  LDI       R16,  1
+sieve_init_test:
+  CPLT      R13,  R12
+  BRZ       sieve_init_done
+  MULI      R14,  R13,  4
+  ADD       R14,  R14,  R11
+  STM       R14,  R16
+  ADDI      R13,  R13,  1
+  JMP       sieve_init_test
+sieve_init_done:
+  LDI       R13,  2
+  LDI       R16,  0
+sieve_outer_test:
+  MUL       R15,  R13,  R13   ; j = i * i
+  CPLT      R15,  R12
+  BRZ       sieve_count
+  MULI      R14,  R13,  4
+  ADD       R14,  R14,  R11
+  LDM       R17,  R14
+  CPZ       R17
+  BRNZ      sieve_outer_inc
+sieve_inner_test:
+  CPLT      R15,  R12
+  BRZ       sieve_outer_inc
+  MULI      R14,  R15,  4
+  ADD       R14,  R14,  R11
+  STM       R14,  R16
+  ADD       R15,  R15,  R13
+  JMP       sieve_inner_test
+sieve_outer_inc:
+  ADDI      R13,  R13,  1
+  JMP       sieve_outer_test
+sieve_count:
+  LDI       R10,  0
+  LDI       R13,  2
+sieve_count_test:
+  CPLT      R13,  R12
+  BRZ       sieve_ret
+  MULI      R14,  R13,  4
+  ADD       R14,  R14,  R11
+  LDM       R17,  R14
+  ADD       R10,  R10,  R17
+  ADDI      R13,  R13,  1
+  JMP       sieve_count_test
+sieve_ret:
+  RET       8
+
+; Entry point
+main:
+  LDI       R1,   1000000     ; n
+  MULI      R2,   R1,   4
+  NEW       R0,   R2          ; flags
+  LDI       R3,   0           ; rep
+
+main_test:
+  LDI       R4,   3
+  CPLT      R3,   R4
+  BRZ       main_done
+  MOVS      R1
+  MOVS      R0
+  CALL      sieve
+  ADDI      R3,   R3,   1
+  JMP       main_test
+
+main_done:
+  STR       R5,   _S0
+  MOVS      R5
+  SARG      132
+  MOVS      R10
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     12,   "primes: %d\n"
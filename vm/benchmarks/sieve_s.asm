@@ -0,0 +1,178 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: sieve_s.asm
+; Description: Counts the primes below 1,000,000 with the sieve of
+;              Eratosthenes, 3 times over. Dominated by tight integer loops
+;              and LDM/STM on a heap array.
+
+.MODE       Stack
+.HEAP       4100
+.HEAP_MAX   4100
+
+  JMP       main
+
+; int sieve(int flags, int n)
+;
+; for (i = 0; i < n; ++i)
+;     flags[i] = 1;
+; for (i = 2; i * i < n; ++i)
+;     if (flags[i])
+;         for (j = i * i; j < n; j += i)
+;             flags[j] = 0;
+; count = 0;
+; for (i = 2; i < n; ++i)
+;     count += flags[i];
+; return count;
+sieve:
+  LDI       0                 ; +4  int i
+  LDI       0                 ; +8  int j
+  LDI       0                 ; +12 int count
+sieve_init_test:
+  LDL       4
+  LDA       8
+  CPLT
+  BRZ       sieve_init_done
+  LDI       1
+  LDL       4
+  LDI       4
+  MUL
+  LDA       4
+  ADD
+  STM
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       sieve_init_test
+sieve_init_done:
+  LDI       2
+  STL       4
+sieve_outer_test:
+  LDL       4
+  LDL       4
+  MUL
+  STL       8                 ; j = i * i
+  LDL       8
+  LDA       8
+  CPLT
+  BRZ       sieve_count
+  LDL       4
+  LDI       4
+  MUL
+  LDA       4
+  ADD
+  LDM
+  BRZ       sieve_outer_inc
+sieve_inner_test:
+  LDL       8
+  LDA       8
+  CPLT
+  BRZ       sieve_outer_inc
+  LDI       0
+  LDL       8
+  LDI       4
+  MUL
+  LDA       4
+  ADD
+  STM
+  LDL       8
+  LDL       4
+  ADD
+  STL       8
+  JMP       sieve_inner_test
+sieve_outer_inc:
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       sieve_outer_test
+sieve_count:
+  LDI       2
+  STL       4
+sieve_count_test:
+  LDL       4
+  LDA       8
+  CPLT
+  BRZ       sieve_ret
+  LDL       12
+  LDL       4
+  LDI       4
+  MUL
+  LDA       4
+  ADD
+  LDM
+  ADD
+  STL       12
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       sieve_count_test
+sieve_ret:
+  LDL       12
+  RET.32    8
+
+; Entry point
+main:
+  LDI       0                 ; +4  int n
+  LDI       0                 ; +8  int flags
+  LDI       0                 ; +12 int rep
+  LDI       0                 ; +16 int count
+
+  LDI       1000000
+  STL       4
+  LDL       4
+  LDI       4
+  MUL
+  NEW
+  STL       8
+
+main_test:
+  LDL       12
+  LDI       3
+  CPLT
+  BRZ       main_done
+  LDL       4
+  LDL       8
+  CALL      sieve
+  STL       16
+  LDL       12
+  LDI       1
+  ADD
+  STL       12
+  JMP       main_test
+
+main_done:
+  STR       _S0
+  SARG      132
+  LDL       16
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     12,   "primes: %d\n"
@@ -0,0 +1,95 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: strings_r.asm
+; Description: Converts 1,000,000 integers to strings, concatenates and
+;              compares them. Dominated by ITOS/STRCAT/STRCMB/CPSTR and the
+;              short-lived heap allocations they make.
+
+.MODE       Register
+.HEAP       64
+.HEAP_MAX   64
+
+  JMP       main
+
+; Entry point
+;
+; for (i = 0; i < 1000000; ++i) {
+;     s = string(i);
+;     t = s + "-suffix";
+;     u = t + s;
+;     if (t == "4242-suffix")
+;         ++matches;
+;     if (u[0] == '7')
+;         ++sevens;
+;     delete s, t, u;
+; }
+main:
+  LDI       R0,   0           ; i
+  LDI       R1,   0           ; matches
+  LDI       R2,   0           ; sevens
+  LDI       R12,  1000000
+  STR       R10,  _S1         ; key
+  STR       R11,  _S2         ; seven
+main_test:
+  CPLT      R0,   R12
+  BRZ       main_done
+  ITOS      R3,   R0
+  STRCAT    R4,   R3,   _S3
+  STRCMB    R5,   R4,   R3
+  CPSTR     R4,   R10
+  BRZ       main_sevens
+  ADDI      R1,   R1,   1
+main_sevens:
+  CPCHR     R5,   R11
+  BRZ       main_inc
+  ADDI      R2,   R2,   1
+main_inc:
+  DEL       R3
+  DEL       R4
+  DEL       R5
+  ADDI      R0,   R0,   1
+  JMP       main_test
+
+main_done:
+  STR       R5,   _S0
+  MOVS      R5
+  SARG      132
+  MOVS      R1
+  SARG      4
+  MOVS      R2
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     25,   "matches: %d, sevens: %d\n"
+_S1:
+  .BYTE     12,   "4242-suffix"
+_S2:
+  .BYTE     2,    "7"
+_S3:
+  .BYTE     8,    "-suffix"
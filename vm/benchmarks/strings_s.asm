@@ -0,0 +1,121 @@
+; BSD 2-Clause License
+; 
+; Copyright (c) 2022, Kasper Skott
+; 
+; Redistribution and use in source and binary forms, with or without
+; modification, are permitted provided that the following conditions are met:
+; 
+; 1. Redistributions of source code must retain the above copyright notice, this
+;    list of conditions and the following disclaimer.
+; 
+; 2. Redistributions in binary form must reproduce the above copyright notice,
+;    this list of conditions and the following disclaimer in the documentation
+;    and/or other materials provided with the distribution.
+; 
+; THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+; AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+; IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+; DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+; FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+; DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+; SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+; CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+; OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+; OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+; File: strings_s.asm
+; Description: Converts 1,000,000 integers to strings, concatenates and
+;              compares them. Dominated by ITOS/STRCAT/STRCMB/CPSTR and the
+;              short-lived heap allocations they make.
+
+.MODE       Stack
+.HEAP       64
+.HEAP_MAX   64
+
+  JMP       main
+
+; Entry point
+;
+; for (i = 0; i < 1000000; ++i) {
+;     s = string(i);
+;     t = s + "-suffix";
+;     u = t + s;
+;     if (t == "4242-suffix")
+;         ++matches;
+;     if (u[0] == '7')
+;         ++sevens;
+;     delete s, t, u;
+; }
+main:
+  LDI       0                 ; +4  int i
+  LDI       0                 ; +8  int matches
+  LDI       0                 ; +12 int sevens
+  STR       _S1               ; +16 string key
+  STR       _S2               ; +20 string seven
+  LDI       0                 ; +24 string s
+  LDI       0                 ; +28 string t
+  LDI       0                 ; +32 string u
+main_test:
+  LDL       4
+  LDI       1000000
+  CPLT
+  BRZ       main_done
+  LDL       4
+  ITOS
+  STL       24
+  LDL       24
+  STRCAT    _S3
+  STL       28
+  LDL       28
+  LDL       24
+  STRCMB
+  STL       32
+  LDL       28
+  LDL       16
+  CPSTR
+  BRZ       main_sevens
+  LDL       8
+  LDI       1
+  ADD
+  STL       8
+main_sevens:
+  LDL       32
+  LDL       20
+  CPCHR
+  BRZ       main_inc
+  LDL       12
+  LDI       1
+  ADD
+  STL       12
+main_inc:
+  LDL       24
+  DEL
+  LDL       28
+  DEL
+  LDL       32
+  DEL
+  LDL       4
+  LDI       1
+  ADD
+  STL       4
+  JMP       main_test
+
+main_done:
+  STR       _S0
+  SARG      132
+  LDL       8
+  SARG      4
+  LDL       12
+  SARG      4
+  SCALL     __print
+  EXIT
+
+.DATA
+_S0:
+  .BYTE     25,   "matches: %d, sevens: %d\n"
+_S1:
+  .BYTE     12,   "4242-suffix"
+_S2:
+  .BYTE     2,    "7"
+_S3:
+  .BYTE     8,    "-suffix"
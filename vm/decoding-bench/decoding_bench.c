@@ -0,0 +1,1311 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Decoding micro-benchmark. This replaces the initial experiment, which used
+ * hardcoded mock instructions and volatile registers.
+ *
+ * Instead, it reads programs produced by the assembler, and walks their code
+ * section using the operand layout of every opcode. Each technique then
+ * decodes the same instruction stream, over and over:
+ *
+ *   union      - copies the 13 bytes into an Instr_t and reads union fields,
+ *                exactly like the VM built with UNION_DECODING.
+ *   bitmask    - copies the 13 bytes into an Instr_t and masks out the
+ *                operands, exactly like the VM built without UNION_DECODING.
+ *   memcpy     - reads each operand straight from the program with memcpy,
+ *                which is the strictly conforming way of doing unaligned reads.
+ *   predecoded - reads aligned records, converted once from the program.
+ *                The cost of the conversion itself is reported separately.
+ *
+ * No handlers are run, so neither dispatch nor the work of the instructions
+ * is part of the measurement. The times are reported as they are, including
+ * walking the stream, since no baseline without the operands reliably costs 
+ * less than the techniques themselves. Every technique folds the operands into a
+ * checksum, which is returned and verified to match between techniques.
+ * That keeps the compiler from throwing the decoding away, and ensures that
+ * every technique decodes the same thing.
+ *
+ * The process is pinned to a single CPU, and the techniques are interleaved
+ * within every sample, so that drift affects all of them alike.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+    #include <sched.h>
+#endif
+
+#include "../opcodes.h"
+
+#define DEFAULT_SAMPLES   30
+#define DEFAULT_SAMPLE_MS 20.0
+#define MAX_SAMPLES       1000
+#define MAX_PASSES        (1 << 24)
+
+/* Instructions are always fetched 13 bytes at a time, so the last one needs
+ * some room after it. */
+#define FETCH_PADDING 16
+
+#ifdef __GNUC__
+    #define GCC_PACK __attribute__ ((__packed__))
+#else
+    #define GCC_PACK
+#endif
+
+#if defined(__clang__)
+    #define NOINLINE __attribute__ ((noinline))
+#elif defined(__GNUC__)
+    #define NOINLINE __attribute__ ((noinline, noclone))
+#elif defined(_MSC_VER)
+    #define NOINLINE __declspec(noinline)
+#else
+    #define NOINLINE
+#endif
+
+#ifndef __GNUC__
+    #pragma pack(1)
+#endif
+
+/* The layouts of the VM's Instr_t, which are used by the benchmarked
+ * programs. The float layouts are left out, since they are read the same
+ * way as their integer counterparts. */
+typedef union {
+    uint8_t raw[13];
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t C;
+    } u8;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        int32_t C;
+    } i32;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        int64_t C;
+    } i64;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        uint8_t b;
+    } u8_u8;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        int32_t C;
+    } u8_i32;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        int64_t C;
+    } u8_i64;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        uint8_t b;
+        int32_t C;
+    } u8_u8_i32;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        uint8_t b;
+        int64_t C;
+    } u8_u8_i64;
+
+    struct GCC_PACK {
+        uint8_t opcode;
+        uint8_t a;
+        uint8_t b;
+        uint8_t c;
+    } u8_u8_u8;
+
+    struct GCC_PACK {
+        uint8_t  opcode;
+        uint32_t operand[3];
+    };
+} Instr_t;
+
+#ifndef __GNUC__
+    #pragma pack()
+#endif
+
+/* An instruction decoded ahead of time. The operand bytes are stored in
+ * order, and any immediate is sign-extended into C. */
+typedef struct {
+    int64_t C;
+    uint8_t opcode;
+    uint8_t ops[3];
+    uint8_t layout;
+} Decoded_t;
+
+typedef enum {
+    LAYOUT_INVALID = 0,
+    LAYOUT_OP,
+    LAYOUT_U8,
+    LAYOUT_I32,
+    LAYOUT_I64,
+    LAYOUT_U8_U8,
+    LAYOUT_U8_I32,
+    LAYOUT_U8_I64,
+    LAYOUT_U8_U8_U8,
+    LAYOUT_U8_U8_I32,
+    LAYOUT_U8_U8_I64,
+    LAYOUT_COUNT
+} Layout_t;
+
+/* The encoded size of each layout, opcode included. */
+static const uint8_t layoutSizes[LAYOUT_COUNT] = {
+    0, 1, 2, 5, 9, 3, 6, 10, 4, 7, 11
+};
+
+/* The sizes are those the assembler emits, which is what matters when
+ * walking the program. */
+#define SHARED_LAYOUTS \
+    [NOP]         = LAYOUT_OP, \
+    [EXIT]        = LAYOUT_OP, \
+    [JMP]         = LAYOUT_I32, \
+    [CALL]        = LAYOUT_I32, \
+    [RET]         = LAYOUT_U8, \
+    [RET_32]      = LAYOUT_U8, \
+    [RET_64]      = LAYOUT_U8, \
+    [SCALL]       = LAYOUT_U8, \
+    [SARG]        = LAYOUT_U8
+
+static const uint8_t registerLayouts[256] = {
+    SHARED_LAYOUTS,
+
+    /* Load & Store */
+    [R_MOV]       = LAYOUT_U8_U8,
+    [R_MOV_64]    = LAYOUT_U8_U8,
+    [R_LDI]       = LAYOUT_U8_I32,
+    [R_LDI_64]    = LAYOUT_U8_I64,
+    [R_STM]       = LAYOUT_U8_U8,
+    [R_STM_64]    = LAYOUT_U8_U8,
+    [R_STMI]      = LAYOUT_U8_U8_I32,
+    [R_STMI_64]   = LAYOUT_U8_U8_I32,
+    [R_LDM]       = LAYOUT_U8_U8,
+    [R_LDM_64]    = LAYOUT_U8_U8,
+    [R_LDMI]      = LAYOUT_U8_U8_I32,
+    [R_LDMI_64]   = LAYOUT_U8_U8_I32,
+    [R_LDL]       = LAYOUT_U8_U8,
+    [R_LDL_64]    = LAYOUT_U8_U8,
+    [R_LDA]       = LAYOUT_U8_U8,
+    [R_LDA_64]    = LAYOUT_U8_U8,
+    [R_STL]       = LAYOUT_U8_U8,
+    [R_STL_64]    = LAYOUT_U8_U8,
+    [R_STA]       = LAYOUT_U8_U8,
+    [R_STA_64]    = LAYOUT_U8_U8,
+    [R_MOVS]      = LAYOUT_U8,
+    [R_MOVS_64]   = LAYOUT_U8,
+    [R_POP]       = LAYOUT_U8,
+    [R_POP_64]    = LAYOUT_U8,
+    [R_PUSH]      = LAYOUT_I32,
+    [R_PUSH_64]   = LAYOUT_I64,
+
+    /* Arithmetics */
+    [R_ADD]       = LAYOUT_U8_U8_U8,
+    [R_ADD_64]    = LAYOUT_U8_U8_U8,
+    [R_ADD_F]     = LAYOUT_U8_U8_U8,
+    [R_ADD_F64]   = LAYOUT_U8_U8_U8,
+    [R_ADDI]      = LAYOUT_U8_U8_I32,
+    [R_ADDI_64]   = LAYOUT_U8_U8_I64,
+    [R_ADDI_F]    = LAYOUT_U8_U8_I32,
+    [R_ADDI_F64]  = LAYOUT_U8_U8_I64,
+    [R_SUB]       = LAYOUT_U8_U8_U8,
+    [R_SUB_64]    = LAYOUT_U8_U8_U8,
+    [R_SUB_F]     = LAYOUT_U8_U8_U8,
+    [R_SUB_F64]   = LAYOUT_U8_U8_U8,
+    [R_SUBI]      = LAYOUT_U8_U8_I32,
+    [R_SUBI_64]   = LAYOUT_U8_U8_I64,
+    [R_SUBI_F]    = LAYOUT_U8_U8_I32,
+    [R_SUBI_F64]  = LAYOUT_U8_U8_I64,
+    [R_MUL]       = LAYOUT_U8_U8_U8,
+    [R_MUL_64]    = LAYOUT_U8_U8_U8,
+    [R_MUL_F]     = LAYOUT_U8_U8_U8,
+    [R_MUL_F64]   = LAYOUT_U8_U8_U8,
+    [R_MULI]      = LAYOUT_U8_U8_I32,
+    [R_MULI_64]   = LAYOUT_U8_U8_I64,
+    [R_MULI_F]    = LAYOUT_U8_U8_I32,
+    [R_MULI_F64]  = LAYOUT_U8_U8_I64,
+    [R_DIV]       = LAYOUT_U8_U8_U8,
+    [R_DIV_64]    = LAYOUT_U8_U8_U8,
+    [R_DIV_F]     = LAYOUT_U8_U8_U8,
+    [R_DIV_F64]   = LAYOUT_U8_U8_U8,
+    [R_DIVI]      = LAYOUT_U8_U8_I32,
+    [R_DIVI_64]   = LAYOUT_U8_U8_I64,
+    [R_DIVI_F]    = LAYOUT_U8_U8_I32,
+    [R_DIVI_F64]  = LAYOUT_U8_U8_I64,
+
+    /* Bit Stuff */
+    [R_INV]       = LAYOUT_U8,
+    [R_INV_64]    = LAYOUT_U8,
+    [R_NEG]       = LAYOUT_U8,
+    [R_NEG_64]    = LAYOUT_U8,
+    [R_NEG_F]     = LAYOUT_U8,
+    [R_NEG_F64]   = LAYOUT_U8,
+    [R_BOR]       = LAYOUT_U8_U8_U8,
+    [R_BOR_64]    = LAYOUT_U8_U8_U8,
+    [R_BORI]      = LAYOUT_U8_U8_I32,
+    [R_BORI_64]   = LAYOUT_U8_U8_I64,
+    [R_BXOR]      = LAYOUT_U8_U8_U8,
+    [R_BXOR_64]   = LAYOUT_U8_U8_U8,
+    [R_BXORI]     = LAYOUT_U8_U8_I32,
+    [R_BXORI_64]  = LAYOUT_U8_U8_I64,
+    [R_BAND]      = LAYOUT_U8_U8_U8,
+    [R_BAND_64]   = LAYOUT_U8_U8_U8,
+    [R_BANDI]     = LAYOUT_U8_U8_I32,
+    [R_BANDI_64]  = LAYOUT_U8_U8_I64,
+
+    /* Conditions & Branches */
+    [R_OR]        = LAYOUT_U8_U8,
+    [R_ORI]       = LAYOUT_U8_I32,
+    [R_AND]       = LAYOUT_U8_U8,
+    [R_ANDI]      = LAYOUT_U8_I32,
+    [R_CPZ]       = LAYOUT_U8,
+    [R_CPZ_64]    = LAYOUT_U8,
+    [R_CPI]       = LAYOUT_U8_I32,
+    [R_CPI_64]    = LAYOUT_U8_I64,
+    [R_CPEQ]      = LAYOUT_U8_U8,
+    [R_CPEQ_64]   = LAYOUT_U8_U8,
+    [R_CPEQ_F]    = LAYOUT_U8_U8,
+    [R_CPEQ_F64]  = LAYOUT_U8_U8,
+    [R_CPNQ]      = LAYOUT_U8_U8,
+    [R_CPNQ_64]   = LAYOUT_U8_U8,
+    [R_CPNQ_F]    = LAYOUT_U8_U8,
+    [R_CPNQ_F64]  = LAYOUT_U8_U8,
+    [R_CPGT]      = LAYOUT_U8_U8,
+    [R_CPGT_64]   = LAYOUT_U8_U8,
+    [R_CPGT_F]    = LAYOUT_U8_U8,
+    [R_CPGT_F64]  = LAYOUT_U8_U8,
+    [R_CPLT]      = LAYOUT_U8_U8,
+    [R_CPLT_64]   = LAYOUT_U8_U8,
+    [R_CPLT_F]    = LAYOUT_U8_U8,
+    [R_CPLT_F64]  = LAYOUT_U8_U8,
+    [R_CPGQ]      = LAYOUT_U8_U8,
+    [R_CPGQ_64]   = LAYOUT_U8_U8,
+    [R_CPGQ_F]    = LAYOUT_U8_U8,
+    [R_CPGQ_F64]  = LAYOUT_U8_U8,
+    [R_CPLQ]      = LAYOUT_U8_U8,
+    [R_CPLQ_64]   = LAYOUT_U8_U8,
+    [R_CPLQ_F]    = LAYOUT_U8_U8,
+    [R_CPLQ_F64]  = LAYOUT_U8_U8,
+    [R_CPSTR]     = LAYOUT_U8_U8,
+    [R_CPCHR]     = LAYOUT_U8_U8,
+    [R_BRZ]       = LAYOUT_I32,
+    [R_BRNZ]      = LAYOUT_I32,
+    [R_BRIZ]      = LAYOUT_U8,
+    [R_BRINZ]     = LAYOUT_U8,
+    [R_JMPI]      = LAYOUT_U8,
+
+    /* Conversions */
+    [R_ITOL]      = LAYOUT_U8_U8,
+    [R_ITOF]      = LAYOUT_U8_U8,
+    [R_ITOD]      = LAYOUT_U8_U8,
+    [R_ITOS]      = LAYOUT_U8_U8,
+    [R_LTOI]      = LAYOUT_U8_U8,
+    [R_LTOF]      = LAYOUT_U8_U8,
+    [R_LTOD]      = LAYOUT_U8_U8,
+    [R_LTOS]      = LAYOUT_U8_U8,
+    [R_FTOI]      = LAYOUT_U8_U8,
+    [R_FTOL]      = LAYOUT_U8_U8,
+    [R_FTOD]      = LAYOUT_U8_U8,
+    [R_FTOS]      = LAYOUT_U8_U8_U8,
+    [R_DTOI]      = LAYOUT_U8_U8,
+    [R_DTOL]      = LAYOUT_U8_U8,
+    [R_DTOF]      = LAYOUT_U8_U8,
+    [R_DTOS]      = LAYOUT_U8_U8_U8,
+    [R_STOI]      = LAYOUT_U8_U8_I32,
+    [R_STOL]      = LAYOUT_U8_U8_I64,
+    [R_STOF]      = LAYOUT_U8_U8_I32,
+    [R_STOD]      = LAYOUT_U8_U8_I64,
+
+    /* Miscellaneous */
+    [R_NEW]       = LAYOUT_U8_U8,
+    [R_NEWI]      = LAYOUT_U8_I32,
+    [R_DEL]       = LAYOUT_U8,
+    [R_RESZ]      = LAYOUT_U8_U8,
+    [R_RESZI]     = LAYOUT_U8_I32,
+    [R_SIZE]      = LAYOUT_U8_U8,
+    [R_STR]       = LAYOUT_U8_I32,
+    [R_STRCPY]    = LAYOUT_U8_U8_I32,
+    [R_STRCAT]    = LAYOUT_U8_U8_I32,
+    [R_STRCMB]    = LAYOUT_U8_U8_U8,
+
+    /* Calls */
+    [R_TAILCALL]  = LAYOUT_U8_U8_I32,
+
+    /* Indexed Locals */
+    [R_LDLX]      = LAYOUT_U8_U8_I32,
+    [R_LDLX_64]   = LAYOUT_U8_U8_I32,
+    [R_STLX]      = LAYOUT_U8_U8_I32,
+    [R_STLX_64]   = LAYOUT_U8_U8_I32,
+
+    /* Vectors */
+    [R_VLEN]      = LAYOUT_U8,
+    [R_VADD]      = LAYOUT_U8_U8_U8,
+    [R_VADD_64]   = LAYOUT_U8_U8_U8,
+    [R_VADD_F]    = LAYOUT_U8_U8_U8,
+    [R_VADD_F64]  = LAYOUT_U8_U8_U8,
+    [R_VSUB]      = LAYOUT_U8_U8_U8,
+    [R_VSUB_64]   = LAYOUT_U8_U8_U8,
+    [R_VSUB_F]    = LAYOUT_U8_U8_U8,
+    [R_VSUB_F64]  = LAYOUT_U8_U8_U8,
+    [R_VMUL]      = LAYOUT_U8_U8_U8,
+    [R_VMUL_64]   = LAYOUT_U8_U8_U8,
+    [R_VMUL_F]    = LAYOUT_U8_U8_U8,
+    [R_VMUL_F64]  = LAYOUT_U8_U8_U8,
+    [R_VDIV]      = LAYOUT_U8_U8_U8,
+    [R_VDIV_64]   = LAYOUT_U8_U8_U8,
+    [R_VDIV_F]    = LAYOUT_U8_U8_U8,
+    [R_VDIV_F64]  = LAYOUT_U8_U8_U8,
+    [R_VFMA]      = LAYOUT_U8_U8_U8,
+    [R_VFMA_64]   = LAYOUT_U8_U8_U8,
+    [R_VFMA_F]    = LAYOUT_U8_U8_U8,
+    [R_VFMA_F64]  = LAYOUT_U8_U8_U8,
+    [R_VMIN]      = LAYOUT_U8_U8_U8,
+    [R_VMIN_64]   = LAYOUT_U8_U8_U8,
+    [R_VMIN_F]    = LAYOUT_U8_U8_U8,
+    [R_VMIN_F64]  = LAYOUT_U8_U8_U8,
+    [R_VMAX]      = LAYOUT_U8_U8_U8,
+    [R_VMAX_64]   = LAYOUT_U8_U8_U8,
+    [R_VMAX_F]    = LAYOUT_U8_U8_U8,
+    [R_VMAX_F64]  = LAYOUT_U8_U8_U8,
+    [R_VCPEQ]     = LAYOUT_U8_U8_U8,
+    [R_VCPEQ_64]  = LAYOUT_U8_U8_U8,
+    [R_VCPEQ_F]   = LAYOUT_U8_U8_U8,
+    [R_VCPEQ_F64] = LAYOUT_U8_U8_U8,
+    [R_VCPLT]     = LAYOUT_U8_U8_U8,
+    [R_VCPLT_64]  = LAYOUT_U8_U8_U8,
+    [R_VCPLT_F]   = LAYOUT_U8_U8_U8,
+    [R_VCPLT_F64] = LAYOUT_U8_U8_U8,
+    [R_MEMCPY]    = LAYOUT_U8_U8_U8,
+    [R_MEMMOVE]   = LAYOUT_U8_U8_U8,
+    [R_MEMSET]    = LAYOUT_U8_U8_U8,
+    [R_FILL]      = LAYOUT_U8_U8_U8,
+    [R_FILL_64]   = LAYOUT_U8_U8_U8,
+    [R_SQRT_F]    = LAYOUT_U8_U8,
+    [R_SQRT_F64]  = LAYOUT_U8_U8,
+    [R_FMA_F]     = LAYOUT_U8_U8_U8,
+    [R_FMA_F64]   = LAYOUT_U8_U8_U8,
+    [R_ABS]       = LAYOUT_U8_U8,
+    [R_ABS_64]    = LAYOUT_U8_U8,
+    [R_ABS_F]     = LAYOUT_U8_U8,
+    [R_ABS_F64]   = LAYOUT_U8_U8,
+    [R_MIN]       = LAYOUT_U8_U8_U8,
+    [R_MIN_64]    = LAYOUT_U8_U8_U8,
+    [R_MIN_F]     = LAYOUT_U8_U8_U8,
+    [R_MIN_F64]   = LAYOUT_U8_U8_U8,
+    [R_MAX]       = LAYOUT_U8_U8_U8,
+    [R_MAX_64]    = LAYOUT_U8_U8_U8,
+    [R_MAX_F]     = LAYOUT_U8_U8_U8,
+    [R_MAX_F64]   = LAYOUT_U8_U8_U8,
+    [R_FLOOR_F]   = LAYOUT_U8_U8,
+    [R_FLOOR_F64] = LAYOUT_U8_U8,
+    [R_CEIL_F]    = LAYOUT_U8_U8,
+    [R_CEIL_F64]  = LAYOUT_U8_U8,
+    [R_ROUND_F]   = LAYOUT_U8_U8,
+    [R_ROUND_F64] = LAYOUT_U8_U8,
+    [R_SIN_F]     = LAYOUT_U8_U8,
+    [R_SIN_F64]   = LAYOUT_U8_U8,
+    [R_COS_F]     = LAYOUT_U8_U8,
+    [R_COS_F64]   = LAYOUT_U8_U8,
+    [R_EXP_F]     = LAYOUT_U8_U8,
+    [R_EXP_F64]   = LAYOUT_U8_U8,
+    [R_LOG_F]     = LAYOUT_U8_U8,
+    [R_LOG_F64]   = LAYOUT_U8_U8,
+    [R_POW_F]     = LAYOUT_U8_U8_U8,
+    [R_POW_F64]   = LAYOUT_U8_U8_U8,
+
+    /* Compare & Branch. The immediate and the target of BxxI are read
+     * together, as a single 64-bit operand. */
+    [R_BEQ]       = LAYOUT_U8_U8_I32,
+    [R_BEQ_64]    = LAYOUT_U8_U8_I32,
+    [R_BEQ_F]     = LAYOUT_U8_U8_I32,
+    [R_BEQ_F64]   = LAYOUT_U8_U8_I32,
+    [R_BNE]       = LAYOUT_U8_U8_I32,
+    [R_BNE_64]    = LAYOUT_U8_U8_I32,
+    [R_BNE_F]     = LAYOUT_U8_U8_I32,
+    [R_BNE_F64]   = LAYOUT_U8_U8_I32,
+    [R_BLT]       = LAYOUT_U8_U8_I32,
+    [R_BLT_64]    = LAYOUT_U8_U8_I32,
+    [R_BLT_F]     = LAYOUT_U8_U8_I32,
+    [R_BLT_F64]   = LAYOUT_U8_U8_I32,
+    [R_BGE]       = LAYOUT_U8_U8_I32,
+    [R_BGE_64]    = LAYOUT_U8_U8_I32,
+    [R_BGE_F]     = LAYOUT_U8_U8_I32,
+    [R_BGE_F64]   = LAYOUT_U8_U8_I32,
+    [R_BEQI]      = LAYOUT_U8_I64,
+    [R_BNEI]      = LAYOUT_U8_I64,
+    [R_BLTI]      = LAYOUT_U8_I64,
+    [R_BGEI]      = LAYOUT_U8_I64,
+    [R_SEL]       = LAYOUT_U8_U8_U8,
+    [R_SEL_64]    = LAYOUT_U8_U8_U8,
+};
+
+static const uint8_t stackLayouts[256] = {
+    SHARED_LAYOUTS,
+
+    /* Load & Store */
+    [S_LDI]       = LAYOUT_I32,
+    [S_LDI_64]    = LAYOUT_I64,
+    [S_STM]       = LAYOUT_OP,
+    [S_STM_64]    = LAYOUT_OP,
+    [S_STMI]      = LAYOUT_I32,
+    [S_STMI_64]   = LAYOUT_I32,
+    [S_LDM]       = LAYOUT_OP,
+    [S_LDM_64]    = LAYOUT_OP,
+    [S_LDMI]      = LAYOUT_I32,
+    [S_LDMI_64]   = LAYOUT_I32,
+    [S_LDL]       = LAYOUT_U8,
+    [S_LDL_64]    = LAYOUT_U8,
+    [S_LDA]       = LAYOUT_U8,
+    [S_LDA_64]    = LAYOUT_U8,
+    [S_STL]       = LAYOUT_U8,
+    [S_STL_64]    = LAYOUT_U8,
+    [S_STA]       = LAYOUT_U8,
+    [S_STA_64]    = LAYOUT_U8,
+
+    /* Arithmetics */
+    [S_ADD]       = LAYOUT_OP,
+    [S_ADD_64]    = LAYOUT_OP,
+    [S_ADD_F]     = LAYOUT_OP,
+    [S_ADD_F64]   = LAYOUT_OP,
+    [S_SUB]       = LAYOUT_OP,
+    [S_SUB_64]    = LAYOUT_OP,
+    [S_SUB_F]     = LAYOUT_OP,
+    [S_SUB_F64]   = LAYOUT_OP,
+    [S_MUL]       = LAYOUT_OP,
+    [S_MUL_64]    = LAYOUT_OP,
+    [S_MUL_F]     = LAYOUT_OP,
+    [S_MUL_F64]   = LAYOUT_OP,
+    [S_DIV]       = LAYOUT_OP,
+    [S_DIV_64]    = LAYOUT_OP,
+    [S_DIV_F]     = LAYOUT_OP,
+    [S_DIV_F64]   = LAYOUT_OP,
+
+    /* Bit Stuff */
+    [S_INV]       = LAYOUT_OP,
+    [S_INV_64]    = LAYOUT_OP,
+    [S_NEG]       = LAYOUT_OP,
+    [S_NEG_64]    = LAYOUT_OP,
+    [S_NEG_F]     = LAYOUT_OP,
+    [S_NEG_F64]   = LAYOUT_OP,
+    [S_BOR]       = LAYOUT_OP,
+    [S_BOR_64]    = LAYOUT_OP,
+    [S_BXOR]      = LAYOUT_OP,
+    [S_BXOR_64]   = LAYOUT_OP,
+    [S_BAND]      = LAYOUT_OP,
+    [S_BAND_64]   = LAYOUT_OP,
+
+    /* Conditions & Branches */
+    [S_OR]        = LAYOUT_OP,
+    [S_AND]       = LAYOUT_OP,
+    [S_CPZ]       = LAYOUT_OP,
+    [S_CPZ_64]    = LAYOUT_OP,
+    [S_CPEQ]      = LAYOUT_OP,
+    [S_CPEQ_64]   = LAYOUT_OP,
+    [S_CPEQ_F]    = LAYOUT_OP,
+    [S_CPEQ_F64]  = LAYOUT_OP,
+    [S_CPNQ]      = LAYOUT_OP,
+    [S_CPNQ_64]   = LAYOUT_OP,
+    [S_CPNQ_F]    = LAYOUT_OP,
+    [S_CPNQ_F64]  = LAYOUT_OP,
+    [S_CPGT]      = LAYOUT_OP,
+    [S_CPGT_64]   = LAYOUT_OP,
+    [S_CPGT_F]    = LAYOUT_OP,
+    [S_CPGT_F64]  = LAYOUT_OP,
+    [S_CPLT]      = LAYOUT_OP,
+    [S_CPLT_64]   = LAYOUT_OP,
+    [S_CPLT_F]    = LAYOUT_OP,
+    [S_CPLT_F64]  = LAYOUT_OP,
+    [S_CPGQ]      = LAYOUT_OP,
+    [S_CPGQ_64]   = LAYOUT_OP,
+    [S_CPGQ_F]    = LAYOUT_OP,
+    [S_CPGQ_F64]  = LAYOUT_OP,
+    [S_CPLQ]      = LAYOUT_OP,
+    [S_CPLQ_64]   = LAYOUT_OP,
+    [S_CPLQ_F]    = LAYOUT_OP,
+    [S_CPLQ_F64]  = LAYOUT_OP,
+    [S_CPSTR]     = LAYOUT_OP,
+    [S_CPCHR]     = LAYOUT_OP,
+    [S_BRZ]       = LAYOUT_I32,
+    [S_BRNZ]      = LAYOUT_I32,
+    [S_BRIZ]      = LAYOUT_OP,
+    [S_BRINZ]     = LAYOUT_OP,
+    [S_JMPI]      = LAYOUT_OP,
+
+    /* Conversions */
+    [S_ITOL]      = LAYOUT_OP,
+    [S_ITOF]      = LAYOUT_OP,
+    [S_ITOD]      = LAYOUT_OP,
+    [S_ITOS]      = LAYOUT_OP,
+    [S_LTOI]      = LAYOUT_OP,
+    [S_LTOF]      = LAYOUT_OP,
+    [S_LTOD]      = LAYOUT_OP,
+    [S_LTOS]      = LAYOUT_OP,
+    [S_FTOI]      = LAYOUT_OP,
+    [S_FTOL]      = LAYOUT_OP,
+    [S_FTOD]      = LAYOUT_OP,
+    [S_FTOS]      = LAYOUT_U8,
+    [S_DTOI]      = LAYOUT_OP,
+    [S_DTOL]      = LAYOUT_OP,
+    [S_DTOF]      = LAYOUT_OP,
+    [S_DTOS]      = LAYOUT_U8,
+    [S_STOI]      = LAYOUT_I32,
+    [S_STOL]      = LAYOUT_I64,
+    [S_STOF]      = LAYOUT_I32,
+    [S_STOD]      = LAYOUT_I64,
+
+    /* Miscellaneous */
+    [S_NEW]       = LAYOUT_OP,
+    [S_DEL]       = LAYOUT_OP,
+    [S_RESZ]      = LAYOUT_OP,
+    [S_SIZE]      = LAYOUT_OP,
+    [S_STR]       = LAYOUT_I32,
+    [S_STRCPY]    = LAYOUT_I32,
+    [S_STRCAT]    = LAYOUT_I32,
+    [S_STRCMB]    = LAYOUT_OP,
+
+    /* Calls */
+    [S_TAILCALL]  = LAYOUT_U8_U8_I32,
+
+    /* Vectors */
+    [S_VADD]      = LAYOUT_OP,
+    [S_VADD_64]   = LAYOUT_OP,
+    [S_VADD_F]    = LAYOUT_OP,
+    [S_VADD_F64]  = LAYOUT_OP,
+    [S_VSUB]      = LAYOUT_OP,
+    [S_VSUB_64]   = LAYOUT_OP,
+    [S_VSUB_F]    = LAYOUT_OP,
+    [S_VSUB_F64]  = LAYOUT_OP,
+    [S_VMUL]      = LAYOUT_OP,
+    [S_VMUL_64]   = LAYOUT_OP,
+    [S_VMUL_F]    = LAYOUT_OP,
+    [S_VMUL_F64]  = LAYOUT_OP,
+    [S_VDIV]      = LAYOUT_OP,
+    [S_VDIV_64]   = LAYOUT_OP,
+    [S_VDIV_F]    = LAYOUT_OP,
+    [S_VDIV_F64]  = LAYOUT_OP,
+    [S_VFMA]      = LAYOUT_OP,
+    [S_VFMA_64]   = LAYOUT_OP,
+    [S_VFMA_F]    = LAYOUT_OP,
+    [S_VFMA_F64]  = LAYOUT_OP,
+    [S_VMIN]      = LAYOUT_OP,
+    [S_VMIN_64]   = LAYOUT_OP,
+    [S_VMIN_F]    = LAYOUT_OP,
+    [S_VMIN_F64]  = LAYOUT_OP,
+    [S_VMAX]      = LAYOUT_OP,
+    [S_VMAX_64]   = LAYOUT_OP,
+    [S_VMAX_F]    = LAYOUT_OP,
+    [S_VMAX_F64]  = LAYOUT_OP,
+    [S_VCPEQ]     = LAYOUT_OP,
+    [S_VCPEQ_64]  = LAYOUT_OP,
+    [S_VCPEQ_F]   = LAYOUT_OP,
+    [S_VCPEQ_F64] = LAYOUT_OP,
+    [S_VCPLT]     = LAYOUT_OP,
+    [S_VCPLT_64]  = LAYOUT_OP,
+    [S_VCPLT_F]   = LAYOUT_OP,
+    [S_VCPLT_F64] = LAYOUT_OP,
+    [S_MEMCPY]    = LAYOUT_OP,
+    [S_MEMMOVE]   = LAYOUT_OP,
+    [S_MEMSET]    = LAYOUT_OP,
+    [S_FILL]      = LAYOUT_OP,
+    [S_FILL_64]   = LAYOUT_OP,
+    [S_SQRT_F]    = LAYOUT_OP,
+    [S_SQRT_F64]  = LAYOUT_OP,
+    [S_FMA_F]     = LAYOUT_OP,
+    [S_FMA_F64]   = LAYOUT_OP,
+    [S_ABS]       = LAYOUT_OP,
+    [S_ABS_64]    = LAYOUT_OP,
+    [S_ABS_F]     = LAYOUT_OP,
+    [S_ABS_F64]   = LAYOUT_OP,
+    [S_MIN]       = LAYOUT_OP,
+    [S_MIN_64]    = LAYOUT_OP,
+    [S_MIN_F]     = LAYOUT_OP,
+    [S_MIN_F64]   = LAYOUT_OP,
+    [S_MAX]       = LAYOUT_OP,
+    [S_MAX_64]    = LAYOUT_OP,
+    [S_MAX_F]     = LAYOUT_OP,
+    [S_MAX_F64]   = LAYOUT_OP,
+    [S_FLOOR_F]   = LAYOUT_OP,
+    [S_FLOOR_F64] = LAYOUT_OP,
+    [S_CEIL_F]    = LAYOUT_OP,
+    [S_CEIL_F64]  = LAYOUT_OP,
+    [S_ROUND_F]   = LAYOUT_OP,
+    [S_ROUND_F64] = LAYOUT_OP,
+    [S_SIN_F]     = LAYOUT_OP,
+    [S_SIN_F64]   = LAYOUT_OP,
+    [S_COS_F]     = LAYOUT_OP,
+    [S_COS_F64]   = LAYOUT_OP,
+    [S_EXP_F]     = LAYOUT_OP,
+    [S_EXP_F64]   = LAYOUT_OP,
+    [S_LOG_F]     = LAYOUT_OP,
+    [S_LOG_F64]   = LAYOUT_OP,
+    [S_POW_F]     = LAYOUT_OP,
+    [S_POW_F64]   = LAYOUT_OP,
+    [S_SEL]       = LAYOUT_OP,
+    [S_SEL_64]    = LAYOUT_OP,
+};
+
+typedef struct {
+    uint8_t   *code;      /* The program, padded with FETCH_PADDING bytes. */
+    uint32_t   codeSize;
+    uint32_t   mode;      /* 0 = register, 1 = stack, 2 = wide register. */
+    size_t     count;     /* Number of instructions. */
+    uint32_t  *offsets;   /* Offset of every instruction into code. */
+    uint8_t   *layouts;   /* Layout of every instruction. */
+    Decoded_t *decoded;   /* Filled in by PreDecode(). */
+} Stream_t;
+
+typedef uint64_t (*Technique_t)(const Stream_t *);
+
+/* The stream is always read through this, so that the compiler cannot
+ * assume two calls with the same stream to give the same result. */
+static const Stream_t *volatile benchStream;
+static volatile uint64_t checksumSink;
+
+/* The instruction "register", which is static just like in the VM. */
+static Instr_t instr;
+
+/*
+ * The loop shared by all techniques. Before expanding it, a technique
+ * defines FETCH(), which makes 'layout' and the current instruction
+ * available, as well as the same DECODE_* macros that the VM uses.
+ * The operands are summed up separately, so that the checksum does not
+ * become a long dependency chain.
+ */
+#define DECODE_LOOP() \
+    uint64_t op = 0, a = 0, b = 0, c = 0, C = 0;\
+    uint8_t layout;\
+    for (size_t i = 0; i < stream->count; ++i)\
+    {\
+        FETCH();\
+        op += DECODE_OPCODE();\
+        switch (layout)\
+        {\
+            case LAYOUT_U8:\
+                a += DECODE_8(u8, C, 0);\
+                break;\
+            case LAYOUT_I32:\
+                C += DECODE_32(i32, C, 0);\
+                break;\
+            case LAYOUT_I64:\
+                C += DECODE_64(i64, C, 0);\
+                break;\
+            case LAYOUT_U8_U8:\
+                a += DECODE_8(u8_u8, a, 0);\
+                b += DECODE_8(u8_u8, b, 1);\
+                break;\
+            case LAYOUT_U8_I32:\
+                a += DECODE_8(u8_i32, a, 0);\
+                C += DECODE_32(u8_i32, C, 1);\
+                break;\
+            case LAYOUT_U8_I64:\
+                a += DECODE_8(u8_i64, a, 0);\
+                C += DECODE_64(u8_i64, C, 1);\
+                break;\
+            case LAYOUT_U8_U8_U8:\
+                a += DECODE_8(u8_u8_u8, a, 0);\
+                b += DECODE_8(u8_u8_u8, b, 1);\
+                c += DECODE_8(u8_u8_u8, c, 2);\
+                break;\
+            case LAYOUT_U8_U8_I32:\
+                a += DECODE_8(u8_u8_i32, a, 0);\
+                b += DECODE_8(u8_u8_i32, b, 1);\
+                C += DECODE_32(u8_u8_i32, C, 2);\
+                break;\
+            case LAYOUT_U8_U8_I64:\
+                a += DECODE_8(u8_u8_i64, a, 0);\
+                b += DECODE_8(u8_u8_i64, b, 1);\
+                C += DECODE_64(u8_u8_i64, C, 2);\
+                break;\
+            default:\
+                break;\
+        }\
+    }\
+    return Checksum(op, a, b, c, C)
+
+static uint64_t Checksum(uint64_t op, uint64_t a, uint64_t b, uint64_t c, uint64_t C)
+{
+    return op ^ (a << 13) ^ (b << 26) ^ (c << 39) ^ (C * 0x9E3779B97F4A7C15ull);
+}
+
+static inline int32_t ReadI32(const uint8_t *p)
+{
+    int32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static inline int64_t ReadI64(const uint8_t *p)
+{
+    int64_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static NOINLINE uint64_t DecodeUnion(const Stream_t *stream)
+{
+    const uint8_t *code = stream->code;
+
+#define FETCH() instr = *(const Instr_t *)(code + stream->offsets[i]); layout = stream->layouts[i]
+#define DECODE_OPCODE() instr.opcode
+#define DECODE_8( layout, field, offset) instr.layout.field
+#define DECODE_32(layout, field, offset) instr.layout.field
+#define DECODE_64(layout, field, offset) instr.layout.field
+
+    DECODE_LOOP();
+
+#undef FETCH
+#undef DECODE_OPCODE
+#undef DECODE_8
+#undef DECODE_32
+#undef DECODE_64
+}
+
+static NOINLINE uint64_t DecodeBitmask(const Stream_t *stream)
+{
+    const uint8_t *code = stream->code;
+
+#define FETCH() instr = *(const Instr_t *)(code + stream->offsets[i]); layout = stream->layouts[i]
+#define DECODE(layout, type, field, offset, mask) (*(type *)((instr.raw + 1 + offset)) & mask)
+#define DECODE_OPCODE() (*(uint8_t *)(&instr) & 0xFF)
+#define DECODE_8( layout, field, offset) ((uint8_t)(DECODE(layout, uint8_t, field, offset, 0xFF)))
+#define DECODE_32(layout, field, offset) ((int32_t)(DECODE(layout, int32_t, field, offset, 0xFFFFFFFF)))
+#define DECODE_64(layout, field, offset) ((int64_t)(DECODE(layout, int64_t, field, offset, 0xFFFFFFFFFFFFFFFF)))
+
+    DECODE_LOOP();
+
+#undef FETCH
+#undef DECODE
+#undef DECODE_OPCODE
+#undef DECODE_8
+#undef DECODE_32
+#undef DECODE_64
+}
+
+static NOINLINE uint64_t DecodeMemcpy(const Stream_t *stream)
+{
+    const uint8_t *code = stream->code;
+    const uint8_t *ptr;
+
+#define FETCH() ptr = code + stream->offsets[i]; layout = stream->layouts[i]
+#define DECODE_OPCODE() ptr[0]
+#define DECODE_8( layout, field, offset) ptr[1 + offset]
+#define DECODE_32(layout, field, offset) ReadI32(ptr + 1 + offset)
+#define DECODE_64(layout, field, offset) ReadI64(ptr + 1 + offset)
+
+    DECODE_LOOP();
+
+#undef FETCH
+#undef DECODE_OPCODE
+#undef DECODE_8
+#undef DECODE_32
+#undef DECODE_64
+}
+
+static NOINLINE uint64_t DecodePreDecoded(const Stream_t *stream)
+{
+    const Decoded_t *decoded = stream->decoded;
+    const Decoded_t *dec;
+
+#define FETCH() dec = decoded + i; layout = dec->layout
+#define DECODE_OPCODE() dec->opcode
+#define DECODE_8( layout, field, offset) dec->ops[offset]
+#define DECODE_32(layout, field, offset) dec->C
+#define DECODE_64(layout, field, offset) dec->C
+
+    DECODE_LOOP();
+
+#undef FETCH
+#undef DECODE_OPCODE
+#undef DECODE_8
+#undef DECODE_32
+#undef DECODE_64
+}
+
+/* Converts the program into Decoded_t records. This is timed as well, since
+ * a VM would have to do it every time a program is loaded. */
+static NOINLINE uint64_t PreDecode(const Stream_t *stream)
+{
+    Decoded_t *decoded = stream->decoded;
+
+    for (size_t i = 0; i < stream->count; ++i)
+    {
+        const uint8_t *ptr = stream->code + stream->offsets[i];
+        const uint8_t layout = stream->layouts[i];
+        Decoded_t *dec = decoded + i;
+
+        dec->opcode = ptr[0];
+        dec->layout = layout;
+        dec->ops[0] = dec->ops[1] = dec->ops[2] = 0;
+        dec->C = 0;
+
+        switch (layout)
+        {
+            case LAYOUT_U8:
+                dec->ops[0] = ptr[1];
+                break;
+            case LAYOUT_I32:
+                dec->C = ReadI32(ptr + 1);
+                break;
+            case LAYOUT_I64:
+                dec->C = ReadI64(ptr + 1);
+                break;
+            case LAYOUT_U8_U8:
+                dec->ops[0] = ptr[1];
+                dec->ops[1] = ptr[2];
+                break;
+            case LAYOUT_U8_I32:
+                dec->ops[0] = ptr[1];
+                dec->C = ReadI32(ptr + 2);
+                break;
+            case LAYOUT_U8_I64:
+                dec->ops[0] = ptr[1];
+                dec->C = ReadI64(ptr + 2);
+                break;
+            case LAYOUT_U8_U8_U8:
+                dec->ops[0] = ptr[1];
+                dec->ops[1] = ptr[2];
+                dec->ops[2] = ptr[3];
+                break;
+            case LAYOUT_U8_U8_I32:
+                dec->ops[0] = ptr[1];
+                dec->ops[1] = ptr[2];
+                dec->C = ReadI32(ptr + 3);
+                break;
+            case LAYOUT_U8_U8_I64:
+                dec->ops[0] = ptr[1];
+                dec->ops[1] = ptr[2];
+                dec->C = ReadI64(ptr + 3);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return decoded[stream->count - 1].opcode;
+}
+
+typedef struct {
+    const char  *name;
+    Technique_t  func;
+    int          decodes; /* Whether it is checked against the others. */
+} TechniqueInfo_t;
+
+static const TechniqueInfo_t techniques[] = {
+    { "union",       DecodeUnion,      1 },
+    { "bitmask",     DecodeBitmask,    1 },
+    { "memcpy",      DecodeMemcpy,     1 },
+    { "predecoded",  DecodePreDecoded, 1 },
+    { "(pre-decode)",PreDecode,        0 },
+};
+
+#define TECHNIQUE_COUNT (sizeof(techniques) / sizeof(techniques[0]))
+
+/**** TIMING ****/
+
+#ifdef _WIN32
+static double timerFreq;
+
+static void InitTimer(void)
+{
+    LARGE_INTEGER li;
+    QueryPerformanceFrequency(&li);
+    timerFreq = (double)li.QuadPart / 1e9;
+}
+
+static double NowNs(void)
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return (double)li.QuadPart / timerFreq;
+}
+#else
+static void InitTimer(void) {}
+
+static double NowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+#endif
+
+/* Pins the process to the given CPU, or the last one available if negative.
+ * Returns the CPU pinned to, or -1 if pinning is not supported. */
+static int PinToCpu(int cpu)
+{
+#if defined(_WIN32)
+    DWORD_PTR processMask, systemMask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        return -1;
+
+    if (cpu < 0)
+    {
+        for (cpu = sizeof(DWORD_PTR) * 8 - 1; cpu >= 0; --cpu)
+            if (processMask & ((DWORD_PTR)1 << cpu))
+                break;
+    }
+
+    if (cpu < 0 || !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+        return -1;
+
+    return cpu;
+#elif defined(__linux__)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+
+    if (cpu < 0)
+    {
+        for (cpu = CPU_SETSIZE - 1; cpu >= 0; --cpu)
+            if (CPU_ISSET(cpu, &set))
+                break;
+    }
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return -1;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+
+    return cpu;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+/**** STATISTICS ****/
+
+/* Two-sided critical values of Student's t-distribution for a 95%
+ * confidence level, indexed by degrees of freedom. */
+static const double tTable[] = {
+    0.0,   12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+    2.228, 2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+    2.086, 2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+    2.042
+};
+
+static double TCritical(int df)
+{
+    if (df < (int)(sizeof(tTable) / sizeof(tTable[0])))
+        return tTable[df];
+    if (df < 60)
+        return 2.021;
+    if (df < 120)
+        return 2.000;
+    return 1.960;
+}
+
+typedef struct {
+    double mean;
+    double ci;
+    double min;
+} Stats_t;
+
+static Stats_t ComputeStats(const double *samples, int n)
+{
+    Stats_t stats = { 0.0, 0.0, samples[0] };
+
+    for (int i = 0; i < n; ++i)
+    {
+        stats.mean += samples[i];
+        if (samples[i] < stats.min)
+            stats.min = samples[i];
+    }
+
+    stats.mean /= n;
+
+    if (n > 1)
+    {
+        double sumSq = 0.0;
+        for (int i = 0; i < n; ++i)
+            sumSq += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+
+        stats.ci = TCritical(n - 1) * sqrt(sumSq / (n - 1)) / sqrt((double)n);
+    }
+
+    return stats;
+}
+
+/**** PROGRAM ****/
+
+static void FreeStream(Stream_t *stream)
+{
+    free(stream->code);
+    free(stream->offsets);
+    free(stream->layouts);
+    free(stream->decoded);
+}
+
+/* Reads a program the same way the VM does, and walks its code section. */
+static int ReadStream(const char *filepath, Stream_t *stream)
+{
+    memset(stream, 0, sizeof(*stream));
+
+    FILE *file = fopen(filepath, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Couldn't read file \"%s\".\n", filepath);
+        return 0;
+    }
+
+    uint32_t header[4];
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (fileSize < (long)sizeof(header) || fread(header, sizeof(uint32_t), 4, file) != 4)
+    {
+        fprintf(stderr, "\"%s\" is not a RackVM program.\n", filepath);
+        fclose(file);
+        return 0;
+    }
+
+    uint32_t programSize = (uint32_t)(fileSize - sizeof(header));
+    stream->mode = header[0];
+    stream->codeSize = header[3] < programSize ? header[3] : programSize;
+    stream->code = calloc(programSize + FETCH_PADDING, 1);
+
+    if (!stream->code || fread(stream->code, 1, programSize, file) != programSize)
+    {
+        fprintf(stderr, "Couldn't read file \"%s\".\n", filepath);
+        fclose(file);
+        FreeStream(stream);
+        return 0;
+    }
+
+    fclose(file);
+
+    if (stream->mode > 2 || stream->codeSize == 0)
+    {
+        fprintf(stderr, "\"%s\" has an invalid header.\n", filepath);
+        FreeStream(stream);
+        return 0;
+    }
+
+    const uint8_t *table = stream->mode == 1 ? stackLayouts : registerLayouts;
+
+    stream->offsets = malloc(stream->codeSize * sizeof(uint32_t));
+    stream->layouts = malloc(stream->codeSize);
+    stream->decoded = malloc(stream->codeSize * sizeof(Decoded_t));
+    if (!stream->offsets || !stream->layouts || !stream->decoded)
+    {
+        fputs("Out of memory.\n", stderr);
+        FreeStream(stream);
+        return 0;
+    }
+
+    uint32_t offset = 0;
+    while (offset < stream->codeSize)
+    {
+        uint8_t layout = table[stream->code[offset]];
+        if (layout == LAYOUT_INVALID)
+        {
+            fprintf(stderr, "\"%s\": unknown opcode 0x%02X at 0x%X.\n",
+                filepath, stream->code[offset], offset);
+            FreeStream(stream);
+            return 0;
+        }
+
+        stream->offsets[stream->count] = offset;
+        stream->layouts[stream->count] = layout;
+        ++stream->count;
+
+        offset += layoutSizes[layout];
+    }
+
+    return 1;
+}
+
+/* Runs a technique 'passes' times, and returns the time per instruction. */
+static double TimeTechnique(Technique_t func, long passes)
+{
+    uint64_t sum = 0;
+    double start = NowNs();
+
+    for (long i = 0; i < passes; ++i)
+        sum += func(benchStream);
+
+    double elapsed = NowNs() - start;
+    checksumSink = sum;
+
+    return elapsed / ((double)passes * benchStream->count);
+}
+
+static int RunBenchmark(const char *filepath, int samples, double sampleMs)
+{
+    Stream_t stream;
+    if (!ReadStream(filepath, &stream))
+        return 0;
+
+    benchStream = &stream;
+
+    /* Warm up, and make sure that every technique decodes the same thing. */
+    PreDecode(&stream);
+    uint64_t expected = DecodeUnion(&stream);
+    for (size_t t = 0; t < TECHNIQUE_COUNT; ++t)
+    {
+        uint64_t checksum = techniques[t].func(&stream);
+        if (techniques[t].decodes && checksum != expected)
+        {
+            fprintf(stderr, "\"%s\": checksum mismatch for %s (%016llX, expected %016llX).\n",
+                filepath, techniques[t].name,
+                (unsigned long long)checksum, (unsigned long long)expected);
+            FreeStream(&stream);
+            return 0;
+        }
+    }
+
+    /* Find a number of passes that makes each sample long enough to time. */
+    long passes = 1;
+    while (passes < MAX_PASSES &&
+           TimeTechnique(DecodeUnion, passes) * passes * stream.count < sampleMs * 1e6)
+        passes *= 2;
+
+    double *results = malloc(TECHNIQUE_COUNT * samples * sizeof(double));
+    if (!results)
+    {
+        fputs("Out of memory.\n", stderr);
+        FreeStream(&stream);
+        return 0;
+    }
+
+    for (int s = 0; s < samples; ++s)
+    {
+        /* Rotate the order, so no technique always runs first. */
+        for (size_t i = 0; i < TECHNIQUE_COUNT; ++i)
+        {
+            size_t t = (i + s) % TECHNIQUE_COUNT;
+            results[t * samples + s] = TimeTechnique(techniques[t].func, passes);
+        }
+    }
+
+    printf("%s: %s mode, %zu instructions, %u bytes of code\n", filepath,
+        stream.mode == 1 ? "stack" : (stream.mode == 2 ? "wide register" : "register"),
+        stream.count, stream.codeSize);
+    printf("%d samples of %ld passes, checksum %016llX\n\n",
+        samples, passes, (unsigned long long)expected);
+    printf("%-14s%12s%12s%12s\n", "Technique", "ns/instr", "95% CI", "min");
+    puts("--------------------------------------------------");
+
+    for (size_t t = 0; t < TECHNIQUE_COUNT; ++t)
+    {
+        Stats_t stats = ComputeStats(results + t * samples, samples);
+        printf("%-14s%12.4f%12.4f%12.4f\n", techniques[t].name, stats.mean, stats.ci, stats.min);
+    }
+
+    puts("");
+
+    free(results);
+    FreeStream(&stream);
+    return 1;
+}
+
+static void PrintUsage(void)
+{
+    puts("Usage: decoding-bench [-n samples] [-t sample_ms] [-c cpu] program.bin...");
+    puts("  -n  number of samples per technique (default 30)");
+    puts("  -t  minimum duration of a sample in milliseconds (default 20)");
+    puts("  -c  CPU to pin to (default is the last one available)");
+}
+
+int main(int argc, char **argv)
+{
+    int samples = DEFAULT_SAMPLES;
+    double sampleMs = DEFAULT_SAMPLE_MS;
+    int cpu = -1;
+    int argi = 1;
+
+    for (; argi < argc && argv[argi][0] == '-'; ++argi)
+    {
+        if (argi + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        if (strcmp(argv[argi], "-n") == 0)
+            samples = atoi(argv[++argi]);
+        else if (strcmp(argv[argi], "-t") == 0)
+            sampleMs = atof(argv[++argi]);
+        else if (strcmp(argv[argi], "-c") == 0)
+            cpu = atoi(argv[++argi]);
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (argi >= argc || samples < 2 || samples > MAX_SAMPLES || sampleMs <= 0.0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (sizeof(Instr_t) != 13)
+    {
+        fprintf(stderr, "Invalid size of instruction struct (%zu).\n", sizeof(Instr_t));
+        return 1;
+    }
+
+    InitTimer();
+
+    int pinned = PinToCpu(cpu);
+    if (pinned < 0)
+        puts("Warning: couldn't pin to a CPU, results may be noisy.\n");
+    else
+        printf("Pinned to CPU %d.\n\n", pinned);
+
+    int success = 1;
+    for (; argi < argc; ++argi)
+        success &= RunBenchmark(argv[argi], samples, sampleMs);
+
+    return success ? 0 : 1;
+}
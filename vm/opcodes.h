@@ -170,6 +170,121 @@ typedef enum {
     R_STRCAT,
     R_STRCMB,
 
+    /* Calls */
+    R_TAILCALL  = 0x9A,
+
+    /* Indexed Locals */
+    R_LDLX      = 0x9B,
+    R_LDLX_64,
+    R_STLX,
+    R_STLX_64,
+
+    /* Vectors */
+    R_VLEN      = 0x9F,
+    R_VADD      = 0xA0,
+    R_VADD_64,
+    R_VADD_F,
+    R_VADD_F64,
+    R_VSUB,
+    R_VSUB_64,
+    R_VSUB_F,
+    R_VSUB_F64,
+    R_VMUL,
+    R_VMUL_64,
+    R_VMUL_F,
+    R_VMUL_F64,
+    R_VDIV,
+    R_VDIV_64,
+    R_VDIV_F,
+    R_VDIV_F64,
+    R_VFMA,
+    R_VFMA_64,
+    R_VFMA_F,
+    R_VFMA_F64,
+    R_VMIN,
+    R_VMIN_64,
+    R_VMIN_F,
+    R_VMIN_F64,
+    R_VMAX,
+    R_VMAX_64,
+    R_VMAX_F,
+    R_VMAX_F64,
+    R_VCPEQ,
+    R_VCPEQ_64,
+    R_VCPEQ_F,
+    R_VCPEQ_F64,
+    R_VCPLT,
+    R_VCPLT_64,
+    R_VCPLT_F,
+    R_VCPLT_F64,
+
+    /* Bulk Memory */
+    R_MEMCPY    = 0xC4,
+    R_MEMMOVE,
+    R_MEMSET,
+    R_FILL,
+    R_FILL_64,
+
+    /* Math */
+    R_SQRT_F    = 0xC9,
+    R_SQRT_F64,
+    R_FMA_F,
+    R_FMA_F64,
+    R_ABS,
+    R_ABS_64,
+    R_ABS_F,
+    R_ABS_F64,
+    R_MIN,
+    R_MIN_64,
+    R_MIN_F,
+    R_MIN_F64,
+    R_MAX,
+    R_MAX_64,
+    R_MAX_F,
+    R_MAX_F64,
+    R_FLOOR_F,
+    R_FLOOR_F64,
+    R_CEIL_F,
+    R_CEIL_F64,
+    R_ROUND_F,
+    R_ROUND_F64,
+    R_SIN_F,
+    R_SIN_F64,
+    R_COS_F,
+    R_COS_F64,
+    R_EXP_F,
+    R_EXP_F64,
+    R_LOG_F,
+    R_LOG_F64,
+    R_POW_F,
+    R_POW_F64,
+
+    /* Compare & Branch */
+    R_BEQ       = 0xE9,
+    R_BEQ_64,
+    R_BEQ_F,
+    R_BEQ_F64,
+    R_BNE,
+    R_BNE_64,
+    R_BNE_F,
+    R_BNE_F64,
+    R_BLT,
+    R_BLT_64,
+    R_BLT_F,
+    R_BLT_F64,
+    R_BGE,
+    R_BGE_64,
+    R_BGE_F,
+    R_BGE_F64,
+    R_BEQI,
+    R_BNEI,
+    R_BLTI,
+    R_BGEI,
+
+    /* Select */
+    R_SEL       = 0xFD,
+    R_SEL_64,
+
     R_OPCODE_COUNT,
 
     /******** STACK-BASED INSTRUCTIONS ********/
@@ -294,6 +409,92 @@ typedef enum {
     S_STRCAT,
     S_STRCMB,
 
+    /* Calls */
+    S_TAILCALL  = 0x76,
+
+    /* Vectors */
+    S_VADD      = 0x7B,
+    S_VADD_64,
+    S_VADD_F,
+    S_VADD_F64,
+    S_VSUB,
+    S_VSUB_64,
+    S_VSUB_F,
+    S_VSUB_F64,
+    S_VMUL,
+    S_VMUL_64,
+    S_VMUL_F,
+    S_VMUL_F64,
+    S_VDIV,
+    S_VDIV_64,
+    S_VDIV_F,
+    S_VDIV_F64,
+    S_VFMA,
+    S_VFMA_64,
+    S_VFMA_F,
+    S_VFMA_F64,
+    S_VMIN,
+    S_VMIN_64,
+    S_VMIN_F,
+    S_VMIN_F64,
+    S_VMAX,
+    S_VMAX_64,
+    S_VMAX_F,
+    S_VMAX_F64,
+    S_VCPEQ,
+    S_VCPEQ_64,
+    S_VCPEQ_F,
+    S_VCPEQ_F64,
+    S_VCPLT,
+    S_VCPLT_64,
+    S_VCPLT_F,
+    S_VCPLT_F64,
+
+    /* Bulk Memory */
+    S_MEMCPY    = 0x9F,
+    S_MEMMOVE,
+    S_MEMSET,
+    S_FILL,
+    S_FILL_64,
+
+    /* Math */
+    S_SQRT_F    = 0xA4,
+    S_SQRT_F64,
+    S_FMA_F,
+    S_FMA_F64,
+    S_ABS,
+    S_ABS_64,
+    S_ABS_F,
+    S_ABS_F64,
+    S_MIN,
+    S_MIN_64,
+    S_MIN_F,
+    S_MIN_F64,
+    S_MAX,
+    S_MAX_64,
+    S_MAX_F,
+    S_MAX_F64,
+    S_FLOOR_F,
+    S_FLOOR_F64,
+    S_CEIL_F,
+    S_CEIL_F64,
+    S_ROUND_F,
+    S_ROUND_F64,
+    S_SIN_F,
+    S_SIN_F64,
+    S_COS_F,
+    S_COS_F64,
+    S_EXP_F,
+    S_EXP_F64,
+    S_LOG_F,
+    S_LOG_F64,
+    S_POW_F,
+    S_POW_F64,
+
+    /* Select */
+    S_SEL       = 0xC4,
+    S_SEL_64,
+
     S_OPCODE_COUNT
 } Opcode_t;
 
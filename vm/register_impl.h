@@ -47,10 +47,11 @@ int RegisterInterpreterLoop()
 
     /* The last register is used for storing comparison results, and is
      * checked in conditional branches. */
-    int32_t *cpr = stackBegin + 31;
+    int32_t *cpr = reg + (vmMode == VM_MODE_REGISTER_WIDE ? (REGISTER_COUNT - 1) * 2 : REGISTER_COUNT - 1);
 
 /* Allows the access of registers as doubled registers, i.e. 64-bits.
- * This uses the register directly after. */
+ * This uses the register directly after, or in wide register mode, 
+ * the upper half of the same register. */
 #define dreg(idx) (*(int64_t*)(reg+idx))
 
     while (instrPtr < instrEnd)
@@ -165,6 +166,29 @@ int RegisterInterpreterLoop()
                 instrPtr += 3;
                 break;
 
+            /* Indexed locals, e.g. arrays placed in the frame. */
+            case R_LDLX: reg[DECODE_8(u8_u8_u32, a, 0)] = 
+                *(int32_t*)((uint8_t*)stackFrameLocals + reg[DECODE_8(u8_u8_u32, b, 1)] + DECODE_u32(u8_u8_u32, C, 2));
+                instrPtr += 7;
+                break;
+
+            case R_LDLX_64: dreg(DECODE_8(u8_u8_u32, a, 0)) = 
+                *(int64_t*)((uint8_t*)stackFrameLocals + reg[DECODE_8(u8_u8_u32, b, 1)] + DECODE_u32(u8_u8_u32, C, 2));
+                instrPtr += 7;
+                break;
+
+            case R_STLX: 
+                *(int32_t*)((uint8_t*)stackFrameLocals + reg[DECODE_8(u8_u8_u32, a, 0)] + DECODE_u32(u8_u8_u32, C, 2)) 
+                    = reg[DECODE_8(u8_u8_u32, b, 1)];
+                instrPtr += 7;
+                break;
+
+            case R_STLX_64: 
+                *(int64_t*)((uint8_t*)stackFrameLocals + reg[DECODE_8(u8_u8_u32, a, 0)] + DECODE_u32(u8_u8_u32, C, 2)) 
+                    = dreg(DECODE_8(u8_u8_u32, b, 1));
+                instrPtr += 7;
+                break;
+
             case R_MOVS: *++sp = reg[DECODE_8(u8, C, 0)];
                 instrPtr += 2;
                 break;
@@ -209,6 +233,19 @@ int RegisterInterpreterLoop()
     *(type)(reg+DECODE_8(layout, b, 1)) MACRO_LITERAL(op) \
     DECODE_64(layout, C, 2)
 
+/* Math instructions call a function of the type on one or two registers. */
+#define REG_MATH_1(type, fn) \
+    *(type)(reg+DECODE_8(u8_u8, a, 0)) = fn(*(type)(reg+DECODE_8(u8_u8, b, 1)))
+
+#define REG_MATH_2(type, fn) \
+    *(type)(reg+DECODE_8(u8_u8_u8, a, 0)) = \
+    fn(*(type)(reg+DECODE_8(u8_u8_u8, b, 1)), *(type)(reg+DECODE_8(u8_u8_u8, c, 2)))
+
+/* Ra += Rb * Rc, rounded once. */
+#define REG_FMA(type, fn) \
+    *(type)(reg+DECODE_8(u8_u8_u8, a, 0)) = fn(*(type)(reg+DECODE_8(u8_u8_u8, b, 1)), \
+    *(type)(reg+DECODE_8(u8_u8_u8, c, 2)), *(type)(reg+DECODE_8(u8_u8_u8, a, 0)))
+
 #ifdef UNION_DECODING
     #define REG_OPI_f32(type, layout, op) \
         *(type)(reg+DECODE_8(layout, a, 0)) = \
@@ -401,11 +438,11 @@ int RegisterInterpreterLoop()
                 break;
             
             case R_BORI: REG_OPI_32(int32_t *, u8_u8_i32, |);
-                instrPtr += 4;
+                instrPtr += 7;
                 break;
 
             case R_BORI_64: REG_OPI_64(int64_t *, u8_u8_i64, |);
-                instrPtr += 4;
+                instrPtr += 11;
                 break;
 
             case R_BXOR: REG_OP(int32_t *, ^);
@@ -417,11 +454,11 @@ int RegisterInterpreterLoop()
                 break;
             
             case R_BXORI: REG_OPI_32(int32_t *, u8_u8_i32, ^);
-                instrPtr += 4;
+                instrPtr += 7;
                 break;
 
             case R_BXORI_64: REG_OPI_64(int64_t *, u8_u8_i64, ^);
-                instrPtr += 4;
+                instrPtr += 11;
                 break;
 
             case R_BAND: REG_OP(int32_t *, &);
@@ -433,11 +470,11 @@ int RegisterInterpreterLoop()
                 break;
             
             case R_BANDI: REG_OPI_32(int32_t *, u8_u8_i32, &);
-                instrPtr += 4;
+                instrPtr += 7;
                 break;
 
             case R_BANDI_64: REG_OPI_64(int64_t *, u8_u8_i64, &);
-                instrPtr += 4;
+                instrPtr += 11;
                 break;
 
             /**** Comparisons ****/
@@ -592,10 +629,12 @@ int RegisterInterpreterLoop()
                 instrPtr += 3;
                 break;
             
-            case R_BRZ: instrPtr = !*cpr ? program + DECODE_ADDR() : instrPtr + 5;
+            case R_BRZ: PROFILE_BRANCH(!*cpr);
+                instrPtr = !*cpr ? program + DECODE_ADDR() : instrPtr + 5;
                 break;
 
-            case R_BRNZ: instrPtr = *cpr ? program + DECODE_ADDR() : instrPtr + 5;
+            case R_BRNZ: PROFILE_BRANCH(*cpr);
+                instrPtr = *cpr ? program + DECODE_ADDR() : instrPtr + 5;
                 break;
 
             case R_BRIZ: instrPtr = !*cpr ? program + reg[DECODE_8(u8, C, 0)] : instrPtr + 5;
@@ -607,6 +646,96 @@ int RegisterInterpreterLoop()
             case R_JMPI: instrPtr = program + reg[DECODE_8(u8, C, 0)];
                 break;
 
+/* Compares two registers, or a register and an immediate, and jumps to 
+ * the address C if the comparison holds, without going through CPR. */
+#define REG_BRANCH_OP(type, op) \
+    tmpInt = *(type)(reg+DECODE_8(u8_u8_u32, a, 0)) MACRO_LITERAL(op) \
+             *(type)(reg+DECODE_8(u8_u8_u32, b, 1)); \
+    PROFILE_BRANCH(tmpInt); \
+    instrPtr = tmpInt ? program + DECODE_u32(u8_u8_u32, C, 2) : instrPtr + 7
+
+#define REG_BRANCH_OPI(op) \
+    tmpInt = reg[DECODE_8(u8_i32_u32, a, 0)] MACRO_LITERAL(op) DECODE_32(u8_i32_u32, B, 1); \
+    PROFILE_BRANCH(tmpInt); \
+    instrPtr = tmpInt ? program + DECODE_u32(u8_i32_u32, C, 5) : instrPtr + 10
+
+            case R_BEQ: REG_BRANCH_OP(int32_t *, ==);
+                break;
+
+            case R_BEQ_64: REG_BRANCH_OP(int64_t *, ==);
+                break;
+
+            case R_BEQ_F: REG_BRANCH_OP(float *, ==);
+                break;
+
+            case R_BEQ_F64: REG_BRANCH_OP(double *, ==);
+                break;
+
+            case R_BNE: REG_BRANCH_OP(int32_t *, !=);
+                break;
+
+            case R_BNE_64: REG_BRANCH_OP(int64_t *, !=);
+                break;
+
+            case R_BNE_F: REG_BRANCH_OP(float *, !=);
+                break;
+
+            case R_BNE_F64: REG_BRANCH_OP(double *, !=);
+                break;
+
+            case R_BLT: REG_BRANCH_OP(int32_t *, <);
+                break;
+
+            case R_BLT_64: REG_BRANCH_OP(int64_t *, <);
+                break;
+
+            case R_BLT_F: REG_BRANCH_OP(float *, <);
+                break;
+
+            case R_BLT_F64: REG_BRANCH_OP(double *, <);
+                break;
+
+            case R_BGE: REG_BRANCH_OP(int32_t *, >=);
+                break;
+
+            case R_BGE_64: REG_BRANCH_OP(int64_t *, >=);
+                break;
+
+            case R_BGE_F: REG_BRANCH_OP(float *, >=);
+                break;
+
+            case R_BGE_F64: REG_BRANCH_OP(double *, >=);
+                break;
+
+            case R_BEQI: REG_BRANCH_OPI(==);
+                break;
+
+            case R_BNEI: REG_BRANCH_OPI(!=);
+                break;
+
+            case R_BLTI: REG_BRANCH_OPI(<);
+                break;
+
+            case R_BGEI: REG_BRANCH_OPI(>=);
+                break;
+
+            /**** Select ****/
+
+/* Ra = cpr ? Rb : Rc. Both operands are loaded and blended through a mask,
+ * so the host never branches on the condition. */
+#define REG_SEL(type) \
+    *(type *)(reg+DECODE_8(u8_u8_u8, a, 0)) = *(type *)(reg+DECODE_8(u8_u8_u8, c, 2)) ^ \
+    ((*(type *)(reg+DECODE_8(u8_u8_u8, b, 1)) ^ *(type *)(reg+DECODE_8(u8_u8_u8, c, 2))) & \
+    (type)-(type)(*cpr != 0))
+
+            case R_SEL: REG_SEL(uint32_t);
+                instrPtr += 4;
+                break;
+
+            case R_SEL_64: REG_SEL(uint64_t);
+                instrPtr += 4;
+                break;
+
             /**** Conversions ****/
 
 #define REG_CONVERT(from, to) *(to*)(reg + DECODE_8(u8_u8, a, 0)) = (to)(*(from*)(reg + DECODE_8(u8_u8, b, 1)))
@@ -759,6 +888,185 @@ int RegisterInterpreterLoop()
                 instrPtr += 4;
                 break;
 
+            /**** Calls ****/
+
+            case R_TAILCALL: SHARED_TAILCALL(); break;
+
+            /**** Vectors ****/
+
+            case R_VLEN: vecLen = (uint32_t)reg[DECODE_8(u8, C, 0)];
+                instrPtr += 2;
+                break;
+
+            case R_VADD: case R_VADD_64: case R_VADD_F: case R_VADD_F64:
+            case R_VSUB: case R_VSUB_64: case R_VSUB_F: case R_VSUB_F64:
+            case R_VMUL: case R_VMUL_64: case R_VMUL_F: case R_VMUL_F64:
+            case R_VDIV: case R_VDIV_64: case R_VDIV_F: case R_VDIV_F64:
+            case R_VFMA: case R_VFMA_64: case R_VFMA_F: case R_VFMA_F64:
+            case R_VMIN: case R_VMIN_64: case R_VMIN_F: case R_VMIN_F64:
+            case R_VMAX: case R_VMAX_64: case R_VMAX_F: case R_VMAX_F64:
+            case R_VCPEQ: case R_VCPEQ_64: case R_VCPEQ_F: case R_VCPEQ_F64:
+            case R_VCPLT: case R_VCPLT_64: case R_VCPLT_F: case R_VCPLT_F64:
+                SHARED_VECTOR(DECODE_OPCODE() - R_VADD, 
+                    reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    reg[DECODE_8(u8_u8_u8, b, 1)], 
+                    reg[DECODE_8(u8_u8_u8, c, 2)], vecLen);
+                instrPtr += 4;
+                break;
+
+            case R_MEMCPY: SHARED_MEMCPY(reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    reg[DECODE_8(u8_u8_u8, b, 1)], reg[DECODE_8(u8_u8_u8, c, 2)]);
+                instrPtr += 4;
+                break;
+
+            case R_MEMMOVE: SHARED_MEMMOVE(reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    reg[DECODE_8(u8_u8_u8, b, 1)], reg[DECODE_8(u8_u8_u8, c, 2)]);
+                instrPtr += 4;
+                break;
+
+            case R_MEMSET: SHARED_MEMSET(reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    reg[DECODE_8(u8_u8_u8, b, 1)], reg[DECODE_8(u8_u8_u8, c, 2)]);
+                instrPtr += 4;
+                break;
+
+            case R_FILL: SHARED_FILL(32, reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    reg[DECODE_8(u8_u8_u8, b, 1)], reg[DECODE_8(u8_u8_u8, c, 2)]);
+                instrPtr += 4;
+                break;
+
+            case R_FILL_64: SHARED_FILL(64, reg[DECODE_8(u8_u8_u8, a, 0)], 
+                    dreg(DECODE_8(u8_u8_u8, b, 1)), reg[DECODE_8(u8_u8_u8, c, 2)]);
+                instrPtr += 4;
+                break;
+
+            case R_SQRT_F: REG_MATH_1(float *, sqrtf);
+                instrPtr += 3;
+                break;
+
+            case R_SQRT_F64: REG_MATH_1(double *, sqrt);
+                instrPtr += 3;
+                break;
+
+            case R_FMA_F: REG_FMA(float *, fmaf);
+                instrPtr += 4;
+                break;
+
+            case R_FMA_F64: REG_FMA(double *, fma);
+                instrPtr += 4;
+                break;
+
+            case R_ABS: REG_MATH_1(int32_t *, MATH_ABS);
+                instrPtr += 3;
+                break;
+
+            case R_ABS_64: REG_MATH_1(int64_t *, MATH_ABS);
+                instrPtr += 3;
+                break;
+
+            case R_ABS_F: REG_MATH_1(float *, fabsf);
+                instrPtr += 3;
+                break;
+
+            case R_ABS_F64: REG_MATH_1(double *, fabs);
+                instrPtr += 3;
+                break;
+
+            case R_MIN: REG_MATH_2(int32_t *, MATH_MIN);
+                instrPtr += 4;
+                break;
+
+            case R_MIN_64: REG_MATH_2(int64_t *, MATH_MIN);
+                instrPtr += 4;
+                break;
+
+            case R_MIN_F: REG_MATH_2(float *, fminf);
+                instrPtr += 4;
+                break;
+
+            case R_MIN_F64: REG_MATH_2(double *, fmin);
+                instrPtr += 4;
+                break;
+
+            case R_MAX: REG_MATH_2(int32_t *, MATH_MAX);
+                instrPtr += 4;
+                break;
+
+            case R_MAX_64: REG_MATH_2(int64_t *, MATH_MAX);
+                instrPtr += 4;
+                break;
+
+            case R_MAX_F: REG_MATH_2(float *, fmaxf);
+                instrPtr += 4;
+                break;
+
+            case R_MAX_F64: REG_MATH_2(double *, fmax);
+                instrPtr += 4;
+                break;
+
+            case R_FLOOR_F: REG_MATH_1(float *, floorf);
+                instrPtr += 3;
+                break;
+
+            case R_FLOOR_F64: REG_MATH_1(double *, floor);
+                instrPtr += 3;
+                break;
+
+            case R_CEIL_F: REG_MATH_1(float *, ceilf);
+                instrPtr += 3;
+                break;
+
+            case R_CEIL_F64: REG_MATH_1(double *, ceil);
+                instrPtr += 3;
+                break;
+
+            case R_ROUND_F: REG_MATH_1(float *, roundf);
+                instrPtr += 3;
+                break;
+
+            case R_ROUND_F64: REG_MATH_1(double *, round);
+                instrPtr += 3;
+                break;
+
+            case R_SIN_F: REG_MATH_1(float *, sinf);
+                instrPtr += 3;
+                break;
+
+            case R_SIN_F64: REG_MATH_1(double *, sin);
+                instrPtr += 3;
+                break;
+
+            case R_COS_F: REG_MATH_1(float *, cosf);
+                instrPtr += 3;
+                break;
+
+            case R_COS_F64: REG_MATH_1(double *, cos);
+                instrPtr += 3;
+                break;
+
+            case R_EXP_F: REG_MATH_1(float *, expf);
+                instrPtr += 3;
+                break;
+
+            case R_EXP_F64: REG_MATH_1(double *, exp);
+                instrPtr += 3;
+                break;
+
+            case R_LOG_F: REG_MATH_1(float *, logf);
+                instrPtr += 3;
+                break;
+
+            case R_LOG_F64: REG_MATH_1(double *, log);
+                instrPtr += 3;
+                break;
+
+            case R_POW_F: REG_MATH_2(float *, powf);
+                instrPtr += 4;
+                break;
+
+            case R_POW_F64: REG_MATH_2(double *, pow);
+                instrPtr += 4;
+                break;
+
             default: 
                 return VM_EXIT_FAILURE;
         }
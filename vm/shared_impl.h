@@ -37,7 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define SHARED_EXIT() return VM_EXIT_SUCCESS
 
-#define SHARED_JMP() instrPtr = program + DECODE_ADDR()
+#define SHARED_JMP() PROFILE_BRANCH(1); instrPtr = program + DECODE_ADDR()
 
 #define SHARED_CALL() \
     tmp1 = (char *)stackFrame;\
@@ -71,6 +71,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     ++sp;\
     *(int64_t*)sp++ = *(int64_t*)tmp1
 
+/* Reuses the current stack frame for a call in tail position. The arguments 
+   of the new call are on top of the stack, and are moved down over those of 
+   the current function. The frame keeps the same previous frame offset and
+   return address, so the callee returns directly to our caller. */
+#define SHARED_TAILCALL() \
+    tmpInt = *stackFrame;                                      /* Keep offset to previous stack frame. */\
+    tmp2 = program + *(stackFrame + 1);                        /* Keep return address. */\
+    tmp1 = (uint8_t*)stackFrame - DECODE_8(u8_u8_u32, a, 0);   /* Start of the current arguments. */\
+    memmove(tmp1, (uint8_t*)(sp + 1) - DECODE_8(u8_u8_u32, b, 1), DECODE_8(u8_u8_u32, b, 1));\
+    stackFrame = (int32_t*)((uint8_t*)tmp1 + DECODE_8(u8_u8_u32, b, 1));\
+    stackFrameLocals = stackFrame + 1;\
+    sp = stackFrame;\
+    *sp = tmpInt;\
+    *(Addr_t*)++sp = (Addr_t)((uint8_t*)tmp2 - program);\
+    instrPtr = program + DECODE_u32(u8_u8_u32, C, 2)
+
 #define SHARED_SCALL() \
     /* Number of arguments system function call. */\
     tmpInt = sysArgPtr - sysArgs; \
@@ -78,10 +94,37 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     {\
         case SYSFUNC_PRINT: SysPrint(tmpInt);\
             break;\
-        case SYSFUNC_INPUT: *++sp = VMHeapAllocString(fgets(strBuf, 128, stdin));\
+        case SYSFUNC_INPUT: VMPrintFlush(); *++sp = VMHeapAllocString(fgets(strBuf, 128, stdin));\
             break;\
         case SYSFUNC_STR: SysStr(tmpInt);\
             break;\
+        case SYSFUNC_WRITE: if (!SysFileRange(true, false)) return VM_EXIT_OUT_OF_BOUNDS;\
+            break;\
+        case SYSFUNC_READ: if (!SysFileRange(false, false)) return VM_EXIT_OUT_OF_BOUNDS;\
+            break;\
+        case SYSFUNC_OPEN: --sp; if (!SysIsString(sp[0]) || !SysIsString(sp[1])) return VM_EXIT_OUT_OF_BOUNDS;\
+            *sp = VMFileOpen((char *)heap + sp[0], (char *)heap + sp[1]);\
+            break;\
+        case SYSFUNC_CLOSE: *sp = VMFileClose(*sp);\
+            break;\
+        case SYSFUNC_READALL: *sp = (int32_t)VMFileReadAll(*sp);\
+            break;\
+        case SYSFUNC_AREAD: if (!SysFileRange(false, true)) return VM_EXIT_OUT_OF_BOUNDS;\
+            break;\
+        case SYSFUNC_AWRITE: if (!SysFileRange(true, true)) return VM_EXIT_OUT_OF_BOUNDS;\
+            break;\
+        case SYSFUNC_AWAIT: *sp = VMFileWait(*sp);\
+            break;\
+        case SYSFUNC_APOLL: *sp = VMFilePoll(*sp);\
+            break;\
+        case SYSFUNC_MMAP: --sp; if (!SysIsString(sp[0])) return VM_EXIT_OUT_OF_BOUNDS;\
+            *sp = (int32_t)VMHeapMapFile((char *)heap + sp[0], sp[1] != 0);\
+            break;\
+        case SYSFUNC_MUNMAP: *sp = VMHeapUnmapFile(*sp);\
+            break;\
+        case SYSFUNC_SNAPSHOT: if (!SysIsString(*sp)) return VM_EXIT_OUT_OF_BOUNDS;\
+            *sp = SaveSnapshot((char *)heap + *sp);\
+            break;\
     }\
     sysArgPtr = sysArgs;     /* Reset the pointer. */\
     *(uint64_t*)sysArgs = 0; /* Reset all 8 bytes to 0 at once. */\
@@ -96,182 +139,146 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     *sysArgPtr++ = DECODE_8(u8, C, 0);\
     instrPtr += 2
 
-
-/*
- * Below is some ugly code. Hardcoding function calls that should really be
- * variadic really does get ugly, especially with support for differing types. 
-*/
-
-#define PRINT_VAL_SIZE(argIdx) ((sysArgs[argIdx] & 0x0F) / 4)
-#define PRINT_ARG(argIdx) (argVal[argIdx].addr)
-
-void SysPrint(int32_t argCnt)
+/* Integer variants of the math instructions. The float variants use libm. */
+#define MATH_ABS(x)    ((x) < 0 ? -(x) : (x))
+#define MATH_MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MATH_MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* Bulk memory on heap ranges. Every range must lie within the block it starts 
+   in, and destinations must be writable, or the program exits. Overlapping MEMCPY ranges are copied as by MEMMOVE. */
+#define SHARED_MEMCPY(dst, src, size) {\
+    Addr_t dst_ = (Addr_t)(dst), src_ = (Addr_t)(src); uint32_t size_ = (uint32_t)(size);\
+    if (!VMHeapIsRangeWritable(dst_, size_) || !VMHeapIsRangeValid(src_, size_))\
+        return VM_EXIT_OUT_OF_BOUNDS;\
+    if ((uint64_t)dst_ + size_ <= src_ || (uint64_t)src_ + size_ <= dst_)\
+        memcpy(heap + dst_, heap + src_, size_);\
+    else\
+        memmove(heap + dst_, heap + src_, size_);}
+
+#define SHARED_MEMMOVE(dst, src, size) {\
+    Addr_t dst_ = (Addr_t)(dst), src_ = (Addr_t)(src); uint32_t size_ = (uint32_t)(size);\
+    if (!VMHeapIsRangeWritable(dst_, size_) || !VMHeapIsRangeValid(src_, size_))\
+        return VM_EXIT_OUT_OF_BOUNDS;\
+    memmove(heap + dst_, heap + src_, size_);}
+
+#define SHARED_MEMSET(dst, value, size) {\
+    Addr_t dst_ = (Addr_t)(dst); uint32_t size_ = (uint32_t)(size);\
+    if (!VMHeapIsRangeWritable(dst_, size_))\
+        return VM_EXIT_OUT_OF_BOUNDS;\
+    memset(heap + dst_, (uint8_t)(value), size_);}
+
+/* FILL writes 'count' copies of a 32-bit or 64-bit value, e.g. to initialize arrays. */
+#define SHARED_FILL(bits, dst, value, count) {\
+    Addr_t dst_ = (Addr_t)(dst); uint32_t count_ = (uint32_t)(count);\
+    if (!VMHeapIsRangeWritable(dst_, (uint64_t)count_ * (bits / 8)))\
+        return VM_EXIT_OUT_OF_BOUNDS;\
+    VMHeapFill##bits(dst_, (uint##bits##_t)(value), count_);}
+
+/* Runs a vector kernel on 'count' elements. Like bulk memory, all three arrays 
+   must lie within their blocks, and the destination must be writable. */
+#define SHARED_VECTOR(kernel, dst, a, b, count) {\
+    uint32_t kernel_ = (uint32_t)(kernel), count_ = (uint32_t)(count);\
+    Addr_t dst_ = (Addr_t)(dst), a_ = (Addr_t)(a), b_ = (Addr_t)(b);\
+    uint64_t size_ = (uint64_t)count_ * VEC_ELEMENT_SIZE(kernel_ % VEC_TYPE_COUNT);\
+    if (!VMHeapIsRangeWritable(dst_, size_) || !VMHeapIsRangeValid(a_, size_) || !VMHeapIsRangeValid(b_, size_))\
+        return VM_EXIT_OUT_OF_BOUNDS;\
+    vecKernels[kernel_](heap + dst_, heap + a_, heap + b_, count_);}
+
+
+/* Pops the arguments of a print or str call, as described by the flags given 
+ * to them by SARG, and returns the number of them. The first is the format. */
+int32_t SysFormatArgs(int32_t argCnt, VMFormatArg_t *args)
 {
-    union {
-        char    *addr;
-        int32_t i32;
-        int64_t i64;
-        double  f64; /* No need for floats since only doubles are really used in printf, etc. */
-    } argVal[8] = {0};
-
-    size_t valueSizeSum = 0;
-    uint8_t sysArgFlags;
-    for (int i = argCnt - 1; i >= 0; --i)
+    /* A format without SARG is printed on its own. */
+    if (argCnt == 0)
+        sysArgs[argCnt++] = 0x84;
+
+    for (int32_t i = argCnt - 1; i >= 0; --i)
     {
-        sysArgFlags = sysArgs[i];
+        uint8_t sysArgFlags = sysArgs[i];
+        args[i].flags = sysArgFlags;
+
         if (sysArgFlags & 0x80)
         {
-            argVal[i].addr = (char *)(heap + *(sp - valueSizeSum));
-            ++valueSizeSum;
+            args[i].value.addr = (Addr_t)*sp--;
         }
         else if (sysArgFlags & 0x40)
         {
-            argVal[i].f64 = *(double*)(sp - valueSizeSum - 1);
-            valueSizeSum += 2;
+            sp -= 2;
+            args[i].value.f64 = *(double*)(sp + 1);
         }
         else if (sysArgFlags & 0x20)
         {
-            argVal[i].f64 = *(float*)(sp - valueSizeSum);
-            ++valueSizeSum;
+            args[i].value.f64 = *(float*)sp;
+            --sp;
         }
         else if (sysArgFlags & 0x10)
         {
-            argVal[i].i64 = *(int64_t*)(sp - valueSizeSum - 1);
-            valueSizeSum += 2;
+            sp -= 2;
+            args[i].value.i64 = *(int64_t*)(sp + 1);
         }
         else
         {
-            argVal[i].i32 = *(int32_t*)(sp - valueSizeSum);
-            ++valueSizeSum;
+            args[i].value.i64 = *sp--;
         }
     }
 
-    switch (argCnt)
-    {
-        case 0:
-        case 1: printf(heap + *sp--); 
-            break;
-        case 2: printf(PRINT_ARG(0), PRINT_ARG(1)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1);
-            break;
-        case 3: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2);
-            break;
-        case 4: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3);
-            break;
-        case 5: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4);
-            break;
-        case 6: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5);
-            break;
-        case 7: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5), PRINT_ARG(6)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5) +
-                  PRINT_VAL_SIZE(6);
-            break;
-        case 8: printf(PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5), PRINT_ARG(6), PRINT_ARG(7)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5) +
-                  PRINT_VAL_SIZE(6) + PRINT_VAL_SIZE(7);
-            break;
-    }
+    return argCnt;
 }
 
-void SysStr(int32_t argCnt)
+void SysPrint(int32_t argCnt)
 {
-    union {
-        char    *addr;
-        int32_t i32;
-        int64_t i64;
-        float   f32;
-        double  f64;
-    } argVal[8] = {0};
-
-    size_t valueSizeSum = 0;
-    uint8_t sysArgFlags;
-    for (int i = argCnt - 1; i >= 0; --i)
-    {
-        sysArgFlags = sysArgs[i];
-        if (sysArgFlags & 0x80)
-        {
-            argVal[i].addr = (char *)(heap + *(sp - valueSizeSum++));
-            continue;
-        }
-
-        if (sysArgFlags & 0x40)
-        {
-            argVal[i].f64 = *(double*)(sp - valueSizeSum);
-            valueSizeSum += 2;
-            continue;
-        }
+    VMFormatArg_t args[8];
+    argCnt = SysFormatArgs(argCnt, args);
+    VMPrint(args[0].value.addr, args + 1, argCnt - 1);
+}
 
-        if (sysArgFlags & 0x20)
-        {
-            argVal[i].f32 = *(float*)(sp - valueSizeSum++);
-            continue;
-        }
+void SysStr(int32_t argCnt)
+{
+    VMFormatArg_t args[8];
+    argCnt = SysFormatArgs(argCnt, args);
+    VMFormatString(strBuf, 128, args[0].value.addr, args + 1, argCnt - 1);
+    *++sp = VMHeapAllocString(strBuf);
+}
 
-        if (sysArgFlags & 0x10)
-        {
-            argVal[i].i64 = *(int64_t*)(sp - valueSizeSum);
-            valueSizeSum += 2;
-            continue;
-        }
+/* Returns whether a string at the heap address is terminated within the heap 
+ * block it starts in, e.g. before it is passed on as a path. */
+bool SysIsString(int32_t address)
+{
+    uint32_t size = VMHeapRangeSize((Addr_t)address);
+    return size > 0 && memchr(heap + (Addr_t)address, '\0', size) != NULL;
+}
 
-        argVal[i].i32 = *(int32_t*)(sp - valueSizeSum++);
-    }
+/* Pops a file, a heap address and a byte count, and pushes the number of bytes
+ * written or read, or -1. The bytes go directly between the file and the heap. 
+ * A negative count writes up to the terminating null, as for strings. Requests
+ * that are asynchronous push a handle instead. Returns false if the range 
+ * doesn't lie within the heap block it starts in, or a read would go into a
+ * read-only mapping. */
+bool SysFileRange(bool isWrite, bool isAsync)
+{
+    sp -= 2;
+    int32_t fd = sp[0];
+    Addr_t address = (Addr_t)sp[1];
+    uint32_t size = (uint32_t)sp[2];
 
-    switch (argCnt)
+    if (isWrite && sp[2] < 0)
     {
-        case 0:
-        case 1: snprintf(strBuf, 128, heap + *sp--); 
-            break;
-        case 2: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1);
-            break;
-        case 3: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2);
-            break;
-        case 4: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3);
-            break;
-        case 5: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4);
-            break;
-        case 6: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5);
-            break;
-        case 7: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5), PRINT_ARG(6)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5) +
-                  PRINT_VAL_SIZE(6);
-            break;
-        case 8: snprintf(strBuf, 128, PRINT_ARG(0), PRINT_ARG(1), PRINT_ARG(2), PRINT_ARG(3),
-                       PRINT_ARG(4), PRINT_ARG(5), PRINT_ARG(6), PRINT_ARG(7)); 
-            sp -= PRINT_VAL_SIZE(0) + PRINT_VAL_SIZE(1) + PRINT_VAL_SIZE(2) + 
-                  PRINT_VAL_SIZE(3) + PRINT_VAL_SIZE(4) + PRINT_VAL_SIZE(5) +
-                  PRINT_VAL_SIZE(6) + PRINT_VAL_SIZE(7);
-            break;
+        size = VMHeapRangeSize(address);
+        const char *end = memchr(heap + address, '\0', size);
+        if (end != NULL)
+            size = (uint32_t)(end - (const char *)(heap + address));
     }
 
-    *++sp = VMHeapAllocString(strBuf);
-}
+    bool isValid = isWrite ? VMHeapIsRangeValid(address, size) : VMHeapIsRangeWritable(address, size);
+    if (!isValid)
+        return false;
 
-#undef PRINT_VAL_SIZE
+    if (isAsync)
+        *sp = isWrite ? VMFileWriteAsync(fd, heap + address, size) : VMFileReadAsync(fd, heap + address, size);
+    else
+        *sp = isWrite ? VMFileWrite(fd, heap + address, size) : VMFileRead(fd, heap + address, size);
+    return true;
+}
 
 #endif /* INC_SHARED_IMPL_H */
\ No newline at end of file
@@ -159,6 +159,20 @@ int StackInterpreterLoop()
 /* Consumes 2 64-bit values and pushes a 64-bit value. */
 #define STACK_OP_64(type, op) sp -= 3; *(type)sp++ = *(type)sp MACRO_LITERAL(op) *(type)(sp+2)
 
+/* Math instructions replace the value(s) on top of the stack with the result of a function. */
+#define STACK_MATH_1_32(type, fn) *(type)sp = fn(*(type)sp)
+#define STACK_MATH_1_64(type, fn) *(type)(sp-1) = fn(*(type)(sp-1))
+#define STACK_MATH_2_32(type, fn) sp -= 1; *(type)sp = fn(*(type)sp, *(type)(sp+1))
+#define STACK_MATH_2_64(type, fn) sp -= 2; *(type)(sp-1) = fn(*(type)(sp-1), *(type)(sp+1))
+
+/* Consumes c, a and b, with b on top, and pushes c + a * b, rounded once. */
+#define STACK_FMA_32(type, fn) sp -= 2; *(type)sp = fn(*(type)(sp+1), *(type)(sp+2), *(type)sp)
+#define STACK_FMA_64(type, fn) sp -= 4; *(type)(sp-1) = fn(*(type)(sp+1), *(type)(sp+3), *(type)(sp-1))
+
+/* Consumes a, b and the condition on top, and pushes cond ? a : b, blended through a mask. */
+#define STACK_SEL(type, a, b, cond) *(type *)(a) = *(type *)(b) ^ \
+    ((*(type *)(a) ^ *(type *)(b)) & (type)-(type)(*(cond) != 0))
+
             case S_ADD: STACK_OP_32(int32_t *, +);
                 instrPtr += 1;
                 break;
@@ -401,10 +415,12 @@ int StackInterpreterLoop()
                 instrPtr += 1;
                 break;
 
-            case S_BRZ: instrPtr = !*sp-- ? program + DECODE_ADDR() : instrPtr + 5;
+            case S_BRZ: PROFILE_BRANCH(!*sp);
+                instrPtr = !*sp-- ? program + DECODE_ADDR() : instrPtr + 5;
                 break;
 
-            case S_BRNZ: instrPtr = *sp-- ? program + DECODE_ADDR() : instrPtr + 5;
+            case S_BRNZ: PROFILE_BRANCH(*sp);
+                instrPtr = *sp-- ? program + DECODE_ADDR() : instrPtr + 5;
                 break;
 
 
@@ -541,7 +557,193 @@ int StackInterpreterLoop()
                 instrPtr += 5;
                 break;
 
-            case S_STRCMB: *--sp = VMHeapAllocCombinedString(heap + *(sp-1), heap + *sp);
+            case S_STRCMB: tmpInt = VMHeapAllocCombinedString(heap + *(sp-1), heap + *sp);
+                *--sp = tmpInt;
+                instrPtr += 1;
+                break;
+
+            /**** Calls ****/
+
+            case S_TAILCALL: SHARED_TAILCALL(); break;
+
+            /**** Vectors ****/
+
+            /* Operands are pushed in the order: dst, a, b, count. */
+            case S_VADD: case S_VADD_64: case S_VADD_F: case S_VADD_F64:
+            case S_VSUB: case S_VSUB_64: case S_VSUB_F: case S_VSUB_F64:
+            case S_VMUL: case S_VMUL_64: case S_VMUL_F: case S_VMUL_F64:
+            case S_VDIV: case S_VDIV_64: case S_VDIV_F: case S_VDIV_F64:
+            case S_VFMA: case S_VFMA_64: case S_VFMA_F: case S_VFMA_F64:
+            case S_VMIN: case S_VMIN_64: case S_VMIN_F: case S_VMIN_F64:
+            case S_VMAX: case S_VMAX_64: case S_VMAX_F: case S_VMAX_F64:
+            case S_VCPEQ: case S_VCPEQ_64: case S_VCPEQ_F: case S_VCPEQ_F64:
+            case S_VCPLT: case S_VCPLT_64: case S_VCPLT_F: case S_VCPLT_F64:
+                SHARED_VECTOR(DECODE_OPCODE() - S_VADD, *(sp-3), *(sp-2), *(sp-1), *sp);
+                sp -= 4;
+                instrPtr += 1;
+                break;
+
+            /* The destination is pushed first, and the size or count last. */
+            case S_MEMCPY: SHARED_MEMCPY(*(sp-2), *(sp-1), *sp);
+                sp -= 3;
+                instrPtr += 1;
+                break;
+
+            case S_MEMMOVE: SHARED_MEMMOVE(*(sp-2), *(sp-1), *sp);
+                sp -= 3;
+                instrPtr += 1;
+                break;
+
+            case S_MEMSET: SHARED_MEMSET(*(sp-2), *(sp-1), *sp);
+                sp -= 3;
+                instrPtr += 1;
+                break;
+
+            case S_FILL: SHARED_FILL(32, *(sp-2), *(sp-1), *sp);
+                sp -= 3;
+                instrPtr += 1;
+                break;
+
+            case S_FILL_64: SHARED_FILL(64, *(sp-3), *(int64_t*)(sp-2), *sp);
+                sp -= 4;
+                instrPtr += 1;
+                break;
+
+            case S_SQRT_F: STACK_MATH_1_32(float *, sqrtf);
+                instrPtr += 1;
+                break;
+
+            case S_SQRT_F64: STACK_MATH_1_64(double *, sqrt);
+                instrPtr += 1;
+                break;
+
+            case S_FMA_F: STACK_FMA_32(float *, fmaf);
+                instrPtr += 1;
+                break;
+
+            case S_FMA_F64: STACK_FMA_64(double *, fma);
+                instrPtr += 1;
+                break;
+
+            case S_ABS: STACK_MATH_1_32(int32_t *, MATH_ABS);
+                instrPtr += 1;
+                break;
+
+            case S_ABS_64: STACK_MATH_1_64(int64_t *, MATH_ABS);
+                instrPtr += 1;
+                break;
+
+            case S_ABS_F: STACK_MATH_1_32(float *, fabsf);
+                instrPtr += 1;
+                break;
+
+            case S_ABS_F64: STACK_MATH_1_64(double *, fabs);
+                instrPtr += 1;
+                break;
+
+            case S_MIN: STACK_MATH_2_32(int32_t *, MATH_MIN);
+                instrPtr += 1;
+                break;
+
+            case S_MIN_64: STACK_MATH_2_64(int64_t *, MATH_MIN);
+                instrPtr += 1;
+                break;
+
+            case S_MIN_F: STACK_MATH_2_32(float *, fminf);
+                instrPtr += 1;
+                break;
+
+            case S_MIN_F64: STACK_MATH_2_64(double *, fmin);
+                instrPtr += 1;
+                break;
+
+            case S_MAX: STACK_MATH_2_32(int32_t *, MATH_MAX);
+                instrPtr += 1;
+                break;
+
+            case S_MAX_64: STACK_MATH_2_64(int64_t *, MATH_MAX);
+                instrPtr += 1;
+                break;
+
+            case S_MAX_F: STACK_MATH_2_32(float *, fmaxf);
+                instrPtr += 1;
+                break;
+
+            case S_MAX_F64: STACK_MATH_2_64(double *, fmax);
+                instrPtr += 1;
+                break;
+
+            case S_FLOOR_F: STACK_MATH_1_32(float *, floorf);
+                instrPtr += 1;
+                break;
+
+            case S_FLOOR_F64: STACK_MATH_1_64(double *, floor);
+                instrPtr += 1;
+                break;
+
+            case S_CEIL_F: STACK_MATH_1_32(float *, ceilf);
+                instrPtr += 1;
+                break;
+
+            case S_CEIL_F64: STACK_MATH_1_64(double *, ceil);
+                instrPtr += 1;
+                break;
+
+            case S_ROUND_F: STACK_MATH_1_32(float *, roundf);
+                instrPtr += 1;
+                break;
+
+            case S_ROUND_F64: STACK_MATH_1_64(double *, round);
+                instrPtr += 1;
+                break;
+
+            case S_SIN_F: STACK_MATH_1_32(float *, sinf);
+                instrPtr += 1;
+                break;
+
+            case S_SIN_F64: STACK_MATH_1_64(double *, sin);
+                instrPtr += 1;
+                break;
+
+            case S_COS_F: STACK_MATH_1_32(float *, cosf);
+                instrPtr += 1;
+                break;
+
+            case S_COS_F64: STACK_MATH_1_64(double *, cos);
+                instrPtr += 1;
+                break;
+
+            case S_EXP_F: STACK_MATH_1_32(float *, expf);
+                instrPtr += 1;
+                break;
+
+            case S_EXP_F64: STACK_MATH_1_64(double *, exp);
+                instrPtr += 1;
+                break;
+
+            case S_LOG_F: STACK_MATH_1_32(float *, logf);
+                instrPtr += 1;
+                break;
+
+            case S_LOG_F64: STACK_MATH_1_64(double *, log);
+                instrPtr += 1;
+                break;
+
+            case S_POW_F: STACK_MATH_2_32(float *, powf);
+                instrPtr += 1;
+                break;
+
+            case S_POW_F64: STACK_MATH_2_64(double *, pow);
+                instrPtr += 1;
+                break;
+
+            case S_SEL: STACK_SEL(uint32_t, sp-2, sp-1, sp);
+                sp -= 2;
+                instrPtr += 1;
+                break;
+
+            case S_SEL_64: STACK_SEL(uint64_t, sp-4, sp-2, sp);
+                sp -= 3;
                 instrPtr += 1;
                 break;
 
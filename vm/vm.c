@@ -30,8 +30,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
 
 #include "vm_memory.h"
+#include "vm_vector.h"
+#include "vm_file.h"
+#include "vm_print.h"
 
 #ifdef BENCHMARK
     #ifndef NDEBUG
@@ -41,7 +45,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
         #error Benchmarks is currently only supported on windows.
     #endif
     
-    #include <math.h>
     #include <time.h>
     #include <windows.h>
 #endif
@@ -54,26 +57,40 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* The number of 32-bit elements on the stack. 512 = 2 KiB stack. */
 #define STACK_SIZE 512
 
+/* The number of registers, and the alignment of the wide register file in bytes. */
+#define REGISTER_COUNT 32
+#define REGISTER_FILE_ALIGNMENT 64
+
 /* VM runtime exit codes. */
 #define VM_EXIT_SUCCESS        0
 #define VM_EXIT_FAILURE        100
 #define VM_EXIT_STACK_OVERFLOW 101
+#define VM_EXIT_OUT_OF_BOUNDS  102
 
 #define MACRO_LITERAL(x) x
 
 typedef enum {
     VM_MODE_REGISTER = 0,
-    VM_MODE_STACK = 1
+    VM_MODE_STACK = 1,
+    VM_MODE_REGISTER_WIDE = 2 /* Register instruction set on a separate 64-bit register file. */
 } VMMode_t;
 
 typedef enum {
-    SYSFUNC_PRINT = 0,
-    SYSFUNC_INPUT = 1,
-    SYSFUNC_WRITE = 2,
-    SYSFUNC_READ  = 3,
-    SYSFUNC_OPEN  = 4,
-    SYSFUNC_CLOSE = 5,
-    SYSFUNC_STR   = 6
+    SYSFUNC_PRINT   = 0,
+    SYSFUNC_INPUT   = 1,
+    SYSFUNC_WRITE   = 2,
+    SYSFUNC_READ    = 3,
+    SYSFUNC_OPEN    = 4,
+    SYSFUNC_CLOSE   = 5,
+    SYSFUNC_STR     = 6,
+    SYSFUNC_READALL = 7,
+    SYSFUNC_AREAD   = 8,
+    SYSFUNC_AWRITE  = 9,
+    SYSFUNC_AWAIT   = 10,
+    SYSFUNC_APOLL   = 11,
+    SYSFUNC_MMAP    = 12,
+    SYSFUNC_MUNMAP  = 13,
+    SYSFUNC_SNAPSHOT = 14
 } SysFunc_t;
 
 #ifdef __GNUC__
@@ -197,6 +214,13 @@ typedef union {
         uint8_t c;
     } u8_u8_u8;
 
+    struct GCC_PACK {
+        uint8_t  opcode;
+        uint8_t  a;
+        int32_t  B;
+        uint32_t C;
+    } u8_i32_u32;
+
 #endif
     struct GCC_PACK {
         uint8_t  opcode;
@@ -232,6 +256,7 @@ static int32_t  *sp;         /* Stack pointer (top-of-stack). */
 static int32_t  *stackBegin; /* Pointer to the beginning of the stack. */
 static int32_t  *stackEnd;   /* Pointer to the beginning of the stack. */
 static int32_t  *reg;        /* Pointer to the beginning of the registers. */
+static void     *regFile;    /* Allocation of the wide register file, which 'reg' points into. */
 static int32_t  *stackFrame; /* Pointer to the current function's stack frame. */
 static Instr_t  instr;       /* Instruction "register". */
 static uint8_t  *instrPtr;   /* Pointer to the next instruction. */
@@ -241,8 +266,30 @@ static uint8_t  *instrEnd;   /* Pointer to end of instructions in program memory
 static VMMode_t vmMode;
 static uint8_t  sysArgs[8];  /* Holds temporary size information about system function arguments. */
 static uint8_t  *sysArgPtr;  /* This and sysArgs is used only for variadic system function calls. */
+static uint32_t vecLen;      /* Number of elements operated on by vector instructions, set by VLEN. */
 static char     strBuf[128];
 
+#ifdef PROFILE
+/* Taken and not-taken counts of a branch instruction. */
+typedef struct {
+    uint64_t taken;
+    uint64_t notTaken;
+} BranchCount_t;
+
+static BranchCount_t *branchCounts; /* Indexed by the address of the branch instruction. */
+static size_t branchCountsSize;
+
+/* Counts the outcome of the branch at instrPtr. Must be used before instrPtr is changed. */
+#define PROFILE_BRANCH(isTaken) \
+    ((isTaken) ? ++branchCounts[instrPtr - program].taken : ++branchCounts[instrPtr - program].notTaken)
+#else
+#define PROFILE_BRANCH(isTaken)
+#endif
+
+/* Saves the state of the VM to a file, to be continued from with --restore. 
+ * Used by SCALL, which pushes the result, before instrPtr is moved past it. */
+static int32_t SaveSnapshot(const char *path);
+
 /* Shorthand macros for casting the stack pointer. */
 #define i32sp ((int32_t*)sp)
 #define u32sp ((unt32_t*)sp)
@@ -323,6 +370,11 @@ static bool ReadProgram(const char *fileName)
     
     fclose(file);
 
+#ifdef PROFILE
+    branchCountsSize = programSize;
+    branchCounts = calloc(programSize, sizeof(BranchCount_t));
+#endif
+
     /* Setup some other pointers. */
     instrPtr = program;
     sysArgPtr = sysArgs;
@@ -330,9 +382,15 @@ static bool ReadProgram(const char *fileName)
     return true;
 }
 
-static void AllocateStack()
+static bool AllocateStack()
 {
     stackBegin = malloc(STACK_SIZE * sizeof(int32_t));
+    if (stackBegin == NULL)
+    {
+        printf("Failed to allocate the stack!\n");
+        return false;
+    }
+
     stackEnd = stackBegin + STACK_SIZE;
     reg = stackBegin;
     sp = stackBegin;
@@ -341,11 +399,196 @@ static void AllocateStack()
     /* In register mode, use the first 32 locations on the stack as
      * virtual registers. The last one (R31) is also known as CPR. */
     if (vmMode == VM_MODE_REGISTER)
-        sp += 32;
+        sp += REGISTER_COUNT;
+
+    /* In wide register mode, the registers are instead 64-bit slots of their own,
+     * aligned to a cache line. The assembler encodes register n as the 32-bit index 
+     * 2n, so the same instructions access the low half or the whole register. */
+    if (vmMode == VM_MODE_REGISTER_WIDE)
+    {
+        regFile = calloc(1, REGISTER_COUNT * sizeof(int64_t) + REGISTER_FILE_ALIGNMENT);
+        if (regFile == NULL)
+        {
+            printf("Failed to allocate the register file!\n");
+            return false;
+        }
+
+        reg = (int32_t *)(((uintptr_t)regFile + REGISTER_FILE_ALIGNMENT - 1) & ~(uintptr_t)(REGISTER_FILE_ALIGNMENT - 1));
+    }
 
     *sp++ = 0xAC1D;
     *sp = 0xFACE;
 
+    return true;
+}
+
+/* Snapshots start with this header. The heap is placed last, at an offset 
+ * aligned for mapping it. Offsets into the stack are in 32-bit slots. */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t vmMode;
+    uint64_t heapSize;
+    uint64_t heapUsed;     /* The number of bytes saved from the start of the heap. */
+    uint64_t heapOffset;   /* Where the heap is in the file. */
+    uint32_t programSize;  /* The program, including data, follows the header. */
+    uint32_t instrEnd;
+    uint32_t instrPtr;
+    uint32_t sp;           /* The stack follows the program, and then the wide registers. */
+    uint32_t stackFrame;
+    uint32_t vecLen;
+    uint8_t  sysArgs[8];
+} SnapshotHeader_t;
+
+#define SNAPSHOT_MAGIC   "RACKSNAP"
+#define SNAPSHOT_VERSION 2
+
+/* Aligns the heap in a snapshot to any page size it may be mapped with. */
+#define SNAPSHOT_HEAP_ALIGNMENT (64 * 1024)
+
+static int32_t SaveSnapshot(const char *path)
+{
+    /* Open files and mappings can't be brought back. */
+    if (AnyFilesInUse() || VMHeapHasMappings())
+        return -1;
+
+    /* The snapshot replaces any old one only once it's complete, which also
+     * keeps the old one intact for a VM that has it mapped. */
+    char tmpPath[512];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath))
+        return -1;
+
+    FILE *file = fopen(tmpPath, "wb");
+    if (file == NULL)
+        return -1;
+
+    VMPrintFlush();
+
+    SnapshotHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.vmMode = vmMode;
+    header.heapSize = heapSize;
+    header.programSize = (uint32_t)(programEnd - program);
+    header.instrEnd = (uint32_t)(instrEnd - program);
+    header.instrPtr = (uint32_t)(instrPtr - program) + 2;
+    header.sp = (uint32_t)(sp - stackBegin);
+    header.stackFrame = (uint32_t)(stackFrame - stackBegin);
+    header.vecLen = vecLen;
+
+    size_t registerSize = vmMode == VM_MODE_REGISTER_WIDE ? REGISTER_COUNT * sizeof(int64_t) : 0;
+    uint64_t stateEnd = sizeof(header) + header.programSize + STACK_SIZE * sizeof(int32_t) + registerSize;
+    header.heapOffset = (stateEnd + SNAPSHOT_HEAP_ALIGNMENT - 1) / SNAPSHOT_HEAP_ALIGNMENT * SNAPSHOT_HEAP_ALIGNMENT;
+
+    /* The restored program sees 1 as the result, instead of 0. */
+    *sp = 1;
+    header.heapUsed = VMHeapUnlink();
+
+    bool isWritten = 
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(program, 1, header.programSize, file) == header.programSize &&
+        fwrite(stackBegin, sizeof(int32_t), STACK_SIZE, file) == STACK_SIZE &&
+        fwrite(reg, 1, registerSize, file) == registerSize &&
+        fseek(file, (long)header.heapOffset, SEEK_SET) == 0 &&
+        fwrite(heap, 1, header.heapUsed, file) == header.heapUsed;
+
+    VMHeapRelink(header.heapUsed);
+    isWritten = fclose(file) == 0 && isWritten;
+
+    if (isWritten && rename(tmpPath, path) != 0)
+    {
+        /* Renaming onto an existing file fails on some systems. */
+        remove(path);
+        isWritten = rename(tmpPath, path) == 0;
+    }
+
+    if (!isWritten)
+        remove(tmpPath);
+
+    return isWritten ? 0 : -1;
+}
+
+static bool RestoreSnapshot(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    SnapshotHeader_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.vmMode > VM_MODE_REGISTER_WIDE ||
+        header.instrEnd > header.programSize || header.instrPtr >= header.programSize || 
+        header.sp >= STACK_SIZE || header.stackFrame >= STACK_SIZE)
+    {
+        printf("Malformed snapshot header.\n");
+        fclose(file);
+        return false;
+    }
+
+    /* The saved heap must fit in the heap, and lie within the file after the rest. */
+    size_t registerSize = header.vmMode == VM_MODE_REGISTER_WIDE ? REGISTER_COUNT * sizeof(int64_t) : 0;
+    uint64_t stateEnd = sizeof(header) + header.programSize + STACK_SIZE * sizeof(int32_t) + registerSize;
+    if (fseek(file, 0, SEEK_END) != 0 || 
+        header.heapUsed > header.heapSize || header.heapOffset < stateEnd ||
+        header.heapOffset > (uint64_t)ftell(file) || 
+        header.heapUsed > (uint64_t)ftell(file) - header.heapOffset ||
+        fseek(file, sizeof(header), SEEK_SET) != 0)
+    {
+        printf("Malformed snapshot header.\n");
+        fclose(file);
+        return false;
+    }
+
+    vmMode = header.vmMode;
+    if (!AllocateHeap(header.heapSize, header.heapSize))
+    {
+        printf("Failed to allocate %llu heap memory!\n", (unsigned long long)header.heapSize);
+        fclose(file);
+        return false;
+    }
+
+    program = malloc(header.programSize);
+    if (program == NULL)
+    {
+        printf("Failed to allocate program memory!\n");
+        fclose(file);
+        return false;
+    }
+
+    instrEnd = program + header.instrEnd;
+    programEnd = program + header.programSize;
+    instrPtr = program + header.instrPtr;
+
+    if (!AllocateStack())
+    {
+        fclose(file);
+        return false;
+    }
+
+    sp = stackBegin + header.sp;
+    stackFrame = stackBegin + header.stackFrame;
+
+    memcpy(sysArgs, header.sysArgs, sizeof(sysArgs));
+    sysArgPtr = sysArgs;
+    vecLen = header.vecLen;
+
+    bool isRead =
+        fread(program, 1, header.programSize, file) == header.programSize &&
+        fread(stackBegin, sizeof(int32_t), STACK_SIZE, file) == STACK_SIZE &&
+        fread(reg, 1, registerSize, file) == registerSize &&
+        VMHeapLoad(file, header.heapOffset, header.heapUsed);
+
+    fclose(file);
+
+#ifdef PROFILE
+    branchCountsSize = header.programSize;
+    branchCounts = calloc(header.programSize, sizeof(BranchCount_t));
+#endif
+
+    return isRead;
 }
 
 static void DumpStack()
@@ -383,11 +626,55 @@ static void DumpStack()
     puts("---------------------------------------------------------------------------------------");
 }
 
+#ifdef PROFILE
+/* Writes the branch counts next to the program, e.g. "fib.bin" -> "fib.prof".
+ * The assembler reads this with -p to lay out the hot path of each function. */
+static void DumpProfile(const char *programPath)
+{
+    char path[512];
+    const char *dot = strrchr(programPath, '.');
+    size_t baseLen = dot && !strpbrk(dot, "/\\") ? (size_t)(dot - programPath) : strlen(programPath);
+    if (baseLen > sizeof(path) - 6)
+        baseLen = sizeof(path) - 6;
+
+    memcpy(path, programPath, baseLen);
+    strcpy(path + baseLen, ".prof");
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("[RackVM] Couldn't write profile \"%s\".\n", path);
+        return;
+    }
+
+    fputs("# RackVM branch profile\n# address taken not-taken\n", file);
+
+    size_t i;
+    for (i = 0; i < branchCountsSize; i++)
+    {
+        if (branchCounts[i].taken || branchCounts[i].notTaken)
+        {
+            fprintf(file, "0x%08X %llu %llu\n", (unsigned)i, 
+                (unsigned long long)branchCounts[i].taken, 
+                (unsigned long long)branchCounts[i].notTaken);
+        }
+    }
+
+    fclose(file);
+    printf("[RackVM] Wrote branch profile to \"%s\".\n", path);
+}
+#endif
+
 static void Cleanup()
 {
+    CloseFiles();
     DeallocateHeap();
     free(stackBegin);
+    free(regFile);
     free(program);
+#ifdef PROFILE
+    free(branchCounts);
+#endif
 }
 
 int main(int argc, const char **argv)
@@ -408,19 +695,42 @@ int main(int argc, const char **argv)
         return 0;
     }
 
-    if (argc != 2)
+    /* Either a program, or --restore and a snapshot saved by a program. */
+    bool isRestoring = argc == 3 && strcmp(argv[1], "--restore") == 0;
+    if (argc != 2 && !isRestoring)
     {
         printf("[RackVM] Invalid arguments.\n");
         return 0;
     }
 
-    if (!ReadProgram(argv[1]))
+    const char *programPath = argv[argc - 1];
+    if (isRestoring)
     {
-        printf("[RackVM] Couldn't read file \"%s\".\n", argv[1]);
-        return 0;
+        if (!RestoreSnapshot(programPath))
+        {
+            printf("[RackVM] Couldn't restore snapshot \"%s\".\n", programPath);
+            return 0;
+        }
+    }
+    else
+    {
+        if (!ReadProgram(programPath))
+        {
+            printf("[RackVM] Couldn't read file \"%s\".\n", programPath);
+            return 0;
+        }
+
+        if (!AllocateStack())
+            return 0;
     }
 
-    AllocateStack();
+#if !defined(NDEBUG) || defined(BENCHMARK)
+    printf("[RackVM] Using the %s kernels for vector instructions.\n", InitVectorKernels());
+#else
+    InitVectorKernels();
+#endif
+
+    InitFiles();
 
     int exitCode;
 
@@ -430,6 +740,8 @@ int main(int argc, const char **argv)
     char vmModeStr[] = "Register";
     if (vmMode == VM_MODE_STACK)
         strcpy(vmModeStr, "Stack");
+    else if (vmMode == VM_MODE_REGISTER_WIDE)
+        strcpy(vmModeStr, "Wide");
 
     LARGE_INTEGER li;
     if  (!QueryPerformanceFrequency(&li))
@@ -475,14 +787,16 @@ int main(int argc, const char **argv)
         /* Reset some things for the next run. */
         instrPtr = program;
         sysArgPtr = sysArgs;
+        vecLen = 0;
         sp = stackBegin;
 
         if (vmMode == VM_MODE_REGISTER)
-            sp += 32;
+            sp += REGISTER_COUNT;
 
         *sp++ = 0xAC1D;
         *sp = 0xFACE;
 
+        CloseFiles();
         ResetHeap();
     }
 
@@ -503,14 +817,14 @@ int main(int argc, const char **argv)
 
     puts("=============================================");
     printf(" Benchmark Results: %s", ctime(&benchStartTime));
-    printf(" Program: %s\n", argv[1]);
+    printf(" Program: %s\n", programPath);
     printf(" VM Mode: %s\n\n", vmModeStr);
     printf("%6s%16s%16s\n", "Run", "Elapsed (ms)", "Dev. from mean");
     puts("---------------------------------------------");
     
     fputs("=============================================\n", outFile);
     fprintf(outFile, " Benchmark Results: %s", ctime(&benchStartTime));
-    fprintf(outFile, " Program: %s\n", argv[1]);
+    fprintf(outFile, " Program: %s\n", programPath);
     fprintf(outFile, " VM Mode: %s\n", vmModeStr);
 #ifdef UNION_DECODING
     fputs(" Decoding: Union\n\n", outFile);
@@ -552,10 +866,12 @@ int main(int argc, const char **argv)
         exitCode = StackInterpreterLoop();
     else
         exitCode = RegisterInterpreterLoop();
+
+    VMPrintFlush();
 #endif
 
     /* Check and report on potential stack corruption. */
-    if (vmMode == VM_MODE_STACK &&
+    if (vmMode != VM_MODE_REGISTER &&
         (stackBegin[0] != 0xAC1D || stackBegin[1] != 0xFACE))
     {
         puts("[RackVM] Warning: stack was corrupted during execution (underflow).\n");
@@ -573,6 +889,10 @@ int main(int argc, const char **argv)
     DumpStack();
 #endif
 
+#ifdef PROFILE
+    DumpProfile(programPath);
+#endif
+
     Cleanup();
     return 0;
 }
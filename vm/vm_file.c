@@ -0,0 +1,466 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vm_file.h"
+#include "vm_print.h"
+
+/* Asynchronous requests are carried out by a pool of threads where pthreads
+ * are available, or else synchronously when they are made. */
+#if !defined(_WIN32) && !defined(WIN32)
+    #define ASYNC_THREADS
+    #include <pthread.h>
+#endif
+
+/* Files without a known size are read whole in chunks of at least this size. */
+#define READ_ALL_CHUNK_SIZE (64 * 1024)
+
+typedef enum {
+    FILE_OP_NONE = 0,
+    FILE_OP_READ,
+    FILE_OP_WRITE
+} FileOp_t;
+
+typedef struct {
+    FILE    *file;
+    char    *buffer;  /* Given to setvbuf, or NULL for the standard streams. */
+    FileOp_t lastOp;  /* Files opened for update must be flushed between reads and writes. */
+    uint32_t pending; /* The number of asynchronous requests on the file that aren't done. */
+    bool     busy;    /* Whether a worker is carrying out a request on the file. */
+} VMFile_t;
+
+typedef enum {
+    REQUEST_FREE = 0,
+    REQUEST_QUEUED,
+    REQUEST_RUNNING,
+    REQUEST_DONE
+} RequestState_t;
+
+typedef struct {
+    RequestState_t state;
+    FileOp_t       op;
+    int32_t        fd;
+    void          *data;
+    uint32_t       size;
+    int32_t        result;
+    uint32_t       order; /* When the request was made, relative to the others. */
+} VMRequest_t;
+
+static VMFile_t files[VM_FILE_MAX];
+
+static VMRequest_t requests[VM_ASYNC_MAX];
+static uint32_t    requestOrder;
+
+#ifdef ASYNC_THREADS
+    /* Guards the requests, and the pending and busy members of the files. */
+    static pthread_mutex_t asyncLock   = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t  asyncQueued = PTHREAD_COND_INITIALIZER;
+    static pthread_cond_t  asyncDone   = PTHREAD_COND_INITIALIZER;
+    static int             workerCount = -1; /* Started by the first request. */
+
+    #define ASYNC_LOCK()   pthread_mutex_lock(&asyncLock)
+    #define ASYNC_UNLOCK() pthread_mutex_unlock(&asyncLock)
+    #define ASYNC_WAIT()   pthread_cond_wait(&asyncDone, &asyncLock)
+#else
+    #define ASYNC_LOCK()
+    #define ASYNC_UNLOCK()
+    #define ASYNC_WAIT()
+#endif
+
+/* Gets the open file of the descriptor, or NULL. Printed text is written out 
+ * before the standard streams are used, so that it comes out in order. */
+static VMFile_t *GetFile(int32_t fd)
+{
+    if (fd < 0 || fd >= VM_FILE_MAX || files[fd].file == NULL)
+        return NULL;
+
+    if (fd < 3)
+        VMPrintFlush();
+
+    return &files[fd];
+}
+
+/* Prepares the file for the given operation, as required by the C standard 
+ * when switching between reading and writing a file opened for update. */
+static void SwitchOp(VMFile_t *file, FileOp_t op)
+{
+    if (file->lastOp != op && file->lastOp != FILE_OP_NONE)
+        fseek(file->file, 0, SEEK_CUR);
+
+    file->lastOp = op;
+}
+
+/* Reads or writes the file. Returns the number of bytes transferred, or -1. */
+static int32_t Transfer(VMFile_t *file, FileOp_t op, void *data, uint32_t size)
+{
+    SwitchOp(file, op);
+    size_t count = op == FILE_OP_READ ? 
+        fread(data, 1, size, file->file) : 
+        fwrite(data, 1, size, file->file);
+
+    if (count < size && (op == FILE_OP_WRITE || ferror(file->file)))
+    {
+        clearerr(file->file);
+        return -1;
+    }
+
+    return (int32_t)count;
+}
+
+/* Waits for the asynchronous requests on the file to be done. */
+static void WaitForFile(VMFile_t *file)
+{
+    ASYNC_LOCK();
+    while (file->pending > 0)
+        ASYNC_WAIT();
+    ASYNC_UNLOCK();
+}
+
+#ifdef ASYNC_THREADS
+/* Gets the earliest queued request on a file that isn't busy, or NULL. */
+static VMRequest_t *NextRequest()
+{
+    VMRequest_t *next = NULL;
+    for (int32_t i = 0; i < VM_ASYNC_MAX; ++i)
+    {
+        VMRequest_t *request = &requests[i];
+        if (request->state != REQUEST_QUEUED || files[request->fd].busy)
+            continue;
+
+        if (next == NULL || (int32_t)(request->order - next->order) < 0)
+            next = request;
+    }
+
+    return next;
+}
+
+static void *Worker(void *arg)
+{
+    (void)arg;
+
+    ASYNC_LOCK();
+    for (;;)
+    {
+        VMRequest_t *request = NextRequest();
+        if (request == NULL)
+        {
+            pthread_cond_wait(&asyncQueued, &asyncLock);
+            continue;
+        }
+
+        VMFile_t *file = &files[request->fd];
+        request->state = REQUEST_RUNNING;
+        file->busy = true;
+        ASYNC_UNLOCK();
+
+        int32_t result = Transfer(file, request->op, request->data, request->size);
+
+        ASYNC_LOCK();
+        request->result = result;
+        request->state = REQUEST_DONE;
+        file->busy = false;
+        --file->pending;
+        pthread_cond_broadcast(&asyncDone);
+    }
+
+    return NULL;
+}
+
+/* Starts the worker threads, unless they have been already. */
+static void StartWorkers()
+{
+    if (workerCount >= 0)
+        return;
+
+    workerCount = 0;
+    for (int i = 0; i < VM_ASYNC_THREADS; ++i)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, Worker, NULL) != 0)
+            break;
+
+        pthread_detach(thread);
+        ++workerCount;
+    }
+}
+#endif
+
+/* Queues a request on the file, or carries it out right away if there are no workers. */
+static int32_t Submit(int32_t fd, FileOp_t op, void *data, uint32_t size)
+{
+    VMFile_t *file = GetFile(fd);
+    if (file == NULL)
+        return -1;
+
+#ifdef ASYNC_THREADS
+    StartWorkers();
+#endif
+
+    ASYNC_LOCK();
+    int32_t handle = 0;
+    while (handle < VM_ASYNC_MAX && requests[handle].state != REQUEST_FREE)
+        ++handle;
+
+    if (handle == VM_ASYNC_MAX)
+    {
+        ASYNC_UNLOCK();
+        return -1;
+    }
+
+    VMRequest_t *request = &requests[handle];
+    request->op = op;
+    request->fd = fd;
+    request->data = data;
+    request->size = size;
+    request->order = requestOrder++;
+
+#ifdef ASYNC_THREADS
+    if (workerCount > 0)
+    {
+        request->state = REQUEST_QUEUED;
+        ++file->pending;
+        pthread_cond_signal(&asyncQueued);
+        ASYNC_UNLOCK();
+        return handle;
+    }
+#endif
+
+    ASYNC_UNLOCK();
+    request->result = Transfer(file, op, data, size);
+    request->state = REQUEST_DONE;
+    return handle;
+}
+
+void InitFiles()
+{
+    memset(files, 0, sizeof(files));
+    files[0].file = stdin;
+    files[1].file = stdout;
+    files[2].file = stderr;
+}
+
+void CloseFiles()
+{
+    VMPrintFlush();
+
+    for (int32_t fd = 0; fd < 3; ++fd)
+        WaitForFile(&files[fd]);
+
+    for (int32_t fd = 3; fd < VM_FILE_MAX; ++fd)
+        VMFileClose(fd);
+
+    /* Results that were never waited for are dropped. */
+    ASYNC_LOCK();
+    memset(requests, 0, sizeof(requests));
+    ASYNC_UNLOCK();
+
+    fflush(stdout);
+    fflush(stderr);
+}
+
+bool AnyFilesInUse()
+{
+    for (int32_t fd = 3; fd < VM_FILE_MAX; ++fd)
+        if (files[fd].file != NULL)
+            return true;
+
+    bool isInUse = false;
+    ASYNC_LOCK();
+    for (int32_t i = 0; i < VM_ASYNC_MAX && !isInUse; ++i)
+        isInUse = requests[i].state != REQUEST_FREE;
+    ASYNC_UNLOCK();
+
+    return isInUse;
+}
+
+int32_t VMFileOpen(const char *path, const char *mode)
+{
+    int32_t fd = 3;
+    while (fd < VM_FILE_MAX && files[fd].file != NULL)
+        ++fd;
+
+    if (fd == VM_FILE_MAX)
+        return -1;
+
+    FILE *file = fopen(path, mode);
+    if (file == NULL)
+        return -1;
+
+    /* Fall back to the default buffer if a large one can't be had. */
+    char *buffer = malloc(VM_FILE_BUFFER_SIZE);
+    if (buffer != NULL && setvbuf(file, buffer, _IOFBF, VM_FILE_BUFFER_SIZE) != 0)
+    {
+        free(buffer);
+        buffer = NULL;
+    }
+
+    files[fd].file = file;
+    files[fd].buffer = buffer;
+    files[fd].lastOp = FILE_OP_NONE;
+    return fd;
+}
+
+int32_t VMFileClose(int32_t fd)
+{
+    VMFile_t *file = GetFile(fd);
+    if (file == NULL || fd < 3)
+        return -1;
+
+    WaitForFile(file);
+    int result = fclose(file->file);
+    free(file->buffer);
+    memset(file, 0, sizeof(VMFile_t));
+
+    return result == 0 ? 0 : -1;
+}
+
+int32_t VMFileRead(int32_t fd, void *dst, uint32_t size)
+{
+    VMFile_t *file = GetFile(fd);
+    if (file == NULL)
+        return -1;
+
+    WaitForFile(file);
+    return Transfer(file, FILE_OP_READ, dst, size);
+}
+
+int32_t VMFileWrite(int32_t fd, const void *src, uint32_t size)
+{
+    VMFile_t *file = GetFile(fd);
+    if (file == NULL)
+        return -1;
+
+    WaitForFile(file);
+    return Transfer(file, FILE_OP_WRITE, (void *)src, size);
+}
+
+Addr_t VMFileReadAll(int32_t fd)
+{
+    VMFile_t *file = GetFile(fd);
+    if (file == NULL)
+        return 0;
+
+    WaitForFile(file);
+    SwitchOp(file, FILE_OP_READ);
+
+    /* Files that can be seeked are read into a single allocation of the right size. */
+    long size = -1;
+    long begin = ftell(file->file);
+    if (begin >= 0 && fseek(file->file, 0, SEEK_END) == 0)
+    {
+        size = ftell(file->file) - begin;
+        fseek(file->file, begin, SEEK_SET);
+    }
+
+    if (size >= UINT32_MAX)
+        return 0;
+
+    uint32_t capacity = size >= 0 ? (uint32_t)size + 1 : READ_ALL_CHUNK_SIZE;
+    Addr_t str = VMHeapAlloc(capacity);
+    if (str == 0)
+        return 0;
+
+    uint32_t length = (uint32_t)fread(heap + str, 1, capacity - 1, file->file);
+
+    /* Otherwise, the allocation is doubled until the end of the file is reached. */
+    while (size < 0 && length == capacity - 1)
+    {
+        if (capacity > UINT32_MAX / 2)
+        {
+            VMHeapFree(str);
+            return 0;
+        }
+
+        capacity *= 2;
+        Addr_t grown = VMHeapRealloc(str, capacity);
+        if (grown == 0)
+        {
+            VMHeapFree(str);
+            return 0;
+        }
+
+        str = grown;
+        length += (uint32_t)fread(heap + str + length, 1, capacity - 1 - length, file->file);
+    }
+
+    heap[str + length] = '\0';
+    return str;
+}
+
+int32_t VMFileReadAsync(int32_t fd, void *dst, uint32_t size)
+{
+    return Submit(fd, FILE_OP_READ, dst, size);
+}
+
+int32_t VMFileWriteAsync(int32_t fd, const void *src, uint32_t size)
+{
+    return Submit(fd, FILE_OP_WRITE, (void *)src, size);
+}
+
+int32_t VMFileWait(int32_t handle)
+{
+    if (handle < 0 || handle >= VM_ASYNC_MAX)
+        return -1;
+
+    VMRequest_t *request = &requests[handle];
+
+    ASYNC_LOCK();
+    if (request->state == REQUEST_FREE)
+    {
+        ASYNC_UNLOCK();
+        return -1;
+    }
+
+    while (request->state != REQUEST_DONE)
+        ASYNC_WAIT();
+
+    int32_t result = request->result;
+    request->state = REQUEST_FREE;
+    ASYNC_UNLOCK();
+
+    return result;
+}
+
+int32_t VMFilePoll(int32_t handle)
+{
+    if (handle < 0 || handle >= VM_ASYNC_MAX)
+        return -1;
+
+    ASYNC_LOCK();
+    RequestState_t state = requests[handle].state;
+    ASYNC_UNLOCK();
+
+    if (state == REQUEST_FREE)
+        return -1;
+
+    return state == REQUEST_DONE ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_VM_FILE_H
+#define INC_VM_FILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vm_memory.h"
+
+/* The number of files that may be open at once, including stdin, stdout and stderr. */
+#define VM_FILE_MAX 64
+
+/* The size of the buffer given to each opened file. Reads and writes that are 
+ * at least this large go directly between the file and the heap. */
+#define VM_FILE_BUFFER_SIZE (1 << 20)
+
+/* The number of asynchronous requests that may be pending at once, and the 
+ * number of worker threads that carry them out. */
+#define VM_ASYNC_MAX     256
+#define VM_ASYNC_THREADS 4
+
+/* Files are referred to by descriptors, which index a table of open files. 
+ * 0, 1 and 2 are stdin, stdout and stderr. The functions return -1 on failure. */
+void    InitFiles();
+
+/* Flushes and closes all files opened by the program. */
+void    CloseFiles();
+
+/* Whether the program has files open besides the standard streams, or 
+ * asynchronous requests that haven't been waited for. */
+bool    AnyFilesInUse();
+
+/* Opens the file with a mode as given to fopen, e.g. "r", "w" or "a". */
+int32_t VMFileOpen(const char *path, const char *mode);
+int32_t VMFileClose(int32_t fd);
+
+/* Returns the number of bytes transferred. Reads return 0 at the end of the file. */
+int32_t VMFileRead(int32_t fd, void *dst, uint32_t size);
+int32_t VMFileWrite(int32_t fd, const void *src, uint32_t size);
+
+/* Reads the rest of the file into a new null-terminated string on the heap.
+ * Returns its address, or 0 on failure. */
+Addr_t  VMFileReadAll(int32_t fd);
+
+/* Queues a read or write to be carried out by a worker thread, and returns a 
+ * handle to the request, or -1. Requests on the same file are carried out in 
+ * the order they were made, and the file isn't used by other functions until 
+ * they are done. The bytes go directly between the file and the given memory, 
+ * which must stay valid until the request is waited for. */
+int32_t VMFileReadAsync(int32_t fd, void *dst, uint32_t size);
+int32_t VMFileWriteAsync(int32_t fd, const void *src, uint32_t size);
+
+/* Waits for the request to be done, and returns its result like VMFileRead 
+ * and VMFileWrite. The handle may not be used after this. */
+int32_t VMFileWait(int32_t handle);
+
+/* Returns 1 if the request is done, 0 if it's pending, or -1 for invalid handles. */
+int32_t VMFilePoll(int32_t handle);
+
+#endif /* INC_VM_FILE_H */
@@ -32,9 +32,23 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm_memory.h"
 
+/* Files can be mapped into the heap address space where mmap is available. */
+#if !defined(_WIN32) && !defined(WIN32)
+    #define HEAP_MAPPING
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 /* Uncomment to enable trace printing for VM heap memory.*/
 /* #define TRACE_MEMORY */
 
+/* The number of bytes of address space reserved after the heap for mapped files,
+ * if the 32-bit addresses reach that far, and the number of files mapped at once. */
+#define MAP_RESERVE_SIZE ((uint64_t)1 << 30)
+#define MAP_MAX          16
+
 typedef struct Alloc {
     uint32_t safebytes;
     uint8_t occupied;
@@ -42,9 +56,24 @@ typedef struct Alloc {
     struct Alloc *prev;
 } Alloc_t;
 
+typedef struct {
+    Addr_t   address; /* 0 if the slot is unused. */
+    uint32_t size;    /* The size of the file. */
+    uint64_t span;    /* The page aligned size of the range, including the terminating zero. */
+    bool     writable;
+} Mapping_t;
+
 uint8_t *heap;
 uint64_t heapSize;
 
+#ifdef HEAP_MAPPING
+/* The mapped files lie in [mapBegin, heapReserved), after the heap. */
+static uint64_t  heapReserved;
+static uint64_t  mapBegin;
+static uint64_t  pageSize;
+static Mapping_t mappings[MAP_MAX];
+#endif
+
 int i = sizeof(Alloc_t);
 
 /* Gets the number of bytes between alloc and its 'next' pointer. */
@@ -52,32 +81,234 @@ int i = sizeof(Alloc_t);
 
 #define ALLOC_SAFE_BYTES 0xDEADC0DE
 
+/* Points one past the last byte of the heap. The 'next' pointer of the last
+ * block always points here, so it must never be dereferenced. */
+#define HEAP_END (heap + heapSize)
+
+/* Initializes the heap as a single free block spanning all of it. */
+static void InitHeapHead()
+{
+    Alloc_t *head = (Alloc_t*)heap;
+    head->next = (Alloc_t*)HEAP_END;
+    head->prev = NULL;
+    head->occupied = false;
+    head->safebytes = ALLOC_SAFE_BYTES;
+}
+
+/* Makes the block that follows 'alloc' point back to it, unless 'alloc' is 
+ * the last block in the heap. */
+#define LinkNextBack(alloc) \
+    if ((uint8_t*)(alloc)->next < HEAP_END) (alloc)->next->prev = (alloc)
+
+/* Places a new free block at 'at', directly after 'alloc', and inserts it
+ * into the list. The free block will span until the old 'next' of 'alloc'. */
+static void SplitAlloc(Alloc_t *alloc, Alloc_t *at)
+{
+    at->safebytes = ALLOC_SAFE_BYTES;
+    at->occupied = false;
+    at->next = alloc->next;
+    at->prev = alloc;
+    LinkNextBack(at);
+    alloc->next = at;
+}
+
+/* Joins the block after 'alloc' into 'alloc', if that one is free. */
+static void MergeWithNext(Alloc_t *alloc)
+{
+    if ((uint8_t*)(alloc->next) < HEAP_END && !alloc->next->occupied)
+    {
+        alloc->next = alloc->next->next;
+        LinkNextBack(alloc);
+    }
+}
+
+#ifdef HEAP_MAPPING
+/* Finds the mapping whose file holds the given address, or NULL. */
+static Mapping_t *FindMapping(Addr_t address)
+{
+    for (int i = 0; i < MAP_MAX; ++i)
+    {
+        Mapping_t *mapping = &mappings[i];
+        if (mapping->address != 0 && address >= mapping->address && 
+            address - mapping->address < mapping->size)
+        {
+            return mapping;
+        }
+    }
+
+    return NULL;
+}
+
+/* Finds the lowest free range of address space for a mapping, or returns 0. */
+static Addr_t FindMapSpace(uint64_t span)
+{
+    uint64_t begin = mapBegin;
+    for (int i = 0; i < MAP_MAX; ++i)
+    {
+        Mapping_t *mapping = &mappings[i];
+        if (mapping->address != 0 && begin < mapping->address + mapping->span && 
+            mapping->address < begin + span)
+        {
+            /* Try again after the mapping that's in the way. */
+            begin = mapping->address + mapping->span;
+            i = -1;
+        }
+    }
+
+    return begin + span <= heapReserved ? (Addr_t)begin : 0;
+}
+
+/* Returns the range of the mapping to reserved, inaccessible address space. */
+static void ReleaseMapping(Mapping_t *mapping)
+{
+    mmap(heap + mapping->address, mapping->span, PROT_NONE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    memset(mapping, 0, sizeof(Mapping_t));
+}
+#endif
+
 bool AllocateHeap(uint64_t size, uint64_t maxSize)
 {
     if (size > maxSize || size > 0x100000000 /* 4 GiB */ )
         return false;
 
+#ifdef HEAP_MAPPING
+    /* Address space is reserved after the heap, within reach of 32-bit addresses. */
+    pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    mapBegin = (size + pageSize - 1) / pageSize * pageSize;
+    heapReserved = mapBegin;
+    if (mapBegin < 0x100000000)
+        heapReserved += 0x100000000 - mapBegin < MAP_RESERVE_SIZE ? 0x100000000 - mapBegin : MAP_RESERVE_SIZE;
+
+    heap = mmap(NULL, heapReserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED)
+    {
+        heap = NULL;
+        return false;
+    }
+
+    if (size > 0 && mprotect(heap, size, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(heap, heapReserved);
+        heap = NULL;
+        return false;
+    }
+
+    memset(mappings, 0, sizeof(mappings));
+#else
     heap = calloc(size, 1);
     if (!heap)
         return false;
+#endif
 
     heapSize = size;
-    Alloc_t *head = (Alloc_t*)heap;
-    head->next = (Alloc_t*)(heap + heapSize);
-    head->prev = NULL;
-    head->safebytes = ALLOC_SAFE_BYTES;
+    InitHeapHead();
 
     return true;
 }
 
 void DeallocateHeap()
 {
+#ifdef HEAP_MAPPING
+    munmap(heap, heapReserved);
+#else
     free(heap);
+#endif
 }
 
 void ResetHeap()
 {
+#ifdef HEAP_MAPPING
+    for (int i = 0; i < MAP_MAX; ++i)
+        if (mappings[i].address != 0)
+            ReleaseMapping(&mappings[i]);
+#endif
+
     memset(heap, 0, heapSize);
+    InitHeapHead();
+}
+
+uint64_t VMHeapUnlink()
+{
+    Alloc_t *curr = (Alloc_t*)heap;
+    while ((uint8_t*)curr->next < HEAP_END)
+    {
+        Alloc_t *next = curr->next;
+        curr->next = (Alloc_t*)((uint8_t*)next - heap);
+        curr->prev = NULL;
+        curr = next;
+    }
+
+    if (!curr->occupied)
+        return (uint64_t)((uint8_t*)curr - heap);
+
+    curr->next = (Alloc_t*)(uintptr_t)heapSize;
+    curr->prev = NULL;
+    return heapSize;
+}
+
+bool VMHeapRelink(uint64_t size)
+{
+    /* There must be room for the free block header at the end. */
+    if (size < heapSize && size + sizeof(Alloc_t) > heapSize)
+        return false;
+
+    Alloc_t *prev = NULL;
+    Alloc_t *curr = (Alloc_t*)heap;
+    while ((uint8_t*)curr < heap + size)
+    {
+        /* Each block must end after its header, and no later than the saved bytes. */
+        uint64_t dataBegin = (uint64_t)((uint8_t*)curr - heap) + sizeof(Alloc_t);
+        if (dataBegin > size)
+            return false;
+
+        uint64_t next = (uintptr_t)curr->next;
+        if (next < dataBegin || next > size)
+            return false;
+
+        curr->next = (Alloc_t*)(heap + next);
+        curr->prev = prev;
+        prev = curr;
+        curr = curr->next;
+    }
+
+    if (size < heapSize)
+    {
+        curr->safebytes = ALLOC_SAFE_BYTES;
+        curr->occupied = false;
+        curr->next = (Alloc_t*)HEAP_END;
+        curr->prev = prev;
+    }
+
+    return true;
+}
+
+bool VMHeapLoad(FILE *file, uint64_t offset, uint64_t size)
+{
+    if (size > heapSize)
+        return false;
+
+#ifdef HEAP_MAPPING
+    if (size > 0 && offset % pageSize == 0 && mmap(heap, size, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_FIXED, fileno(file), (off_t)offset) != MAP_FAILED)
+        return VMHeapRelink(size);
+#endif
+
+    if (fseek(file, (long)offset, SEEK_SET) != 0 || fread(heap, 1, size, file) != size)
+        return false;
+
+    return VMHeapRelink(size);
+}
+
+bool VMHeapHasMappings()
+{
+#ifdef HEAP_MAPPING
+    for (int i = 0; i < MAP_MAX; ++i)
+        if (mappings[i].address != 0)
+            return true;
+#endif
+
+    return false;
 }
 
 Addr_t VMHeapAlloc(uint32_t size)
@@ -91,7 +322,7 @@ Addr_t VMHeapAlloc(uint32_t size)
     Alloc_t *curr = (Alloc_t*)heap;
     
     /* Search for a free block that is big enough. */
-    while ((uint8_t*)curr < heap + heapSize && 
+    while ((uint8_t*)curr < HEAP_END && 
            (curr->occupied || GetAllocSize(curr) < size + sizeof(Alloc_t)))
     {
         curr = curr->next;
@@ -105,26 +336,24 @@ Addr_t VMHeapAlloc(uint32_t size)
         return 0;
     }
 
+    if ((uint8_t*)curr >= HEAP_END)
+    {
+        /* TODO: Handle heap resize. */
+        puts("[RackVM] Out of heap memory.");
+        return 0;
+    }
+
 #if !defined(NDEBUG) && defined(TRACE_MEMORY)
     printf("Found free block of size %llu, starting at %lu.\n", 
         GetAllocSize(curr), (Addr_t)((uint8_t *)curr - heap));
 #endif
 
-    Alloc_t *next = (Alloc_t *)((uint8_t*)curr + sizeof(Alloc_t) + size);
-
-    if ((uint8_t*)curr >= heap + heapSize || (uint8_t*)next >= heap + heapSize)
-    {
-        /* TODO: Handle heap resize. */
-    }
-
-    next->prev = curr;
-    curr->occupied = true;
+    /* Only split off the rest of the block if there's room for a header. */
+    if (GetAllocSize(curr) - (size + sizeof(Alloc_t)) >= sizeof(Alloc_t))
+        SplitAlloc(curr, (Alloc_t *)((uint8_t*)curr + sizeof(Alloc_t) + size));
 
-    Alloc_t *tmp = curr->next;
     curr->safebytes = ALLOC_SAFE_BYTES;
-    curr->next = next;
-    curr->next->next = tmp;
-    curr->next->prev = curr;
+    curr->occupied = true;
 
     return (Addr_t)((uint8_t *)curr - heap) + sizeof(Alloc_t);
 }
@@ -147,49 +376,54 @@ Addr_t VMHeapRealloc(Addr_t address, uint32_t size)
 
     if (reqSize < currSize)
     {
-        Alloc_t *next = (Alloc_t *)((uint8_t*)curr + reqSize);
-        next->prev = curr;
-        next->safebytes = ALLOC_SAFE_BYTES;
-        next->next = curr->next->next;
-
-        curr->next = next;
+        if (currSize - reqSize >= sizeof(Alloc_t))
+        {
+            Alloc_t *next = (Alloc_t *)((uint8_t*)curr + reqSize);
+            SplitAlloc(curr, next);
+            MergeWithNext(next);
+        }
 
         return address + sizeof(Alloc_t);
     }
 
-    Addr_t newAddress = address;
-
     /* Check if next is suitable for expansion. Best case scenario! */
-    if ((uint8_t*)(curr->next) < heap + heapSize && 
+    if ((uint8_t*)(curr->next) < HEAP_END && 
         !curr->next->occupied && 
-        GetAllocSize(curr->next) >= reqSize)
+        currSize + GetAllocSize(curr->next) >= reqSize)
     {
-        Alloc_t *next = (Alloc_t *)((uint8_t*)curr + reqSize);
-        next->prev = curr;
-        next->safebytes = ALLOC_SAFE_BYTES;
-        next->next = curr->next->next;
+        MergeWithNext(curr);
+        if (GetAllocSize(curr) - reqSize >= sizeof(Alloc_t))
+            SplitAlloc(curr, (Alloc_t *)((uint8_t*)curr + reqSize));
 
-        curr->next = next;
+        return address + sizeof(Alloc_t);
     }
-    else /* Otherwise, find a new block of memory to inhabit. */
-    {
-        Alloc_t *old = (Alloc_t*)(heap + address);
-        uint32_t oldDataSize = ((uint8_t*)(old->next) - (uint8_t*)old) - sizeof(Alloc_t);
-        address += sizeof(Alloc_t);
 
-        newAddress = VMHeapAlloc(size);
+    /* Otherwise, find a new block of memory to inhabit. */
+    address += sizeof(Alloc_t);
 
-        /* Copy the old data to the new data. No Alloc_t header, only data.*/
-        memcpy(heap + newAddress, heap + address,  oldDataSize);
+    Addr_t newAddress = VMHeapAlloc(size);
+    if (newAddress == 0)
+        return 0;
 
-        VMHeapFree(address);
-    }
+    /* Copy the old data to the new data. No Alloc_t header, only data.*/
+    memcpy(heap + newAddress, heap + address, currSize - sizeof(Alloc_t));
+
+    VMHeapFree(address);
 
     return newAddress;
 }
 
 void VMHeapFree(Addr_t address)
 {
+    if (address == 0)
+        return;
+
+    if (address >= heapSize)
+    {
+        VMHeapUnmapFile(address);
+        return;
+    }
+
     address -= sizeof(Alloc_t);
 
     /* Check for corruption by checking the safebytes.*/
@@ -204,20 +438,16 @@ void VMHeapFree(Addr_t address)
         GetAllocSize(curr), (Addr_t)((uint8_t *)curr - heap));
 #endif
 
-    
-    /* If the prev is free, join them. */
-    if (curr->prev != NULL && !curr->prev->occupied)
-    {
-        curr->prev->next = curr->next;
-    }
+    curr->occupied = false;
 
     /* If the next is free, join them. */
-    if ((uint8_t*)(curr->next) < heap + heapSize && !curr->next->occupied)
-        curr->next = curr->next->next;
+    MergeWithNext(curr);
 
-    /* The previous statements will mitigate memory fragmentation. */
+    /* If the prev is free, join them. */
+    if (curr->prev != NULL && !curr->prev->occupied)
+        MergeWithNext(curr->prev);
 
-    curr->occupied = false;
+    /* The previous statements will mitigate memory fragmentation. */
 }
 
 Addr_t VMHeapAllocString(const char *content)
@@ -244,7 +474,7 @@ Addr_t VMHeapAllocCombinedString(const char *content1, const char *content2)
 
     memcpy(heap + str, content1, content1Size);
     memcpy(heap + str + content1Size, content2, content2Size);
-    *(char*)(heap + str + size) = '\0';
+    *(char*)(heap + str + size - 1) = '\0';
 
 #if !defined(NDEBUG) && defined(TRACE_MEMORY)
     printf("Created new string \"%s\" at %lu.\n", 
@@ -260,7 +490,7 @@ Addr_t VMHeapAllocSubStr(const char *content, uint32_t size)
     if (size > realSize)
         size = realSize;
 
-    Addr_t str = VMHeapAlloc(size);
+    Addr_t str = VMHeapAlloc(size + 1);
 
     memcpy(heap + str, content, size);
     *(char*)(heap+str+size) = '\0';
@@ -275,6 +505,185 @@ Addr_t VMHeapAllocSubStr(const char *content, uint32_t size)
 
 uint32_t VMGetHeapAllocSize(Addr_t address)
 {
+#ifdef HEAP_MAPPING
+    if (address >= heapSize)
+    {
+        Mapping_t *mapping = FindMapping(address);
+        return mapping != NULL ? mapping->size : 0;
+    }
+#endif
+
     Alloc_t *curr = (Alloc_t*)(heap + address - sizeof(Alloc_t));
     return (uint32_t)GetAllocSize(curr);
 }
+
+/* Finds the block whose data holds the given address, or NULL. Addresses at 
+ * the start of a block are looked up directly through their header, which is 
+ * only trusted if the previous block links to it, since the data of another 
+ * block could hold a copy of the safebytes. Other addresses are searched for. */
+static Alloc_t *FindAlloc(Addr_t address)
+{
+    if (address >= sizeof(Alloc_t) && address < heapSize)
+    {
+        Alloc_t *alloc = (Alloc_t*)(heap + address - sizeof(Alloc_t));
+        Alloc_t *prev = alloc->prev;
+        if (alloc->safebytes == ALLOC_SAFE_BYTES && (prev == NULL ? (uint8_t*)alloc == heap :
+            (uint8_t*)prev >= heap && prev < alloc && prev->next == alloc))
+        {
+            return alloc;
+        }
+    }
+
+    if (address >= heapSize)
+        return NULL;
+
+    Alloc_t *curr = (Alloc_t*)heap;
+    while ((uint8_t*)curr->next <= heap + address)
+        curr = curr->next;
+
+    return curr;
+}
+
+/* Checks the range for VMHeapIsRangeValid and VMHeapIsRangeWritable. Only
+ * mappings differ between them, since all heap blocks are writable. */
+static bool IsRangeValid(Addr_t address, uint64_t size, bool isWrite)
+{
+    if (size == 0)
+        return true;
+
+#ifdef HEAP_MAPPING
+    if (address >= heapSize)
+    {
+        Mapping_t *mapping = FindMapping(address);
+        return mapping != NULL && (mapping->writable || !isWrite) && 
+               size <= mapping->address + mapping->size - address;
+    }
+#else
+    (void)isWrite;
+#endif
+
+    Alloc_t *alloc = FindAlloc(address);
+    if (alloc == NULL || !alloc->occupied)
+        return false;
+
+    uint8_t *begin = heap + address;
+    return begin >= (uint8_t*)alloc + sizeof(Alloc_t) && 
+           size <= (uint64_t)((uint8_t*)alloc->next - begin);
+}
+
+bool VMHeapIsRangeValid(Addr_t address, uint64_t size)
+{
+    return IsRangeValid(address, size, false);
+}
+
+bool VMHeapIsRangeWritable(Addr_t address, uint64_t size)
+{
+    return IsRangeValid(address, size, true);
+}
+
+uint32_t VMHeapRangeSize(Addr_t address)
+{
+#ifdef HEAP_MAPPING
+    if (address >= heapSize)
+    {
+        Mapping_t *mapping = FindMapping(address);
+        return mapping != NULL ? mapping->address + mapping->size - address : 0;
+    }
+#endif
+
+    Alloc_t *alloc = FindAlloc(address);
+    if (alloc == NULL || !alloc->occupied)
+        return 0;
+
+    uint8_t *begin = heap + address;
+    if (begin < (uint8_t*)alloc + sizeof(Alloc_t))
+        return 0;
+
+    return (uint32_t)((uint8_t*)alloc->next - begin);
+}
+
+Addr_t VMHeapMapFile(const char *path, bool writable)
+{
+#ifdef HEAP_MAPPING
+    Mapping_t *mapping = NULL;
+    for (int i = 0; i < MAP_MAX && mapping == NULL; ++i)
+        if (mappings[i].address == 0)
+            mapping = &mappings[i];
+
+    int fd = mapping != NULL ? open(path, O_RDONLY) : -1;
+    if (fd < 0)
+        return 0;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || 
+        info.st_size == 0 || (uint64_t)info.st_size >= UINT32_MAX)
+    {
+        close(fd);
+        return 0;
+    }
+
+    /* The rest of the last page reads as zeros, unless the file fills it. Then 
+     * a page of zeros is added, since reading past the file isn't allowed. */
+    uint64_t fileSpan = ((uint64_t)info.st_size + pageSize - 1) / pageSize * pageSize;
+    uint64_t span = fileSpan + ((uint64_t)info.st_size == fileSpan ? pageSize : 0);
+
+    Addr_t address = FindMapSpace(span);
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    if (address == 0 || 
+        mmap(heap + address, info.st_size, prot, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+
+    close(fd);
+
+    mapping->address = address;
+    mapping->size = (uint32_t)info.st_size;
+    mapping->span = span;
+    mapping->writable = writable;
+
+    if (span > fileSpan && 
+        mprotect(heap + address + fileSpan, pageSize, prot) != 0)
+    {
+        ReleaseMapping(mapping);
+        return 0;
+    }
+
+    return address;
+#else
+    (void)path;
+    (void)writable;
+    return 0;
+#endif
+}
+
+int32_t VMHeapUnmapFile(Addr_t address)
+{
+#ifdef HEAP_MAPPING
+    Mapping_t *mapping = FindMapping(address);
+    if (mapping == NULL || mapping->address != address)
+        return -1;
+
+    ReleaseMapping(mapping);
+    return 0;
+#else
+    (void)address;
+    return -1;
+#endif
+}
+
+/* The loops are simple enough to be vectorized by the compiler. */
+void VMHeapFill32(Addr_t address, uint32_t value, uint32_t count)
+{
+    uint32_t *dst = (uint32_t*)(heap + address);
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = value;
+}
+
+void VMHeapFill64(Addr_t address, uint64_t value, uint32_t count)
+{
+    uint64_t *dst = (uint64_t*)(heap + address);
+    for (uint32_t i = 0; i < count; i++)
+        dst[i] = value;
+}
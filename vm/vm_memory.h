@@ -29,15 +29,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define INC_VM_MEMORY_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef uint32_t Addr_t;
 
-extern uint8_t *heap; /* Pointer to the start of the heap. */
+extern uint8_t *heap;     /* Pointer to the start of the heap. */
+extern uint64_t heapSize; /* The size of the heap in bytes. */
 
 bool     AllocateHeap(uint64_t size, uint64_t maxSize);
 void     DeallocateHeap();
 void     ResetHeap();
 
+/* Makes the links between heap blocks offsets from the heap, so that it can be 
+ * saved and loaded at another address, and returns the number of bytes to save.
+ * A free block at the end isn't included. VMHeapRelink must be used after. */
+uint64_t VMHeapUnlink();
+
+/* Makes the links between heap blocks pointers again, after the first 'size'
+ * bytes have been saved or loaded, and adds back the free block at the end. 
+ * Returns false if the links don't describe blocks within those bytes. */
+bool     VMHeapRelink(uint64_t size);
+
+/* Loads 'size' bytes at 'offset' in the file into the start of the heap, and 
+ * relinks them. Where possible, the file is mapped copy-on-write instead of read,
+ * so only the pages that are used get loaded. */
+bool     VMHeapLoad(FILE *file, uint64_t offset, uint64_t size);
+
+/* Whether any files are mapped into the heap address space. */
+bool     VMHeapHasMappings();
+
 Addr_t   VMHeapAlloc(uint32_t size);
 Addr_t   VMHeapRealloc(Addr_t address, uint32_t size);
 void     VMHeapFree(Addr_t address);
@@ -46,4 +66,29 @@ Addr_t   VMHeapAllocSubStr(const char *content, uint32_t size);
 Addr_t   VMHeapAllocCombinedString(const char *content1, const char *content2);
 uint32_t VMGetHeapAllocSize(Addr_t address);
 
+/* Whether [address, address + size) lies within the data of a single 
+ * occupied block. Bulk memory instructions check their ranges with this. */
+bool     VMHeapIsRangeValid(Addr_t address, uint64_t size);
+
+/* Like VMHeapIsRangeValid, but also requires the range to be writable, which
+ * files mapped read-only are not. Anything writing to the heap checks this. */
+bool     VMHeapIsRangeWritable(Addr_t address, uint64_t size);
+
+/* The number of bytes from the address to the end of the occupied block 
+ * holding it, or 0 if there is no such block. */
+uint32_t VMHeapRangeSize(Addr_t address);
+
+/* Maps the file into a range of addresses after the heap, which VMHeapAlloc 
+ * never hands out, and returns the address of its first byte, or 0. A file 
+ * that isn't writable is mapped read-only, and otherwise copy-on-write, so 
+ * changes are never written back to it. The mapping is followed by at least
+ * one zero byte, so text files can be used as strings. */
+Addr_t   VMHeapMapFile(const char *path, bool writable);
+
+/* Unmaps a mapping made by VMHeapMapFile. Returns 0, or -1 if there is none. 
+ * Freeing the address does the same. */
+int32_t  VMHeapUnmapFile(Addr_t address);
+void     VMHeapFill32(Addr_t address, uint32_t value, uint32_t count);
+void     VMHeapFill64(Addr_t address, uint64_t value, uint32_t count);
+
 #endif /* INC_VM_MEMORY_H */
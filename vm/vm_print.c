@@ -0,0 +1,460 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vm_print.h"
+
+/* Conversions whose flags, width and precision are longer than this are printed as text. */
+#define SPEC_MAX 24
+
+/* Format strings longer than this are parsed each time instead of being cached. */
+#define FORMAT_CACHE_MAX_LENGTH 4096
+
+/* Formatted conversions that don't fit in this are formatted into an allocation instead. */
+#define CONVERSION_BUFFER_SIZE 256
+
+typedef enum {
+    CONV_NONE = 0, /* Only literal text. */
+    CONV_INT,      /* d, i */
+    CONV_UINT,     /* u, o, x, X */
+    CONV_CHAR,     /* c */
+    CONV_FLOAT,    /* f, F, e, E, g, G, a, A */
+    CONV_STRING    /* s */
+} ConvType_t;
+
+/* Literal text, followed by a conversion of an argument. */
+typedef struct {
+    uint32_t   literalBegin;   /* Offset into the text of the format. */
+    uint32_t   literalLength;
+    ConvType_t type;
+    bool       isPlain;        /* Whether there are no flags, width or precision. */
+    uint8_t    starCount;      /* The number of arguments taken by a '*' width and precision. */
+    char       spec[SPEC_MAX]; /* For snprintf, with the length modifier of the argument type. */
+} FormatPart_t;
+
+typedef struct {
+    Addr_t        address;
+    char         *text;    /* A copy of the format, to tell whether the address holds another one now. */
+    FormatPart_t *parts;
+    uint32_t      partCount;
+} Format_t;
+
+typedef struct {
+    char    *buffer;
+    uint32_t length;
+    uint32_t capacity;
+    bool     isPrint;  /* The print buffer is written out when full, and other buffers are truncated. */
+} Writer_t;
+
+static char     printBuffer[VM_PRINT_BUFFER_SIZE];
+static uint32_t printLength;
+
+static Format_t formatCache[VM_FORMAT_CACHE_SIZE];
+
+static const VMFormatArg_t missingArg = { 0, { 0 } };
+
+static void WriteOut(Writer_t *writer)
+{
+    fwrite(writer->buffer, 1, writer->length, stdout);
+    fflush(stdout);
+    writer->length = 0;
+}
+
+static void Emit(Writer_t *writer, const char *text, size_t length)
+{
+    while (length > 0)
+    {
+        if (writer->length == writer->capacity)
+        {
+            if (!writer->isPrint)
+                return;
+
+            WriteOut(writer);
+        }
+
+        size_t count = writer->capacity - writer->length;
+        if (count > length)
+            count = length;
+
+        memcpy(writer->buffer + writer->length, text, count);
+        writer->length += (uint32_t)count;
+        text += count;
+        length -= count;
+    }
+}
+
+static void EmitFormatted(Writer_t *writer, const char *spec, ...)
+{
+    char buffer[CONVERSION_BUFFER_SIZE];
+    va_list args, argsCopy;
+    va_start(args, spec);
+    va_copy(argsCopy, args);
+
+    int length = vsnprintf(buffer, sizeof(buffer), spec, args);
+    if (length >= (int)sizeof(buffer))
+    {
+        char *large = malloc((size_t)length + 1);
+        if (large != NULL)
+        {
+            vsnprintf(large, (size_t)length + 1, spec, argsCopy);
+            Emit(writer, large, (size_t)length);
+            free(large);
+        }
+    }
+    else if (length > 0)
+    {
+        Emit(writer, buffer, (size_t)length);
+    }
+
+    va_end(argsCopy);
+    va_end(args);
+}
+
+/* Plain %d is by far the most common conversion, so it skips snprintf. */
+static void EmitInt(Writer_t *writer, int64_t value)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *first = end;
+
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do
+    {
+        *--first = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+        *--first = '-';
+
+    Emit(writer, first, (size_t)(end - first));
+}
+
+static int64_t ArgAsInt(const VMFormatArg_t *arg)
+{
+    if (arg->flags & 0x80)
+        return arg->value.addr;
+    if (arg->flags & 0x60)
+        return (int64_t)arg->value.f64;
+
+    return arg->value.i64;
+}
+
+static double ArgAsDouble(const VMFormatArg_t *arg)
+{
+    if (!(arg->flags & 0x80) && (arg->flags & 0x60))
+        return arg->value.f64;
+
+    return (double)ArgAsInt(arg);
+}
+
+static ConvType_t GetConvType(char conv)
+{
+    switch (conv)
+    {
+        case 'd': case 'i': 
+            return CONV_INT;
+        case 'u': case 'o': case 'x': case 'X': 
+            return CONV_UINT;
+        case 'c': 
+            return CONV_CHAR;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': 
+            return CONV_FLOAT;
+        case 's': 
+            return CONV_STRING;
+        default: 
+            return CONV_NONE;
+    }
+}
+
+static void FreeFormat(Format_t *format)
+{
+    free(format->text);
+    free(format->parts);
+    memset(format, 0, sizeof(Format_t));
+}
+
+static bool IsOneOf(char c, const char *set)
+{
+    return c != '\0' && strchr(set, c) != NULL;
+}
+
+/* Splits the format into parts of literal text and conversions. Conversions
+ * that aren't supported, like %n, are left as literal text. */
+static bool ParseFormat(Format_t *format, const char *text, size_t length)
+{
+    uint32_t maxParts = 1;
+    for (size_t i = 0; i < length; ++i)
+        maxParts += text[i] == '%';
+
+    format->text = malloc(length + 1);
+    format->parts = malloc(maxParts * sizeof(FormatPart_t));
+    if (format->text == NULL || format->parts == NULL)
+    {
+        FreeFormat(format);
+        return false;
+    }
+
+    memcpy(format->text, text, length + 1);
+    text = format->text;
+
+    uint32_t literalBegin = 0;
+    uint32_t i = 0;
+    while (text[i] != '\0')
+    {
+        if (text[i] != '%')
+        {
+            ++i;
+            continue;
+        }
+
+        FormatPart_t *part = &format->parts[format->partCount];
+        part->literalBegin = literalBegin;
+        part->starCount = 0;
+
+        /* Literal percent signs end the literal text after the first '%'. */
+        if (text[i + 1] == '%')
+        {
+            part->literalLength = i + 1 - literalBegin;
+            part->type = CONV_NONE;
+            ++format->partCount;
+
+            i += 2;
+            literalBegin = i;
+            continue;
+        }
+
+        uint32_t specBegin = i++;
+        while (IsOneOf(text[i], "-+ #0"))
+            ++i;
+
+        if (text[i] == '*')
+        {
+            ++part->starCount;
+            ++i;
+        }
+        while (IsOneOf(text[i], "0123456789"))
+            ++i;
+
+        if (text[i] == '.')
+        {
+            ++i;
+            if (text[i] == '*')
+            {
+                ++part->starCount;
+                ++i;
+            }
+            while (IsOneOf(text[i], "0123456789"))
+                ++i;
+        }
+
+        /* The length modifier is replaced by one for the type of the argument. */
+        uint32_t specLength = i - specBegin;
+        while (IsOneOf(text[i], "hlLqjzt"))
+            ++i;
+
+        char conv = text[i];
+        part->type = GetConvType(conv);
+        if (part->type == CONV_NONE || specLength + 4 > SPEC_MAX)
+        {
+            if (conv != '\0')
+                ++i;
+
+            continue;
+        }
+
+        part->literalLength = specBegin - literalBegin;
+        part->isPlain = specLength == 1;
+
+        memcpy(part->spec, text + specBegin, specLength);
+        if (part->type == CONV_INT || part->type == CONV_UINT)
+        {
+            part->spec[specLength++] = 'l';
+            part->spec[specLength++] = 'l';
+        }
+        part->spec[specLength++] = conv;
+        part->spec[specLength] = '\0';
+        ++format->partCount;
+
+        ++i;
+        literalBegin = i;
+    }
+
+    FormatPart_t *last = &format->parts[format->partCount++];
+    last->literalBegin = literalBegin;
+    last->literalLength = i - literalBegin;
+    last->type = CONV_NONE;
+    last->starCount = 0;
+
+    return true;
+}
+
+/* Passes the '*' widths and precisions before the value. */
+#define EMIT_WITH_STARS(value) \
+    switch (part->starCount)\
+    {\
+        case 0: EmitFormatted(writer, part->spec, value);\
+            break;\
+        case 1: EmitFormatted(writer, part->spec, stars[0], value);\
+            break;\
+        default: EmitFormatted(writer, part->spec, stars[0], stars[1], value);\
+            break;\
+    }
+
+static void EmitConversion(Writer_t *writer, const FormatPart_t *part, 
+                           const VMFormatArg_t *args, int32_t argCount, int32_t *argIdx)
+{
+    int stars[2] = {0};
+    for (uint8_t i = 0; i < part->starCount; ++i)
+        stars[i] = *argIdx < argCount ? (int)ArgAsInt(&args[(*argIdx)++]) : 0;
+
+    const VMFormatArg_t *arg = *argIdx < argCount ? &args[(*argIdx)++] : &missingArg;
+
+    switch (part->type)
+    {
+        case CONV_INT:
+            if (part->isPlain)
+                EmitInt(writer, ArgAsInt(arg));
+            else
+                EMIT_WITH_STARS((long long)ArgAsInt(arg));
+            break;
+
+        case CONV_UINT:
+        {
+            /* Ints are 32-bit, so negative ones aren't printed as 64-bit values. */
+            uint64_t value = (uint64_t)ArgAsInt(arg);
+            if (!(arg->flags & 0xF0))
+                value = (uint32_t)value;
+
+            EMIT_WITH_STARS((unsigned long long)value);
+            break;
+        }
+
+        case CONV_CHAR:
+            if (part->isPlain)
+            {
+                char c = (char)ArgAsInt(arg);
+                Emit(writer, &c, 1);
+            }
+            else
+            {
+                EMIT_WITH_STARS((int)ArgAsInt(arg));
+            }
+            break;
+
+        case CONV_FLOAT:
+            EMIT_WITH_STARS(ArgAsDouble(arg));
+            break;
+
+        case CONV_STRING:
+        {
+            const char *str = arg != &missingArg ? (const char *)heap + (Addr_t)ArgAsInt(arg) : "";
+            if (part->isPlain)
+                Emit(writer, str, strlen(str));
+            else
+                EMIT_WITH_STARS(str);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+#undef EMIT_WITH_STARS
+
+/* Formats through the cached parts of the format. The cache is indexed by 
+ * address, and an entry is only used if the format at the address still 
+ * matches its copy, since heap blocks are reused. */
+static void Format(Writer_t *writer, Addr_t address, const VMFormatArg_t *args, int32_t argCount)
+{
+    const char *text = (const char *)heap + address;
+
+    /* Heap blocks are aligned to 8 bytes, so the lowest bits are the same. */
+    Format_t *format = &formatCache[(address >> 3) & (VM_FORMAT_CACHE_SIZE - 1)];
+    Format_t uncached = {0};
+
+    if (format->text == NULL || format->address != address || strcmp(format->text, text) != 0)
+    {
+        size_t length = strlen(text);
+        if (length > FORMAT_CACHE_MAX_LENGTH)
+            format = &uncached;
+        else
+            FreeFormat(format);
+
+        if (!ParseFormat(format, text, length))
+        {
+            Emit(writer, text, length);
+            return;
+        }
+
+        format->address = address;
+    }
+
+    int32_t argIdx = 0;
+    for (uint32_t i = 0; i < format->partCount; ++i)
+    {
+        const FormatPart_t *part = &format->parts[i];
+        Emit(writer, format->text + part->literalBegin, part->literalLength);
+
+        if (part->type != CONV_NONE)
+            EmitConversion(writer, part, args, argCount, &argIdx);
+    }
+
+    if (format == &uncached)
+        FreeFormat(&uncached);
+}
+
+void VMPrint(Addr_t format, const VMFormatArg_t *args, int32_t argCount)
+{
+    Writer_t writer = { printBuffer, printLength, VM_PRINT_BUFFER_SIZE, true };
+    Format(&writer, format, args, argCount);
+    printLength = writer.length;
+}
+
+void VMFormatString(char *dst, uint32_t capacity, Addr_t format, const VMFormatArg_t *args, int32_t argCount)
+{
+    if (capacity == 0)
+        return;
+
+    Writer_t writer = { dst, 0, capacity - 1, false };
+    Format(&writer, format, args, argCount);
+    dst[writer.length] = '\0';
+}
+
+void VMPrintFlush()
+{
+    Writer_t writer = { printBuffer, printLength, VM_PRINT_BUFFER_SIZE, true };
+    WriteOut(&writer);
+    printLength = 0;
+}
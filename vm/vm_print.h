@@ -0,0 +1,63 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_VM_PRINT_H
+#define INC_VM_PRINT_H
+
+#include <stdint.h>
+
+#include "vm_memory.h"
+
+/* The size of the buffer that printed text is gathered in before being written to stdout. */
+#define VM_PRINT_BUFFER_SIZE (64 * 1024)
+
+/* The number of parsed format strings that are kept, which must be a power of 2. */
+#define VM_FORMAT_CACHE_SIZE 64
+
+/* An argument to a format string, with the flags given to it by SARG. */
+typedef struct {
+    uint8_t flags;
+    union {
+        int64_t i64;  /* Ints are sign extended. */
+        double  f64;  /* Floats are converted. */
+        Addr_t  addr;
+    } value;
+} VMFormatArg_t;
+
+/* Formats the arguments like printf into the print buffer, which is written 
+ * to stdout when it fills up. Each argument is formatted as the type given by
+ * its flags, regardless of length modifiers in the format. */
+void VMPrint(Addr_t format, const VMFormatArg_t *args, int32_t argCount);
+
+/* Formats like VMPrint into dst, truncated to fit its capacity, including the null. */
+void VMFormatString(char *dst, uint32_t capacity, Addr_t format, const VMFormatArg_t *args, int32_t argCount);
+
+/* Writes the contents of the print buffer to stdout. This must be done before 
+ * anything else is read from stdin or written to stdout or stderr. */
+void VMPrintFlush();
+
+#endif /* INC_VM_PRINT_H */
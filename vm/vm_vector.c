@@ -0,0 +1,131 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+#include "vm_vector.h"
+
+VecKernel_t vecKernels[VEC_OP_COUNT * VEC_TYPE_COUNT];
+
+/* The kernels are plain loops over the elements, which the compiler vectorizes
+ * for the target it is built for, e.g. SSE2 on x86-64. On x86 with GCC or Clang,
+ * the same loops are also built for AVX2, and chosen at startup if the CPU 
+ * supports it. The arrays may overlap, e.g. when adding an array to itself. */
+#define VEC_KERNEL(target, name, T, body) \
+    target static void name(void *dstPtr, const void *aPtr, const void *bPtr, uint32_t count) \
+    { \
+        T *dst = (T *)dstPtr; \
+        const T *a = (const T *)aPtr; \
+        const T *b = (const T *)bPtr; \
+        for (uint32_t i = 0; i < count; ++i) \
+            body; \
+    }
+
+/* Comparisons write a mask, i.e. an integer of the same size as the elements. */
+#define VEC_MASK_KERNEL(target, name, T, M, op) \
+    target static void name(void *dstPtr, const void *aPtr, const void *bPtr, uint32_t count) \
+    { \
+        M *dst = (M *)dstPtr; \
+        const T *a = (const T *)aPtr; \
+        const T *b = (const T *)bPtr; \
+        for (uint32_t i = 0; i < count; ++i) \
+            dst[i] = a[i] op b[i] ? -1 : 0; \
+    }
+
+/* Integer division is defined for every divisor, instead of trapping, so a 
+ * zero in an array doesn't crash the VM. Dividing by 0 gives 0, and dividing
+ * the smallest value by -1 wraps around to itself. */
+#define VEC_INT_DIV(T, U) (b[i] == 0 ? 0 : b[i] == -1 ? (T)(0 - (U)a[i]) : a[i] / b[i])
+#define VEC_FLOAT_DIV     (a[i] / b[i])
+
+/* Float min and max return the number where one of the operands is NaN, like
+ * fmin and fmax in the scalar MIN.F and MAX.F. Written as a select, instead of
+ * calling them, so that the loop is still vectorized. */
+#define VEC_INT_MIN   (a[i] < b[i] ? a[i] : b[i])
+#define VEC_INT_MAX   (a[i] > b[i] ? a[i] : b[i])
+#define VEC_FLOAT_MIN (a[i] < b[i] || b[i] != b[i] ? a[i] : b[i])
+#define VEC_FLOAT_MAX (a[i] > b[i] || b[i] != b[i] ? a[i] : b[i])
+
+#define VEC_KERNELS_OF_TYPE(target, set, type, T, M, div, min, max) \
+    VEC_KERNEL(target, set##_add_##type, T, dst[i] = a[i] + b[i]) \
+    VEC_KERNEL(target, set##_sub_##type, T, dst[i] = a[i] - b[i]) \
+    VEC_KERNEL(target, set##_mul_##type, T, dst[i] = a[i] * b[i]) \
+    VEC_KERNEL(target, set##_div_##type, T, dst[i] = div) \
+    VEC_KERNEL(target, set##_fma_##type, T, dst[i] += a[i] * b[i]) \
+    VEC_KERNEL(target, set##_min_##type, T, dst[i] = min) \
+    VEC_KERNEL(target, set##_max_##type, T, dst[i] = max) \
+    VEC_MASK_KERNEL(target, set##_cpeq_##type, T, M, ==) \
+    VEC_MASK_KERNEL(target, set##_cplt_##type, T, M, <)
+
+#define VEC_KERNEL_SET(target, set) \
+    VEC_KERNELS_OF_TYPE(target, set, i32, int32_t, int32_t, VEC_INT_DIV(int32_t, uint32_t), VEC_INT_MIN, VEC_INT_MAX) \
+    VEC_KERNELS_OF_TYPE(target, set, i64, int64_t, int64_t, VEC_INT_DIV(int64_t, uint64_t), VEC_INT_MIN, VEC_INT_MAX) \
+    VEC_KERNELS_OF_TYPE(target, set, f32, float,   int32_t, VEC_FLOAT_DIV, VEC_FLOAT_MIN, VEC_FLOAT_MAX) \
+    VEC_KERNELS_OF_TYPE(target, set, f64, double,  int64_t, VEC_FLOAT_DIV, VEC_FLOAT_MIN, VEC_FLOAT_MAX)
+
+#define VEC_LOAD_KERNELS_OF_TYPE(set, type, idx) \
+    vecKernels[VEC_ADD  * VEC_TYPE_COUNT + idx] = set##_add_##type; \
+    vecKernels[VEC_SUB  * VEC_TYPE_COUNT + idx] = set##_sub_##type; \
+    vecKernels[VEC_MUL  * VEC_TYPE_COUNT + idx] = set##_mul_##type; \
+    vecKernels[VEC_DIV  * VEC_TYPE_COUNT + idx] = set##_div_##type; \
+    vecKernels[VEC_FMA  * VEC_TYPE_COUNT + idx] = set##_fma_##type; \
+    vecKernels[VEC_MIN  * VEC_TYPE_COUNT + idx] = set##_min_##type; \
+    vecKernels[VEC_MAX  * VEC_TYPE_COUNT + idx] = set##_max_##type; \
+    vecKernels[VEC_CPEQ * VEC_TYPE_COUNT + idx] = set##_cpeq_##type; \
+    vecKernels[VEC_CPLT * VEC_TYPE_COUNT + idx] = set##_cplt_##type;
+
+#define VEC_LOAD_KERNEL_SET(set) \
+    VEC_LOAD_KERNELS_OF_TYPE(set, i32, VEC_I32) \
+    VEC_LOAD_KERNELS_OF_TYPE(set, i64, VEC_I64) \
+    VEC_LOAD_KERNELS_OF_TYPE(set, f32, VEC_F32) \
+    VEC_LOAD_KERNELS_OF_TYPE(set, f64, VEC_F64)
+
+VEC_KERNEL_SET(, generic)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define VEC_HAS_AVX2
+    /* Only AVX2, and not FMA, so that "dst += a * b" is rounded the same way
+     * by both sets of kernels. */
+    VEC_KERNEL_SET(__attribute__((target("avx2"))), avx2)
+#endif
+
+const char *InitVectorKernels()
+{
+    VEC_LOAD_KERNEL_SET(generic)
+
+#ifdef VEC_HAS_AVX2
+    /* Checks the CPU features through cpuid. */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        VEC_LOAD_KERNEL_SET(avx2)
+        return "AVX2";
+    }
+#endif
+
+    return "generic";
+}
@@ -0,0 +1,69 @@
+/*
+BSD 2-Clause License
+
+Copyright (c) 2022, Kasper Skott
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INC_VM_VECTOR_H
+#define INC_VM_VECTOR_H
+
+#include <stdint.h>
+
+/* Element-wise operations over arrays on the heap. The opcodes of each 
+ * operation come in the order of the element types below, e.g. VADD, 
+ * VADD.64, VADD.F and VADD.F64, so that an opcode maps directly to a kernel. */
+typedef enum {
+    VEC_ADD = 0,
+    VEC_SUB,
+    VEC_MUL,
+    VEC_DIV,    /* Integer division by 0 gives 0, and by -1 wraps around. */
+    VEC_FMA,    /* dst += a * b, rounded after the multiplication. */
+    VEC_MIN,
+    VEC_MAX,
+    VEC_CPEQ,   /* dst = a == b ? -1 : 0, as an integer of the element size. */
+    VEC_CPLT,   /* dst = a < b ? -1 : 0, as an integer of the element size. */
+    VEC_OP_COUNT
+} VecOp_t;
+
+typedef enum {
+    VEC_I32 = 0,
+    VEC_I64,
+    VEC_F32,
+    VEC_F64,
+    VEC_TYPE_COUNT
+} VecType_t;
+
+/* The size in bytes of the elements of each type. */
+#define VEC_ELEMENT_SIZE(type) ((type) == VEC_I64 || (type) == VEC_F64 ? 8 : 4)
+
+typedef void (*VecKernel_t)(void *dst, const void *a, const void *b, uint32_t count);
+
+/* Indexed by op * VEC_TYPE_COUNT + type. */
+extern VecKernel_t vecKernels[VEC_OP_COUNT * VEC_TYPE_COUNT];
+
+/* Selects the fastest kernels supported by the CPU. Must be called before 
+ * any vector instruction is executed. Returns the name of the kernels used. */
+const char *InitVectorKernels();
+
+#endif /* INC_VM_VECTOR_H */